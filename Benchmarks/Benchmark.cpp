@@ -0,0 +1,357 @@
+// Benchmark.cpp
+//
+// Runner, allocation counting and reporting for the benchmark suite.
+//
+// Usage: LaserCommBenchmarks [-f filter] [-m min seconds] [-o results.csv|.json]
+//                            [-w workload file]... [-d scratch directory] [-l]
+
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+// Every operator new in the process goes through these counters. malloc() calls made by
+// the C code are not seen.
+static std::atomic<long long> allocationCounter(0);
+static std::atomic<long long> allocationByteCounter(0);
+
+static void* countedAllocation(size_t size) {
+    allocationCounter.fetch_add(1, std::memory_order_relaxed);
+    allocationByteCounter.fetch_add((long long)size, std::memory_order_relaxed);
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t size) {
+    return countedAllocation(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAllocation(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+BenchmarkState::BenchmarkState(long long iterations, const std::vector<double>& args)
+    : iterationCount(iterations), remaining(iterations), args(args) {}
+
+void BenchmarkState::start() {
+    allocationsAtStart = allocationCounter.load(std::memory_order_relaxed);
+    allocationBytesAtStart = allocationByteCounter.load(std::memory_order_relaxed);
+    started = std::chrono::steady_clock::now();
+    running = true;
+}
+
+void BenchmarkState::stop() {
+    if (!running) {
+        return;
+    }
+    elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    allocationCount += allocationCounter.load(std::memory_order_relaxed) - allocationsAtStart;
+    allocationBytes += allocationByteCounter.load(std::memory_order_relaxed) - allocationBytesAtStart;
+    running = false;
+}
+
+void BenchmarkState::pauseTiming() {
+    stop();
+}
+
+void BenchmarkState::resumeTiming() {
+    start();
+}
+
+struct RegisteredBenchmark {
+    std::string name;
+    BenchmarkFunction function;
+    std::vector<std::string> argNames;
+    std::vector<std::vector<double>> argSets;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    std::string label;
+    long long iterations = 0;
+    double seconds = 0.0;
+    long long slots = 0;
+    long long bytes = 0;
+    long long allocations = 0;
+    long long allocatedBytes = 0;
+    bool skipped = false;
+};
+
+static std::vector<RegisteredBenchmark>& registry() {
+    static std::vector<RegisteredBenchmark> benchmarks;
+    return benchmarks;
+}
+
+static std::vector<std::string> workloads;
+static std::string scratch;
+
+void registerBenchmark(const std::string& name, BenchmarkFunction function,
+    const std::vector<std::string>& argNames, const std::vector<std::vector<double>>& argSets) {
+    registry().push_back({ name, function, argNames, argSets });
+}
+
+std::vector<std::vector<double>> argProduct(const std::vector<std::vector<double>>& lists) {
+    std::vector<std::vector<double>> product(1);
+    for (const std::vector<double>& list : lists) {
+        std::vector<std::vector<double>> next;
+        for (const std::vector<double>& prefix : product) {
+            for (double value : list) {
+                next.push_back(prefix);
+                next.back().push_back(value);
+            }
+        }
+        product.swap(next);
+    }
+    return product;
+}
+
+const std::vector<std::string>& workloadFiles() {
+    return workloads;
+}
+
+const std::string& scratchDirectory() {
+    return scratch;
+}
+
+// name/size:1048576/frame:1024
+static std::string fullName(const RegisteredBenchmark& benchmark, const std::vector<double>& args) {
+    std::ostringstream name;
+    name << benchmark.name;
+    for (size_t i = 0; i < args.size(); i++) {
+        name << "/";
+        if (i < benchmark.argNames.size()) {
+            name << benchmark.argNames[i] << ":";
+        }
+        // Sizes print as 16777216 rather than 1.67772e+07
+        if (args[i] == (double)(long long)args[i]) {
+            name << (long long)args[i];
+        }
+        else {
+            name << args[i];
+        }
+    }
+    return name.str();
+}
+
+// Grows the iteration count until one run takes at least minSeconds
+static BenchmarkResult runBenchmark(const RegisteredBenchmark& benchmark, const std::vector<double>& args,
+    double minSeconds) {
+    BenchmarkResult result;
+    result.name = fullName(benchmark, args);
+
+    long long iterations = 1;
+    while (true) {
+        BenchmarkState state(iterations, args);
+        benchmark.function(state);
+        if (state.wasSkipped()) {
+            result.label = state.labelText();
+            result.skipped = true;
+            return result;
+        }
+        // Give up growing after 1e9 iterations, or once the run is long enough
+        if (state.seconds() >= minSeconds || iterations >= 1000000000LL) {
+            result.label = state.labelText();
+            result.iterations = iterations;
+            result.seconds = state.seconds();
+            result.slots = state.slots();
+            result.bytes = state.bytes();
+            result.allocations = state.allocations();
+            result.allocatedBytes = state.allocatedBytes();
+            return result;
+        }
+        // Aim 40% past the target so the next run is usually the last one
+        double perIteration = state.seconds() / (double)iterations;
+        long long next = perIteration > 0.0 ? (long long)(minSeconds * 1.4 / perIteration) : iterations * 10;
+        iterations = std::max(iterations * 2, std::min(next, iterations * 100));
+    }
+}
+
+// 1.23G, 456M, 7.8k
+static std::string humanRate(double value) {
+    const char* suffixes[] = { "", "k", "M", "G", "T" };
+    int i = 0;
+    while (value >= 1000.0 && i < 4) {
+        value /= 1000.0;
+        i++;
+    }
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(value < 10.0 ? 2 : 1) << value << suffixes[i];
+    return text.str();
+}
+
+static void printResult(const BenchmarkResult& result) {
+    std::cout << std::left << std::setw(64) << result.name << std::right;
+    if (result.skipped) {
+        std::cout << "  skipped: " << result.label << std::endl;
+        return;
+    }
+    double perIteration = result.seconds / (double)result.iterations;
+    std::cout << std::setw(12) << std::fixed << std::setprecision(0) << perIteration * 1e9 << " ns"
+        << std::setw(12) << result.iterations;
+    std::cout << std::setw(12) << (result.slots > 0 ? humanRate(result.slots / result.seconds) + "/s" : "-")
+        << std::setw(12) << (result.bytes > 0 ? humanRate(result.bytes / result.seconds) + "B/s" : "-")
+        << std::setw(10) << std::setprecision(1) << (double)result.allocations / (double)result.iterations;
+    if (!result.label.empty()) {
+        std::cout << "  " << result.label;
+    }
+    std::cout << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+// Writes one row per run as CSV, or JSON if the filename ends in ".json"
+static bool writeResults(const std::string& filename, const std::vector<BenchmarkResult>& results) {
+    std::ofstream outfile(filename);
+    if (!outfile.is_open()) {
+        return false;
+    }
+    outfile.precision(10);
+    bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+
+    if (json) {
+        outfile << "[\n";
+    }
+    else {
+        outfile << "name,label,iterations,seconds,ns_per_iteration,slots_per_second,bytes_per_second,"
+            << "allocations_per_iteration,allocated_bytes_per_iteration\n";
+    }
+
+    bool first = true;
+    for (const BenchmarkResult& result : results) {
+        if (result.skipped) {
+            continue;
+        }
+        double perIteration = result.seconds / (double)result.iterations;
+        double slotRate = result.seconds > 0.0 ? result.slots / result.seconds : 0.0;
+        double byteRate = result.seconds > 0.0 ? result.bytes / result.seconds : 0.0;
+        double allocations = (double)result.allocations / (double)result.iterations;
+        double allocatedBytes = (double)result.allocatedBytes / (double)result.iterations;
+        if (json) {
+            outfile << (first ? "" : ",\n")
+                << "  {\"name\": \"" << result.name << "\""
+                << ", \"label\": \"" << result.label << "\""
+                << ", \"iterations\": " << result.iterations
+                << ", \"seconds\": " << result.seconds
+                << ", \"ns_per_iteration\": " << perIteration * 1e9
+                << ", \"slots_per_second\": " << slotRate
+                << ", \"bytes_per_second\": " << byteRate
+                << ", \"allocations_per_iteration\": " << allocations
+                << ", \"allocated_bytes_per_iteration\": " << allocatedBytes << "}";
+        }
+        else {
+            outfile << result.name << "," << result.label << "," << result.iterations << "," << result.seconds
+                << "," << perIteration * 1e9 << "," << slotRate << "," << byteRate << "," << allocations
+                << "," << allocatedBytes << "\n";
+        }
+        first = false;
+    }
+
+    if (json) {
+        outfile << "\n]\n";
+    }
+    return true;
+}
+
+static void usage() {
+    std::cout << "Usage: LaserCommBenchmarks [options]" << std::endl
+        << "  -f filter      only run benchmarks whose name contains filter" << std::endl
+        << "  -m seconds     minimum time per benchmark (default 0.5)" << std::endl
+        << "  -o file        also write the results as CSV, or JSON if file ends in .json" << std::endl
+        << "  -w file        add a reference workload (RLE pulse or photon file); may be repeated" << std::endl
+        << "  -d directory   where the file benchmarks write (default: the system temp directory)" << std::endl
+        << "  -l             list the benchmarks and exit" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string filter;
+    std::string output_file;
+    double min_seconds = 0.5;
+    bool list = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "-f" && hasValue) {
+            filter = argv[++i];
+        }
+        else if (option == "-m" && hasValue) {
+            min_seconds = std::atof(argv[++i]);
+        }
+        else if (option == "-o" && hasValue) {
+            output_file = argv[++i];
+        }
+        else if (option == "-w" && hasValue) {
+            workloads.push_back(argv[++i]);
+        }
+        else if (option == "-d" && hasValue) {
+            scratch = argv[++i];
+        }
+        else if (option == "-l") {
+            list = true;
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (scratch.empty()) {
+        scratch = std::filesystem::temp_directory_path().string();
+    }
+
+    registerChannelBenchmarks();
+    registerCodecBenchmarks();
+
+    std::vector<BenchmarkResult> results;
+    if (!list) {
+        std::cout << std::left << std::setw(64) << "Benchmark" << std::right << std::setw(15) << "Time"
+            << std::setw(12) << "Iterations" << std::setw(12) << "Slots" << std::setw(12) << "Bytes"
+            << std::setw(10) << "Allocs" << std::endl;
+    }
+    for (const RegisteredBenchmark& benchmark : registry()) {
+        for (const std::vector<double>& args : benchmark.argSets) {
+            std::string name = fullName(benchmark, args);
+            if (!filter.empty() && name.find(filter) == std::string::npos) {
+                continue;
+            }
+            if (list) {
+                std::cout << name << std::endl;
+                continue;
+            }
+            results.push_back(runBenchmark(benchmark, args, min_seconds));
+            printResult(results.back());
+        }
+    }
+
+    if (!output_file.empty() && !writeResults(output_file, results)) {
+        std::cerr << "Unable to write " << output_file << std::endl;
+        return 1;
+    }
+    return 0;
+}
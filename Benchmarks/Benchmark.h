@@ -0,0 +1,147 @@
+// Benchmark.h
+//
+// Small microbenchmark harness in the style of Google Benchmark.
+//
+// A benchmark is a function that times a loop:
+//
+//     void benchmarkFoo(BenchmarkState& state) {
+//         ... setup ...
+//         while (state.keepRunning()) {
+//             doNotOptimize(foo(input));
+//         }
+//         state.setSlotsProcessed(state.iterations() * slots);
+//     }
+//
+// It is registered with one or more argument sets (input size, pulse density,
+// probability, ...). The runner repeats it with more and more iterations until one
+// run takes at least the minimum time, then reports time per iteration,
+// slots/s, bytes/s and the heap allocations made inside the timed loop.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class BenchmarkState {
+public:
+    BenchmarkState(long long iterations, const std::vector<double>& args);
+
+    // True until the loop has run iterations() times. Timing starts on the first
+    // call and stops when it returns false.
+    bool keepRunning() {
+        if (remaining == iterationCount) {
+            start();
+        }
+        if (remaining-- > 0) {
+            return true;
+        }
+        stop();
+        return false;
+    }
+
+    long long iterations() const {
+        return iterationCount;
+    }
+
+    double arg(size_t i) const {
+        return args[i];
+    }
+
+    // Leaves per-iteration setup (copying an input back, say) out of the time
+    void pauseTiming();
+    void resumeTiming();
+
+    // Totals over all iterations
+    void setSlotsProcessed(long long slots) {
+        slotsProcessed = slots;
+    }
+    void setBytesProcessed(long long bytes) {
+        bytesProcessed = bytes;
+    }
+
+    // Shown next to the benchmark name, e.g. the workload file
+    void setLabel(const std::string& text) {
+        label = text;
+    }
+
+    // Marks the run as failed (missing workload file, say); nothing else is reported
+    void skip(const std::string& reason) {
+        label = reason;
+        skipped = true;
+    }
+
+    double seconds() const {
+        return elapsed;
+    }
+
+    long long slots() const {
+        return slotsProcessed;
+    }
+    long long bytes() const {
+        return bytesProcessed;
+    }
+    long long allocations() const {
+        return allocationCount;
+    }
+    long long allocatedBytes() const {
+        return allocationBytes;
+    }
+    const std::string& labelText() const {
+        return label;
+    }
+    bool wasSkipped() const {
+        return skipped;
+    }
+
+private:
+    void start();
+    void stop();
+
+    long long iterationCount;
+    long long remaining;
+    std::vector<double> args;
+    std::chrono::steady_clock::time_point started;
+    bool running = false;
+    double elapsed = 0.0;
+    long long slotsProcessed = 0;
+    long long bytesProcessed = 0;
+    long long allocationCount = 0;  // operator new calls while timed
+    long long allocationBytes = 0;
+    long long allocationsAtStart = 0;
+    long long allocationBytesAtStart = 0;
+    std::string label;
+    bool skipped = false;
+};
+
+using BenchmarkFunction = std::function<void(BenchmarkState&)>;
+
+// Runs the function once for every argument set; argNames label the arguments in the report
+void registerBenchmark(const std::string& name, BenchmarkFunction function,
+    const std::vector<std::string>& argNames, const std::vector<std::vector<double>>& argSets);
+
+// Every combination of the lists, in order, e.g. sizes x densities x probabilities
+std::vector<std::vector<double>> argProduct(const std::vector<std::vector<double>>& lists);
+
+// Reference workload files given with -w (the uncoded_PPM_m10 pulse and photon files, say)
+const std::vector<std::string>& workloadFiles();
+
+// Directory for the files the I/O benchmarks write
+const std::string& scratchDirectory();
+
+// Keeps the compiler from discarding a result that is never used
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(_MSC_VER)
+    static const void* volatile sink;
+    sink = &value;
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+// Registration hooks, one per benchmark source file
+void registerChannelBenchmarks();
+void registerCodecBenchmarks();
@@ -0,0 +1,224 @@
+// ChannelBenchmarks.cpp
+//
+// The LaserCommNoise kernels: openfile, ASCIItoBinary, signalErasure, signalNoise,
+// BinarytoASCII, the RLE channel, and the text RLE encoder and decoder.
+//
+// Synthetic inputs are swept over size (slots), pulse density (one pulse per
+// frame slots) and probability. Every kernel is also run on each -w workload file.
+
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "Benchmark.h"
+#include "BlockStream.h"
+#include "RLEChannel.h"
+#include "SlotChannel.h"
+#include "Workload.h"
+
+static const std::vector<double> sizes = { 1 << 16, 1 << 20, 1 << 24 };
+static const std::vector<double> frames = { 8, 64, 1024 };          // pulse density 1/8, 1/64, 1/1024 (m10)
+static const std::vector<double> probabilities = { 1e-5, 1e-3, 0.1 };
+
+// Workload files are repeated up to this many slots
+static const long long workload_slots = 1 << 22;
+
+// Synthetic input for args (size, frame, ...), or the -w file for args (index)
+static bool workloadFor(BenchmarkState& state, bool fromFile, PulseWorkload& workload) {
+    if (!fromFile) {
+        workload = syntheticPPM((long long)state.arg(0), (long long)state.arg(1), 1);
+        return true;
+    }
+    const std::string& filename = workloadFiles()[(size_t)state.arg(0)];
+    if (!loadWorkload(filename, workload_slots, workload)) {
+        state.skip("can't read " + filename);
+        return false;
+    }
+    state.setLabel(workload.name);
+    return true;
+}
+
+static void writePairs(const std::string& filename, const std::vector<long long>& pairs) {
+    std::ofstream file(filename);
+    for (long long value : pairs) {
+        file << value << " ";
+    }
+}
+
+static void benchmarkOpenfile(BenchmarkState& state, bool fromFile) {
+    PulseWorkload workload;
+    if (!workloadFor(state, fromFile, workload)) {
+        return;
+    }
+    std::string filename = scratchPath("openfile.rle.txt");
+    writePairs(filename, workload.pairs);
+    long long bytes = fileSize(filename);
+
+    while (state.keepRunning()) {
+        doNotOptimize(openfile(filename));
+    }
+    std::remove(filename.c_str());
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * bytes);
+}
+
+static void benchmarkASCIItoBinary(BenchmarkState& state, bool fromFile) {
+    PulseWorkload workload;
+    if (!workloadFor(state, fromFile, workload)) {
+        return;
+    }
+    while (state.keepRunning()) {
+        doNotOptimize(ASCIItoBinary(workload.pairs));
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+}
+
+// Erasure or noise on a fresh copy of the signal each time; the copy isn't timed
+static void benchmarkMask(BenchmarkState& state, bool fromFile, bool erasure) {
+    PulseWorkload workload;
+    if (!workloadFor(state, fromFile, workload)) {
+        return;
+    }
+    double probability = state.arg(fromFile ? 1 : 2);
+    SlotBitmap signal = ASCIItoBinary(workload.pairs);
+    SlotBitmap block;
+    uint64_t seed = 1;
+
+    while (state.keepRunning()) {
+        state.pauseTiming();
+        block = signal;
+        seed++;
+        state.resumeTiming();
+        if (erasure) {
+            doNotOptimize(signalErasure(block, 0, probability, seed));
+        }
+        else {
+            doNotOptimize(signalNoise(block, 0, probability, seed));
+        }
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+}
+
+static void benchmarkBinarytoASCII(BenchmarkState& state, bool fromFile) {
+    PulseWorkload workload;
+    if (!workloadFor(state, fromFile, workload)) {
+        return;
+    }
+    SlotBitmap signal = ASCIItoBinary(workload.pairs);
+    while (state.keepRunning()) {
+        doNotOptimize(BinarytoASCII(signal));
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+}
+
+static void benchmarkChannelRLE(BenchmarkState& state, bool fromFile) {
+    PulseWorkload workload;
+    if (!workloadFor(state, fromFile, workload)) {
+        return;
+    }
+    double probability = state.arg(fromFile ? 1 : 2);
+    std::ostringstream text;
+    for (long long value : workload.pairs) {
+        text << value << " ";
+    }
+    std::string input = text.str();
+    std::mt19937_64 rng(1);
+
+    while (state.keepRunning()) {
+        std::istringstream in(input);
+        std::ostringstream out;
+        doNotOptimize(channelRLE(in, out, probability, probability, rng));
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * (long long)input.size());
+}
+
+// Slots to "<zeros> 1" text pairs
+static void benchmarkRLEEncode(BenchmarkState& state, bool fromFile) {
+    PulseWorkload workload;
+    if (!workloadFor(state, fromFile, workload)) {
+        return;
+    }
+    SlotBitmap signal = ASCIItoBinary(workload.pairs);
+    long long bytes = 0;
+
+    while (state.keepRunning()) {
+        std::ostringstream out;
+        RLEWriter writer(out);
+        long long previous = -1;
+        signal.forEachOne([&](long long slot) {
+            writer.addZeros(slot - previous - 1);
+            writer.addOne();
+            previous = slot;
+        });
+        writer.addZeros(signal.size() - previous - 1);
+        writer.finish();
+        bytes = (long long)out.tellp();
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * bytes);
+}
+
+// Text pairs back to slots, one 16M-slot block at a time as LaserCommNoise reads them
+static void benchmarkRLEDecode(BenchmarkState& state, bool fromFile) {
+    PulseWorkload workload;
+    if (!workloadFor(state, fromFile, workload)) {
+        return;
+    }
+    std::ostringstream text;
+    for (long long value : workload.pairs) {
+        text << value << " ";
+    }
+    std::string input = text.str();
+    SlotBitmap block;
+
+    while (state.keepRunning()) {
+        std::istringstream in(input);
+        RLEBlockReader reader(in);
+        while (reader.readBlock(block, 16777216)) {
+            doNotOptimize(block.size());
+        }
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * (long long)input.size());
+}
+
+// Registers name/size/frame[/p] on synthetic input and workload/name/file[/p] on each -w file
+static void registerKernel(const std::string& name, void (*kernel)(BenchmarkState&, bool), bool withProbability) {
+    std::vector<std::string> argNames = { "size", "frame" };
+    std::vector<std::vector<double>> lists = { sizes, frames };
+    if (withProbability) {
+        argNames.push_back("p");
+        lists.push_back(probabilities);
+    }
+    registerBenchmark(name, [kernel](BenchmarkState& state) { kernel(state, false); }, argNames, argProduct(lists));
+
+    std::vector<double> files;
+    for (size_t i = 0; i < workloadFiles().size(); i++) {
+        files.push_back((double)i);
+    }
+    if (files.empty()) {
+        return;
+    }
+    std::vector<std::string> fileArgNames = { "file" };
+    std::vector<std::vector<double>> fileLists = { files };
+    if (withProbability) {
+        fileArgNames.push_back("p");
+        fileLists.push_back(probabilities);
+    }
+    registerBenchmark("workload/" + name, [kernel](BenchmarkState& state) { kernel(state, true); },
+        fileArgNames, argProduct(fileLists));
+}
+
+void registerChannelBenchmarks() {
+    registerKernel("openfile", benchmarkOpenfile, false);
+    registerKernel("ASCIItoBinary", benchmarkASCIItoBinary, false);
+    registerKernel("signalErasure",
+        [](BenchmarkState& state, bool fromFile) { benchmarkMask(state, fromFile, true); }, true);
+    registerKernel("signalNoise",
+        [](BenchmarkState& state, bool fromFile) { benchmarkMask(state, fromFile, false); }, true);
+    registerKernel("BinarytoASCII", benchmarkBinarytoASCII, false);
+    registerKernel("channelRLE", benchmarkChannelRLE, true);
+    registerKernel("rle_encode", benchmarkRLEEncode, false);
+    registerKernel("rle_decode", benchmarkRLEDecode, false);
+}
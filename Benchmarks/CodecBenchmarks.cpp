@@ -0,0 +1,393 @@
+// CodecBenchmarks.cpp
+//
+// The C code behind stls_pulse_to_photons_poisson: poisson(), the batch Poisson
+// generator, and the file read and write paths for each input format
+// (ASCII and binary, compressed and uncompressed, varint RLE and .slots containers),
+// and the 16-bit run-length kernels with and without SIMD.
+//
+// The file benchmarks write their input to the scratch directory (-d) first and
+// read it back through the same calls the main loop makes, so the page cache is
+// warm and the numbers are for parsing and formatting rather than the disk.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "Benchmark.h"
+#include "Workload.h"
+#include "mapped_file.h"
+#include "poisson.h"
+#include "rle.h"
+#include "slot_container.h"
+#include "text_io.h"
+#include "varint.h"
+
+static const std::vector<double> sizes = { 1 << 16, 1 << 20, 1 << 24 };
+static const std::vector<double> frames = { 8, 64, 1024 };
+static const std::vector<double> lambdas = { 0.5, 3, 20 };
+
+// Samples drawn per iteration of the Poisson benchmarks
+static const int poisson_samples = 4096;
+
+static void benchmarkPoisson(BenchmarkState& state) {
+    double L = std::exp(-state.arg(0));
+    srand(1);
+    while (state.keepRunning()) {
+        int32_t total = 0;
+        for (int i = 0; i < poisson_samples; i++) {
+            total += poisson(L);
+        }
+        doNotOptimize(total);
+    }
+    state.setSlotsProcessed(state.iterations() * poisson_samples);
+}
+
+static void benchmarkPoissonBatch(BenchmarkState& state) {
+    poisson_table table;
+    poisson_table_init(&table, state.arg(0));
+    poisson_rng rng;
+    poisson_rng_seed(&rng, 1);
+    std::vector<int32_t> counts(poisson_samples);
+    while (state.keepRunning()) {
+        poisson_batch(&table, &rng, counts.data(), counts.size());
+        doNotOptimize(counts[0]);
+    }
+    state.setSlotsProcessed(state.iterations() * poisson_samples);
+}
+
+// The compressed pulse words STLS reads: <zeros> <1> pairs with runs over 65535
+// split into 65535-word continuations, as in the .rle.txt and .rle.bin files
+static std::vector<uint16_t> compressedWords(const PulseWorkload& workload) {
+    std::vector<uint16_t> words;
+    for (size_t i = 0; i + 1 < workload.pairs.size(); i += 2) {
+        long long zeros = workload.pairs[i];
+        while (zeros >= 65535) {
+            words.push_back(65535);
+            zeros -= 65535;
+        }
+        words.push_back((uint16_t)zeros);
+        words.push_back((uint16_t)std::min(workload.pairs[i + 1], 65535LL));
+    }
+    return words;
+}
+
+static PulseWorkload syntheticFor(BenchmarkState& state) {
+    return syntheticPPM((long long)state.arg(0), (long long)state.arg(1), 1);
+}
+
+// ASCII compressed input: text_read_uint over "<zeros> <pulses>" words
+static void benchmarkReadCompressedText(BenchmarkState& state) {
+    PulseWorkload workload = syntheticFor(state);
+    std::string filename = scratchPath("read.pulses.rle.txt");
+    FILE* fp = fopen(filename.c_str(), "w");
+    for (uint16_t word : compressedWords(workload)) {
+        fprintf(fp, "%u ", word);
+    }
+    fclose(fp);
+
+    while (state.keepRunning()) {
+        fp = fopen(filename.c_str(), "r");
+        text_reader reader;
+        text_reader_init(&reader, fp);
+        uint32_t value;
+        uint64_t total = 0;
+        while (text_read_uint(&reader, &value)) {
+            total += value;
+        }
+        doNotOptimize(total);
+        text_reader_free(&reader);
+        fclose(fp);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * fileSize(filename));
+    std::remove(filename.c_str());
+}
+
+// ASCII uncompressed input: text_read_pulse_chars over '0'/'1' characters
+static void benchmarkReadUncompressedText(BenchmarkState& state) {
+    PulseWorkload workload = syntheticFor(state);
+    std::vector<uint32_t> values = expandWorkload(workload);
+    std::string filename = scratchPath("read.pulses.txt");
+    FILE* fp = fopen(filename.c_str(), "w");
+    for (uint32_t value : values) {
+        fputc(value ? '1' : '0', fp);
+    }
+    fclose(fp);
+
+    std::vector<uint32_t> slots(1 << 20);
+    while (state.keepRunning()) {
+        fp = fopen(filename.c_str(), "r");
+        text_reader reader;
+        text_reader_init(&reader, fp);
+        uint64_t ones = 0;
+        int invalid = 0;
+        while (text_read_pulse_chars(&reader, slots.data(), slots.size(), &ones, &invalid) == slots.size()) {
+        }
+        doNotOptimize(ones);
+        text_reader_free(&reader);
+        fclose(fp);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * (long long)values.size());
+    std::remove(filename.c_str());
+}
+
+// Binary compressed input: mapped_file_read_word over 16-bit words
+static void benchmarkReadCompressedBinary(BenchmarkState& state) {
+    PulseWorkload workload = syntheticFor(state);
+    std::vector<uint16_t> words = compressedWords(workload);
+    std::string filename = scratchPath("read.pulses.rle.bin");
+    FILE* fp = fopen(filename.c_str(), "wb");
+    fwrite(words.data(), sizeof(uint16_t), words.size(), fp);
+    fclose(fp);
+
+    while (state.keepRunning()) {
+        mapped_file map;
+        if (mapped_file_open(&map, filename.c_str()) != 0) {
+            state.skip("can't map " + filename);
+            return;
+        }
+        uint16_t word;
+        uint64_t total = 0;
+        while (mapped_file_read_word(&map, &word)) {
+            total += word;
+        }
+        doNotOptimize(total);
+        mapped_file_close(&map);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * (long long)(words.size() * sizeof(uint16_t)));
+    std::remove(filename.c_str());
+}
+
+// Binary uncompressed input: validate_pulse_bytes over the mapped bytes
+static void benchmarkReadUncompressedBinary(BenchmarkState& state) {
+    PulseWorkload workload = syntheticFor(state);
+    std::vector<uint32_t> values = expandWorkload(workload);
+    std::vector<uint8_t> bytes(values.begin(), values.end());
+    std::string filename = scratchPath("read.pulses.bin");
+    FILE* fp = fopen(filename.c_str(), "wb");
+    fwrite(bytes.data(), 1, bytes.size(), fp);
+    fclose(fp);
+
+    while (state.keepRunning()) {
+        mapped_file map;
+        if (mapped_file_open(&map, filename.c_str()) != 0) {
+            state.skip("can't map " + filename);
+            return;
+        }
+        uint64_t ones = 0;
+        doNotOptimize(validate_pulse_bytes(map.data, map.size, &ones));
+        doNotOptimize(ones);
+        mapped_file_close(&map);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * (long long)bytes.size());
+    std::remove(filename.c_str());
+}
+
+// Varint RLE input: varint_rle_expand over the mapped file, a buffer's worth of slots at a time
+static void benchmarkReadVarint(BenchmarkState& state) {
+    PulseWorkload workload = syntheticFor(state);
+    std::string filename = scratchPath("read.pulses.vrle");
+    FILE* fp = fopen(filename.c_str(), "wb");
+    varint_rle_writer writer;
+    varint_rle_writer_init(&writer, fp);
+    for (size_t i = 0; i + 1 < workload.pairs.size(); i += 2) {
+        varint_rle_add_zeros(&writer, (uint64_t)workload.pairs[i]);
+        if (workload.pairs[i + 1] > 0) {
+            varint_rle_add_value(&writer, (uint32_t)workload.pairs[i + 1]);
+        }
+    }
+    varint_rle_finish(&writer);
+    fclose(fp);
+
+    std::vector<uint32_t> slots(1 << 20);
+    while (state.keepRunning()) {
+        mapped_file map;
+        if (mapped_file_open(&map, filename.c_str()) != 0) {
+            state.skip("can't map " + filename);
+            return;
+        }
+        varint_rle_reader reader;
+        varint_rle_reader_init(&reader, map.data, map.size);
+        uint64_t total = 0;
+        while (varint_rle_expand(&reader, slots.data(), slots.size()) == slots.size()) {
+            total += slots[0];
+        }
+        doNotOptimize(total);
+        mapped_file_close(&map);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * fileSize(filename));
+    std::remove(filename.c_str());
+}
+
+// run_length_decode over the words of a whole workload; the vector kernel is checked
+// against the scalar one first so a mismatch shows up as a skip, not a fast number
+static void benchmarkDecodeRLE(BenchmarkState& state, bool simd) {
+    PulseWorkload workload = syntheticFor(state);
+    std::vector<uint16_t> words = compressedWords(workload);
+    std::vector<uint32_t> slots(workload.slots), reference(workload.slots);
+    auto decode = simd ? run_length_decode : run_length_decode_scalar;
+
+    uint32_t n = run_length_decode_scalar(words.data(), reference.data(), (uint32_t)words.size());
+    if (decode(words.data(), slots.data(), (uint32_t)words.size()) != n || slots != reference) {
+        state.skip("run_length_decode doesn't match run_length_decode_scalar");
+        return;
+    }
+    while (state.keepRunning()) {
+        doNotOptimize(decode(words.data(), slots.data(), (uint32_t)words.size()));
+        doNotOptimize(slots[0]);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * (long long)(words.size() * sizeof(uint16_t)));
+}
+
+// run_length_encode of a whole workload's slots, checked the same way
+static void benchmarkEncodeRLE(BenchmarkState& state, bool simd) {
+    PulseWorkload workload = syntheticFor(state);
+    std::vector<uint32_t> values = expandWorkload(workload);
+    std::vector<uint16_t> reference = compressedWords(workload);
+    std::vector<uint16_t> words(reference.size() + 2);
+    auto encode = simd ? run_length_encode : run_length_encode_scalar;
+
+    uint32_t n = encode(values.data(), words.data(), (uint32_t)values.size());
+    if (n != reference.size() || !std::equal(reference.begin(), reference.end(), words.begin())) {
+        state.skip("run_length_encode doesn't match the workload's words");
+        return;
+    }
+    while (state.keepRunning()) {
+        doNotOptimize(encode(values.data(), words.data(), (uint32_t)values.size()));
+        doNotOptimize(words[0]);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * (long long)(values.size() * sizeof(uint32_t)));
+}
+
+// ASCII output: text_write_uint of every value, compressed words or one per slot
+static void benchmarkWriteText(BenchmarkState& state, bool compressed) {
+    PulseWorkload workload = syntheticFor(state);
+    std::vector<uint32_t> values;
+    if (compressed) {
+        std::vector<uint16_t> words = compressedWords(workload);
+        values.assign(words.begin(), words.end());
+    }
+    else {
+        values = expandWorkload(workload);
+    }
+    std::string filename = scratchPath(compressed ? "write.photons.rle.txt" : "write.photons.txt");
+
+    while (state.keepRunning()) {
+        FILE* fp = fopen(filename.c_str(), "w");
+        text_writer writer;
+        text_writer_init(&writer, fp);
+        for (uint32_t value : values) {
+            text_write_uint(&writer, value);
+        }
+        text_writer_free(&writer);
+        fclose(fp);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * fileSize(filename));
+    std::remove(filename.c_str());
+}
+
+// Binary uncompressed output, one fwrite() per byte as in the main loop
+static void benchmarkWriteUncompressedBinary(BenchmarkState& state) {
+    PulseWorkload workload = syntheticFor(state);
+    std::vector<uint32_t> values = expandWorkload(workload);
+    std::string filename = scratchPath("write.photons.bin");
+
+    while (state.keepRunning()) {
+        FILE* fp = fopen(filename.c_str(), "wb");
+        for (uint32_t value : values) {
+            uint8_t byte = (uint8_t)value;
+            fwrite((const void*)(&byte), 1, 1, fp);
+        }
+        fclose(fp);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * (long long)values.size());
+    std::remove(filename.c_str());
+}
+
+// .slots container written one 16M-slot block at a time, then read back block by block
+static void benchmarkContainer(BenchmarkState& state, bool write) {
+    PulseWorkload workload = syntheticFor(state);
+    std::vector<uint32_t> values = expandWorkload(workload);
+    std::string filename = scratchPath("container.slots");
+    const size_t block_slots = 1 << 24;
+
+    auto writeContainer = [&]() {
+        slot_container_header info;
+        std::memset(&info, 0, sizeof(info));
+        info.block_slots = block_slots;
+        slot_container_writer writer;
+        if (slot_container_create(&writer, filename.c_str(), &info) != 0) {
+            return false;
+        }
+        for (size_t first = 0; first < values.size(); first += block_slots) {
+            size_t count = std::min(block_slots, values.size() - first);
+            slot_container_write_block(&writer, values.data() + first, count);
+        }
+        return slot_container_close(&writer) == 0;
+    };
+
+    if (!write && !writeContainer()) {
+        state.skip("can't write " + filename);
+        return;
+    }
+    std::vector<uint32_t> block(block_slots);
+    while (state.keepRunning()) {
+        if (write) {
+            writeContainer();
+            continue;
+        }
+        slot_container_reader reader;
+        if (slot_container_open(&reader, filename.c_str()) != 0) {
+            state.skip("can't open " + filename);
+            return;
+        }
+        for (uint64_t b = 0; b < reader.header.block_count; b++) {
+            slot_container_read_block(&reader, b, block.data());
+        }
+        doNotOptimize(block[0]);
+        slot_container_close_reader(&reader);
+    }
+    state.setSlotsProcessed(state.iterations() * workload.slots);
+    state.setBytesProcessed(state.iterations() * fileSize(filename));
+    std::remove(filename.c_str());
+}
+
+void registerCodecBenchmarks() {
+    std::vector<std::vector<double>> lambdaArgs = argProduct({ lambdas });
+    registerBenchmark("poisson", benchmarkPoisson, { "lambda" }, lambdaArgs);
+    registerBenchmark("poisson_batch", benchmarkPoissonBatch, { "lambda" }, lambdaArgs);
+
+    std::vector<std::string> argNames = { "size", "frame" };
+    std::vector<std::vector<double>> argSets = argProduct({ sizes, frames });
+    registerBenchmark("stls/read_rle_txt", benchmarkReadCompressedText, argNames, argSets);
+    registerBenchmark("stls/read_txt", benchmarkReadUncompressedText, argNames, argSets);
+    registerBenchmark("stls/read_rle_bin", benchmarkReadCompressedBinary, argNames, argSets);
+    registerBenchmark("stls/read_bin", benchmarkReadUncompressedBinary, argNames, argSets);
+    registerBenchmark("stls/read_vrle", benchmarkReadVarint, argNames, argSets);
+    registerBenchmark("stls/rle_decode",
+        [](BenchmarkState& state) { benchmarkDecodeRLE(state, true); }, argNames, argSets);
+    registerBenchmark("stls/rle_decode_scalar",
+        [](BenchmarkState& state) { benchmarkDecodeRLE(state, false); }, argNames, argSets);
+    registerBenchmark("stls/rle_encode",
+        [](BenchmarkState& state) { benchmarkEncodeRLE(state, true); }, argNames, argSets);
+    registerBenchmark("stls/rle_encode_scalar",
+        [](BenchmarkState& state) { benchmarkEncodeRLE(state, false); }, argNames, argSets);
+    registerBenchmark("stls/write_rle_txt",
+        [](BenchmarkState& state) { benchmarkWriteText(state, true); }, argNames, argSets);
+    registerBenchmark("stls/write_txt",
+        [](BenchmarkState& state) { benchmarkWriteText(state, false); }, argNames, argSets);
+    registerBenchmark("stls/write_bin", benchmarkWriteUncompressedBinary, argNames, argSets);
+    registerBenchmark("stls/write_slots",
+        [](BenchmarkState& state) { benchmarkContainer(state, true); }, argNames, argSets);
+    registerBenchmark("stls/read_slots",
+        [](BenchmarkState& state) { benchmarkContainer(state, false); }, argNames, argSets);
+}
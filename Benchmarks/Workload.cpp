@@ -0,0 +1,94 @@
+#include "Workload.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include "Benchmark.h"
+#include "SlotChannel.h"
+
+PulseWorkload syntheticPPM(long long slots, long long frame_slots, uint64_t seed) {
+    PulseWorkload workload;
+    workload.name = "synthetic";
+    workload.slots = slots;
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<long long> position(0, frame_slots - 1);
+    long long zeros = 0;
+    for (long long frame = 0; frame < slots; frame += frame_slots) {
+        long long frameSize = std::min(frame_slots, slots - frame);
+        long long pulse = position(rng);
+        if (pulse >= frameSize) {
+            // Short last frame without its pulse
+            zeros += frameSize;
+            continue;
+        }
+        workload.pairs.push_back(zeros + pulse);
+        workload.pairs.push_back(1);
+        workload.pulses++;
+        zeros = frameSize - pulse - 1;
+    }
+    if (zeros > 0) {
+        workload.pairs.push_back(zeros);
+        workload.pairs.push_back(0);
+    }
+    return workload;
+}
+
+bool loadWorkload(const std::string& filename, long long min_slots, PulseWorkload& workload) {
+    if (fileSize(filename) < 0) {
+        return false;
+    }
+    std::vector<long long> pairs = openfile(filename);
+    if (pairs.size() % 2 != 0) {
+        pairs.push_back(0);
+    }
+    long long slots = 0;
+    long long pulses = 0;
+    for (size_t i = 0; i < pairs.size(); i += 2) {
+        slots += pairs[i] + (pairs[i + 1] > 0 ? 1 : 0);
+        pulses += pairs[i + 1] > 0 ? 1 : 0;
+    }
+    if (slots == 0) {
+        return false;
+    }
+
+    long long copies = (min_slots + slots - 1) / slots;
+    workload.name = std::filesystem::path(filename).filename().string();
+    if (copies > 1) {
+        workload.name += " x" + std::to_string(copies);
+    }
+    workload.pairs.clear();
+    for (long long copy = 0; copy < copies; copy++) {
+        workload.pairs.insert(workload.pairs.end(), pairs.begin(), pairs.end());
+    }
+    workload.slots = slots * copies;
+    workload.pulses = pulses * copies;
+    return true;
+}
+
+std::vector<uint32_t> expandWorkload(const PulseWorkload& workload) {
+    std::vector<uint32_t> values;
+    values.reserve(workload.slots);
+    for (size_t i = 0; i + 1 < workload.pairs.size(); i += 2) {
+        values.insert(values.end(), (size_t)workload.pairs[i], 0);
+        // Each pair holds at most one occupied slot, whose value is the count
+        if (workload.pairs[i + 1] > 0) {
+            values.push_back((uint32_t)workload.pairs[i + 1]);
+        }
+    }
+    return values;
+}
+
+std::string scratchPath(const std::string& name) {
+    return (std::filesystem::path(scratchDirectory()) / ("lasercomm_benchmark_" + name)).string();
+}
+
+long long fileSize(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return -1;
+    }
+    return (long long)file.tellg();
+}
@@ -0,0 +1,37 @@
+// Workload.h
+//
+// Inputs for the benchmarks: synthetic PPM pulse streams of any size and pulse
+// density, and the reference files given with -w, tiled up to a useful size.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A pulse stream as <number of zeros> <number of signal photons> pairs
+struct PulseWorkload {
+    std::string name;
+    std::vector<long long> pairs;
+    long long slots = 0;
+    long long pulses = 0;
+};
+
+// One pulse in a random slot of every frame_slots slots, like uncoded PPM of order
+// log2(frame_slots), so the pulse density is 1 / frame_slots. Written as "<zeros> 1"
+// pairs with a trailing "<zeros> 0" if the stream ends on empty slots.
+PulseWorkload syntheticPPM(long long slots, long long frame_slots, uint64_t seed);
+
+// Reads an RLE pulse or photon file and repeats it until it covers at least min_slots
+// slots (the 100-symbol reference files are far too short to time on their own).
+// Photon counts above 1 are kept as they are. Returns false if the file can't be read.
+bool loadWorkload(const std::string& filename, long long min_slots, PulseWorkload& workload);
+
+// Slot values (0 or 1 for pulses, photon counts for photon files) of a workload
+std::vector<uint32_t> expandWorkload(const PulseWorkload& workload);
+
+// Path for a benchmark's file in the scratch directory
+std::string scratchPath(const std::string& name);
+
+// Size of a file in bytes, or -1 if it can't be opened
+long long fileSize(const std::string& filename);
@@ -0,0 +1,177 @@
+/* Sparse photon-event streams - see event_stream.h */
+#include <stdlib.h>
+#include <string.h>
+
+#include "event_stream.h"
+
+
+int event_stream_create(event_stream_writer *writer, const char *filename, double mean_photons, uint64_t seed)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->buffer = malloc(EVENT_STREAM_BUFFER_SIZE);
+    writer->fp = fopen(filename, "wb");
+    if (writer->fp == NULL || writer->buffer == NULL)
+    {
+        if (writer->fp != NULL)
+            fclose(writer->fp);
+        free(writer->buffer);
+        writer->fp = NULL;
+        writer->buffer = NULL;
+        return -1;
+    }
+
+    memcpy(writer->header.magic, EVENT_STREAM_MAGIC, 4);
+    writer->header.version = EVENT_STREAM_VERSION;
+    writer->header.mean_photons = mean_photons;
+    writer->header.seed = seed;
+
+    // placeholder header, rewritten by event_stream_close()
+    if (fwrite(&writer->header, sizeof(writer->header), 1, writer->fp) != 1)
+        writer->failed = 1;
+    return writer->failed ? -1 : 0;
+}
+
+
+static void flush_events(event_stream_writer *writer)
+{
+    if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->fp) != writer->length)
+        writer->failed = 1;
+    writer->length = 0;
+}
+
+
+int event_stream_write(event_stream_writer *writer, uint64_t slot, uint32_t count)
+{
+    if (count == 0)
+        return 0;
+    if (slot < writer->next_slot)
+        return -1;
+    if (writer->length + 20 > EVENT_STREAM_BUFFER_SIZE)
+        flush_events(writer);
+    writer->length += varint_put(writer->buffer + writer->length, slot - writer->next_slot);
+    writer->length += varint_put(writer->buffer + writer->length, count);
+    writer->next_slot = slot + 1;
+    writer->header.total_events++;
+    writer->header.total_count += count;
+    return writer->failed ? -1 : 0;
+}
+
+
+int event_stream_write_slots(event_stream_writer *writer, uint64_t first_slot, const uint32_t *slots,
+                             uint64_t slot_count)
+{
+    for (uint64_t i = 0; i < slot_count; i++)
+        if (slots[i] != 0 && event_stream_write(writer, first_slot + i, slots[i]) != 0)
+            return -1;
+    return 0;
+}
+
+
+int event_stream_close(event_stream_writer *writer, uint64_t total_slots)
+{
+    int status = 0;
+
+    flush_events(writer);
+    writer->header.total_slots = (total_slots > writer->next_slot) ? total_slots : writer->next_slot;
+    if (writer->failed ||
+        fseek(writer->fp, 0, SEEK_SET) != 0 ||
+        fwrite(&writer->header, sizeof(writer->header), 1, writer->fp) != 1)
+        status = -1;
+
+    if (fclose(writer->fp) != 0)
+        status = -1;
+    free(writer->buffer);
+    writer->fp = NULL;
+    writer->buffer = NULL;
+    return status;
+}
+
+
+int event_stream_is_events(const void *data, size_t size)
+{
+    return (size >= sizeof(event_stream_header)) && (memcmp(data, EVENT_STREAM_MAGIC, 4) == 0);
+}
+
+
+int event_stream_open(event_stream_reader *reader, const char *filename)
+{
+    memset(reader, 0, sizeof(*reader));
+    if (mapped_file_open(&reader->map, filename) != 0)
+        return -1;
+    if (!event_stream_is_events(reader->map.data, reader->map.size))
+    {
+        mapped_file_close(&reader->map);
+        return -1;
+    }
+    memcpy(&reader->header, reader->map.data, sizeof(reader->header));
+    if (reader->header.version != EVENT_STREAM_VERSION)
+    {
+        mapped_file_close(&reader->map);
+        return -1;
+    }
+    reader->map.position = sizeof(reader->header);
+    return 0;
+}
+
+
+void event_stream_close_reader(event_stream_reader *reader)
+{
+    mapped_file_close(&reader->map);
+}
+
+
+int event_stream_next(event_stream_reader *reader, uint64_t *slot, uint32_t *count)
+{
+    const uint8_t *end = reader->map.data + reader->map.size;
+    const uint8_t *in = reader->map.data + reader->map.position;
+    uint64_t gap, value;
+    size_t n;
+
+    if (reader->events_read == reader->header.total_events)
+        return 0;
+    if ((n = varint_get(in, end, &gap)) == 0)
+        return -1;
+    in += n;
+    if ((n = varint_get(in, end, &value)) == 0)
+        return -1;
+    in += n;
+
+    // every event must be occupied and lie inside the stream
+    if (value == 0 || value > UINT32_MAX || gap >= reader->header.total_slots - reader->next_slot)
+        return -1;
+    *slot = reader->next_slot + gap;
+    *count = (uint32_t)value;
+    reader->next_slot = *slot + 1;
+    reader->map.position = (size_t)(in - reader->map.data);
+    reader->events_read++;
+    return 1;
+}
+
+
+long event_stream_read(event_stream_reader *reader, uint64_t end_slot, uint64_t *slots, uint32_t *counts,
+                       size_t max_events)
+{
+    size_t n = 0;
+
+    while (n < max_events)
+    {
+        // look ahead without consuming an event that belongs to the next batch
+        size_t position = reader->map.position;
+        uint64_t next_slot = reader->next_slot;
+        uint64_t events_read = reader->events_read;
+        int status = event_stream_next(reader, &slots[n], &counts[n]);
+        if (status < 0)
+            return -1;
+        if (status == 0)
+            break;
+        if (slots[n] >= end_slot)
+        {
+            reader->map.position = position;
+            reader->next_slot = next_slot;
+            reader->events_read = events_read;
+            break;
+        }
+        n++;
+    }
+    return (long)n;
+}
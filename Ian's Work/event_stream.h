@@ -0,0 +1,98 @@
+/* Sparse photon-event streams (.events files)
+
+ A pulse or photon-count stream is mostly empty slots, so instead of one value per slot
+ (or 16-bit run lengths with 65535 continuation words) an event stream lists only the
+ occupied slots: a 64-bit slot index and the count in it (1 for a pulse). On disk each
+ event is two LEB128 varints (varint.h), the gap since the previous event (empty slots
+ skipped) and the count, so a typical event takes 2 to 4 bytes and memory and file size
+ follow the number of photons, not slots.
+
+ Layout (all header fields little-endian, as written by an x86/ARM host):
+
+     header      event_stream_header, 64 bytes
+     events      total_events (gap, count) varint pairs; the first gap counts from slot 0
+
+ The header records the total number of slots, so a stream can end in empty slots.
+
+*/
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mapped_file.h"
+#include "varint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EVENT_STREAM_MAGIC "LCEV"
+#define EVENT_STREAM_VERSION 1
+#define EVENT_STREAM_BUFFER_SIZE (1 << 16)   // bytes of encoded events written per fwrite()
+
+typedef struct
+{
+    char magic[4];              // "LCEV"
+    uint32_t version;
+    uint64_t total_slots;
+    uint64_t total_events;      // occupied slots
+    uint64_t total_count;       // sum of the counts (pulses or photons)
+    double mean_photons;        // -k used to make the file, 0 for pulse files
+    uint64_t seed;              // random seed used to make the file, 0 if none
+    uint64_t reserved[2];
+} event_stream_header;
+
+typedef struct
+{
+    FILE *fp;
+    event_stream_header header;
+    uint64_t next_slot;         // first slot the next event may use
+    uint8_t *buffer;            // encoded events not yet written
+    size_t length;
+    int failed;
+} event_stream_writer;
+
+typedef struct
+{
+    mapped_file map;
+    event_stream_header header;
+    uint64_t events_read;
+    uint64_t next_slot;         // slot after the last event read
+} event_stream_reader;
+
+// Start a new stream; mean_photons and seed are only recorded in the header. Returns 0 on success.
+int event_stream_create(event_stream_writer *writer, const char *filename, double mean_photons, uint64_t seed);
+
+// Append an event. Slots must increase; a zero count is skipped. Returns 0 on success.
+int event_stream_write(event_stream_writer *writer, uint64_t slot, uint32_t count);
+
+// Append the non-zero values of slots[0 .. slot_count-1] as the slots starting at first_slot
+int event_stream_write_slots(event_stream_writer *writer, uint64_t first_slot, const uint32_t *slots,
+                             uint64_t slot_count);
+
+// Record the stream length, finalise the header and close the file; returns 0 on success
+int event_stream_close(event_stream_writer *writer, uint64_t total_slots);
+
+// check whether the start of a file looks like an event stream
+int event_stream_is_events(const void *data, size_t size);
+
+// Map a stream and check its header. Returns 0 on success.
+int event_stream_open(event_stream_reader *reader, const char *filename);
+void event_stream_close_reader(event_stream_reader *reader);
+
+// Next event; returns 1, 0 at the end of the stream, or -1 if the stream is malformed
+int event_stream_next(event_stream_reader *reader, uint64_t *slot, uint32_t *count);
+
+// Up to max_events events with slots before end_slot, the form used by batch loops; returns the
+// number read or -1 if the stream is malformed
+long event_stream_read(event_stream_reader *reader, uint64_t end_slot, uint64_t *slots, uint32_t *counts,
+                       size_t max_events);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
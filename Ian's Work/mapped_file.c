@@ -0,0 +1,83 @@
+/* Memory-mapped input for binary pulse files - see mapped_file.h */
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+
+
+int mapped_file_open(mapped_file *file, const char *filename)
+{
+    struct stat info;
+
+    memset(file, 0, sizeof(*file));
+    file->fd = open(filename, O_RDONLY);
+    if (file->fd < 0)
+        return -1;
+    if (fstat(file->fd, &info) != 0)
+    {
+        close(file->fd);
+        return -1;
+    }
+
+    file->size = (size_t)info.st_size;
+    if (file->size == 0)    // nothing to map
+        return 0;
+
+    void *map = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(file->fd);
+        return -1;
+    }
+    madvise(map, file->size, MADV_SEQUENTIAL);
+    file->data = (const uint8_t *)map;
+
+    return 0;
+}
+
+
+void mapped_file_close(mapped_file *file)
+{
+    if (file->data != NULL)
+        munmap((void *)file->data, file->size);
+    if (file->fd >= 0)
+        close(file->fd);
+    file->data = NULL;
+    file->size = 0;
+}
+
+
+size_t validate_pulse_bytes(const uint8_t *bytes, size_t n, uint64_t *ones)
+{
+    const uint64_t low_bits = 0x0101010101010101ULL;
+    size_t i = 0;
+
+    // 64 bytes per step: OR together anything other than bit 0, and since every valid byte
+    // is 0 or 1 the number of 1s is just the popcount of the words
+    for (; i + 64 <= n; i += 64)
+    {
+        uint64_t words[8];
+        uint64_t invalid = 0;
+        uint64_t count = 0;
+        memcpy(words, bytes + i, 64);
+        for (int j = 0; j < 8; j++)
+        {
+            invalid |= words[j] & ~low_bits;
+            count += (uint64_t)__builtin_popcountll(words[j]);
+        }
+        if (invalid != 0)
+            break;     // let the byte loop below find exactly where
+        *ones += count;
+    }
+
+    for (; i < n; i++)
+    {
+        if (bytes[i] > 1)
+            return i;
+        *ones += bytes[i];
+    }
+    return n;
+}
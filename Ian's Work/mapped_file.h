@@ -0,0 +1,52 @@
+/* Memory-mapped, read-only access to binary pulse files (.pulses.bin and .pulses.rle.bin)
+
+ The whole file is mapped into the address space and read in place, so there is no
+ per-byte or per-word fread() call and no copy through a stdio buffer. The kernel is
+ told the access is sequential so it reads ahead aggressively and drops pages behind us.
+
+*/
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    const uint8_t *data;    // start of the file contents (NULL for an empty file)
+    size_t size;            // file size in bytes
+    size_t position;        // read position for the sequential helpers below
+    int fd;                 // underlying file descriptor
+} mapped_file;
+
+// map a file for reading; returns 0 on success, -1 on failure
+int mapped_file_open(mapped_file *file, const char *filename);
+
+// unmap and close
+void mapped_file_close(mapped_file *file);
+
+// read the next native-endian 16-bit word (as fread(&word, 2, 1, fp) would); returns 1, or 0 at EOF
+static inline int mapped_file_read_word(mapped_file *file, uint16_t *word)
+{
+    if (file->position + 2 > file->size)
+        return 0;
+    memcpy(word, file->data + file->position, 2);
+    file->position += 2;
+    return 1;
+}
+
+// Check that every byte is 0 or 1, 64 bytes at a time without a branch per byte.
+// Returns the index of the first invalid byte (n if all are valid), and adds the number
+// of 1s before that point to *ones.
+size_t validate_pulse_bytes(const uint8_t *bytes, size_t n, uint64_t *ones);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+/* Philox4x32-10 counter-based random number generator
+
+ See: Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC11
+
+ Each output is a pure function of a key (the seed) and a counter, so a random number can be
+ tied to a slot index instead of to the order in which slots happen to be processed. The same
+ seed gives the same photon counts no matter how the input is split into buffers or threads.
+
+ Used from C by stls_pulse_to_photons_poisson and from C++ by LaserCommNoise, which also gets
+ the Philox stream class at the end.
+
+*/
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the raw block function: four 32-bit outputs for a 128-bit counter and 64-bit key
+static inline void philox4x32_10(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53 * c0;
+        uint64_t p1 = (uint64_t)0xCD9E8D57 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// uniformly distributed random number in (0,1] for draw number 'draw' of slot 'slot'
+static inline double philox_uniform(uint64_t seed, uint64_t slot, uint32_t draw)
+{
+    uint32_t counter[4] = { draw, 0, (uint32_t)slot, (uint32_t)(slot >> 32) };
+    uint32_t key[2] = { (uint32_t)seed, (uint32_t)(seed >> 32) };
+    uint32_t out[4];
+
+    philox4x32_10(counter, key, out);
+    uint64_t bits = ((uint64_t)out[1] << 32) | out[0];
+    return (double)((bits >> 11) + 1) * 0x1.0p-53;
+}
+
+#ifdef __cplusplus
+}
+
+// C++ callers (LaserCommNoise) draw a stream of 64-bit words from the same block function.
+// Each stream is keyed by the seed, and (stream, index) pick an independent sequence under
+// that key, e.g. a channel stage and the block of slots it is processing.
+class Philox
+{
+public:
+    // lets Philox be used with the <random> distributions
+    using result_type = uint64_t;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~(result_type)0; }
+
+    Philox(uint64_t seed, uint32_t stream, uint64_t index)
+        : key{ (uint32_t)seed, (uint32_t)(seed >> 32) }, counter{ 0, stream, (uint32_t)index, (uint32_t)(index >> 32) }
+    {
+    }
+
+    // next 64 random bits
+    uint64_t operator()()
+    {
+        if (used == 2)
+        {
+            uint32_t out[4];
+            philox4x32_10(counter, key, out);
+            counter[0]++;
+            output[0] = ((uint64_t)out[1] << 32) | out[0];
+            output[1] = ((uint64_t)out[3] << 32) | out[2];
+            used = 0;
+        }
+        return output[used++];
+    }
+
+    // next 64 random bits of the Philox at context, for the C samplers that take a source
+    // function (poisson_sample() and friends)
+    static uint64_t bits(void *context) { return (*(Philox *)context)(); }
+
+    // number of 64-bit outputs handed out so far
+    uint64_t draws() const { return 2 * (uint64_t)counter[0] + used - 2; }
+
+private:
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint64_t output[2] = { 0, 0 };
+    int used = 2;
+};
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+/* Poisson-distributed random numbers for photon counts
+
+Ian Morrison
+March 2021
+
+*/
+#ifndef POISSON_H
+#define POISSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Knuth's algorithm using rand(); L = exp(-lambda)
+int32_t poisson(double L);
+
+// Batch generation for a fixed lambda
+//
+// Small lambda (photon-starved pulses, dark background): inverse CDF with the cumulative
+// probabilities stored as 64-bit integer thresholds and a 256-entry guide table, so a
+// sample costs one random word and usually a single compare.
+// Large lambda (bright pulses, daytime background): PTRS transformed rejection
+// (Hormann 1993), which needs about 1.1 pairs of uniforms per sample whatever lambda is.
+
+#define POISSON_TABLE_MAX 64        // longest CDF table (covers lambda up to POISSON_PTRS_LAMBDA)
+#define POISSON_PTRS_LAMBDA 10.0    // switch to PTRS at or above this mean
+
+// xoshiro256** generator: fast, 64 bits per call, 2^256 - 1 period
+typedef struct
+{
+    uint64_t s[4];
+    uint64_t draws;     // 64-bit words drawn since seeding
+} poisson_rng;
+
+typedef struct
+{
+    double lambda;
+    int use_ptrs;                            // set when lambda >= POISSON_PTRS_LAMBDA
+    int size;                                // entries used in threshold[]
+    uint64_t threshold[POISSON_TABLE_MAX];   // P(X <= k) scaled to 2^64
+    uint8_t guide[256];                      // first k worth checking for each top byte of u
+    double ptrs_a, ptrs_b, ptrs_inv_alpha, ptrs_vr, log_lambda;   // PTRS constants
+} poisson_table;
+
+// seed the generator (any seed is fine, including 0)
+void poisson_rng_seed(poisson_rng *rng, uint64_t seed);
+
+// precompute the table for a mean of lambda (>= 0); returns 0 on success
+int poisson_table_init(poisson_table *table, double lambda);
+
+// fill counts[0..n-1] with independent Poisson(lambda) samples; scalar on purpose, since each
+// sample follows on from the generator state of the last and lanes would change the sequence
+void poisson_batch(const poisson_table *table, poisson_rng *rng, int32_t *counts, size_t n);
+
+// Samples on a caller's generator, such as LaserCommNoise's Philox streams: source returns 64
+// random bits from context on each call. Unlike the <random> distributions, the samples for a
+// given stream of words are the same with every compiler and standard library.
+typedef uint64_t (*poisson_source)(void *context);
+
+// one sample from a table made by poisson_table_init(), for many draws at the same mean
+int32_t poisson_table_sample(const poisson_table *table, poisson_source source, void *context);
+
+// One sample for a mean that changes from draw to draw, with no table to set up: inversion by
+// sequential search from one uniform below POISSON_PTRS_LAMBDA, PTRS above. A mean of 0 or
+// less (or NaN) gives 0.
+int32_t poisson_sample(double lambda, poisson_source source, void *context);
+
+// Pearson chi-square statistic of counts[0..n-1] against the exact Poisson PMF, with tail bins
+// merged until each expects at least 5; the degrees of freedom are returned through dof
+double poisson_chi_square(double lambda, const int32_t *counts, size_t n, int *dof);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
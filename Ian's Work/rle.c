@@ -0,0 +1,233 @@
+/* 16-bit run-length coding of slot buffers - see rle.h */
+#include <string.h>
+
+#include "rle.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define CONTINUATION_WORD 65535
+
+
+// the count stored for an occupied slot
+static inline uint16_t count_word(uint32_t count)
+{
+    return (count > 65535) ? 65535 : (uint16_t)count;
+}
+
+
+// a zero run (with its continuation words) and the count after it; returns the new length
+static inline uint32_t put_pair(uint16_t *out, uint32_t n, uint32_t run, uint32_t count)
+{
+    while (run >= CONTINUATION_WORD)
+    {
+        out[n++] = CONTINUATION_WORD;
+        run -= CONTINUATION_WORD;
+    }
+    out[n++] = (uint16_t)run;
+    out[n++] = count_word(count);
+    return n;
+}
+
+
+uint32_t run_length_decode_scalar(const uint16_t *in, uint32_t *out, uint32_t words)
+{
+    uint32_t n = 0;
+    uint32_t i = 0;
+
+    while (i < words)
+    {
+        uint32_t run = 0;
+        uint16_t word;
+        do
+        {
+            word = in[i++];
+            run += word;
+        }
+        while ((word == CONTINUATION_WORD) && (i < words));
+
+        for (uint32_t k = 0; k < run; k++)
+            out[n++] = 0;
+        if (i < words)
+        {
+            uint16_t count = in[i++];
+            if (count != 0)     // a 0 count only ends a buffer of empty slots
+                out[n++] = count;
+        }
+    }
+    return n;
+}
+
+
+uint32_t run_length_encode_scalar(const uint32_t *in, uint16_t *out, uint32_t slots)
+{
+    uint32_t n = 0;
+    uint32_t run = 0;
+
+    for (uint32_t i = 0; i < slots; i++)
+    {
+        if (in[i] == 0)
+            run++;
+        else
+        {
+            n = put_pair(out, n, run, in[i]);
+            run = 0;
+        }
+    }
+    if (run > 0)
+        n = put_pair(out, n, run, 0);
+    return n;
+}
+
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+// Writes run zeros followed by count (nothing for a 0 count) and returns the slots written.
+// Whole vectors of zeros first, then one masked store for the last few zeros and the count,
+// so a short run costs a single store and nothing is written past the last slot.
+static inline uint32_t put_run(uint32_t *out, uint32_t run, uint32_t count)
+{
+    uint32_t filled = 0;
+    uint32_t occupied = (count != 0);
+
+#if defined(__AVX512F__)
+    __m512i zero = _mm512_setzero_si512();
+    for (; filled + 16 <= run; filled += 16)
+        _mm512_storeu_si512((void *)(out + filled), zero);
+    uint32_t left = run - filled;                       // 0 to 15 zeros, then the count
+    __m512i tail = _mm512_maskz_mov_epi32((__mmask16)(1u << left), _mm512_set1_epi32((int)count));
+    _mm512_mask_storeu_epi32((void *)(out + filled), (__mmask16)((1u << (left + occupied)) - 1), tail);
+#else
+    __m256i zero = _mm256_setzero_si256();
+    for (; filled + 8 <= run; filled += 8)
+        _mm256_storeu_si256((__m256i *)(out + filled), zero);
+    uint32_t left = run - filled;                       // 0 to 7 zeros, then the count
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i tail = _mm256_and_si256(_mm256_cmpeq_epi32(lanes, _mm256_set1_epi32((int)left)),
+                                    _mm256_set1_epi32((int)count));
+    __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(left + occupied)), lanes);
+    _mm256_maskstore_epi32((int *)(out + filled), mask, tail);
+#endif
+    return run + occupied;
+}
+#endif
+
+
+uint32_t run_length_decode(const uint16_t *in, uint32_t *out, uint32_t words)
+{
+#if defined(__AVX512F__) || defined(__AVX2__)
+    uint32_t n = 0;
+    uint32_t i = 0;
+
+    while (i < words)
+    {
+        uint32_t run = 0;
+        uint16_t word;
+        do
+        {
+            word = in[i++];
+            run += word;
+        }
+        while ((word == CONTINUATION_WORD) && (i < words));
+
+        uint32_t count = (i < words) ? in[i++] : 0;
+        n += put_run(out + n, run, count);
+    }
+    return n;
+#else
+    return run_length_decode_scalar(in, out, words);
+#endif
+}
+
+
+uint64_t run_length_decoded_slots(const uint16_t *in, uint32_t words)
+{
+    uint64_t n = 0;
+    uint32_t i = 0;
+
+    while (i < words)
+    {
+        uint16_t word;
+        do
+        {
+            word = in[i++];
+            n += word;
+        }
+        while ((word == CONTINUATION_WORD) && (i < words));
+
+        if (i < words)
+            n += (in[i++] != 0);
+    }
+    return n;
+}
+
+
+uint32_t run_length_encode(const uint32_t *in, uint16_t *out, uint32_t slots)
+{
+    uint32_t n = 0;
+    uint32_t run_start = 0;     // first slot of the current zero run
+    uint32_t i = 0;
+
+    // empty stretches are skipped a block of slots at a time, and the occupied slots of a
+    // block are walked lowest first through a bit mask
+#if defined(__AVX512F__)
+    for (; i + 32 <= slots; i += 32)
+    {
+        __m512i a = _mm512_loadu_si512((const void *)(in + i));
+        __m512i b = _mm512_loadu_si512((const void *)(in + i + 16));
+        uint32_t occupied = (uint32_t)_mm512_test_epi32_mask(a, a) | ((uint32_t)_mm512_test_epi32_mask(b, b) << 16);
+        while (occupied != 0)
+        {
+            uint32_t slot = i + (uint32_t)__builtin_ctz(occupied);
+            n = put_pair(out, n, slot - run_start, in[slot]);
+            run_start = slot + 1;
+            occupied &= occupied - 1;
+        }
+    }
+#elif defined(__AVX2__)
+    __m256i zero = _mm256_setzero_si256();
+    for (; i + 16 <= slots; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(in + i + 8));
+        if (_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b)))
+            continue;
+        uint32_t empty = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, zero)))
+                       | ((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(b, zero))) << 8);
+        uint32_t occupied = ~empty & 0xFFFF;
+        while (occupied != 0)
+        {
+            uint32_t slot = i + (uint32_t)__builtin_ctz(occupied);
+            n = put_pair(out, n, slot - run_start, in[slot]);
+            run_start = slot + 1;
+            occupied &= occupied - 1;
+        }
+    }
+#else
+    // four slots per pair of 64-bit loads
+    for (; i + 4 <= slots; i += 4)
+    {
+        uint64_t a, b;
+        memcpy(&a, in + i, 8);
+        memcpy(&b, in + i + 2, 8);
+        if ((a | b) == 0)
+            continue;
+        for (uint32_t slot = i; slot < i + 4; slot++)
+            if (in[slot] != 0)
+            {
+                n = put_pair(out, n, slot - run_start, in[slot]);
+                run_start = slot + 1;
+            }
+    }
+#endif
+
+    for (; i < slots; i++)
+        if (in[i] != 0)
+        {
+            n = put_pair(out, n, i - run_start, in[i]);
+            run_start = i + 1;
+        }
+    if (run_start < slots)
+        n = put_pair(out, n, slots - run_start, 0);
+    return n;
+}
@@ -0,0 +1,44 @@
+/* 16-bit run-length coding of slot buffers (.rle.bin and .rle.txt files)
+
+ A buffer of slots (one 32-bit count per slot, mostly zero) is stored as pairs of 16-bit
+ words: the number of empty slots, then the count in the next slot. A run of 65535 or more
+ empty slots is split into 65535 words, each carrying on into the next word, so a run of
+ exactly 65535 is written "65535 0 <count>". If the buffer ends in empty slots the last
+ pair is "<run> 0", and a 0 count never stands for a slot of its own. Counts above 65535
+ are stored as 65535.
+
+ run_length_decode() and run_length_encode() use AVX-512 or AVX2 when the compiler targets
+ them: decoding writes each zero run and the count after it with full-width (and one masked)
+ stores, and encoding compares whole vectors of slots against zero and walks the occupied
+ ones with a bit mask. The _scalar versions are the plain loops, kept as the reference the
+ vector code must match and as the baseline in the benchmarks.
+
+ Both work on one buffer at a time, so a buffer cannot exceed 2^32 slots or words.
+
+*/
+#ifndef RLE_H
+#define RLE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Expands words 16-bit words into out; returns the number of slots written
+uint32_t run_length_decode(const uint16_t *in, uint32_t *out, uint32_t words);
+uint32_t run_length_decode_scalar(const uint16_t *in, uint32_t *out, uint32_t words);
+
+// The number of slots words 16-bit words expand to, so the output can be sized before decoding
+uint64_t run_length_decoded_slots(const uint16_t *in, uint32_t words);
+
+// Compresses slots counts into out, which needs room for 2 words per occupied slot plus one
+// per 65535 empty slots plus 2; returns the number of words written
+uint32_t run_length_encode(const uint32_t *in, uint16_t *out, uint32_t slots);
+uint32_t run_length_encode_scalar(const uint32_t *in, uint16_t *out, uint32_t slots);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
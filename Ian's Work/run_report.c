@@ -0,0 +1,277 @@
+/* Run metrics and report files - see run_report.h */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "run_report.h"
+
+
+static double wall_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static double cpu_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static double thread_cpu_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static double stage_cpu_now(const run_report *report)
+{
+    return report->thread_cpu ? thread_cpu_now() : cpu_now();
+}
+
+
+void run_report_init(run_report *report, const char *program)
+{
+    memset(report, 0, sizeof(*report));
+    report->program = program;
+    report->wall_start = wall_now();
+    report->cpu_start = cpu_now();
+    report->last_progress = report->wall_start;
+}
+
+
+// index of the named stage, adding it on first use (-1 once the table is full)
+static int find_stage(run_report *report, const char *name)
+{
+    int i;
+    for (i = 0; i < report->num_stages; i++)
+        if (strcmp(report->stages[i].name, name) == 0)
+            break;
+    if (i == report->num_stages)
+    {
+        if (report->num_stages == RUN_REPORT_MAX_STAGES)
+            return -1;
+        report->stages[i].name = name;
+        report->num_stages++;
+    }
+    return i;
+}
+
+
+int run_report_add_stage(run_report *report, const char *name)
+{
+    return find_stage(report, name);
+}
+
+
+int run_report_begin(run_report *report, const char *name)
+{
+    int i = find_stage(report, name);
+    if (i < 0)
+        return -1;
+    report->stages[i].wall_start = wall_now();
+    report->stages[i].cpu_start = stage_cpu_now(report);
+    return i;
+}
+
+
+void run_report_end(run_report *report, int stage)
+{
+    if (stage < 0)
+        return;
+    run_report_stage *s = &report->stages[stage];
+    s->wall_seconds += wall_now() - s->wall_start;
+    s->cpu_seconds += stage_cpu_now(report) - s->cpu_start;
+    s->calls++;
+}
+
+
+void run_report_count(run_report *report, const char *name, uint64_t value)
+{
+    int i;
+    for (i = 0; i < report->num_counters; i++)
+        if (strcmp(report->counters[i].name, name) == 0)
+            break;
+    if (i == report->num_counters)
+    {
+        if (report->num_counters == RUN_REPORT_MAX_COUNTERS)
+            return;
+        report->counters[i].name = name;
+        report->num_counters++;
+    }
+    report->counters[i].value += value;
+}
+
+
+void run_report_add_histogram(run_report *report, const uint64_t *counts, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        report->histogram[(i < RUN_REPORT_HISTOGRAM_BINS) ? i : RUN_REPORT_HISTOGRAM_BINS - 1] += counts[i];
+    report->has_histogram = 1;
+}
+
+
+uint64_t run_report_peak_rss(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;           // bytes on macOS
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;    // kilobytes on Linux
+#endif
+}
+
+
+void run_report_progress(run_report *report)
+{
+    if (report->progress_interval <= 0)
+        return;
+    double now = wall_now();
+    if (now - report->last_progress < report->progress_interval)
+        return;
+    report->last_progress = now;
+
+    double elapsed = now - report->wall_start;
+    fprintf(stderr, "[%s] %.1f s: %llu slots (%.3g slots/s), %llu pulses, %.1f MB in, %.1f MB out, peak RSS %.1f MB\n",
+            report->program, elapsed, (unsigned long long)report->slots,
+            (elapsed > 0) ? (double)report->slots / elapsed : 0.0, (unsigned long long)report->pulses,
+            (double)report->bytes_in / 1e6, (double)report->bytes_out / 1e6, (double)run_report_peak_rss() / 1e6);
+}
+
+
+// index of the last non-empty histogram bin, so reports don't carry hundreds of zeros
+static int last_histogram_bin(const run_report *report)
+{
+    int last = 0;
+    for (int i = 0; i < RUN_REPORT_HISTOGRAM_BINS; i++)
+        if (report->histogram[i] != 0)
+            last = i;
+    return last;
+}
+
+
+static void write_json(const run_report *report, FILE *fp, double wall, double cpu)
+{
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"program\": \"%s\",\n", report->program);
+    fprintf(fp, "  \"wall_seconds\": %.6f,\n", wall);
+    fprintf(fp, "  \"cpu_seconds\": %.6f,\n", cpu);
+    fprintf(fp, "  \"peak_rss_bytes\": %llu,\n", (unsigned long long)run_report_peak_rss());
+    fprintf(fp, "  \"slots\": %llu,\n", (unsigned long long)report->slots);
+    fprintf(fp, "  \"pulses\": %llu,\n", (unsigned long long)report->pulses);
+    fprintf(fp, "  \"bytes_in\": %llu,\n", (unsigned long long)report->bytes_in);
+    fprintf(fp, "  \"bytes_out\": %llu,\n", (unsigned long long)report->bytes_out);
+    fprintf(fp, "  \"rng_draws\": %llu,\n", (unsigned long long)report->rng_draws);
+    fprintf(fp, "  \"slots_per_second\": %.6g,\n", (wall > 0) ? (double)report->slots / wall : 0.0);
+
+    fprintf(fp, "  \"stages\": {");
+    for (int i = 0; i < report->num_stages; i++)
+    {
+        const run_report_stage *s = &report->stages[i];
+        fprintf(fp, "%s\n    \"%s\": {\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"calls\": %llu}",
+                (i > 0) ? "," : "", s->name, s->wall_seconds, s->cpu_seconds, (unsigned long long)s->calls);
+    }
+    fprintf(fp, "%s},\n", (report->num_stages > 0) ? "\n  " : "");
+
+    fprintf(fp, "  \"counters\": {");
+    for (int i = 0; i < report->num_counters; i++)
+        fprintf(fp, "%s\"%s\": %llu", (i > 0) ? ", " : "", report->counters[i].name,
+                (unsigned long long)report->counters[i].value);
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "  \"histogram\": [");
+    if (report->has_histogram)
+        for (int i = 0; i <= last_histogram_bin(report); i++)
+            fprintf(fp, "%s%llu", (i > 0) ? ", " : "", (unsigned long long)report->histogram[i]);
+    fprintf(fp, "]\n}\n");
+}
+
+
+static void write_prometheus(const run_report *report, FILE *fp, double wall, double cpu)
+{
+    const char *p = report->program;
+
+    fprintf(fp, "# HELP lasercomm_wall_seconds Wall-clock time of the run.\n# TYPE lasercomm_wall_seconds gauge\n");
+    fprintf(fp, "lasercomm_wall_seconds{program=\"%s\"} %.6f\n", p, wall);
+    fprintf(fp, "# HELP lasercomm_cpu_seconds CPU time of the run over all threads.\n# TYPE lasercomm_cpu_seconds gauge\n");
+    fprintf(fp, "lasercomm_cpu_seconds{program=\"%s\"} %.6f\n", p, cpu);
+    fprintf(fp, "# HELP lasercomm_peak_rss_bytes Peak resident set size.\n# TYPE lasercomm_peak_rss_bytes gauge\n");
+    fprintf(fp, "lasercomm_peak_rss_bytes{program=\"%s\"} %llu\n", p, (unsigned long long)run_report_peak_rss());
+
+    const char *names[] = { "slots", "pulses", "bytes_in", "bytes_out", "rng_draws" };
+    const uint64_t values[] = { report->slots, report->pulses, report->bytes_in, report->bytes_out, report->rng_draws };
+    for (int i = 0; i < 5; i++)
+    {
+        fprintf(fp, "# TYPE lasercomm_%s_total counter\n", names[i]);
+        fprintf(fp, "lasercomm_%s_total{program=\"%s\"} %llu\n", names[i], p, (unsigned long long)values[i]);
+    }
+    fprintf(fp, "# HELP lasercomm_slots_per_second Slots processed per second of wall-clock time.\n"
+                "# TYPE lasercomm_slots_per_second gauge\n");
+    fprintf(fp, "lasercomm_slots_per_second{program=\"%s\"} %.6g\n", p, (wall > 0) ? (double)report->slots / wall : 0.0);
+
+    if (report->num_stages > 0)
+    {
+        fprintf(fp, "# HELP lasercomm_stage_wall_seconds Wall-clock time spent in each stage.\n"
+                    "# TYPE lasercomm_stage_wall_seconds gauge\n");
+        for (int i = 0; i < report->num_stages; i++)
+            fprintf(fp, "lasercomm_stage_wall_seconds{program=\"%s\",stage=\"%s\"} %.6f\n",
+                    p, report->stages[i].name, report->stages[i].wall_seconds);
+        fprintf(fp, "# HELP lasercomm_stage_cpu_seconds CPU time spent in each stage.\n"
+                    "# TYPE lasercomm_stage_cpu_seconds gauge\n");
+        for (int i = 0; i < report->num_stages; i++)
+            fprintf(fp, "lasercomm_stage_cpu_seconds{program=\"%s\",stage=\"%s\"} %.6f\n",
+                    p, report->stages[i].name, report->stages[i].cpu_seconds);
+        fprintf(fp, "# TYPE lasercomm_stage_calls_total counter\n");
+        for (int i = 0; i < report->num_stages; i++)
+            fprintf(fp, "lasercomm_stage_calls_total{program=\"%s\",stage=\"%s\"} %llu\n",
+                    p, report->stages[i].name, (unsigned long long)report->stages[i].calls);
+    }
+
+    if (report->num_counters > 0)
+    {
+        fprintf(fp, "# HELP lasercomm_events_total Named event counts (erasures, noise photons, ...).\n"
+                    "# TYPE lasercomm_events_total counter\n");
+        for (int i = 0; i < report->num_counters; i++)
+            fprintf(fp, "lasercomm_events_total{program=\"%s\",event=\"%s\"} %llu\n",
+                    p, report->counters[i].name, (unsigned long long)report->counters[i].value);
+    }
+
+    if (report->has_histogram)
+    {
+        fprintf(fp, "# HELP lasercomm_photon_histogram Pulses by number of detected photons.\n"
+                    "# TYPE lasercomm_photon_histogram gauge\n");
+        for (int i = 0; i <= last_histogram_bin(report); i++)
+            fprintf(fp, "lasercomm_photon_histogram{program=\"%s\",photons=\"%d\"} %llu\n",
+                    p, i, (unsigned long long)report->histogram[i]);
+    }
+}
+
+
+int run_report_write(const run_report *report, const char *filename)
+{
+    size_t length = strlen(filename);
+    int json = (length >= 5) && (strcmp(filename + length - 5, ".json") == 0);
+    double wall = wall_now() - report->wall_start;
+    double cpu = cpu_now() - report->cpu_start;
+
+    // write beside the target and rename, so a collector never reads a partial file
+    char temporary[4096];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", filename) >= (int)sizeof(temporary))
+        return -1;
+    FILE *fp = fopen(temporary, "w");
+    if (fp == NULL)
+        return -1;
+    if (json)
+        write_json(report, fp, wall, cpu);
+    else
+        write_prometheus(report, fp, wall, cpu);
+    if (fclose(fp) != 0)
+        return -1;
+    return (rename(temporary, filename) == 0) ? 0 : -1;
+}
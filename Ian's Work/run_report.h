@@ -0,0 +1,105 @@
+/* Run metrics for the simulators: per-stage timing, throughput counters and a report file
+
+ A run_report collects wall and CPU time for each named stage of the main loop (read, decode,
+ photon counts, write, ...), running totals of slots, pulses, bytes in and out and random
+ numbers drawn, any extra named counters, a photon-count histogram, and the peak resident
+ set size. Timing a stage costs two clock reads at each end, so it is meant to wrap whole
+ buffers or blocks rather than single slots.
+
+ At the end the report is written as JSON (a filename ending in ".json") or in the
+ Prometheus text exposition format for a node_exporter textfile collector (anything else).
+ The file is written under a temporary name and renamed into place, so a scraper or
+ scheduler polling it never sees half a report. A one-line progress summary can also be
+ printed to stderr every few seconds while the run is going.
+
+*/
+#ifndef RUN_REPORT_H
+#define RUN_REPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RUN_REPORT_MAX_STAGES 16
+#define RUN_REPORT_MAX_COUNTERS 32
+#define RUN_REPORT_HISTOGRAM_BINS 256   // photon counts 0..254, and 255 or more in the last bin
+
+typedef struct
+{
+    const char *name;
+    double wall_seconds;
+    double cpu_seconds;         // CPU time of the process, or of the timing thread with thread_cpu set
+    uint64_t calls;
+    double wall_start;          // set while the stage is running
+    double cpu_start;
+} run_report_stage;
+
+typedef struct
+{
+    const char *name;
+    uint64_t value;
+} run_report_counter;
+
+typedef struct
+{
+    const char *program;
+    double wall_start;
+    double cpu_start;
+
+    run_report_stage stages[RUN_REPORT_MAX_STAGES];
+    int num_stages;
+    int thread_cpu;             // time stages with the CPU clock of the thread running them
+    run_report_counter counters[RUN_REPORT_MAX_COUNTERS];
+    int num_counters;
+
+    // running totals, kept up to date by the caller
+    uint64_t slots;
+    uint64_t pulses;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t rng_draws;         // 64-bit random words drawn
+
+    uint64_t histogram[RUN_REPORT_HISTOGRAM_BINS];
+    int has_histogram;          // set by run_report_add_histogram()
+
+    double progress_interval;   // seconds between progress lines, 0 for none
+    double last_progress;
+} run_report;
+
+// start the clocks; program names the run in the report (names are not copied)
+void run_report_init(run_report *report, const char *program);
+
+// add a stage ahead of time, fixing its place in the report; returns its stage number.
+// Threads may time different stages at once, provided every stage was added before they started.
+int run_report_add_stage(run_report *report, const char *name);
+
+// Start timing the named stage (added on first use); returns the stage number for run_report_end.
+// Stage CPU time is the whole process's, which counts the helper threads of a stage that fans
+// out to a pool; set thread_cpu when each stage runs on a thread of its own, so that stages
+// running at once don't each count the others, and end a stage on the thread that began it.
+int run_report_begin(run_report *report, const char *name);
+void run_report_end(run_report *report, int stage);
+
+// add to a named counter (added on first use)
+void run_report_count(run_report *report, const char *name, uint64_t value);
+
+// add counts[0..n-1] to the histogram; anything past the last bin goes into the last bin
+void run_report_add_histogram(run_report *report, const uint64_t *counts, size_t n);
+
+// print a progress line to stderr if progress_interval seconds have passed since the last one
+void run_report_progress(run_report *report);
+
+// peak resident set size of the process in bytes (0 if unknown)
+uint64_t run_report_peak_rss(void);
+
+// write the report as JSON or a Prometheus textfile, by the filename; returns 0 on success
+int run_report_write(const run_report *report, const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,361 @@
+/* Per-format readers and writers for the stls slot files - see slot_codec.h */
+#include <stdlib.h>
+#include <string.h>
+
+#include "slot_codec.h"
+
+#define PACK_CHUNK_SIZE_IN_BYTES 65536     // slots packed into bytes per sink call
+
+// the generic loops below are only ever called with constant format arguments, and must be
+// inlined into each format's entry for those constants to be folded away
+#define SPECIALISE static inline __attribute__((always_inline))
+
+
+// next number of an RLE file: a parsed integer (text) or a 16-bit word (binary); 0 at the end
+SPECIALISE int next_word(slot_codec_reader *reader, uint32_t *value, const int text)
+{
+    if (text)
+        return text_read_uint(&reader->text, value);
+    uint16_t word;
+    if (!mapped_file_read_word(&reader->map, &word))
+        return 0;
+    *value = word;
+    return 1;
+}
+
+
+// what a failed next_word() means: the end of the file, unless the text there wasn't a number
+SPECIALISE int end_status(const slot_codec_reader *reader, int status, const int text)
+{
+    return (text && reader->text.failed) ? SLOT_CODEC_INVALID : status;
+}
+
+
+SPECIALISE int read_words_generic(slot_codec_reader *reader, uint16_t *words, size_t target, size_t capacity,
+                                  uint32_t limit, size_t *num_words, uint64_t *occupied, const int text)
+{
+    size_t n = 0;
+    uint64_t ones = 0;
+    uint32_t value;
+    int status = SLOT_CODEC_OK;
+
+    while (n < target)
+    {
+        // a zero run, carried on through any 65535s (unless the last read stopped before its count)
+        if (!reader->count_pending)
+            do
+            {
+                if (n == capacity)
+                {
+                    status = SLOT_CODEC_FULL;
+                    goto done;
+                }
+                if (!next_word(reader, &value, text))
+                {
+                    status = end_status(reader, SLOT_CODEC_END, text);
+                    goto done;
+                }
+                if (value > 65535)
+                {
+                    reader->bad_value = value;
+                    status = SLOT_CODEC_INVALID;
+                    goto done;
+                }
+                words[n++] = (uint16_t)value;
+            }
+            while (value == 65535);
+
+        // and the count after it
+        if (n == capacity)
+        {
+            reader->count_pending = 1;
+            status = SLOT_CODEC_FULL;
+            goto done;
+        }
+        reader->count_pending = 0;
+        if (!next_word(reader, &value, text))
+        {
+            status = end_status(reader, SLOT_CODEC_TRUNCATED, text);
+            goto done;
+        }
+        if (value > limit)
+        {
+            reader->bad_value = value;
+            status = SLOT_CODEC_INVALID;
+            goto done;
+        }
+        words[n++] = (uint16_t)value;
+        ones += (value != 0);
+    }
+
+done:
+    *num_words = n;
+    *occupied += ones;
+    return status;
+}
+
+
+static int read_words_text(slot_codec_reader *reader, uint16_t *words, size_t target, size_t capacity,
+                           uint32_t limit, size_t *num_words, uint64_t *occupied)
+{
+    return read_words_generic(reader, words, target, capacity, limit, num_words, occupied, 1);
+}
+
+
+static int read_words_binary(slot_codec_reader *reader, uint16_t *words, size_t target, size_t capacity,
+                             uint32_t limit, size_t *num_words, uint64_t *occupied)
+{
+    return read_words_generic(reader, words, target, capacity, limit, num_words, occupied, 0);
+}
+
+
+static int read_slots_pulse_text(slot_codec_reader *reader, uint32_t *slots, size_t max_slots, uint32_t limit,
+                                 size_t *num_slots, uint64_t *occupied)
+{
+    int invalid;
+    (void)limit;    // the characters can only say 0 or 1
+    *num_slots = text_read_pulse_chars(&reader->text, slots, max_slots, occupied, &invalid);
+    if (invalid)
+        return SLOT_CODEC_INVALID;
+    return (*num_slots < max_slots) ? SLOT_CODEC_END : SLOT_CODEC_OK;
+}
+
+
+static int read_slots_count_text(slot_codec_reader *reader, uint32_t *slots, size_t max_slots, uint32_t limit,
+                                 size_t *num_slots, uint64_t *occupied)
+{
+    size_t n = 0;
+    uint64_t ones = 0;
+    uint32_t value;
+    int status = SLOT_CODEC_OK;
+    while (n < max_slots)
+    {
+        if (!text_read_uint(&reader->text, &value))
+        {
+            status = end_status(reader, SLOT_CODEC_END, 1);
+            break;
+        }
+        if (value > limit)
+        {
+            reader->bad_value = value;
+            status = SLOT_CODEC_INVALID;
+            break;
+        }
+        slots[n++] = value;
+        ones += (value != 0);
+    }
+    *num_slots = n;
+    *occupied += ones;
+    return status;
+}
+
+
+static int read_slots_count_binary(slot_codec_reader *reader, uint32_t *slots, size_t max_slots, uint32_t limit,
+                                   size_t *num_slots, uint64_t *occupied)
+{
+    const uint8_t *bytes = reader->map.data + reader->map.position;
+    size_t n = reader->map.size - reader->map.position;
+    if (n > max_slots)
+        n = max_slots;
+
+    size_t valid = n;
+    if (limit == 1)    // pulses: checked and counted 64 bytes at a time
+        valid = validate_pulse_bytes(bytes, n, occupied);
+    else
+    {
+        uint64_t ones = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (bytes[i] > limit)
+            {
+                valid = i;
+                break;
+            }
+            ones += (bytes[i] != 0);
+        }
+        *occupied += ones;
+    }
+    if (valid != n)
+    {
+        reader->bad_value = bytes[valid];
+        *num_slots = 0;
+        return SLOT_CODEC_INVALID;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        slots[i] = bytes[i];
+    *num_slots = n;
+    reader->map.position += n;
+    return (reader->map.position == reader->map.size) ? SLOT_CODEC_END : SLOT_CODEC_OK;
+}
+
+
+static int write_words_text(slot_codec_writer *writer, const uint16_t *words, size_t num_words)
+{
+    for (size_t i = 0; i < num_words; i++)
+        text_write_uint(&writer->text, words[i]);
+    text_writer_flush(&writer->text);
+    return ferror(writer->fp) ? SLOT_CODEC_FAILED : SLOT_CODEC_OK;
+}
+
+
+static int write_words_binary(slot_codec_writer *writer, const uint16_t *words, size_t num_words)
+{
+    writer->bytes += num_words * sizeof(uint16_t);
+    return (writer->sink(writer->sink_context, words, num_words * sizeof(uint16_t)) == 0) ? SLOT_CODEC_OK
+                                                                                          : SLOT_CODEC_FAILED;
+}
+
+
+static int write_slots_count_text(slot_codec_writer *writer, const uint32_t *slots, size_t num_slots)
+{
+    for (size_t i = 0; i < num_slots; i++)
+        text_write_uint(&writer->text, slots[i]);
+    text_writer_flush(&writer->text);
+    return ferror(writer->fp) ? SLOT_CODEC_FAILED : SLOT_CODEC_OK;
+}
+
+
+// a byte per slot: the count itself (binary), or a '0' or '1' character (pulse text)
+SPECIALISE int write_bytes_generic(slot_codec_writer *writer, const uint32_t *slots, size_t num_slots, const int text)
+{
+    const uint32_t limit = text ? 1 : 255;     // one less than a power of 2, so the OR of the counts shows it
+    uint8_t bytes[PACK_CHUNK_SIZE_IN_BYTES];
+    for (size_t slot = 0; slot < num_slots; slot += PACK_CHUNK_SIZE_IN_BYTES)
+    {
+        size_t chunk = (num_slots - slot < PACK_CHUNK_SIZE_IN_BYTES) ? num_slots - slot : PACK_CHUNK_SIZE_IN_BYTES;
+        uint32_t all = 0;
+        for (size_t i = 0; i < chunk; i++)
+        {
+            all |= slots[slot + i];
+            bytes[i] = (uint8_t)(text ? '0' + slots[slot + i] : slots[slot + i]);
+        }
+        if (all > limit)    // checked once per chunk
+            return SLOT_CODEC_INVALID;
+        writer->bytes += chunk;
+        if (writer->sink(writer->sink_context, bytes, chunk) != 0)
+            return SLOT_CODEC_FAILED;
+    }
+    return SLOT_CODEC_OK;
+}
+
+
+static int write_slots_pulse_text(slot_codec_writer *writer, const uint32_t *slots, size_t num_slots)
+{
+    return write_bytes_generic(writer, slots, num_slots, 1);
+}
+
+
+static int write_slots_count_binary(slot_codec_writer *writer, const uint32_t *slots, size_t num_slots)
+{
+    return write_bytes_generic(writer, slots, num_slots, 0);
+}
+
+
+const slot_codec slot_codec_rle_text = { ".rle.txt", 1, 1, 65535, read_words_text, NULL, write_words_text, NULL };
+const slot_codec slot_codec_rle_binary = { ".rle.bin", 0, 1, 65535, read_words_binary, NULL, write_words_binary, NULL };
+const slot_codec slot_codec_pulse_text = { ".pulses.txt", 1, 0, 1, NULL, read_slots_pulse_text, NULL, write_slots_pulse_text };
+const slot_codec slot_codec_count_text = { ".photons.txt", 1, 0, UINT32_MAX, NULL, read_slots_count_text, NULL, write_slots_count_text };
+const slot_codec slot_codec_count_binary = { ".bin", 0, 0, 255, NULL, read_slots_count_binary, NULL, write_slots_count_binary };
+
+// longest suffix first, so that ".rle.bin" isn't taken for ".bin"
+static const slot_codec *const codecs[] = { &slot_codec_rle_text, &slot_codec_rle_binary, &slot_codec_pulse_text,
+                                            &slot_codec_count_text, &slot_codec_count_binary };
+
+
+const slot_codec *slot_codec_from_name(const char *filename)
+{
+    size_t length = strlen(filename);
+    for (size_t i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++)
+    {
+        size_t suffix = strlen(codecs[i]->suffix);
+        if (length >= suffix && strcmp(filename + length - suffix, codecs[i]->suffix) == 0)
+            return codecs[i];
+    }
+    return NULL;
+}
+
+
+const slot_codec *slot_codec_select(int text, int compressed, int pulses)
+{
+    if (compressed)
+        return text ? &slot_codec_rle_text : &slot_codec_rle_binary;
+    if (text)
+        return pulses ? &slot_codec_pulse_text : &slot_codec_count_text;
+    return &slot_codec_count_binary;
+}
+
+
+int slot_codec_open_reader(slot_codec_reader *reader, const slot_codec *codec, const char *filename)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->codec = codec;
+    if (!codec->text)   // binary files are read in place from a memory map
+        return mapped_file_open(&reader->map, filename);
+
+    reader->fp = fopen(filename, "r");
+    if (reader->fp == NULL)
+        return -1;
+    text_reader_init(&reader->text, reader->fp);
+    return 0;
+}
+
+
+void slot_codec_close_reader(slot_codec_reader *reader)
+{
+    if (reader->codec->text)
+    {
+        text_reader_free(&reader->text);
+        fclose(reader->fp);
+    }
+    else
+        mapped_file_close(&reader->map);
+}
+
+
+static int file_sink(void *context, const void *data, size_t length)
+{
+    return (fwrite(data, 1, length, (FILE *)context) == length) ? 0 : -1;
+}
+
+
+int slot_codec_create_writer(slot_codec_writer *writer, const slot_codec *codec, const char *filename)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->codec = codec;
+    writer->fp = fopen(filename, codec->text ? "w" : "wb");
+    if (writer->fp == NULL)
+        return -1;
+    writer->sink = file_sink;
+    writer->sink_context = writer->fp;
+    if (codec->text && codec != &slot_codec_pulse_text)   // numbers are formatted by text_io
+        text_writer_init(&writer->text, writer->fp);
+    return 0;
+}
+
+
+int slot_codec_close_writer(slot_codec_writer *writer)
+{
+    if (writer->text.buffer != NULL)
+        text_writer_free(&writer->text);
+    int failed = ferror(writer->fp);
+    if (fclose(writer->fp) != 0)
+        failed = 1;
+    return failed ? -1 : 0;
+}
+
+
+uint64_t slot_codec_bytes_read(const slot_codec_reader *reader)
+{
+    if (reader->codec->text)   // what has been parsed, not what is sitting in the read buffer
+        return (uint64_t)ftell(reader->fp) - (reader->text.length - reader->text.position);
+    return reader->map.position;
+}
+
+
+uint64_t slot_codec_bytes_written(const slot_codec_writer *writer)
+{
+    if (writer->text.buffer != NULL)
+        return (uint64_t)ftell(writer->fp) + writer->text.length;
+    return writer->bytes;
+}
@@ -0,0 +1,115 @@
+/* Per-format readers and writers for the stls slot files (.rle.txt, .rle.bin, .bin, .pulses.txt, .photons.txt)
+
+ Each file format is a slot_codec: a table of read and write functions picked once, when the
+ file is opened, so the per-word and per-slot loops never ask whether the file is text or
+ binary, compressed or not. The loops are written once, as inline functions that take the
+ format as a constant argument, and each table entry is one of them instantiated with its
+ format's constants. Every instantiation compiles to its own loop with the format test
+ folded away, as a template specialised per format would. Adding a format means adding a
+ table; the programs that use the interface don't change.
+
+ The RLE formats are read and written as 16-bit words, whole (zero run, count) pairs at a
+ time, where a zero run of 65535 carries on into the next word. The other formats hold one
+ value per slot. Readers check every count against a limit (1 for pulse files) and add the
+ number of occupied slots to a running total.
+
+ Text output is formatted by text_io. Binary output goes through the writer's sink, which
+ is fwrite() to the file unless the caller swaps in another one (stls uses io_uring).
+
+*/
+#ifndef SLOT_CODEC_H
+#define SLOT_CODEC_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mapped_file.h"
+#include "text_io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// read and write results
+#define SLOT_CODEC_OK 0             // done, and there may be more to read
+#define SLOT_CODEC_END 1            // the read reached the end of the file
+#define SLOT_CODEC_INVALID (-1)     // a value over the limit (bad_value has it), a stray character or
+                                    // text that isn't a number (text.failed is set)
+#define SLOT_CODEC_TRUNCATED (-2)   // a zero run with no count after it at the end of an RLE file
+#define SLOT_CODEC_FULL (-3)        // a zero run longer than the word buffer; the next read carries on
+#define SLOT_CODEC_FAILED (-4)      // the output file could not be written
+
+struct slot_codec;
+
+typedef struct
+{
+    const struct slot_codec *codec;
+    FILE *fp;                   // text formats
+    text_reader text;
+    mapped_file map;            // binary formats, read in place
+    uint32_t bad_value;         // the value that made the last read return SLOT_CODEC_INVALID
+    int count_pending;          // set when a read stopped between a zero run and its count
+} slot_codec_reader;
+
+typedef struct
+{
+    const struct slot_codec *codec;
+    FILE *fp;
+    text_writer text;           // text formats
+    uint64_t bytes;             // bytes handed to the sink (binary formats)
+
+    // where binary output goes: fwrite() to fp by default; returns 0 on success
+    int (*sink)(void *context, const void *data, size_t length);
+    void *sink_context;
+} slot_codec_writer;
+
+typedef struct slot_codec
+{
+    const char *suffix;         // the file name ending that selects the format
+    int text;                   // ASCII rather than binary
+    int compressed;             // 16-bit RLE words rather than a value per slot
+    uint32_t max_count;         // the largest count the format can hold
+
+    // RLE formats: whole (zero run, count) pairs, until at least target words have been read
+    // or the file ends, and never more than capacity words. Counts above limit are invalid.
+    int (*read_words)(slot_codec_reader *reader, uint16_t *words, size_t target, size_t capacity,
+                      uint32_t limit, size_t *num_words, uint64_t *occupied);
+
+    // Formats with a value per slot: up to max_slots slots, stopping early at the end of the file
+    int (*read_slots)(slot_codec_reader *reader, uint32_t *slots, size_t max_slots, uint32_t limit,
+                      size_t *num_slots, uint64_t *occupied);
+
+    int (*write_words)(slot_codec_writer *writer, const uint16_t *words, size_t num_words);
+    int (*write_slots)(slot_codec_writer *writer, const uint32_t *slots, size_t num_slots);
+} slot_codec;
+
+extern const slot_codec slot_codec_rle_text;       // .rle.txt
+extern const slot_codec slot_codec_rle_binary;     // .rle.bin
+extern const slot_codec slot_codec_pulse_text;     // .pulses.txt, a '0' or '1' character per slot
+extern const slot_codec slot_codec_count_text;     // .photons.txt, a number and a space per slot
+extern const slot_codec slot_codec_count_binary;   // .bin, a byte per slot
+
+// The codec for a file name, or NULL if the name isn't one of the formats above
+const slot_codec *slot_codec_from_name(const char *filename);
+
+// The codec for the stls flags; pulses picks the '0'/'1' text of pulse files over numbers
+const slot_codec *slot_codec_select(int text, int compressed, int pulses);
+
+// Open a file for reading or create one for writing; each returns 0 on success
+int slot_codec_open_reader(slot_codec_reader *reader, const slot_codec *codec, const char *filename);
+void slot_codec_close_reader(slot_codec_reader *reader);
+int slot_codec_create_writer(slot_codec_writer *writer, const slot_codec *codec, const char *filename);
+
+// Write out anything buffered and close; returns 0 if everything reached the file
+int slot_codec_close_writer(slot_codec_writer *writer);
+
+// Input consumed and output produced so far, in bytes
+uint64_t slot_codec_bytes_read(const slot_codec_reader *reader);
+uint64_t slot_codec_bytes_written(const slot_codec_writer *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
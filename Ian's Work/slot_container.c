@@ -0,0 +1,365 @@
+/* Seekable, indexed container for pulse and photon-count streams - see slot_container.h */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "slot_container.h"
+
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void build_crc_table(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        crc_table[i] = c;
+    }
+}
+
+
+uint32_t slot_container_crc32(const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+
+    // the decode threads can be the first callers, so the table is built exactly once
+    pthread_once(&crc_table_once, build_crc_table);
+
+    for (size_t i = 0; i < length; i++)
+        crc = crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+
+int slot_container_create(slot_container_writer *writer, const char *filename, const slot_container_header *info)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->fp = fopen(filename, "wb");
+    if (writer->fp == NULL)
+        return -1;
+
+    if (info != NULL)
+        writer->header = *info;
+    memcpy(writer->header.magic, SLOT_CONTAINER_MAGIC, 4);
+    writer->header.version = SLOT_CONTAINER_VERSION;
+    writer->header.total_slots = 0;
+    writer->header.total_pulses = 0;
+    writer->header.block_count = 0;
+    writer->header.index_offset = 0;
+
+    // placeholder header, rewritten by slot_container_close()
+    if (fwrite(&writer->header, sizeof(writer->header), 1, writer->fp) != 1)
+        return -1;
+    return 0;
+}
+
+
+static int reserve_pairs(slot_container_writer *writer, size_t needed)
+{
+    if (needed <= writer->pairs_capacity)
+        return 0;
+    size_t capacity = writer->pairs_capacity ? writer->pairs_capacity : 4096;
+    while (capacity < needed)
+        capacity *= 2;
+    uint32_t *pairs = realloc(writer->pairs, capacity * sizeof(uint32_t));
+    if (pairs == NULL)
+        return -1;
+    writer->pairs = pairs;
+    writer->pairs_capacity = capacity;
+    return 0;
+}
+
+
+int slot_container_write_block(slot_container_writer *writer, const uint32_t *slots, uint64_t slot_count)
+{
+    size_t num_pairs = 0;
+    uint64_t pulses = 0;
+    uint32_t run = 0;
+
+    if (slot_count > SLOT_CONTAINER_MAX_BLOCK_SLOTS)
+        return -1;
+
+    for (uint64_t i = 0; i < slot_count; i++)
+    {
+        if (slots[i] == 0)
+        {
+            run++;
+            continue;
+        }
+        if (reserve_pairs(writer, 2 * (num_pairs + 1)) != 0)
+            return -1;
+        writer->pairs[2 * num_pairs] = run;
+        writer->pairs[2 * num_pairs + 1] = slots[i];
+        num_pairs++;
+        pulses++;
+        run = 0;
+    }
+    if (run > 0)    // block ends with zeros
+    {
+        if (reserve_pairs(writer, 2 * (num_pairs + 1)) != 0)
+            return -1;
+        writer->pairs[2 * num_pairs] = run;
+        writer->pairs[2 * num_pairs + 1] = 0;
+        num_pairs++;
+    }
+
+    return slot_container_write_pairs(writer, writer->pairs, num_pairs, slot_count, pulses);
+}
+
+
+int slot_container_write_pairs(slot_container_writer *writer, const uint32_t *pairs, size_t num_pairs,
+                               uint64_t slot_count, uint64_t pulse_count)
+{
+    slot_container_block entry;
+    long offset = ftell(writer->fp);
+
+    if (offset < 0)
+        return -1;
+    if (writer->header.block_count == writer->capacity)
+    {
+        size_t capacity = writer->capacity ? 2 * writer->capacity : 256;
+        slot_container_block *index = realloc(writer->index, capacity * sizeof(slot_container_block));
+        if (index == NULL)
+            return -1;
+        writer->index = index;
+        writer->capacity = capacity;
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    entry.first_slot = writer->header.total_slots;
+    entry.slot_count = slot_count;
+    entry.pulse_count = pulse_count;
+    entry.byte_offset = (uint64_t)offset;
+    entry.byte_length = (uint64_t)num_pairs * 2 * sizeof(uint32_t);
+    entry.checksum = slot_container_crc32(pairs, (size_t)entry.byte_length);
+
+    if (num_pairs > 0 && fwrite(pairs, 2 * sizeof(uint32_t), num_pairs, writer->fp) != num_pairs)
+        return -1;
+
+    writer->index[writer->header.block_count++] = entry;
+    writer->header.total_slots += slot_count;
+    writer->header.total_pulses += pulse_count;
+    return 0;
+}
+
+
+int slot_container_close(slot_container_writer *writer)
+{
+    int status = 0;
+    long offset = ftell(writer->fp);
+
+    writer->header.index_offset = (uint64_t)offset;
+    if (offset < 0)
+        status = -1;
+    else if (writer->header.block_count > 0 &&
+             fwrite(writer->index, sizeof(slot_container_block), (size_t)writer->header.block_count, writer->fp)
+                 != writer->header.block_count)
+        status = -1;
+    else if (fseek(writer->fp, 0, SEEK_SET) != 0 ||
+             fwrite(&writer->header, sizeof(writer->header), 1, writer->fp) != 1)
+        status = -1;
+
+    if (fclose(writer->fp) != 0)
+        status = -1;
+    free(writer->index);
+    free(writer->pairs);
+    writer->fp = NULL;
+    writer->index = NULL;
+    writer->pairs = NULL;
+    return status;
+}
+
+
+int slot_container_is_container(const void *data, size_t size)
+{
+    return (size >= sizeof(slot_container_header)) && (memcmp(data, SLOT_CONTAINER_MAGIC, 4) == 0);
+}
+
+
+int slot_container_open(slot_container_reader *reader, const char *filename)
+{
+    memset(reader, 0, sizeof(*reader));
+    if (mapped_file_open(&reader->map, filename) != 0)
+        return -1;
+    if (!slot_container_is_container(reader->map.data, reader->map.size))
+    {
+        mapped_file_close(&reader->map);
+        return -1;
+    }
+    memcpy(&reader->header, reader->map.data, sizeof(reader->header));
+
+    // the index and every payload it points at must lie inside the file
+    uint64_t index_bytes = reader->header.block_count * sizeof(slot_container_block);
+    if (reader->header.version != SLOT_CONTAINER_VERSION ||
+        reader->header.index_offset > reader->map.size ||
+        index_bytes > reader->map.size - reader->header.index_offset ||
+        reader->header.index_offset % 8 != 0)
+    {
+        mapped_file_close(&reader->map);
+        return -1;
+    }
+    reader->index = (const slot_container_block *)(reader->map.data + reader->header.index_offset);
+    // the blocks must tile the stream from slot 0 with no gap or overlap, since readers place
+    // each block at its first_slot and size their buffers from total_slots
+    uint64_t next_slot = 0;
+    for (uint64_t b = 0; b < reader->header.block_count; b++)
+    {
+        const slot_container_block *entry = &reader->index[b];
+        if (entry->byte_offset > reader->header.index_offset ||
+            entry->byte_length > reader->header.index_offset - entry->byte_offset ||
+            entry->byte_length % 8 != 0 || entry->byte_offset % 4 != 0 ||
+            entry->slot_count > SLOT_CONTAINER_MAX_BLOCK_SLOTS ||
+            entry->first_slot != next_slot ||
+            (b > 0 && entry->first_slot <= reader->index[b - 1].first_slot))   // find_block bisects on it
+        {
+            mapped_file_close(&reader->map);
+            return -1;
+        }
+        next_slot += entry->slot_count;
+    }
+    if (next_slot != reader->header.total_slots)
+    {
+        mapped_file_close(&reader->map);
+        return -1;
+    }
+    return 0;
+}
+
+
+void slot_container_close_reader(slot_container_reader *reader)
+{
+    mapped_file_close(&reader->map);
+    reader->index = NULL;
+}
+
+
+uint64_t slot_container_find_block(const slot_container_reader *reader, uint64_t slot)
+{
+    uint64_t low = 0, high = reader->header.block_count;
+
+    if (slot >= reader->header.total_slots)
+        return reader->header.block_count;
+    // binary search for the last block starting at or before the slot
+    while (high - low > 1)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (reader->index[middle].first_slot <= slot)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+
+const uint32_t *slot_container_block_pairs(const slot_container_reader *reader, uint64_t block, size_t *num_pairs)
+{
+    if (block >= reader->header.block_count)
+        return NULL;
+    const slot_container_block *entry = &reader->index[block];
+    const void *payload = reader->map.data + entry->byte_offset;
+    if (slot_container_crc32(payload, (size_t)entry->byte_length) != entry->checksum)
+        return NULL;
+    *num_pairs = (size_t)(entry->byte_length / (2 * sizeof(uint32_t)));
+    return (const uint32_t *)payload;
+}
+
+
+int slot_container_read_block(const slot_container_reader *reader, uint64_t block, uint32_t *slots)
+{
+    size_t num_pairs;
+    const uint32_t *pairs = slot_container_block_pairs(reader, block, &num_pairs);
+    uint64_t filled = 0;
+    uint64_t slot_count;
+
+    if (pairs == NULL)
+        return -1;
+    slot_count = reader->index[block].slot_count;
+    for (size_t i = 0; i < num_pairs; i++)
+    {
+        uint32_t run = pairs[2 * i];
+        uint32_t value = pairs[2 * i + 1];
+        if (filled + run + (value != 0) > slot_count)
+            return -1;
+        memset(slots + filled, 0, (size_t)run * sizeof(uint32_t));
+        filled += run;
+        if (value != 0)
+            slots[filled++] = value;
+    }
+    return (filled == slot_count) ? 0 : -1;
+}
+
+
+typedef struct
+{
+    const slot_container_reader *reader;
+    uint64_t first_block;
+    uint64_t count;
+    uint32_t *slots;
+    uint64_t base_slot;         // first slot of first_block, i.e. slots[0]
+    uint64_t next;              // next block to hand out, shared by the threads
+    pthread_mutex_t lock;
+    int status;
+} parallel_decode;
+
+
+static void *decode_worker(void *argument)
+{
+    parallel_decode *job = (parallel_decode *)argument;
+
+    while (1)
+    {
+        pthread_mutex_lock(&job->lock);
+        uint64_t i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (i >= job->count)
+            return NULL;
+
+        uint64_t block = job->first_block + i;
+        uint32_t *out = job->slots + (job->reader->index[block].first_slot - job->base_slot);
+        if (slot_container_read_block(job->reader, block, out) != 0)
+        {
+            pthread_mutex_lock(&job->lock);
+            job->status = -1;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+}
+
+
+int slot_container_read_blocks_parallel(const slot_container_reader *reader, uint64_t first_block, uint64_t count,
+                                        uint32_t *slots, int threads)
+{
+    parallel_decode job;
+    pthread_t *workers;
+
+    if (first_block > reader->header.block_count || count > reader->header.block_count - first_block)
+        return -1;
+    if (count == 0)
+        return 0;
+    if (threads < 1)
+        threads = 1;
+
+    job.reader = reader;
+    job.first_block = first_block;
+    job.count = count;
+    job.slots = slots;
+    job.base_slot = reader->index[first_block].first_slot;
+    job.next = 0;
+    job.status = 0;
+    pthread_mutex_init(&job.lock, NULL);
+
+    workers = malloc((size_t)threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++)
+        pthread_create(&workers[t], NULL, decode_worker, &job);
+    for (int t = 0; t < threads; t++)
+        pthread_join(workers[t], NULL);
+    free(workers);
+    pthread_mutex_destroy(&job.lock);
+
+    return job.status;
+}
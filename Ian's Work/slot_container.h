@@ -0,0 +1,123 @@
+/* Seekable, indexed container for pulse and photon-count streams (.slots files)
+
+ Layout (all fields little-endian, as written by an x86/ARM host):
+
+     header      slot_container_header, 200 bytes
+     blocks      one RLE payload per block: (zero run, value) pairs of uint32, where value is
+                 the photon count (or 1 for a pulse) of the slot after the run; a block that
+                 ends in zeros finishes with a (run, 0) pair
+     index       block_count slot_container_block entries, at header.index_offset
+
+ Every block records where it starts in the slot stream, how many slots and pulses it holds,
+ where its payload is and a CRC-32 of the payload, so a reader can jump straight to the block
+ holding any slot, hand different blocks to different threads, and detect corruption without
+ decoding anything before it.
+
+*/
+#ifndef SLOT_CONTAINER_H
+#define SLOT_CONTAINER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mapped_file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SLOT_CONTAINER_MAGIC "LCSC"
+#define SLOT_CONTAINER_VERSION 1
+#define SLOT_CONTAINER_MAX_BLOCK_SLOTS 0x80000000ULL   // run lengths are stored as uint32
+
+typedef struct
+{
+    char magic[4];              // "LCSC"
+    uint32_t version;
+    uint64_t total_slots;
+    uint64_t total_pulses;      // occupied slots
+    uint64_t block_slots;       // nominal slots per block (the last block may be shorter)
+    uint64_t block_count;
+    uint64_t index_offset;      // byte offset of the block index
+    uint32_t ppm_order;         // log2 of the slots per PPM symbol (e.g. 10 for m10), 0 if unknown
+    uint32_t reserved;
+    double mean_photons;        // -k used to make the file, 0 for pulse files
+    uint64_t seed;              // random seed used to make the file, 0 if none
+    char provenance[128];       // free text: program and source file, NUL padded
+} slot_container_header;
+
+typedef struct
+{
+    uint64_t first_slot;        // index of the block's first slot in the whole stream
+    uint64_t slot_count;
+    uint64_t pulse_count;       // occupied slots in the block
+    uint64_t byte_offset;       // payload position in the file
+    uint64_t byte_length;       // payload size in bytes (a multiple of 8)
+    uint32_t checksum;          // CRC-32 of the payload
+    uint32_t reserved;
+} slot_container_block;
+
+typedef struct
+{
+    FILE *fp;
+    slot_container_header header;
+    slot_container_block *index;
+    size_t capacity;            // entries allocated in index
+    uint32_t *pairs;            // scratch space for encoding a block
+    size_t pairs_capacity;
+} slot_container_writer;
+
+typedef struct
+{
+    mapped_file map;
+    slot_container_header header;
+    const slot_container_block *index;
+} slot_container_reader;
+
+// CRC-32 (IEEE 802.3 polynomial) of a byte range
+uint32_t slot_container_crc32(const void *data, size_t length);
+
+// Start a new container. The informational header fields (ppm_order, mean_photons, seed,
+// provenance, block_slots) are copied from info; the rest are filled in as blocks are written.
+// Returns 0 on success.
+int slot_container_create(slot_container_writer *writer, const char *filename, const slot_container_header *info);
+
+// append a block of slot values (0 = empty, otherwise the count in that slot); returns 0 on success
+int slot_container_write_block(slot_container_writer *writer, const uint32_t *slots, uint64_t slot_count);
+
+// append a block already in (zero run, value) pair form; returns 0 on success
+int slot_container_write_pairs(slot_container_writer *writer, const uint32_t *pairs, size_t num_pairs,
+                               uint64_t slot_count, uint64_t pulse_count);
+
+// write the index, finalise the header and close the file; returns 0 on success
+int slot_container_close(slot_container_writer *writer);
+
+// check whether the start of a file looks like a container
+int slot_container_is_container(const void *data, size_t size);
+
+// Map a container and check its header and index. Returns 0 on success.
+int slot_container_open(slot_container_reader *reader, const char *filename);
+void slot_container_close_reader(slot_container_reader *reader);
+
+// index of the block holding the given slot (block_count if the slot is past the end)
+uint64_t slot_container_find_block(const slot_container_reader *reader, uint64_t slot);
+
+// Pointer to a block's (zero run, value) pairs inside the mapping, after verifying its checksum.
+// Returns NULL if the block number is out of range or the checksum doesn't match.
+const uint32_t *slot_container_block_pairs(const slot_container_reader *reader, uint64_t block, size_t *num_pairs);
+
+// Decode one block into slots[0 .. slot_count-1]. Safe to call from several threads at once.
+// Returns 0 on success.
+int slot_container_read_block(const slot_container_reader *reader, uint64_t block, uint32_t *slots);
+
+// Decode blocks [first_block, first_block + count) into one contiguous array, spreading the blocks
+// over the given number of threads. Returns 0 if every block decoded and verified.
+int slot_container_read_blocks_parallel(const slot_container_reader *reader, uint64_t first_block, uint64_t count,
+                                        uint32_t *slots, int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,135 @@
+/* A compact buffer of photon counts - see slot_counts.h */
+#include <stdlib.h>
+#include <string.h>
+
+#include "slot_counts.h"
+
+
+int slot_counts_init(slot_counts *counts, uint64_t capacity)
+{
+    memset(counts, 0, sizeof(*counts));
+    counts->bytes = malloc((size_t)capacity);
+    if (counts->bytes == NULL)
+        return -1;
+    counts->capacity = capacity;
+    return 0;
+}
+
+
+void slot_counts_free(slot_counts *counts)
+{
+    free(counts->bytes);
+    free(counts->overflow_slots);
+    free(counts->overflow_counts);
+    memset(counts, 0, sizeof(*counts));
+}
+
+
+void slot_counts_reset(slot_counts *counts)
+{
+    counts->num_overflow = 0;
+}
+
+
+uint64_t slot_counts_memory(const slot_counts *counts)
+{
+    return counts->capacity + (uint64_t)counts->overflow_capacity * (sizeof(uint64_t) + sizeof(uint32_t));
+}
+
+
+void slot_counts_escape(slot_counts *counts, uint64_t slot, uint32_t count)
+{
+    if (counts->num_overflow == counts->overflow_capacity)
+    {
+        size_t capacity = counts->overflow_capacity ? 2 * counts->overflow_capacity : 256;
+        uint64_t *slots = realloc(counts->overflow_slots, capacity * sizeof(uint64_t));
+        if (slots != NULL)
+            counts->overflow_slots = slots;
+        uint32_t *values = realloc(counts->overflow_counts, capacity * sizeof(uint32_t));
+        if (values != NULL)
+            counts->overflow_counts = values;
+        if (slots == NULL || values == NULL)
+        {
+            counts->failed = 1;
+            return;
+        }
+        counts->overflow_capacity = capacity;
+    }
+    counts->bytes[slot] = SLOT_COUNTS_ESCAPE;
+    counts->overflow_slots[counts->num_overflow] = slot;
+    counts->overflow_counts[counts->num_overflow] = count;
+    counts->num_overflow++;
+}
+
+
+// index of the first escaped slot at or after slot
+static size_t first_escape(const slot_counts *counts, uint64_t slot)
+{
+    size_t low = 0, high = counts->num_overflow;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (counts->overflow_slots[middle] < slot)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+
+uint32_t slot_counts_get(const slot_counts *counts, uint64_t slot)
+{
+    uint8_t byte = counts->bytes[slot];
+    if (byte != SLOT_COUNTS_ESCAPE)
+        return byte;
+    size_t i = first_escape(counts, slot);
+    return (i < counts->num_overflow && counts->overflow_slots[i] == slot) ? counts->overflow_counts[i] : 0;
+}
+
+
+uint64_t slot_counts_next_occupied(const slot_counts *counts, uint64_t slot, uint64_t end)
+{
+    const uint8_t *bytes = counts->bytes;
+
+    // empty slots are skipped eight at a time
+    for (; slot + 8 <= end; slot += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + slot, sizeof(word));
+        if (word != 0)
+            break;
+    }
+    for (; slot < end; slot++)
+        if (bytes[slot] != 0)
+            return slot;
+    return end;
+}
+
+
+uint32_t slot_counts_pack(slot_counts *counts, uint64_t first, const uint32_t *slots, size_t num_slots)
+{
+    uint8_t *bytes = counts->bytes + first;
+    uint32_t all = 0;
+    for (size_t i = 0; i < num_slots; i++)
+    {
+        all |= slots[i];
+        bytes[i] = (uint8_t)slots[i];
+    }
+    if (all >= SLOT_COUNTS_ESCAPE)   // rare: go back and escape the large counts
+        for (size_t i = 0; i < num_slots; i++)
+            if (slots[i] >= SLOT_COUNTS_ESCAPE)
+                slot_counts_escape(counts, first + i, slots[i]);
+    return all;
+}
+
+
+void slot_counts_unpack(const slot_counts *counts, uint64_t first, uint32_t *slots, size_t num_slots)
+{
+    const uint8_t *bytes = counts->bytes + first;
+    for (size_t i = 0; i < num_slots; i++)
+        slots[i] = bytes[i];
+    for (size_t i = first_escape(counts, first);
+         i < counts->num_overflow && counts->overflow_slots[i] < first + num_slots; i++)
+        slots[counts->overflow_slots[i] - first] = counts->overflow_counts[i];
+}
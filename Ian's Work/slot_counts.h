@@ -0,0 +1,78 @@
+/* A compact buffer of photon counts, one byte per slot
+
+ Counts are almost always small: a pulse catches a Poisson number of photons with a mean
+ below 1, and the empty slots are 0. So each slot takes one byte, a quarter of a 32-bit
+ count, and the rare count of 255 or more is stored as the escape byte 255 with the real
+ count in a side table of (slot, count) entries. Counts are set in slot order, so the side
+ table stays sorted and a lookup is a binary search.
+
+ A byte per slot rather than two bits: a byte is set with a plain store (no read-modify-write
+ of a shared word, so two threads can fill neighbouring stretches), the escapes stay rare
+ for any mean photon count in use, and it is already the layout of the .bin files.
+
+ Slot buffers from the file formats are 32-bit, so they are packed into and unpacked out of
+ the store a tile at a time; a tile of SLOT_COUNTS_TILE_SIZE slots stays in the L2 cache.
+
+*/
+#ifndef SLOT_COUNTS_H
+#define SLOT_COUNTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SLOT_COUNTS_ESCAPE 255          // the byte of a slot whose count is in the side table
+#define SLOT_COUNTS_TILE_SIZE 65536     // slots per tile of 32-bit counts when packing or unpacking
+
+typedef struct
+{
+    uint8_t *bytes;                 // a count per slot, or SLOT_COUNTS_ESCAPE
+    uint64_t capacity;              // slots allocated
+    uint64_t *overflow_slots;       // the escaped slots, in increasing order
+    uint32_t *overflow_counts;      // and their counts
+    size_t num_overflow;
+    size_t overflow_capacity;
+    int failed;                     // set if the side table could not grow
+} slot_counts;
+
+// Allocate room for capacity slots; returns 0 on success
+int slot_counts_init(slot_counts *counts, uint64_t capacity);
+void slot_counts_free(slot_counts *counts);
+
+// Forget the escaped counts, ready to fill the buffer again from slot 0
+void slot_counts_reset(slot_counts *counts);
+
+// Bytes held, including the side table
+uint64_t slot_counts_memory(const slot_counts *counts);
+
+// Record a count of SLOT_COUNTS_ESCAPE or more; slots must be escaped in increasing order
+void slot_counts_escape(slot_counts *counts, uint64_t slot, uint32_t count);
+
+static inline void slot_counts_set(slot_counts *counts, uint64_t slot, uint32_t count)
+{
+    if (count < SLOT_COUNTS_ESCAPE)
+        counts->bytes[slot] = (uint8_t)count;
+    else
+        slot_counts_escape(counts, slot, count);
+}
+
+uint32_t slot_counts_get(const slot_counts *counts, uint64_t slot);
+
+// The first slot in [slot, end) with a non-zero byte, or end if there isn't one
+uint64_t slot_counts_next_occupied(const slot_counts *counts, uint64_t slot, uint64_t end);
+
+// Copy num_slots 32-bit counts into the store from slot first; returns the OR of the counts,
+// so a caller can check them all against a limit of one less than a power of 2
+uint32_t slot_counts_pack(slot_counts *counts, uint64_t first, const uint32_t *slots, size_t num_slots);
+
+// Copy num_slots counts out of the store from slot first
+void slot_counts_unpack(const slot_counts *counts, uint64_t first, uint32_t *slots, size_t num_slots);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+/* Bounded single-producer single-consumer ring - see spsc_ring.h */
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+
+#include "spsc_ring.h"
+
+#define SPIN_TRIES 64       // polls before yielding the processor
+#define YIELD_TRIES 64      // yields before sleeping between polls
+#define SLEEP_NANOSECONDS 20000
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+
+// back off a little more each time a poll finds nothing to do
+static void wait_step(int *tries)
+{
+    if (*tries < SPIN_TRIES)
+        cpu_relax();
+    else if (*tries < SPIN_TRIES + YIELD_TRIES)
+        sched_yield();
+    else
+    {
+        struct timespec pause = { 0, SLEEP_NANOSECONDS };
+        nanosleep(&pause, NULL);
+        return;
+    }
+    (*tries)++;
+}
+
+
+int spsc_ring_init(spsc_ring *ring, uint32_t capacity)
+{
+    uint64_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    ring->items = calloc(size, sizeof(void *));
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    return (ring->items == NULL) ? -1 : 0;
+}
+
+
+void spsc_ring_free(spsc_ring *ring)
+{
+    free(ring->items);
+    ring->items = NULL;
+}
+
+
+void spsc_ring_push(spsc_ring *ring, void *item)
+{
+    uint64_t tail = ring->tail;     // only this thread writes the tail
+    int tries = 0;
+    while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > ring->mask)
+        wait_step(&tries);
+    ring->items[tail & ring->mask] = item;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+void *spsc_ring_pop(spsc_ring *ring)
+{
+    uint64_t head = ring->head;     // only this thread writes the head
+    int tries = 0;
+    while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head)
+        wait_step(&tries);
+    void *item = ring->items[head & ring->mask];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
@@ -0,0 +1,47 @@
+/* Bounded single-producer single-consumer ring of pointers
+
+ Connects two pipeline threads: one thread pushes, one thread pops, and neither takes a lock.
+ The head and tail counters sit on their own cache lines, and each side only writes its own
+ counter (with release ordering, read with acquire by the other side), so a push or pop is
+ a couple of loads and one store. A full ring makes the producer wait and an empty one the
+ consumer: it spins briefly, then yields, then sleeps in short steps, so a stage blocked on
+ slow I/O doesn't burn a core.
+
+ Items are passed by pointer; the ring never owns or frees them. STLS uses three rings to
+ cycle a fixed set of buffers between its reader, compute and writer threads.
+
+*/
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPSC_RING_CACHE_LINE 64
+
+typedef struct
+{
+    void **items;
+    uint64_t mask;              // capacity - 1, the capacity being a power of 2
+    uint64_t head __attribute__((aligned(SPSC_RING_CACHE_LINE)));   // next item to pop, written by the consumer
+    uint64_t tail __attribute__((aligned(SPSC_RING_CACHE_LINE)));   // next free entry, written by the producer
+} spsc_ring;
+
+// Room for at least capacity items; returns 0 on success
+int spsc_ring_init(spsc_ring *ring, uint32_t capacity);
+void spsc_ring_free(spsc_ring *ring);
+
+// Waits while the ring is full (producer side only)
+void spsc_ring_push(spsc_ring *ring, void *item);
+
+// Waits while the ring is empty (consumer side only)
+void *spsc_ring_pop(spsc_ring *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
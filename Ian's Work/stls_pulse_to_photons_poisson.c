@@ -9,16 +9,35 @@
 //     The input file can be binary or ACSII, and compressed or uncompressed.
 //     The output file will be of the same format (i.e. binary vs ASCII,
 //     compressed vs uncompressed) as the input file.
+//     A binary input that is an indexed .slots container (see slot_container.h) is
+//     recognised automatically and produces a .slots container, one block at a time.
+//     Likewise a sparse .events stream (see event_stream.h) produces a .events stream,
+//     a batch of pulses at a time and without expanding the empty slots.
+//     With -v the binary input and output use varint run lengths (see varint.h) in place
+//     of 16-bit words, so runs of any length take a single pair.
+//     With -t the work is pipelined: a reader thread, the compute stage and a writer thread
+//     pass a few reusable blocks around bounded lock-free rings (see spsc_ring.h), so reading
+//     and writing overlap the photon counts. The output is the same as a serial run's.
+//     With -u raw binary output goes through io_uring (see uring_writer.h) on Linux.
+//     The plain stls files (binary or ASCII, compressed or not) are read and written through
+//     a codec picked once at the start (see slot_codec.h), so the per-word loops don't test
+//     the format.
+//     Uncompressed slots are held a byte each (see slot_counts.h), and -m sets a memory budget
+//     that the slot buffers are sized to fit.
 //
 // Inputs:
 //    Files: [infilename].pulses.bin or [infilename].pulses.txt
 //        or [infilename].pulses.rle.bin or [infilename].pulses.rle.txt
+//        or [infilename].pulses.slots or [infilename].pulses.events
+//        or [infilename].pulses.vrle
 //    Parameters:
 //        - compressed flag: whether the input file is compressed with run-length encoding
 //        - ASCII flag: whether the input file is ASCII text (assumes binary by default)
 // Outputs:
 //    Files: [outfilename].photons.bin or [outfilename].photons.txt
 //        or [outfilename].photons.rle.bin or [outfilename].photons.rle.txt
+//        or [outfilename].photons.slots or [outfilename].photons.events
+//        or [outfilename].photons.vrle
 //    Console:
 //        Aany error messages, confirmation of successful completion.
 //
@@ -26,6 +45,8 @@
 //    Uncompressed input contains only 16-bit 0 or 1 (binary case) or characters "0" or "1" (ASCII case).
 //    Compressed input contains binary 16-bit integers according to RLE algorithm (binary case)
 //         or ASCII representations of 16-bit integers (ASCII case).
+//    Slot counts are 64-bit throughout, so a stream may run past 2^32 slots; only a single
+//         loop's buffer is limited by the 16-bit RLE codec.
 //
 // Revision History:
 //     29/08/2022        Ian Morrison        Original version
@@ -36,10 +57,24 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
 
+#include "mapped_file.h"
+#include "slot_codec.h"
+#include "slot_counts.h"
 #include "rle.h"
+#include "event_stream.h"
+#include "varint.h"
+#include "slot_container.h"
+#include "text_io.h"
 #include "poisson.h"
+#include "run_report.h"
+#include "spsc_ring.h"
+#include "uring_writer.h"
 
 #define DEFAULT_MEAN_DETECTED_PHOTONS 0.2           // default value for the mean photon count per incident pulse
 
@@ -48,8 +83,94 @@
                                                     //   that don't exceed this length
                                                     // - can be longer if on a run of (2^16-1) values at the nominal size
 
-#define UNCOMPRESSED_BUFFER_SIZE_IN_SLOTS 100000000 // allow an expansion factor of ~100,000 when uncompressing (a guess)
-                                                    // - cannot exceed 2^32 or de-compression function will fail
+#define POISSON_BATCH_SIZE 4096                     // number of photon counts drawn per call to poisson_batch()
+
+#define UNCOMPRESSED_BUFFER_SIZE_IN_SLOTS 100000000 // slots per loop at most (uncompressed, varint and container cases)
+                                                    // - a byte each, so 100 MB per block in flight
+
+#define EVENT_BUFFER_SIZE_IN_EVENTS 1048576         // pulses read per loop from a .events stream
+
+#define PIPELINE_BLOCK_SIZE_IN_SLOTS 16777216       // slots per loop when pipelined (-t), so several blocks in
+                                                    // flight take less memory than one serial buffer
+
+#define DEFAULT_PIPELINE_BLOCKS 4                   // blocks in flight when pipelined: one being read, one
+                                                    // computed, one written and one spare to absorb jitter
+
+#define MIN_BLOCK_MEMORY_IN_BYTES 65536             // the smallest share of a memory budget (-m) a block can have
+
+#define DECODE_BUFFER_LIMIT_IN_SLOTS 4294967295ULL  // a compressed loop must expand to fewer than 2^32 slots
+
+
+// everything a run needs; each group of members belongs to one stage, so the reader, compute
+// and writer threads of a pipelined run never touch the same state
+typedef struct
+{
+    // selections, fixed before processing starts
+    int ascii;                        // when set, input file is human readable ASCII (default = 0)
+    int compressed;                   // when set, input file is compressed (default = 0)
+    int container;                    // set when the input file is an indexed .slots container
+    int events;                       // set when the input file is a sparse .events stream
+    int varint;                       // set when the input and output files are varint RLE (.vrle)
+    int use_uring;                    // set when raw binary output goes through io_uring
+    uint64_t block_size_in_slots;     // slots per loop (uncompressed, varint and container cases)
+    uint64_t block_size_in_events;    // pulses per loop (event stream case)
+    uint64_t max_memory;              // memory budget for the slot buffers in bytes (0 for none)
+
+    // read stage
+    slot_codec_reader in;             // the input file (binary or ASCII, compressed or uncompressed cases)
+    mapped_file in_map;               // the memory-mapped input file (varint RLE case)
+    slot_container_reader in_container;   // the input file (container case)
+    uint64_t block_number;            // next container block to read
+    event_stream_reader in_events;    // the input file (event stream case)
+    uint64_t event_end_slot;          // slots covered so far (event stream case)
+    varint_rle_reader in_varint;      // decoder over the memory-mapped input (varint RLE case)
+    uint32_t * read_tile;             // 32-bit slots on their way into a block (uncompressed and varint cases)
+    int loop_count;                   // counter that increments each main loop
+    uint64_t occupied_slots;          // number of slots with a 1 (occupied with a pulse or at least one photon)
+
+    // compute stage
+    poisson_table photon_table;       // precomputed Poisson sampler for the mean photon count
+    poisson_rng rng;                  // state of the photon count generator
+    uint32_t * decode_buffer;         // the uncompressed slots of a loop (compressed case)
+    uint64_t decode_capacity;         // slots it has room for; it grows to the largest loop
+    uint64_t * histogram;             // table accumulating photon count stats
+    uint64_t erasures;                // count of erasures across the whole input data set
+
+    // write stage
+    slot_codec_writer out;            // the output file (binary or ASCII, compressed or uncompressed cases)
+    FILE * out_fp;                    // the output file pointer (varint RLE case)
+    slot_container_writer out_container;  // the output file (container case)
+    event_stream_writer out_events;   // the output file (event stream case)
+    varint_rle_writer out_varint;     // encoder for the output file (varint RLE case)
+    uring_writer out_uring;           // asynchronous writer for raw binary output (-u)
+    uint32_t * write_tile;            // 32-bit slots on their way out of a block (uncompressed case)
+    uint32_t * out_pairs;             // (zero run, count) pairs of a block (container case)
+    size_t out_pairs_capacity;        // pairs it has room for
+    uint64_t total_slots;             // total number of slots processed
+    uint64_t total_writes;            // tally of the total number of values written to the output file
+
+    run_report report;                // stage timings and throughput counters; each stage times its own
+} stls_run;
+
+
+// one loop's worth of data, passed from the read stage to the compute stage to the write stage
+typedef struct
+{
+    slot_counts counts;               // pulses, then photon counts, a byte per slot (uncompressed, varint
+                                      // and container cases)
+    uint64_t num_slots;               // slots in this loop (event stream case: the slots its pulses span)
+    uint16_t * words;                 // run-length encoded pulses, then photon counts (compressed case)
+    uint64_t num_words;
+    uint64_t * event_slots;           // slots of the pulses (event stream case)
+    uint32_t * event_counts;          // their pulse flags, then their photon counts
+    uint64_t num_events;
+    int loop;                         // the loop this block holds
+    int eof;                          // set on the last loop
+    uint64_t occupied_slots;          // pulses read up to the end of this loop
+    uint64_t bytes_in;                // input consumed up to the end of this loop
+    uint64_t rng_draws;               // random words drawn up to the end of this loop
+} stls_block;
+
 
 void usage ()
 {
@@ -58,54 +179,682 @@ void usage ()
            "  Convert pulses to photon counts\n"
            "\n"
            "  -a          reads an ASCII text input file (default is a binary file)\n"
+           "  -b          blocks in flight when pipelined (default is 4)\n"
            "  -c          assumes compressed input when flag present [default is uncompressed]\n"
+           "              (.slots container and .events stream inputs are recognised automatically)\n"
+           "  -v          reads and writes varint run lengths (.vrle) instead of 16-bit words; binary only\n"
            "  -h          display this usage information\n"
            "  -k          mean number of detected photons in a slot per incident pulse (default is 0.2)\n"
+           "  -m          memory budget for the slot buffers (--max-memory), in bytes with an optional K, M or G;\n"
+           "              loops get smaller to fit it (default is 100M slots a loop, 16M when pipelined)\n"
+           "  -p          print a progress line to stderr every this many seconds\n"
+           "  -r          write a run report (stage timings, throughput, peak memory, photon histogram)\n"
+           "              to this file: JSON if the name ends in .json, otherwise Prometheus text format\n"
+           "  -s          random seed; the same seed always gives the same photon counts (default is the time)\n"
+           "  -t          pipelined: read and write on their own threads, overlapping the photon counts\n"
+           "  -u          write raw binary output (.bin, .rle.bin) through io_uring where Linux supports it\n"
            "\n"
            );
 }
 
 
-int main(int argc, char **argv)
+static void allocate_block(const stls_run *run, stls_block *block)
+{
+    memset(block, 0, sizeof(*block));
+    if (run->compressed)
+        block->words = malloc((int)COMPRESSED_BUFFER_SIZE_IN_WORDS*2*sizeof(uint16_t));  // double it to allow for extra (2^16-1) values
+    else if (run->events)
+    {
+        block->event_slots = malloc(run->block_size_in_events*sizeof(uint64_t));
+        block->event_counts = malloc(run->block_size_in_events*sizeof(uint32_t));
+    }
+    else
+        slot_counts_init(&block->counts, run->block_size_in_slots);
+
+    if ((run->compressed && block->words == NULL) ||
+        (run->events && (block->event_slots == NULL || block->event_counts == NULL)) ||
+        (!run->compressed && !run->events && block->counts.bytes == NULL))
+    {
+        printf("\nERROR: out of memory\n\n");
+        exit(1);
+    }
+}
+
+
+static void free_block(stls_block *block)
+{
+    slot_counts_free(&block->counts);
+    free(block->words);
+    free(block->event_slots);
+    free(block->event_counts);
+}
+
+
+// io_uring in place of fwrite() for binary output (-u)
+static int uring_sink(void *context, const void *data, size_t length)
+{
+    return uring_writer_write((uring_writer *)context, data, length);
+}
+
+
+// stop on a read that found the input malformed
+static void check_read(const stls_run *run, int status)
+{
+    if (status == SLOT_CODEC_INVALID)
+    {
+        if (run->in.text.failed)
+            printf("\nERROR: invalid content in input file: not a number of at most 4294967295\n\n");
+        else if (run->compressed)
+            printf("\nERROR: invalid content in input file: %u\n\n", run->in.bad_value);
+        else
+            printf("\nERROR: invalid content in input file\n\n");
+        exit(1);
+    }
+    if (status == SLOT_CODEC_TRUNCATED)
+    {
+        printf("\nERROR: this shouldn't happen - odd word count in input?\n\n");
+        exit(1);
+    }
+    if (status == SLOT_CODEC_FULL)
+    {
+        printf("\nERROR: a run of zeros in the input is too long for the input buffer\n\n");
+        exit(1);
+    }
+}
+
+
+// stop on a write that failed
+static void check_write(int status)
+{
+    if (status == SLOT_CODEC_INVALID)
+    {
+        printf("\nERROR: a photon count is too large for the output file format\n\n");
+        exit(1);
+    }
+    if (status != SLOT_CODEC_OK)
+    {
+        printf("\nERROR: could not write to output file\n\n");
+        exit(1);
+    }
+}
+
+
+// expand a container block's (zero run, value) pairs into counts, with the OR of the values in all;
+// returns 0 on success
+static int expand_container_block(const stls_run *run, uint64_t block_number, slot_counts *counts, uint32_t *all)
+{
+    size_t num_pairs;
+    const uint32_t *pairs = slot_container_block_pairs(&run->in_container, block_number, &num_pairs);
+    uint64_t slot_count = run->in_container.index[block_number].slot_count;
+    uint64_t filled = 0;
+
+    if (pairs == NULL)
+        return -1;
+    for (size_t i = 0; i < num_pairs; i++)
+    {
+        uint32_t zeros = pairs[2 * i];
+        uint32_t value = pairs[2 * i + 1];
+        if (filled + zeros + (value != 0) > slot_count)
+            return -1;
+        memset(counts->bytes + filled, 0, zeros);
+        filled += zeros;
+        if (value != 0)
+        {
+            slot_counts_set(counts, filled++, value);
+            *all |= value;
+        }
+    }
+    return (filled == slot_count) ? 0 : -1;
+}
+
+
+// read stage: fill a block from the input and check it holds only pulses
+static void read_block(stls_run *run, stls_block *block)
 {
-    int ascii = 0;                    // when set, input file is human readable ASCII (default = 0)
-    int compressed = 0;               // when set, input file is compressed (default = 0)
-    int loop_count = 0;               // counter that increments each main loop
-    int character;                    // a place to store an input ASCII character
-    uint8_t byte;                     // a place to store an input binary byte
-    int num_read;                     // number of items read/scanned
     int eof_flag = 0;                 // flag set when EOF reached
-    uint32_t slots_this_loop;         // number of slots read in during current loop (uncompressed cases)
-    uint32_t words_this_loop;         // number of words read in during current loop (compressed cases)
-    unsigned long total_slots = 0;    // total number of slots processed
-    unsigned long occupied_slots = 0; // number of slots with a 1 (occupied with a pulse or at least one photon)
-    unsigned long total_writes = 0;   // tally of the total number of values written to the output file
-    uint32_t * uncompressed_buffer;   // pointer to array for storage of raw or uncompressed data
-    uint32_t * uncompressed_pointer;  // pointer to current location in the uncompressed buffer
-    uint16_t * compressed_buffer;     // pointer to array of data that has been run-length encoded for compression
-    uint16_t * compressed_pointer;    // pointer to current location in the compressed buffer
-    FILE * in_fp;                     // the input file pointer
-    FILE * out_fp;                    // the output file pointer
+
+    block->loop = ++run->loop_count;
+    block->num_slots = 0;
+    block->num_words = 0;
+    block->num_events = 0;
+    slot_counts_reset(&block->counts);
+    printf("Loop %d\n", block->loop);
+
+    int stage = run_report_begin(&run->report, "read");
+    if (run->container)   // container case - one block per loop
+    {
+        if (run->block_number < run->in_container.header.block_count)
+        {
+            const slot_container_block *info = &run->in_container.index[run->block_number];
+            if (info->slot_count > run->block_size_in_slots)
+            {
+                printf("\nERROR: container block %llu is larger than the input buffer\n\n",
+                       (unsigned long long)run->block_number);
+                exit(1);
+            }
+            uint32_t all = 0;
+            if (expand_container_block(run, run->block_number, &block->counts, &all) != 0)
+            {
+                printf("\nERROR: container block %llu is corrupt\n\n", (unsigned long long)run->block_number);
+                exit(1);
+            }
+            block->num_slots = info->slot_count;
+            if (all > 1)   // pulses must be 1s; anything else is a photon file
+            {
+                printf("\nERROR: invalid content in input file\n\n");
+                exit(1);
+            }
+            run->occupied_slots += info->pulse_count;
+            run->block_number++;
+        }
+        if (run->block_number >= run->in_container.header.block_count)
+        {
+            printf("Reached end of input file\n");
+            eof_flag = 1;
+        }
+    }
+    else if (run->events)   // event stream case - a buffer's worth of pulses, whatever slots they span
+    {
+        long num_events = event_stream_read(&run->in_events, UINT64_MAX, block->event_slots, block->event_counts,
+                                            (size_t)run->block_size_in_events);
+        if (num_events < 0)
+        {
+            printf("\nERROR: input event stream is corrupt\n\n");
+            exit(1);
+        }
+        block->num_events = (uint64_t)num_events;
+        for (uint64_t i = 0; i < block->num_events; i++)
+            if (block->event_counts[i] != 1)   // pulses must be 1s; anything else is a photon file
+            {
+                printf("\nERROR: invalid content in input file\n\n");
+                exit(1);
+            }
+        run->occupied_slots += block->num_events;
+
+        // the empty slots are never expanded, only counted
+        uint64_t end_slot = (block->num_events > 0) ? block->event_slots[block->num_events - 1] + 1 : run->event_end_slot;
+        if (block->num_events < run->block_size_in_events)
+        {
+            printf("Reached end of input file\n");
+            eof_flag = 1;
+            end_slot = run->in_events.header.total_slots;
+        }
+        block->num_slots = end_slot - run->event_end_slot;
+        run->event_end_slot = end_slot;
+        printf("pulses this loop = %llu\n", (unsigned long long)block->num_events);
+    }
+    else if (run->varint)   // varint RLE case - expand a buffer's worth, however many pairs that takes
+    {
+        run_report_end(&run->report, stage);
+        stage = run_report_begin(&run->report, "decode");
+        uint32_t bad = 0;
+        uint64_t num_read;
+        do    // a tile at a time, packed into the block's bytes
+        {
+            uint64_t tile = run->block_size_in_slots - block->num_slots;
+            if (tile > SLOT_COUNTS_TILE_SIZE)
+                tile = SLOT_COUNTS_TILE_SIZE;
+            num_read = varint_rle_expand(&run->in_varint, run->read_tile, tile);
+            for (uint64_t i = 0; i < num_read; i++)
+                run->occupied_slots += run->read_tile[i];
+            bad |= slot_counts_pack(&block->counts, block->num_slots, run->read_tile, (size_t)num_read);
+            block->num_slots += num_read;
+            if (num_read < tile)
+                break;
+        }
+        while (block->num_slots < run->block_size_in_slots);
+        if (run->in_varint.malformed)
+        {
+            printf("\nERROR: invalid content in input file\n\n");
+            exit(1);
+        }
+        if (bad > 1)   // only expect 0 or 1 (pulses = 1)
+        {
+            printf("\nERROR: invalid content in input file\n\n");
+            exit(1);
+        }
+        if (block->num_slots < run->block_size_in_slots)
+        {
+            printf("Reached end of input file\n");
+            eof_flag = 1;
+        }
+        printf("slots this loop = %llu\n", (unsigned long long)block->num_slots);
+    }
+    else    // binary or ASCII, compressed or uncompressed - through the input file's codec
+    {
+        size_t num_read;
+        int status;
+        if (run->compressed)   // whole (run, flag) pairs until a buffer's worth, carrying on past any (2^16-1)s
+        {
+            status = run->in.codec->read_words(&run->in, block->words, (size_t)COMPRESSED_BUFFER_SIZE_IN_WORDS,
+                                               (size_t)COMPRESSED_BUFFER_SIZE_IN_WORDS*2, 1, &num_read, &run->occupied_slots);
+            block->num_words = num_read;
+        }
+        else   // a buffer's worth of slots, a tile at a time, packed into the block's bytes
+        {
+            status = SLOT_CODEC_OK;
+            while (status == SLOT_CODEC_OK && block->num_slots < run->block_size_in_slots)
+            {
+                uint64_t tile = run->block_size_in_slots - block->num_slots;
+                if (tile > SLOT_COUNTS_TILE_SIZE)
+                    tile = SLOT_COUNTS_TILE_SIZE;
+                status = run->in.codec->read_slots(&run->in, run->read_tile, (size_t)tile, 1, &num_read,
+                                                   &run->occupied_slots);
+                slot_counts_pack(&block->counts, block->num_slots, run->read_tile, num_read);
+                block->num_slots += num_read;
+            }
+        }
+        check_read(run, status);
+        if (status == SLOT_CODEC_END)
+        {
+            printf("Reached end of input file\n");
+            eof_flag = 1;
+        }
+        if (run->compressed)
+            printf("words this loop = %llu\n", (unsigned long long)block->num_words);
+    }
+    run_report_end(&run->report, stage);
+
+    // where the input is up to, for the progress line and the report
+    block->eof = eof_flag;
+    block->occupied_slots = run->occupied_slots;
+    if (run->container)
+        block->bytes_in = (run->block_number > 0) ? run->in_container.index[run->block_number - 1].byte_offset
+                                                    + run->in_container.index[run->block_number - 1].byte_length : 0;
+    else if (run->events)
+        block->bytes_in = run->in_events.map.position;
+    else if (run->varint)
+        block->bytes_in = run->in_map.position;
+    else
+        block->bytes_in = slot_codec_bytes_read(&run->in);
+}
+
+
+// draw the photon counts of a batch of pulses and add them to the histogram
+static void draw_photons(stls_run *run, int32_t *photon_counts, uint32_t num_pulses)
+{
+    int hist_index;                   // index into histogram table
+    poisson_batch(&run->photon_table, &run->rng, photon_counts, num_pulses);
+    for (uint32_t j = 0; j < num_pulses; j++)
+    {
+        hist_index = photon_counts[j];
+        if (hist_index > RUN_REPORT_HISTOGRAM_BINS - 1) hist_index = RUN_REPORT_HISTOGRAM_BINS - 1;
+        run->histogram[hist_index]++;
+        if (hist_index == 0) run->erasures++;     // here was an occupied slot but zero photons were detected
+    }
+}
+
+
+// compute stage: replace each pulse with a Poisson-distributed photon count
+static void photons_block(stls_run *run, stls_block *block)
+{
+    uint64_t pulse_index[POISSON_BATCH_SIZE];   // buffer positions of the pulses waiting for photon counts
+    int32_t photon_counts[POISSON_BATCH_SIZE];  // photon counts drawn for those pulses
+    uint32_t num_pulses;              // number of pulses gathered so far
+    uint32_t * slots = run->decode_buffer;
+    int stage;
+
+    // uncompress the buffer (timed on its own, apart from reading), first making room for it
+    if (run->compressed)
+    {
+        stage = run_report_begin(&run->report, "decode");
+        uint64_t needed = run_length_decoded_slots(block->words, (uint32_t)block->num_words);
+        if (needed > run->decode_capacity)
+        {
+            if (needed > DECODE_BUFFER_LIMIT_IN_SLOTS ||
+                (run->max_memory != 0 && needed*sizeof(uint32_t) > run->max_memory))
+            {
+                printf("\nERROR: a run of zeros in the input is too long for the %s\n\n",
+                       (run->max_memory != 0) ? "memory budget" : "input buffer");
+                exit(1);
+            }
+            free(run->decode_buffer);
+            run->decode_buffer = malloc((size_t)needed*sizeof(uint32_t));
+            if (run->decode_buffer == NULL)
+            {
+                printf("\nERROR: out of memory\n\n");
+                exit(1);
+            }
+            run->decode_capacity = needed;
+            slots = run->decode_buffer;
+        }
+        block->num_slots = run_length_decode(block->words, slots, (uint32_t)block->num_words);
+        run_report_end(&run->report, stage);
+        printf("slots this loop = %llu\n", (unsigned long long)block->num_slots);
+    }
+
+    // process the pulse data of one uncompressed buffer's worth of input
+    // - gather the occupied slots, then draw their photon counts a batch at a time
+    stage = run_report_begin(&run->report, "photons");
+    if (run->events)    // the pulses are already a list, so draw their photon counts in place
+        for (uint64_t i = 0; i < block->num_events; i += POISSON_BATCH_SIZE)
+        {
+            uint32_t batch = (block->num_events - i < POISSON_BATCH_SIZE) ? (uint32_t)(block->num_events - i)
+                                                                           : POISSON_BATCH_SIZE;
+            draw_photons(run, photon_counts, batch);
+            for (uint32_t j = 0; j < batch; j++)
+                block->event_counts[i + j] = photon_counts[j];
+        }
+    else if (run->compressed)
+    {
+        num_pulses = 0;
+        for (uint64_t i = 0; i<block->num_slots; i++)
+        {
+            if (slots[i] == 1)
+                pulse_index[num_pulses++] = i;
+            if ((num_pulses == POISSON_BATCH_SIZE) || ((i == block->num_slots - 1) && (num_pulses > 0)))
+            {
+                draw_photons(run, photon_counts, num_pulses);
+                for (uint32_t j = 0; j < num_pulses; j++)
+                    slots[pulse_index[j]] = photon_counts[j];
+                num_pulses = 0;
+            }
+        }
+    }
+    else    // a byte per slot, where the empty ones are skipped eight at a time
+    {
+        slot_counts *counts = &block->counts;
+        uint64_t i = 0;
+        do
+        {
+            num_pulses = 0;
+            for (i = slot_counts_next_occupied(counts, i, block->num_slots);
+                 i < block->num_slots && num_pulses < POISSON_BATCH_SIZE;
+                 i = slot_counts_next_occupied(counts, i + 1, block->num_slots))
+                pulse_index[num_pulses++] = i;
+            draw_photons(run, photon_counts, num_pulses);
+            for (uint32_t j = 0; j < num_pulses; j++)   // in slot order, as the side table needs
+                slot_counts_set(counts, pulse_index[j], (uint32_t)photon_counts[j]);
+        }
+        while (i < block->num_slots);
+        if (counts->failed)
+        {
+            printf("\nERROR: out of memory\n\n");
+            exit(1);
+        }
+    }
+    run_report_end(&run->report, stage);
+    block->rng_draws = run->rng.draws;
+
+    // compress the photon counts back into the block for the write stage
+    if (run->compressed)
+    {
+        stage = run_report_begin(&run->report, "encode");
+        block->num_words = run_length_encode(slots, block->words, (uint32_t)block->num_slots);
+        run_report_end(&run->report, stage);
+    }
+}
+
+
+// a block's counts as (zero run, count) pairs, ending in a (zero run, 0) pair if the block ends in
+// empty slots; returns the number of pairs, with the occupied slots in num_occupied
+static size_t container_pairs(stls_run *run, const slot_counts *counts, uint64_t num_slots, uint64_t *num_occupied)
+{
+    size_t num_pairs = 0;
+    uint64_t slot = 0;
+    *num_occupied = 0;
+    while (slot < num_slots)
+    {
+        if (num_pairs == run->out_pairs_capacity)
+        {
+            size_t capacity = run->out_pairs_capacity ? 2 * run->out_pairs_capacity : 4096;
+            uint32_t *pairs = realloc(run->out_pairs, capacity * 2 * sizeof(uint32_t));
+            if (pairs == NULL)
+            {
+                printf("\nERROR: out of memory\n\n");
+                exit(1);
+            }
+            run->out_pairs = pairs;
+            run->out_pairs_capacity = capacity;
+        }
+        uint64_t next = slot_counts_next_occupied(counts, slot, num_slots);
+        run->out_pairs[2 * num_pairs] = (uint32_t)(next - slot);
+        run->out_pairs[2 * num_pairs + 1] = (next < num_slots) ? slot_counts_get(counts, next) : 0;
+        num_pairs++;
+        *num_occupied += (next < num_slots);
+        slot = next + 1;
+    }
+    return num_pairs;
+}
+
+
+// write stage: write out photon count data, in the same format as the input data
+static void write_block(stls_run *run, stls_block *block)
+{
+    int stage;
+    if (run->container)  // container case - the loop's block becomes one output block
+    {
+        stage = run_report_begin(&run->report, "write");
+        printf("writing a block of %llu slots to output file\n", (unsigned long long)block->num_slots);
+        uint64_t num_occupied;
+        size_t num_pairs = container_pairs(run, &block->counts, block->num_slots, &num_occupied);
+        if ((block->num_slots > 0) &&
+            (slot_container_write_pairs(&run->out_container, run->out_pairs, num_pairs, block->num_slots,
+                                        num_occupied) != 0))
+        {
+            printf("\nERROR: could not write to output file\n\n");
+            exit(1);
+        }
+        run->total_writes += block->num_slots;
+    }
+    else if (run->events)  // event stream case - pulses that caught no photons drop out
+    {
+        stage = run_report_begin(&run->report, "write");
+        for (uint64_t i = 0; i < block->num_events; i++)
+            if (event_stream_write(&run->out_events, block->event_slots[i], block->event_counts[i]) != 0)
+            {
+                printf("\nERROR: could not write to output file\n\n");
+                exit(1);
+            }
+    }
+    else if (run->varint)  // varint RLE case - a zero run at the end of the loop carries into the next
+    {
+        stage = run_report_begin(&run->report, "encode");
+        uint64_t slot = 0;
+        for (uint64_t next = slot_counts_next_occupied(&block->counts, 0, block->num_slots); next < block->num_slots;
+             next = slot_counts_next_occupied(&block->counts, slot, block->num_slots))
+        {
+            varint_rle_add_zeros(&run->out_varint, next - slot);
+            varint_rle_add_value(&run->out_varint, slot_counts_get(&block->counts, next));
+            slot = next + 1;
+        }
+        varint_rle_add_zeros(&run->out_varint, block->num_slots - slot);
+        if (block->eof && varint_rle_finish(&run->out_varint) != 0)
+        {
+            printf("\nERROR: could not write to output file\n\n");
+            exit(1);
+        }
+    }
+    else if (run->compressed)  // compressed case - already encoded by the compute stage
+    {
+        stage = run_report_begin(&run->report, "write");
+        printf("writing %u compressed words to output file\n", (uint32_t)block->num_words);
+        check_write(run->out.codec->write_words(&run->out, block->words, (size_t)block->num_words));
+    }
+    else  // uncompressed case
+    {
+        stage = run_report_begin(&run->report, "write");
+        printf("writing %llu slots to output file\n", (unsigned long long)block->num_slots);
+        for (uint64_t slot = 0; slot < block->num_slots; slot += SLOT_COUNTS_TILE_SIZE)
+        {
+            size_t tile = (block->num_slots - slot < SLOT_COUNTS_TILE_SIZE) ? (size_t)(block->num_slots - slot)
+                                                                           : SLOT_COUNTS_TILE_SIZE;
+            slot_counts_unpack(&block->counts, slot, run->write_tile, tile);
+            check_write(run->out.codec->write_slots(&run->out, run->write_tile, tile));
+        }
+        run->total_writes += block->num_slots;
+    }
+    run_report_end(&run->report, stage);
+
+    // tally up total slots, and the running totals for the progress line and the report
+    run->total_slots += block->num_slots;
+    run->report.slots = run->total_slots;
+    run->report.pulses = block->occupied_slots;
+    run->report.rng_draws = block->rng_draws;
+    run->report.bytes_in = block->bytes_in;
+    if (run->container)
+        run->report.bytes_out = (uint64_t)ftell(run->out_container.fp);
+    else if (run->events)
+        run->report.bytes_out = (uint64_t)ftell(run->out_events.fp) + run->out_events.length;
+    else if (run->varint)
+        run->report.bytes_out = (uint64_t)ftell(run->out_fp) + run->out_varint.length;
+    else
+        run->report.bytes_out = slot_codec_bytes_written(&run->out);
+    run_report_progress(&run->report);
+}
+
+
+// the rings that cycle the blocks of a pipelined run: free -> read -> computed -> free
+typedef struct
+{
+    stls_run *run;
+    spsc_ring free_blocks;            // read stage takes empty blocks from here
+    spsc_ring read_blocks;            // filled with pulses, waiting for the compute stage
+    spsc_ring computed_blocks;        // holding photon counts, waiting for the write stage
+} stls_pipeline;
+
+
+static void *reader_thread(void *arg)
+{
+    stls_pipeline *pipeline = arg;
+    int eof;
+    do
+    {
+        stls_block *block = spsc_ring_pop(&pipeline->free_blocks);
+        read_block(pipeline->run, block);
+        eof = block->eof;   // the block belongs to the next stage once pushed
+        spsc_ring_push(&pipeline->read_blocks, block);
+    }
+    while (!eof);
+    return NULL;
+}
+
+
+static void *writer_thread(void *arg)
+{
+    stls_pipeline *pipeline = arg;
+    int eof;
+    do
+    {
+        stls_block *block = spsc_ring_pop(&pipeline->computed_blocks);
+        write_block(pipeline->run, block);
+        eof = block->eof;
+        spsc_ring_push(&pipeline->free_blocks, block);
+    }
+    while (!eof);
+    return NULL;
+}
+
+
+// read, compute and write on three threads, with num_blocks blocks circulating between them
+static void run_pipelined(stls_run *run, int num_blocks)
+{
+    stls_pipeline pipeline;
+    pthread_t reader, writer;
+    stls_block *blocks = malloc((size_t)num_blocks*sizeof(stls_block));
+
+    pipeline.run = run;
+    if (blocks == NULL ||
+        spsc_ring_init(&pipeline.free_blocks, (uint32_t)num_blocks) != 0 ||
+        spsc_ring_init(&pipeline.read_blocks, (uint32_t)num_blocks) != 0 ||
+        spsc_ring_init(&pipeline.computed_blocks, (uint32_t)num_blocks) != 0)
+    {
+        printf("\nERROR: out of memory\n\n");
+        exit(1);
+    }
+    for (int i = 0; i < num_blocks; i++)
+    {
+        allocate_block(run, &blocks[i]);
+        spsc_ring_push(&pipeline.free_blocks, &blocks[i]);
+    }
+
+    if (pthread_create(&reader, NULL, reader_thread, &pipeline) != 0 ||
+        pthread_create(&writer, NULL, writer_thread, &pipeline) != 0)
+    {
+        printf("\nERROR: could not start the pipeline threads\n\n");
+        exit(1);
+    }
+
+    // the compute stage runs on this thread
+    int eof;
+    do
+    {
+        stls_block *block = spsc_ring_pop(&pipeline.read_blocks);
+        photons_block(run, block);
+        eof = block->eof;
+        spsc_ring_push(&pipeline.computed_blocks, block);
+    }
+    while (!eof);
+
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+
+    for (int i = 0; i < num_blocks; i++)
+        free_block(&blocks[i]);
+    free(blocks);
+    spsc_ring_free(&pipeline.free_blocks);
+    spsc_ring_free(&pipeline.read_blocks);
+    spsc_ring_free(&pipeline.computed_blocks);
+}
+
+
+// a size in bytes, with an optional K, M or G (powers of 1024); returns 0 on success
+static int parse_size(const char *text, uint64_t *bytes)
+{
+    char *end;
+    double value = strtod(text, &end);
+    double scale = 1.0;
+    if (*end == 'k' || *end == 'K')
+        scale = 1024.0;
+    else if (*end == 'm' || *end == 'M')
+        scale = 1024.0*1024.0;
+    else if (*end == 'g' || *end == 'G')
+        scale = 1024.0*1024.0*1024.0;
+    if (scale != 1.0)
+        end++;
+    if (end == text || *end != '\0' || !(value > 0.0))
+        return -1;
+    *bytes = (uint64_t)(value*scale);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    static stls_run run_state;        // large, and shared with the pipeline threads
+    stls_run *run = &run_state;
     char * infilename;                // the filename for the input file
     char * outfilename;               // the filename for the output file
-    uint32_t *histogram;              // pointer to table accumulating photon count stats
-    int hist_index;                   // index into histogram table
-    int erasures = 0;                 // count of erasures across the whole input data set
     double mean_detected_photons;     // the desired mean number of detected photons per incident pulse
+    uint64_t seed;                    // seed for the photon count generator
+    int pipelined = 0;                // when set, read, compute and write overlap on separate threads
+    int num_blocks = DEFAULT_PIPELINE_BLOCKS;   // blocks in flight when pipelined
+    char * report_filename = NULL;    // where the run report goes (none by default)
+    run_report_init(&run->report, "stls_pulse_to_photons_poisson");
+    seed = (uint64_t)time(NULL);
     mean_detected_photons = (double)DEFAULT_MEAN_DETECTED_PHOTONS;
 
     // parse command line options
+    static const struct option long_options[] =
+    {
+        { "max-memory", required_argument, NULL, 'm' },
+        { NULL, 0, NULL, 0 }
+    };
     int arg = 0;
-    while ((arg = getopt(argc, argv, "achk:")) != -1)
+    while ((arg = getopt_long(argc, argv, "ab:chk:m:p:r:s:tuv", long_options, NULL)) != -1)
     {
         switch (arg)
         {
             case 'a':
-                ascii = 1;
+                run->ascii = 1;
+                break;
+
+            case 'b':
+                num_blocks = atoi(optarg);
                 break;
 
             case 'c':
-                compressed = 1;
+                run->compressed = 1;
                 break;
 
             case 'h':
@@ -116,9 +865,42 @@ int main(int argc, char **argv)
                 mean_detected_photons = atof(optarg);
                 break;
 
+            case 'm':
+                if (parse_size(optarg, &run->max_memory) != 0)
+                {
+                    printf("\nERROR: could not parse memory budget %s\n", optarg);
+                    usage();
+                    exit(1);
+                }
+                break;
+
+            case 'p':
+                run->report.progress_interval = atof(optarg);
+                break;
+
+            case 'r':
+                report_filename = optarg;
+                break;
+
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+
+            case 't':
+                pipelined = 1;
+                break;
+
+            case 'u':
+                run->use_uring = 1;
+                break;
+
+            case 'v':
+                run->varint = 1;
+                break;
+
             default:
                 usage();
-                exit(0);
+                exit(1);
         }
     }
 
@@ -127,324 +909,385 @@ int main(int argc, char **argv)
     {
         printf("\nERROR: 2 arguments are required: the input and output filenames\n");
         usage();
-        exit(0);
+        exit(1);
+    }
+
+    if (run->ascii && run->varint)
+    {
+        printf("\nERROR: varint RLE (-v) files are binary, so -a cannot be used with it\n");
+        usage();
+        exit(1);
+    }
+
+    if (num_blocks < 2)
+    {
+        printf("\nERROR: a pipelined run needs at least 2 blocks in flight\n");
+        usage();
+        exit(1);
     }
 
     infilename = malloc(100);   // allow filename up to 100 chars
     if (sscanf(argv[optind], "%s", infilename) != 1)
     {
         fprintf(stderr, "\nERROR: could not parse filename from %s\n", argv[optind]);
-        exit(0);
+        exit(1);
     }
 
     outfilename = malloc(100);   // allow filename up to 100 chars
     if (sscanf(argv[optind+1], "%s", outfilename) != 1)
     {
         fprintf(stderr, "\nERROR: could not parse filename from %s\n", argv[optind+1]);
-        exit(0);
+        exit(1);
     }
 
-    if (ascii)
-        in_fp = fopen(infilename, "r");
-    else
-        in_fp = fopen(infilename, "rb");
-
-    if (in_fp == NULL)
+    // binary input is mapped first, to recognise a container or an event stream by its header
+    if (!run->ascii && mapped_file_open(&run->in_map, infilename) != 0)
     {
         printf("\nError opening input file %s\n", infilename);
-        exit(0);
+        exit(1);
     }
 
-    if (ascii)
-        out_fp = fopen(outfilename, "w");
-    else
-        out_fp = fopen(outfilename, "wb");
+    // a container carries its own block structure, so -c doesn't apply to it
+    if (!run->ascii && slot_container_is_container(run->in_map.data, run->in_map.size))
+    {
+        mapped_file_close(&run->in_map);
+        if (slot_container_open(&run->in_container, infilename) != 0)
+        {
+            printf("\nError: input file %s is not a valid container\n", infilename);
+            exit(1);
+        }
+        run->container = 1;
+        run->compressed = 0;
+        run->varint = 0;
+    }
+    else if (!run->ascii && event_stream_is_events(run->in_map.data, run->in_map.size))
+    {
+        mapped_file_close(&run->in_map);
+        if (event_stream_open(&run->in_events, infilename) != 0)
+        {
+            printf("\nError: input file %s is not a valid event stream\n", infilename);
+            exit(1);
+        }
+        run->events = 1;
+        run->compressed = 0;
+        run->varint = 0;
+    }
+    else if (run->varint)
+    {
+        varint_rle_reader_init(&run->in_varint, run->in_map.data, run->in_map.size);
+        run->compressed = 0;
+    }
+    else   // a plain stls file: its codec is chosen here, once, from the -a and -c flags
+    {
+        if (!run->ascii)
+            mapped_file_close(&run->in_map);
+        if (slot_codec_open_reader(&run->in, slot_codec_select(run->ascii, run->compressed, 1), infilename) != 0)
+        {
+            printf("\nError opening input file %s\n", infilename);
+            exit(1);
+        }
+    }
+
+    // a loop holds a whole container block, or a buffer's worth of slots (a byte each) or pulses; with
+    // a memory budget, the blocks in flight share it. Checked before the output file is created, so
+    // a budget that can't work leaves nothing behind.
+    int blocks_in_flight = pipelined ? num_blocks : 1;
+    uint64_t block_memory = run->max_memory / (uint64_t)blocks_in_flight;
+    if (run->max_memory != 0 && !run->compressed && block_memory < MIN_BLOCK_MEMORY_IN_BYTES)
+    {
+        printf("\nERROR: a memory budget of %llu bytes is too small; each block in flight needs at least %d\n\n",
+               (unsigned long long)run->max_memory, MIN_BLOCK_MEMORY_IN_BYTES);
+        exit(1);
+    }
+    if (run->container)
+    {
+        run->block_size_in_slots = 1;
+        for (uint64_t b = 0; b < run->in_container.header.block_count; b++)
+            if (run->in_container.index[b].slot_count > run->block_size_in_slots)
+                run->block_size_in_slots = run->in_container.index[b].slot_count;
+        if (run->block_size_in_slots > (uint64_t)UNCOMPRESSED_BUFFER_SIZE_IN_SLOTS)
+            run->block_size_in_slots = (uint64_t)UNCOMPRESSED_BUFFER_SIZE_IN_SLOTS;
+        if (run->max_memory != 0 && run->block_size_in_slots > block_memory)
+        {
+            printf("\nERROR: the container's blocks of up to %llu slots don't fit the memory budget\n\n",
+                   (unsigned long long)run->block_size_in_slots);
+            exit(1);
+        }
+    }
+    else if (run->events)
+    {
+        run->block_size_in_events = (uint64_t)EVENT_BUFFER_SIZE_IN_EVENTS;
+        if (run->max_memory != 0 && block_memory / (sizeof(uint64_t) + sizeof(uint32_t)) < run->block_size_in_events)
+            run->block_size_in_events = block_memory / (sizeof(uint64_t) + sizeof(uint32_t));
+    }
+    else if (!run->compressed)
+    {
+        run->block_size_in_slots = pipelined ? (uint64_t)PIPELINE_BLOCK_SIZE_IN_SLOTS
+                                             : (uint64_t)UNCOMPRESSED_BUFFER_SIZE_IN_SLOTS;
+        if (run->max_memory != 0 && block_memory < run->block_size_in_slots)
+            run->block_size_in_slots = block_memory;
 
-    if (out_fp == NULL)
+        // no bigger than the input needs: a plain file has at least a byte per slot, and one slot
+        // to spare lets the first loop see the end of the file
+        struct stat in_info;
+        if (!run->varint && stat(infilename, &in_info) == 0 &&
+            (uint64_t)in_info.st_size + 1 < run->block_size_in_slots)
+            run->block_size_in_slots = (uint64_t)in_info.st_size + 1;
+    }
+
+    if (run->container)
+    {
+        // keep the input's PPM order and block layout, and record how the photon counts were made
+        slot_container_header info = run->in_container.header;
+        info.mean_photons = mean_detected_photons;
+        info.seed = seed;
+        memset(info.provenance, 0, sizeof(info.provenance));
+        snprintf(info.provenance, sizeof(info.provenance), "stls_pulse_to_photons_poisson %s", infilename);
+        if (slot_container_create(&run->out_container, outfilename, &info) != 0)
+        {
+            printf("\nError opening output file %s\n", outfilename);
+            exit(1);
+        }
+    }
+    else if (run->events)
+    {
+        if (event_stream_create(&run->out_events, outfilename, mean_detected_photons, seed) != 0)
+        {
+            printf("\nError opening output file %s\n", outfilename);
+            exit(1);
+        }
+    }
+    else if (run->varint)
+    {
+        run->out_fp = fopen(outfilename, "wb");
+        if (run->out_fp == NULL)
+        {
+            printf("\nError opening output file %s\n", outfilename);
+            exit(1);
+        }
+        if (varint_rle_writer_init(&run->out_varint, run->out_fp) != 0)
+        {
+            printf("\nERROR: out of memory\n\n");
+            exit(1);
+        }
+    }
+    else if (slot_codec_create_writer(&run->out, slot_codec_select(run->ascii, run->compressed, 0), outfilename) != 0)
     {
         printf("\nError opening output file %s\n", outfilename);
-        exit(0);
+        exit(1);
+    }
+
+    // io_uring only takes over the raw binary files; the other writers keep their own buffering
+    int uring_requested = run->use_uring;
+    run->use_uring = uring_requested && run->out.codec != NULL && !run->out.codec->text;
+    if (run->use_uring)
+    {
+        if (uring_writer_init(&run->out_uring, fileno(run->out.fp)) != 0)
+        {
+            printf("\nERROR: out of memory\n\n");
+            exit(1);
+        }
+        run->out.sink = uring_sink;
+        run->out.sink_context = &run->out_uring;
     }
 
     // display all selections
     printf("\nProcessing pulse data from input file %s\n", infilename);
     printf("Writing photon count data to output file %s\n", outfilename);
-    if (ascii)
+    if (run->ascii)
         printf("Input file is assumed to be ASCII text, and output file will be the same\n");
     else
         printf("Input file is assumed to be binary, and output file will be the same\n");
-    if (compressed)
+    if (run->container)
+        printf("Input file is a container of %llu blocks, and output file will be the same\n\n",
+               (unsigned long long)run->in_container.header.block_count);
+    else if (run->events)
+        printf("Input file is an event stream of %llu pulses in %llu slots, and output file will be the same\n\n",
+               (unsigned long long)run->in_events.header.total_events, (unsigned long long)run->in_events.header.total_slots);
+    else if (run->varint)
+        printf("Input file is assumed to be varint RLE, and output file will be the same\n\n");
+    else if (run->compressed)
         printf("Input file is assumed to be compressed, and output file will be the same\n\n");
     else
         printf("Input file is assumed to be uncompressed, and output file will be the same\n");
-    printf("The specified mean number of detected photons per incident pulse = %f\n\n", mean_detected_photons);
+    printf("The specified mean number of detected photons per incident pulse = %f\n", mean_detected_photons);
+    printf("Random seed = %llu\n", (unsigned long long)seed);
+    if (pipelined)
+        printf("Pipelined: reading, photon counts and writing overlap, with %d blocks in flight\n", num_blocks);
+    if (run->max_memory != 0)
+        printf("Memory budget for the slot buffers = %llu bytes\n", (unsigned long long)run->max_memory);
+    if (run->use_uring)
+        printf("Output is written through %s\n", run->out_uring.active ? "io_uring" : "write() (io_uring is not available)");
+    else if (uring_requested)
+        printf("io_uring (-u) is only used for .bin and .rle.bin output, so it is ignored here\n");
+    printf("\n");
 
     // some memory alocations
-    compressed_buffer = malloc((int)COMPRESSED_BUFFER_SIZE_IN_WORDS*2*sizeof(uint16_t));  // double it to allow for extra (2^16-1) values
-    uncompressed_buffer = malloc((int)UNCOMPRESSED_BUFFER_SIZE_IN_SLOTS*sizeof(uint32_t));
-    histogram = calloc(21,sizeof(uint32_t));      // allow from 0 to 20 photons in a slot (should rarely exceed 3)
+    // - the decode buffer (compressed case) grows with the loops, so there is nothing to allocate for it yet
+    if (!run->compressed && !run->events && !run->container)
+        run->read_tile = malloc(SLOT_COUNTS_TILE_SIZE*sizeof(uint32_t));
+    if (!run->compressed && !run->events && !run->container && !run->varint)
+        run->write_tile = malloc(SLOT_COUNTS_TILE_SIZE*sizeof(uint32_t));
+    run->histogram = calloc(RUN_REPORT_HISTOGRAM_BINS,sizeof(uint64_t));   // the screen shows 0 to 20 photons (should rarely exceed 3)
+    if (run->histogram == NULL ||
+        (!run->compressed && !run->events && !run->container && run->read_tile == NULL) ||
+        (!run->compressed && !run->events && !run->container && !run->varint && run->write_tile == NULL))
+    {
+        printf("\nERROR: out of memory\n\n");
+        exit(1);
+    }
 
-    // set input parameter to poisson() function - which expects L = exp(-lambda) (= the erasure rate)
+    // L = exp(-lambda) is the probability of detecting no photons from a pulse (= the expected erasure rate)
     double L = exp(-mean_detected_photons);
 
-
-    // begin processing
-
-    // if input is compressed, uncompress into buffer, otherwise store directly into uncompressed buffer
-
-    // outer loop until EOF
-
-    do   // process successive input buffer's worth of data until whole file done
+    // the batch sampler precomputes everything that depends on the mean photon count
+    if (poisson_table_init(&run->photon_table, mean_detected_photons) != 0)
     {
-        loop_count++;
-        printf("Loop %d\n", loop_count);
-
-        slots_this_loop = 0;  // reset slot and word counts
-        words_this_loop = 0;
-
-        // fill the input buffer and process that data
-        if (compressed)   // compressed case
-        {
-            compressed_pointer = compressed_buffer;  // reset pointer to start of buffer
-
-            // read until EOF or filled a buffer's worth, but past any (2^16-1)s
-            do
-            {
-                uint16_t this_zero_run_length;
-                uint16_t this_pulse_flag;
-                // read in a run length (or set of values making up a long run length)
-                do
-                {
-                    this_zero_run_length = 0;
-                    if (ascii)
-                        num_read = fscanf(in_fp,"%hu", &this_zero_run_length);
-                    else
-                        num_read = fread((void *)(&this_zero_run_length), 2, 1, in_fp);   // read in a single word
-                    if (num_read != 1)    // if can't read a number, assume we've hit EOF
-                    {
-                        printf("Reached end of input file\n");
-                        eof_flag = 1;
-                    }
-                    if ((num_read == 1) && (this_zero_run_length > 65535))
-                    {
-                        printf("\nERROR: invalid content in input file\n\n");
-                        exit(0);
-                    }
-                    if (num_read == 1)    // valid case
-                    {
-                        *compressed_pointer++ = this_zero_run_length;
-                        words_this_loop++;
-                    }
-                }
-                while((this_zero_run_length == 65535) && (eof_flag == 0));
-
-                // read in a pulse flag (so long as we haven't hit EOF)
-                if (eof_flag == 0)
-                {
-                    this_pulse_flag = 0;
-                    if (ascii)
-                        num_read = fscanf(in_fp,"%hu", &this_pulse_flag);
-                    else
-                        num_read = fread((void *)(&this_pulse_flag), 2, 1, in_fp);   // read in a single word
-                    if (num_read != 1)    // if can't read a number, assume we've hit EOF
-                    {
-                        printf("\nERROR: this shouldn't happen - odd word count in input?\n\n");
-                        exit(0);
-                    }
-                    if ((num_read == 1) && (this_pulse_flag != 0) && (this_pulse_flag != 1))   // only expect 0 or 1 (pulses = 1)
-                    {
-                        printf("\nERROR: invalid content in input file: %hu\n\n", this_pulse_flag);
-                        exit(0);
-                    }
-                    if ((num_read == 1) && (this_pulse_flag == 0))    // valid case - end of a compressed block ending with zeros
-                    {
-                        *compressed_pointer++ = this_pulse_flag;
-                        words_this_loop++;
-                    }
-                    if ((num_read == 1) && (this_pulse_flag == 1))    // valid case - a pulse - write it to the slot
-                    {
-                        *compressed_pointer++ = this_pulse_flag;
-                        occupied_slots++;   // always a 1 here indicates an occupied slot
-                        words_this_loop++;
-                    }
-                }
-            }
-            while ((words_this_loop < (uint32_t)COMPRESSED_BUFFER_SIZE_IN_WORDS) && (eof_flag == 0));
-
-            printf("words this loop = %u\n", words_this_loop);
-
-            // uncompress the buffer
-            slots_this_loop = run_length_decode(compressed_buffer, uncompressed_buffer, words_this_loop);
+        printf("\nERROR: invalid mean number of detected photons %f\n\n", mean_detected_photons);
+        exit(1);
+    }
+    poisson_rng_seed(&run->rng, seed);
 
-            printf("slots this loop = %u\n", slots_this_loop);
-        }
-        else    // uncompressed case
-        {
-            uncompressed_pointer = uncompressed_buffer;  // reset write pointer to start of buffer
-            // read until EOF or filled a buffer's worth
-            if (ascii)   // ASCII case
-            {
-                do
-                {
-                    character = getc(in_fp);
-                    if (character == EOF)
-                    {
-                        printf("\nReached end of input file\n\n");
-                        eof_flag = 1;
-                    }
-                    else
-                    {
-                        slots_this_loop++;
-                        if (character == '0') *uncompressed_pointer++ = 0;
-                        else if (character == '1')
-                        {
-                            *uncompressed_pointer++ = 1;
-                            occupied_slots++;
-                        }
-                        else
-                        {
-                            printf("\nERROR: invalid content in input file\n\n");
-                            exit(0);
-                        }
-                    }
-                }
-                while((slots_this_loop < (uint32_t)UNCOMPRESSED_BUFFER_SIZE_IN_SLOTS) && (eof_flag == 0));
-            }
-            else   // binary case
-            {
-              do
-              {
-                  num_read = fread((void *)(&byte), 1, 1, in_fp);   // read in a single byte
-                  if (num_read != 1)    // if can't read one byte, assume we've hit EOF
-                  {
-                      //printf("\nReached end of input file\n\n");
-                      eof_flag = 1;
-                  }
-                  else
-                  {
-                      slots_this_loop++;
-                      if (byte == 0) *uncompressed_pointer++ = 0;
-                      else if (byte == 1)
-                      {
-                          *uncompressed_pointer++ = 1;
-                          occupied_slots++;
-                      }
-                      else
-                      {
-                          printf("\nERROR: invalid content in input file\n\n");
-                          exit(0);
-                      }
-                  }
-              }
-              while((slots_this_loop < (uint32_t)UNCOMPRESSED_BUFFER_SIZE_IN_SLOTS) && (eof_flag == 0));
-            }
-        }
+    // the stages each format uses, in order, added up front so that pipeline threads can time
+    // their own stages without adding to the list at the same time; they overlap, so each one
+    // counts the CPU time of the thread running it
+    run->report.thread_cpu = 1;
+    run_report_add_stage(&run->report, "read");
+    if (run->compressed || run->varint)
+        run_report_add_stage(&run->report, "decode");
+    run_report_add_stage(&run->report, "photons");
+    if (run->compressed || run->varint)
+        run_report_add_stage(&run->report, "encode");
+    if (!run->varint)
+        run_report_add_stage(&run->report, "write");
 
-        // tally up total slots
-        total_slots += slots_this_loop;
 
-        // process the pulse data of one uncompressed buffer's worth of input
-        for (int i = 0; i<slots_this_loop; i++)
-        {
-            if (uncompressed_buffer[i] == 1)
-            {
-                uncompressed_buffer[i] = poisson(L);
-                hist_index = uncompressed_buffer[i];
-                if (hist_index > 20) hist_index = 20;   // cap at 20
-                histogram[hist_index]++;
-                if (hist_index == 0) erasures++;     // here was an occupied slot but zero photons were detected
-            }
-        }
-
-#if 1
-        // write out photon count data, in the same format as the input data
-        if (compressed)  // compressed case
-        {
-            uint32_t num_compressed_words = run_length_encode(uncompressed_buffer, compressed_buffer, slots_this_loop);
+    // begin processing
 
-            printf("writing %u compressed words to output file\n", num_compressed_words);
+    // if input is compressed, uncompress into buffer, otherwise store directly into uncompressed buffer
 
-            if (ascii)  // ASCII text file case
-            {
-                compressed_pointer = compressed_buffer;
-                uint16_t compressed_value;
-                for (uint32_t word=0; word<num_compressed_words; word++)
-                {
-                    compressed_value = *compressed_pointer++;
-                    fprintf(out_fp, "%u ", compressed_value);
-                }
-            }
-            else   // binary file case
-                fwrite((const void *)compressed_buffer, sizeof(uint16_t), (size_t)num_compressed_words, out_fp);
-        }
-        else  // uncompressed case
+    if (pipelined)
+        run_pipelined(run, num_blocks);
+    else    // outer loop until EOF, a buffer's worth of data at a time
+    {
+        stls_block block;
+        allocate_block(run, &block);
+        do
         {
-            printf("writing %u slots to output file\n", slots_this_loop);
-            uncompressed_pointer = uncompressed_buffer;
-            if (ascii)  // ASCII text file case
-            {
-                uint32_t uncompressed_value;
-                for (uint32_t slot=0; slot<slots_this_loop; slot++)
-                {
-                    uncompressed_value = *uncompressed_pointer++;
-                    fprintf(out_fp, "%u ", uncompressed_value);
-                }
-            }
-            else   // binary file case
-            {
-                for (uint32_t slot=0; slot<slots_this_loop; slot++)
-                {
-                    uint8_t byte = (uint8_t)(*uncompressed_pointer++);
-                    fwrite((const void *)(&byte), 1, 1, out_fp);  // write a single byte
-                }
-            }
-            total_writes += slots_this_loop;
+            read_block(run, &block);
+            photons_block(run, &block);
+            write_block(run, &block);
         }
-#endif
-
+        while (block.eof == 0);
+        free_block(&block);
     }
-    while (eof_flag == 0);
 
 
     // if not compressed, check expected number of writes were performed
-    if (!compressed)
+    if (!run->compressed && !run->events && !run->varint)
     {
-        if (total_writes != total_slots)
-            printf("ERROR: Expected to fill %lu slots, but actually wrote %lu to file\n", total_slots, total_writes);
+        if (run->total_writes != run->total_slots)
+            printf("ERROR: Expected to fill %llu slots, but actually wrote %llu to file\n",
+                   (unsigned long long)run->total_slots, (unsigned long long)run->total_writes);
         else
-            printf("\nWrote a total of %lu slots to file\n", total_writes);
+            printf("\nWrote a total of %llu slots to file\n", (unsigned long long)run->total_writes);
     }
 
 
     // processing done
 
     // calculate stats and write to screen
-    double average_power = (double)occupied_slots/(double)total_slots;
+    double average_power = (double)run->occupied_slots/(double)run->total_slots;
     double peak_power = 1.0;    // the power of an occupied slot
     double peak_to_average_power = peak_power/average_power;
-    printf("\nTotal slots processed = %lu\n", total_slots);
-    printf("Those occupied with a pulse = %lu (fraction = %f)\n", occupied_slots, average_power);
+    printf("\nTotal slots processed = %llu\n", (unsigned long long)run->total_slots);
+    printf("Those occupied with a pulse = %llu (fraction = %f)\n", (unsigned long long)run->occupied_slots, average_power);
     printf("Peak-to-Average Power Ratio = %f\n", peak_to_average_power);
     printf("\nExpected erasure rate = %f\n", L);
-    printf("Measured erasure rate = %f\n", (double)erasures/(double)occupied_slots);
+    printf("Measured erasure rate = %f\n", (double)run->erasures/(double)run->occupied_slots);
     printf("Histogram of photon counts:\n");
     printf("  count     number\n");
     for (int j=0; j<=20; j++)
-        printf("   %d       %d\n", j, histogram[j]);
+    {
+        uint64_t number = run->histogram[j];
+        if (j == 20)    // 20 or more
+            for (int k = 21; k < RUN_REPORT_HISTOGRAM_BINS; k++)
+                number += run->histogram[k];
+        printf("   %d       %llu\n", j, (unsigned long long)number);
+    }
 
     // close the input and output files
-    fclose(in_fp);
-    fclose(out_fp);
+    int status = 0;
+    if (run->use_uring && uring_writer_finish(&run->out_uring) != 0)
+    {
+        printf("\nERROR: could not finish writing output file %s\n", outfilename);
+        status = 1;
+    }
+    if (run->container)
+    {
+        slot_container_close_reader(&run->in_container);
+        if (slot_container_close(&run->out_container) != 0)
+        {
+            printf("\nERROR: could not finish writing output file %s\n", outfilename);
+            status = 1;
+        }
+    }
+    else if (run->events)
+    {
+        event_stream_close_reader(&run->in_events);
+        if (event_stream_close(&run->out_events, run->in_events.header.total_slots) != 0)
+        {
+            printf("\nERROR: could not finish writing output file %s\n", outfilename);
+            status = 1;
+        }
+    }
+    else if (run->varint)
+    {
+        mapped_file_close(&run->in_map);
+        if (fclose(run->out_fp) != 0)
+        {
+            printf("\nERROR: could not finish writing output file %s\n", outfilename);
+            status = 1;
+        }
+    }
+    else
+    {
+        slot_codec_close_reader(&run->in);
+        if (slot_codec_close_writer(&run->out) != 0)
+        {
+            printf("\nERROR: could not finish writing output file %s\n", outfilename);
+            status = 1;
+        }
+    }
+
+    // the report has the whole histogram rather than the capped one on screen
+    if (report_filename != NULL)
+    {
+        struct stat out_info;
+        if (stat(outfilename, &out_info) == 0)   // now including the container index
+            run->report.bytes_out = (uint64_t)out_info.st_size;
+        run_report_add_histogram(&run->report, run->histogram, RUN_REPORT_HISTOGRAM_BINS);
+        run_report_count(&run->report, "erasures", run->erasures);
+        run_report_count(&run->report, "loops", (uint64_t)run->loop_count);
+        if (run_report_write(&run->report, report_filename) != 0)
+        {
+            printf("\nERROR: could not write run report %s\n", report_filename);
+            status = 1;
+        }
+    }
 
     // free allocated memory
     free(infilename);
     free(outfilename);
-    free(compressed_buffer);
-    free(uncompressed_buffer);
-    free(histogram);
+    free(run->decode_buffer);
+    free(run->read_tile);
+    free(run->write_tile);
+    free(run->out_pairs);
+    free(run->histogram);
 
     // all done
-    printf("\nDone!\n\n");
+    if (status == 0)
+        printf("\nDone!\n\n");
 
-    return(1);
+    return(status);
 }
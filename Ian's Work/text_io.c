@@ -0,0 +1,233 @@
+/* Buffered ASCII codec for the pulse/photon text files - see text_io.h */
+#include <stdlib.h>
+#include <string.h>
+
+#include "text_io.h"
+
+#define TEXT_IO_PADDING 16        // zeroed bytes after the data so 8-byte loads stay in bounds
+#define TEXT_IO_MAX_TOKEN 32      // refill when fewer bytes than this are left, so a number never straddles a refill
+
+
+void text_reader_init(text_reader *reader, FILE *fp)
+{
+    reader->fp = fp;
+    reader->buffer = calloc(TEXT_IO_BUFFER_SIZE + TEXT_IO_PADDING, 1);
+    reader->position = 0;
+    reader->length = 0;
+    reader->eof = 0;
+    reader->failed = 0;
+}
+
+
+void text_reader_free(text_reader *reader)
+{
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+
+// move the unread tail to the front and top the buffer up from the file
+static void text_reader_refill(text_reader *reader)
+{
+    size_t left = reader->length - reader->position;
+
+    if (reader->eof)
+        return;
+    memmove(reader->buffer, reader->buffer + reader->position, left);
+    size_t got = fread(reader->buffer + left, 1, TEXT_IO_BUFFER_SIZE - left, reader->fp);
+    if (got < TEXT_IO_BUFFER_SIZE - left)
+        reader->eof = 1;
+    reader->position = 0;
+    reader->length = left + got;
+    memset(reader->buffer + reader->length, 0, TEXT_IO_PADDING);
+}
+
+
+static inline int is_space(char c)
+{
+    return (c == ' ') || (c == '\n') || (c == '\r') || (c == '\t') || (c == '\v') || (c == '\f');
+}
+
+
+// Number of leading decimal digits in the 8 bytes at p, and their value.
+// x = bytes ^ '0' turns digits into 0..9; a byte is a non-digit when it is >= 10, which
+// shows up in its top bit after adding 0x76 (or was already there). A carry out of a
+// non-digit byte can only disturb bytes after it, which we don't look at.
+static inline int swar_digits(const char *p, uint64_t *value)
+{
+    uint64_t x;
+    memcpy(&x, p, 8);
+    x ^= 0x3030303030303030ULL;
+    uint64_t non_digit = ((x + 0x7676767676767676ULL) | x) & 0x8080808080808080ULL;
+    int count = (non_digit == 0) ? 8 : (__builtin_ctzll(non_digit) >> 3);
+    *value = 0;
+    if (count == 0)
+        return 0;
+
+    // right-align the digits as an 8-digit number with leading zeros, then combine pairs, quads, octets
+    x <<= (8 - count) * 8;
+    x = (x * 10 + (x >> 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x * 100 + (x >> 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x * 10000 + (x >> 32)) & 0x00000000FFFFFFFFULL;
+    *value = x;
+    return count;
+}
+
+
+int text_read_uint(text_reader *reader, uint32_t *value)
+{
+    static const uint64_t powers[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+    // skip whitespace, refilling as needed
+    while (1)
+    {
+        if (reader->length - reader->position < TEXT_IO_MAX_TOKEN)
+            text_reader_refill(reader);
+        if (reader->position >= reader->length)
+            return 0;
+        if (!is_space(reader->buffer[reader->position]))
+            break;
+        reader->position++;
+    }
+
+    // Digits are taken eight at a time until a non-digit. A number that runs into the end of
+    // the data read so far carries on after a refill, so however many digits (leading zeros
+    // included) it has, it is read whole; one past UINT32_MAX fails.
+    const char *p = reader->buffer + reader->position;
+    uint64_t total = 0;
+    uint64_t chunk;
+    size_t digits = 0;
+    int overflow = 0;
+    while (1)
+    {
+        const char *end = reader->buffer + reader->length;
+        int count = swar_digits(p, &chunk);
+        if (p + count > end)           // the padding is zeros, so this only trims at EOF
+            count = (int)(end - p);
+        if (total > (UINT32_MAX - chunk) / powers[count])
+            overflow = 1;
+        else
+            total = total * powers[count] + chunk;
+        p += count;
+        digits += (size_t)count;
+        if (count == 8)
+            continue;
+        if (p == end && !reader->eof)
+        {
+            reader->position = reader->length;
+            text_reader_refill(reader);
+            p = reader->buffer + reader->position;
+            continue;
+        }
+        break;
+    }
+
+    if (digits == 0 || overflow)
+    {
+        reader->failed = 1;
+        return 0;
+    }
+    reader->position = (size_t)(p - reader->buffer);
+    *value = (uint32_t)total;
+    return 1;
+}
+
+
+size_t text_read_pulse_chars(text_reader *reader, uint32_t *slots, size_t max_slots,
+                             uint64_t *ones, int *invalid)
+{
+    size_t done = 0;
+
+    *invalid = 0;
+    while (done < max_slots)
+    {
+        if (reader->position >= reader->length)
+            text_reader_refill(reader);
+        if (reader->position >= reader->length)
+            break;
+
+        size_t n = reader->length - reader->position;
+        if (n > max_slots - done)
+            n = max_slots - done;
+
+        // branch-free over the block: anything other than '0'/'1' leaves bits above bit 0
+        const unsigned char *chars = (const unsigned char *)reader->buffer + reader->position;
+        unsigned int bad = 0;
+        uint64_t count = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned int v = (unsigned int)(unsigned char)(chars[i] - '0');
+            bad |= v;
+            slots[done + i] = v;
+            count += v;
+        }
+        if (bad > 1)
+        {
+            *invalid = 1;
+            return done;
+        }
+        *ones += count;
+        done += n;
+        reader->position += n;
+    }
+    return done;
+}
+
+
+void text_writer_init(text_writer *writer, FILE *fp)
+{
+    writer->fp = fp;
+    writer->buffer = malloc(TEXT_IO_BUFFER_SIZE);
+    writer->length = 0;
+}
+
+
+void text_writer_flush(text_writer *writer)
+{
+    if (writer->length > 0)
+        fwrite(writer->buffer, 1, writer->length, writer->fp);
+    writer->length = 0;
+}
+
+
+void text_writer_free(text_writer *writer)
+{
+    text_writer_flush(writer);
+    free(writer->buffer);
+    writer->buffer = NULL;
+}
+
+
+void text_write_uint(text_writer *writer, uint32_t value)
+{
+    static const char pairs[201] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[12];
+    char *p = digits + sizeof(digits);
+
+    if (writer->length + sizeof(digits) > TEXT_IO_BUFFER_SIZE)
+        text_writer_flush(writer);
+
+    // fill from the right, two digits per step
+    *--p = ' ';
+    while (value >= 100)
+    {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        *--p = pairs[pair + 1];
+        *--p = pairs[pair];
+    }
+    if (value >= 10)
+    {
+        *--p = pairs[value * 2 + 1];
+        *--p = pairs[value * 2];
+    }
+    else
+        *--p = (char)('0' + value);
+
+    size_t length = (size_t)(digits + sizeof(digits) - p);
+    memcpy(writer->buffer + writer->length, p, length);
+    writer->length += length;
+}
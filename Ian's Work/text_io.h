@@ -0,0 +1,68 @@
+/* Buffered ASCII codec for the pulse/photon text files
+
+ Replaces fscanf("%hu"), getc() and fprintf("%u ") in the per-word loops. Input is pulled
+ into a large buffer with one fread() per block and integers are parsed 8 digits at a time
+ (SWAR: the digits are located and combined with a few 64-bit multiplies). Output is
+ formatted two digits at a time into a reusable buffer that goes out in one fwrite() per block.
+ The text is byte-for-byte the same as before: values separated by a single space, with a
+ trailing space after the last one.
+
+*/
+#ifndef TEXT_IO_H
+#define TEXT_IO_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXT_IO_BUFFER_SIZE (1 << 20)    // bytes read or written per stdio call
+
+typedef struct
+{
+    FILE *fp;
+    char *buffer;       // TEXT_IO_BUFFER_SIZE bytes plus padding so 8-byte loads never run off the end
+    size_t position;    // next unread byte
+    size_t length;      // bytes currently in the buffer
+    int eof;            // set once fread() has returned short
+    int failed;         // set when text_read_uint() stopped on something that isn't a number
+} text_reader;
+
+typedef struct
+{
+    FILE *fp;
+    char *buffer;
+    size_t length;
+} text_writer;
+
+void text_reader_init(text_reader *reader, FILE *fp);
+void text_reader_free(text_reader *reader);
+
+// skip whitespace and parse an unsigned decimal integer of any number of digits; returns 1 on
+// success, 0 at EOF, and 0 with failed set if the next character isn't a digit or the value
+// is more than UINT32_MAX
+int text_read_uint(text_reader *reader, uint32_t *value);
+
+// Convert up to max_slots characters of '0'/'1' into slot values, stopping early at EOF.
+// Returns the number of slots converted, adds the number of 1s to *ones, and sets *invalid
+// if a character other than '0' or '1' was found.
+size_t text_read_pulse_chars(text_reader *reader, uint32_t *slots, size_t max_slots,
+                             uint64_t *ones, int *invalid);
+
+void text_writer_init(text_writer *writer, FILE *fp);
+void text_writer_flush(text_writer *writer);
+
+// flush, then release the buffer
+void text_writer_free(text_writer *writer);
+
+// write value followed by a space, exactly as fprintf(fp, "%u ", value)
+void text_write_uint(text_writer *writer, uint32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,300 @@
+/* Sequential file output through io_uring - see uring_writer.h */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "uring_writer.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define URING_WRITER_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifndef URING_WRITER_IO_URING
+#define URING_WRITER_IO_URING 0
+#endif
+
+
+#if URING_WRITER_IO_URING
+
+#define RING_ENTRIES (2 * URING_WRITER_DEPTH)
+
+
+static void ring_close(uring_writer *writer)
+{
+    if (writer->cq_map != writer->sq_map)
+        munmap(writer->cq_map, writer->cq_map_size);
+    munmap(writer->sq_map, writer->sq_map_size);
+    munmap(writer->sqe_map, writer->sqe_map_size);
+    close(writer->ring_fd);
+    free(writer->iovecs);
+    writer->iovecs = NULL;
+}
+
+
+static int ring_setup(uring_writer *writer)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    writer->ring_fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (writer->ring_fd < 0)
+        return -1;
+
+    writer->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    writer->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (writer->cq_map_size > writer->sq_map_size)
+            writer->sq_map_size = writer->cq_map_size;
+        writer->cq_map_size = writer->sq_map_size;
+    }
+    writer->sq_map = mmap(NULL, writer->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          writer->ring_fd, IORING_OFF_SQ_RING);
+    if (writer->sq_map == MAP_FAILED)
+    {
+        close(writer->ring_fd);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        writer->cq_map = writer->sq_map;
+    else
+        writer->cq_map = mmap(NULL, writer->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              writer->ring_fd, IORING_OFF_CQ_RING);
+    writer->sqe_map_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    writer->sqe_map = mmap(NULL, writer->sqe_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           writer->ring_fd, IORING_OFF_SQES);
+    if (writer->cq_map == MAP_FAILED || writer->sqe_map == MAP_FAILED)
+    {
+        if (writer->cq_map != MAP_FAILED && writer->cq_map != writer->sq_map)
+            munmap(writer->cq_map, writer->cq_map_size);
+        if (writer->sqe_map != MAP_FAILED)
+            munmap(writer->sqe_map, writer->sqe_map_size);
+        munmap(writer->sq_map, writer->sq_map_size);
+        close(writer->ring_fd);
+        return -1;
+    }
+
+    uint8_t *sq = writer->sq_map, *cq = writer->cq_map;
+    writer->sq_head = (unsigned *)(sq + params.sq_off.head);
+    writer->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    writer->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    writer->sq_array = (unsigned *)(sq + params.sq_off.array);
+    writer->cq_head = (unsigned *)(cq + params.cq_off.head);
+    writer->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    writer->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    writer->sqes = writer->sqe_map;
+    writer->cqes = cq + params.cq_off.cqes;
+    writer->iovecs = calloc(URING_WRITER_DEPTH, sizeof(struct iovec));
+    if (writer->iovecs == NULL)
+    {
+        ring_close(writer);
+        return -1;
+    }
+    return 0;
+}
+
+
+// Hand the kernel every queued write and, with wait set, wait for at least one to complete.
+// Returns 0 on success. On failure the queued writes stay in the ring for the next call.
+static int ring_enter(uring_writer *writer, int wait)
+{
+    unsigned queued = *writer->sq_tail - __atomic_load_n(writer->sq_head, __ATOMIC_ACQUIRE);
+    while (syscall(__NR_io_uring_enter, writer->ring_fd, queued, wait ? 1 : 0,
+                   wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0) < 0)
+        if (errno != EINTR)
+            return -1;
+    return 0;
+}
+
+
+// queue a write of buffer b's iovec at write_offset[b] and tell the kernel
+static void ring_submit(uring_writer *writer, int b)
+{
+    struct iovec *iov = (struct iovec *)writer->iovecs + b;
+    unsigned tail = *writer->sq_tail;
+    unsigned index = tail & *writer->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)writer->sqes + index;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;     // plain IORING_OP_WRITE needs Linux 5.6, WRITEV 5.1
+    sqe->fd = writer->fd;
+    sqe->addr = (uint64_t)(uintptr_t)iov;
+    sqe->len = 1;
+    sqe->off = writer->write_offset[b];
+    sqe->user_data = (uint64_t)b;
+    writer->sq_array[index] = index;
+    __atomic_store_n(writer->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    // the entry is in the ring now, so buffer b stays in flight until its completion is seen
+    if (ring_enter(writer, 0) != 0)
+        writer->failed = 1;
+}
+
+
+// Wait for at least one write to complete and handle every completion that is ready.
+// Returns -1 if the kernel can't be asked, in which case nothing is known about the writes.
+static int ring_reap(uring_writer *writer)
+{
+    if (ring_enter(writer, 1) != 0)
+    {
+        writer->failed = 1;
+        return -1;
+    }
+
+    unsigned head = *writer->cq_head;
+    while (head != __atomic_load_n(writer->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        struct io_uring_cqe *cqe = (struct io_uring_cqe *)writer->cqes + (head & *writer->cq_mask);
+        int b = (int)cqe->user_data;
+        struct iovec *iov = (struct iovec *)writer->iovecs + b;
+        head++;
+        __atomic_store_n(writer->cq_head, head, __ATOMIC_RELEASE);
+
+        if (cqe->res <= 0)
+        {
+            writer->failed = 1;
+            writer->in_flight[b] = 0;
+        }
+        else if ((size_t)cqe->res < iov->iov_len && !writer->failed)    // short write: send the rest
+        {
+            iov->iov_base = (uint8_t *)iov->iov_base + cqe->res;
+            iov->iov_len -= (size_t)cqe->res;
+            writer->write_offset[b] += (uint64_t)cqe->res;
+            ring_submit(writer, b);
+        }
+        else
+            writer->in_flight[b] = 0;
+    }
+    return 0;
+}
+
+#endif
+
+
+// send the current buffer on its way (or write it out at once without io_uring)
+static void submit_buffer(uring_writer *writer)
+{
+    int b = writer->current;
+    size_t length = writer->fill;
+    if (length == 0 || writer->failed)
+        return;
+
+#if URING_WRITER_IO_URING
+    if (writer->active)
+    {
+        struct iovec *iov = (struct iovec *)writer->iovecs + b;
+        iov->iov_base = writer->buffers[b];
+        iov->iov_len = length;
+        writer->write_offset[b] = writer->offset;
+        writer->in_flight[b] = 1;
+        writer->offset += length;
+        ring_submit(writer, b);
+        return;
+    }
+#endif
+
+    const uint8_t *data = writer->buffers[b];
+    while (length > 0)
+    {
+        ssize_t written = pwrite(writer->fd, data, length, (off_t)writer->offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+        {
+            writer->failed = 1;
+            return;
+        }
+        data += written;
+        length -= (size_t)written;
+        writer->offset += (uint64_t)written;
+    }
+}
+
+
+int uring_writer_init(uring_writer *writer, int fd)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = fd;
+    off_t offset = lseek(fd, 0, SEEK_END);
+    writer->offset = (offset < 0) ? 0 : (uint64_t)offset;
+    for (int b = 0; b < URING_WRITER_DEPTH; b++)
+    {
+        writer->buffers[b] = malloc(URING_WRITER_BUFFER_SIZE);
+        if (writer->buffers[b] == NULL)
+        {
+            for (int k = 0; k < b; k++)
+                free(writer->buffers[k]);
+            return -1;
+        }
+    }
+#if URING_WRITER_IO_URING
+    writer->active = (ring_setup(writer) == 0);
+#endif
+    return 0;
+}
+
+
+int uring_writer_write(uring_writer *writer, const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+    while (length > 0 && !writer->failed)
+    {
+        if (writer->fill == URING_WRITER_BUFFER_SIZE)
+        {
+            submit_buffer(writer);
+            writer->current = (writer->current + 1) % URING_WRITER_DEPTH;
+            writer->fill = 0;
+#if URING_WRITER_IO_URING
+            while (writer->active && writer->in_flight[writer->current] && !writer->failed)
+                ring_reap(writer);
+#endif
+            if (writer->failed)     // the next buffer may still be in the kernel's hands
+                break;
+        }
+        size_t n = URING_WRITER_BUFFER_SIZE - writer->fill;
+        if (n > length)
+            n = length;
+        memcpy(writer->buffers[writer->current] + writer->fill, bytes, n);
+        writer->fill += n;
+        bytes += n;
+        length -= n;
+    }
+    return writer->failed ? -1 : 0;
+}
+
+
+int uring_writer_finish(uring_writer *writer)
+{
+    submit_buffer(writer);
+    writer->fill = 0;
+#if URING_WRITER_IO_URING
+    if (writer->active)
+    {
+        // every write handed to the kernel has to complete, failed or not, before its buffer
+        // and the rings go away
+        int drained = 1;
+        for (int b = 0; b < URING_WRITER_DEPTH; b++)
+            while (drained && writer->in_flight[b])
+                drained = (ring_reap(writer) == 0);
+        if (!drained)
+            return -1;      // the kernel may still use them, so the ring and buffers are left alone
+        ring_close(writer);
+        writer->active = 0;
+    }
+#endif
+    for (int b = 0; b < URING_WRITER_DEPTH; b++)
+    {
+        free(writer->buffers[b]);
+        writer->buffers[b] = NULL;
+    }
+    return writer->failed ? -1 : 0;
+}
@@ -0,0 +1,66 @@
+/* Sequential file output through io_uring (Linux), with a write() fallback
+
+ The writer keeps a few staging buffers. Output is copied into the current one, and a full
+ buffer is handed to the kernel as an asynchronous write at its file offset while the next
+ one fills, so up to URING_WRITER_DEPTH writes are in flight and the caller only waits
+ when every buffer is still being written. Short writes are resubmitted for the remainder.
+
+ It talks to the kernel through the raw io_uring_setup/io_uring_enter system calls and the
+ shared rings, so liburing isn't needed. Where io_uring isn't available (not Linux, no
+ <linux/io_uring.h>, or a kernel that refuses io_uring_setup) uring_writer_init() still
+ succeeds and the buffers are written with plain write() calls instead; check
+ uring_writer.active to see which one is in use.
+
+*/
+#ifndef URING_WRITER_H
+#define URING_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define URING_WRITER_DEPTH 4                    // staging buffers, so writes in flight
+#define URING_WRITER_BUFFER_SIZE (1 << 20)      // bytes per write
+
+typedef struct
+{
+    int fd;                     // the output file
+    uint64_t offset;            // file offset of the next buffer submitted
+    int active;                 // set when io_uring is in use, clear for write()
+    int failed;                 // set after any error; later writes are dropped
+
+    uint8_t *buffers[URING_WRITER_DEPTH];
+    size_t fill;                // bytes in the current buffer
+    int current;                // buffer being filled
+    int in_flight[URING_WRITER_DEPTH];
+
+    // io_uring state (unused with the write() fallback)
+    int ring_fd;
+    void *sq_map, *cq_map, *sqe_map;
+    size_t sq_map_size, cq_map_size, sqe_map_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *sqes, *cqes;
+    void *iovecs;               // one struct iovec per buffer, alive while its write is in flight
+    uint64_t write_offset[URING_WRITER_DEPTH];
+} uring_writer;
+
+// Start writing at the current end of fd. Returns 0 on success (with or without io_uring).
+int uring_writer_init(uring_writer *writer, int fd);
+
+// Append bytes; returns 0 on success
+int uring_writer_write(uring_writer *writer, const void *data, size_t length);
+
+// Write out the last buffer, wait for every write, and release the ring and buffers (the file
+// stays open). Returns 0 if everything reached the file. After an error it still waits for the
+// writes the kernel has been given; if even that fails the ring and buffers are not released.
+int uring_writer_finish(uring_writer *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
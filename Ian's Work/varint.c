@@ -0,0 +1,260 @@
+/* LEB128 varints and varint RLE - see varint.h */
+#include <stdlib.h>
+#include <string.h>
+
+#include "varint.h"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+// The word-at-a-time decode reads the bytes as a little-endian 64-bit integer
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define VARINT_WORD_DECODE 0
+#else
+#define VARINT_WORD_DECODE 1
+#endif
+
+#define CONTINUATION_BITS 0x8080808080808080ULL
+
+
+size_t varint_put(uint8_t *out, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+
+size_t varint_get(const uint8_t *in, const uint8_t *end, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (size_t n = 0; n < VARINT_MAX_BYTES && in + n < end; n++)
+    {
+        result |= (uint64_t)(in[n] & 0x7F) << (7 * n);
+        if ((in[n] & 0x80) == 0)
+        {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+
+// the 7-bit groups of up to eight varint bytes, packed together
+static inline uint64_t squeeze_groups(uint64_t bytes)
+{
+#if defined(__BMI2__)
+    return _pext_u64(bytes, 0x7F7F7F7F7F7F7F7FULL);
+#else
+    return  (bytes & 0x7FULL)
+         | ((bytes >> 1) & (0x7FULL << 7))
+         | ((bytes >> 2) & (0x7FULL << 14))
+         | ((bytes >> 3) & (0x7FULL << 21))
+         | ((bytes >> 4) & (0x7FULL << 28))
+         | ((bytes >> 5) & (0x7FULL << 35))
+         | ((bytes >> 6) & (0x7FULL << 42))
+         | ((bytes >> 7) & (0x7FULL << 49));
+#endif
+}
+
+
+size_t varint_decode(const uint8_t *in, const uint8_t *end, uint64_t *out, size_t max_values, size_t *consumed)
+{
+    const uint8_t *p = in;
+    size_t n = 0;
+
+#if VARINT_WORD_DECODE
+    while (n < max_values && end - p >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        uint64_t stops = ~word & CONTINUATION_BITS;     // the last byte of each varint
+
+        if (stops == CONTINUATION_BITS && max_values - n >= 8)
+        {
+            // eight one-byte values, the common case for short runs and counts
+            for (int k = 0; k < 8; k++)
+                out[n + k] = (word >> (8 * k)) & 0x7F;
+            n += 8;
+            p += 8;
+            continue;
+        }
+        if (stops == 0)
+        {
+            // longer than eight bytes, which only a huge run or count needs
+            size_t length = varint_get(p, end, &out[n]);
+            if (length == 0)
+                break;
+            n++;
+            p += length;
+            continue;
+        }
+
+        int length = (__builtin_ctzll(stops) >> 3) + 1;
+        uint64_t bytes = (length == 8) ? word : word & ((1ULL << (8 * length)) - 1);
+        out[n++] = squeeze_groups(bytes);
+        p += length;
+    }
+#endif
+
+    while (n < max_values && p < end)
+    {
+        size_t length = varint_get(p, end, &out[n]);
+        if (length == 0)
+            break;
+        n++;
+        p += length;
+    }
+
+    *consumed = (size_t)(p - in);
+    return n;
+}
+
+
+void varint_rle_reader_init(varint_rle_reader *reader, const uint8_t *data, size_t size)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->data = data;
+    reader->size = size;
+}
+
+
+// next decoded varint; returns 1, or 0 at the end of the data (or a truncated varint)
+static int next_value(varint_rle_reader *reader, uint64_t *value)
+{
+    if (reader->next_value == reader->num_values)
+    {
+        size_t consumed;
+        reader->num_values = varint_decode(reader->data + reader->position, reader->data + reader->size,
+                                           reader->values, VARINT_RLE_BATCH, &consumed);
+        reader->position += consumed;
+        reader->next_value = 0;
+        if (reader->num_values == 0)
+        {
+            if (reader->position < reader->size)
+                reader->malformed = 1;
+            return 0;
+        }
+    }
+    *value = reader->values[reader->next_value++];
+    return 1;
+}
+
+
+int varint_rle_next_pair(varint_rle_reader *reader, uint64_t *zeros, uint32_t *value)
+{
+    uint64_t count;
+
+    if (reader->malformed || !next_value(reader, zeros))
+        return 0;
+    if (!next_value(reader, &count) || count > UINT32_MAX)
+    {
+        reader->malformed = 1;      // a run with no value after it, or a count that doesn't fit
+        return 0;
+    }
+    *value = (uint32_t)count;
+    return 1;
+}
+
+
+uint64_t varint_rle_expand(varint_rle_reader *reader, uint32_t *slots, uint64_t max_slots)
+{
+    uint64_t filled = 0;
+
+    while (filled < max_slots && !reader->malformed)
+    {
+        if (reader->zeros_left == 0 && !reader->value_pending)
+        {
+            uint64_t zeros;
+            uint32_t value;
+            if (!varint_rle_next_pair(reader, &zeros, &value))
+                break;
+            reader->zeros_left = zeros;
+            reader->value = value;
+            reader->value_pending = (value != 0);   // a final (run, 0) pair only carries zeros
+        }
+
+        uint64_t zeros = reader->zeros_left;
+        if (zeros > max_slots - filled)
+            zeros = max_slots - filled;
+        memset(slots + filled, 0, (size_t)zeros * sizeof(uint32_t));
+        filled += zeros;
+        reader->zeros_left -= zeros;
+        if (reader->zeros_left == 0 && reader->value_pending && filled < max_slots)
+        {
+            slots[filled++] = reader->value;
+            reader->value_pending = 0;
+        }
+    }
+    return filled;
+}
+
+
+int varint_rle_writer_init(varint_rle_writer *writer, FILE *fp)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->fp = fp;
+    writer->buffer = malloc(VARINT_RLE_BUFFER_SIZE);
+    return (writer->buffer == NULL) ? -1 : 0;
+}
+
+
+static void flush_pairs(varint_rle_writer *writer)
+{
+    if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->fp) != writer->length)
+        writer->failed = 1;
+    writer->length = 0;
+}
+
+
+static void write_pair(varint_rle_writer *writer, uint64_t zeros, uint32_t value)
+{
+    if (writer->length + 2 * VARINT_MAX_BYTES > VARINT_RLE_BUFFER_SIZE)
+        flush_pairs(writer);
+    writer->length += varint_put(writer->buffer + writer->length, zeros);
+    writer->length += varint_put(writer->buffer + writer->length, value);
+}
+
+
+void varint_rle_add_zeros(varint_rle_writer *writer, uint64_t count)
+{
+    writer->zeros += count;
+}
+
+
+void varint_rle_add_value(varint_rle_writer *writer, uint32_t value)
+{
+    write_pair(writer, writer->zeros, value);
+    writer->zeros = 0;
+}
+
+
+void varint_rle_add_slots(varint_rle_writer *writer, const uint32_t *slots, uint64_t num_slots)
+{
+    for (uint64_t i = 0; i < num_slots; i++)
+    {
+        if (slots[i] == 0)
+            writer->zeros++;
+        else
+            varint_rle_add_value(writer, slots[i]);
+    }
+}
+
+
+int varint_rle_finish(varint_rle_writer *writer)
+{
+    if (writer->zeros > 0)
+        write_pair(writer, writer->zeros, 0);
+    writer->zeros = 0;
+    flush_pairs(writer);
+    free(writer->buffer);
+    writer->buffer = NULL;
+    return writer->failed ? -1 : 0;
+}
@@ -0,0 +1,94 @@
+/* LEB128 varints and the varint run-length format (.vrle files)
+
+ A varint stores 7 bits per byte, low bits first, with the high bit set on every byte
+ but the last, so small numbers take one byte and any 64-bit number at most ten.
+
+ The varint RLE format is the 16-bit RLE of the .rle.bin files with each word replaced
+ by a varint: a zero run followed by the value of the next slot, and a final
+ (zero run, 0) pair if the stream ends in empty slots. Runs and counts are 64-bit, so
+ there are no (2^16-1) continuation words, no limit on a run and no limit on a count
+ short of 2^32; a typical pair takes 2 to 4 bytes instead of 4 or more.
+
+ varint_decode() reads eight bytes at a time: the continuation bits of the word say
+ where the first varint ends, a mask-and-shift (or BMI2 PEXT) squeezes out its 7-bit
+ groups, and a word without any continuation bit is eight one-byte values at once.
+
+*/
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VARINT_MAX_BYTES 10
+#define VARINT_RLE_BATCH 4096                // varints decoded per varint_decode() call
+#define VARINT_RLE_BUFFER_SIZE (1 << 16)     // bytes of encoded pairs written per fwrite()
+
+// Returns the number of bytes written (at most 10)
+size_t varint_put(uint8_t *out, uint64_t value);
+
+// Returns the number of bytes read, or 0 if the varint runs past end or is longer than 10 bytes
+size_t varint_get(const uint8_t *in, const uint8_t *end, uint64_t *value);
+
+// Decodes up to max_values varints from [in, end) into out. Returns the number decoded and
+// sets *consumed to the bytes they took; it stops early at a truncated or overlong varint,
+// which the caller sees as bytes left over.
+size_t varint_decode(const uint8_t *in, const uint8_t *end, uint64_t *out, size_t max_values, size_t *consumed);
+
+// Expands a varint RLE stream held in memory (e.g. a mapped file) into one count per slot
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    size_t position;            // bytes decoded so far
+    uint64_t values[VARINT_RLE_BATCH];
+    size_t num_values;          // decoded varints waiting to be used
+    size_t next_value;
+    uint64_t zeros_left;        // part of the current zero run not yet expanded
+    uint32_t value;             // slot after the run
+    int value_pending;
+    int malformed;
+} varint_rle_reader;
+
+void varint_rle_reader_init(varint_rle_reader *reader, const uint8_t *data, size_t size);
+
+// Next (zero run, value) pair as stored; returns 1, or 0 at the end or if the stream is malformed
+// (which sets reader->malformed). Don't mix with varint_rle_expand() on the same reader.
+int varint_rle_next_pair(varint_rle_reader *reader, uint64_t *zeros, uint32_t *value);
+
+// Fills slots with up to max_slots counts and returns how many it filled (0 at the end).
+// A run of any length is split over as many calls as it needs. Sets reader->malformed
+// and stops if the stream is truncated or a count doesn't fit in 32 bits.
+uint64_t varint_rle_expand(varint_rle_reader *reader, uint32_t *slots, uint64_t max_slots);
+
+// Encodes counts as varint RLE into a stdio file
+typedef struct
+{
+    FILE *fp;
+    uint8_t *buffer;
+    size_t length;
+    uint64_t zeros;             // zero run still open, carried over between calls
+    int failed;
+} varint_rle_writer;
+
+// Returns 0 on success. The writer doesn't own fp.
+int varint_rle_writer_init(varint_rle_writer *writer, FILE *fp);
+
+void varint_rle_add_zeros(varint_rle_writer *writer, uint64_t count);
+void varint_rle_add_value(varint_rle_writer *writer, uint32_t value);     // value must be non-zero
+void varint_rle_add_slots(varint_rle_writer *writer, const uint32_t *slots, uint64_t num_slots);
+
+// Writes the final (zero run, 0) pair if there is one and everything buffered; returns 0 if
+// every write succeeded
+int varint_rle_finish(varint_rle_writer *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+#include "BlockStream.h"
+
+#include <algorithm>
+
+bool BlockSource::readPulses(std::vector<long long>& pulses, long long first_slot, long long& slots,
+    long long maxSlots) {
+    pulses.clear();
+    if (!readBlock(scratch, maxSlots)) {
+        slots = 0;
+        return false;
+    }
+    slots = scratch.size();
+    scratch.forEachOne([&](long long slot) {
+        pulses.push_back(first_slot + slot);
+    });
+    return true;
+}
+
+void BlockSink::writePulses(const std::vector<long long>& pulses, long long first_slot, long long slots) {
+    scratch.clear();
+    scratch.appendZeros(slots);
+    for (long long slot : pulses) {
+        scratch.set(slot - first_slot);
+    }
+    writeBlock(scratch);
+}
+
+RLEBlockReader::RLEBlockReader(std::istream& input) : reader(input) {}
+
+bool RLEBlockReader::readBlock(SlotBitmap& block, long long maxSlots) {
+    block.clear();
+    while (block.size() < maxSlots) {
+        if (zerosLeft == 0 && onesLeft == 0 && !reader.next(zerosLeft, onesLeft)) {
+            break;
+        }
+        long long zeros = std::min(zerosLeft, maxSlots - block.size());
+        block.appendZeros(zeros);
+        zerosLeft -= zeros;
+
+        long long ones = std::min(onesLeft, maxSlots - block.size());
+        block.appendOnes(ones);
+        onesLeft -= ones;
+    }
+    return block.size() > 0;
+}
+
+void writeBlock(const SlotBitmap& block, RLEWriter& writer) {
+    long long previous = -1; // Last occupied slot in this block
+    block.forEachOne([&](long long slot) {
+        writer.addZeros(slot - previous - 1);
+        writer.addOne();
+        previous = slot;
+    });
+    writer.addZeros(block.size() - previous - 1);
+}
+
+RLEBlockWriter::RLEBlockWriter(std::ostream& output) : writer(output) {}
+
+void RLEBlockWriter::writeBlock(const SlotBitmap& block) {
+    ::writeBlock(block, writer);
+}
+
+void RLEBlockWriter::writePulses(const std::vector<long long>& pulses, long long first_slot, long long slots) {
+    long long previous = first_slot - 1; // Last occupied slot written
+    for (long long slot : pulses) {
+        writer.addZeros(slot - previous - 1);
+        writer.addOne();
+        previous = slot;
+    }
+    writer.addZeros(first_slot + slots - previous - 1);
+}
+
+void RLEBlockWriter::finish() {
+    writer.finish();
+}
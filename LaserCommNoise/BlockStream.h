@@ -0,0 +1,96 @@
+// BlockStream.h
+//
+// Reads and writes an RLE signal one fixed-size block of slots at a time.
+//
+// A run that crosses a block boundary is split: the reader keeps whatever is left
+// of the current <zeros> <ones> pair for the next block, and the RLEWriter keeps the
+// trailing zero run of one block open so it merges with the start of the next.
+// Only one block is ever held in memory no matter how long the input is.
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include "RLEChannel.h"
+#include "SlotBitmap.h"
+
+// Where channelBlocks gets its slots from, one block at a time and in order
+class BlockSource {
+public:
+    virtual ~BlockSource() = default;
+
+    // Fills block (reusing its memory) with the next slots of the stream.
+    // Returns false once there is nothing left to read.
+    virtual bool readBlock(SlotBitmap& block, long long maxSlots) = 0;
+
+    // The same block as a list of its occupied slots, numbered from first_slot (where the block
+    // starts in the stream), with its length in slots. The default expands the block into a
+    // bitmap first; sources that store only the occupied slots override it.
+    virtual bool readPulses(std::vector<long long>& pulses, long long first_slot, long long& slots, long long maxSlots);
+
+    // True if readPulses never expands the empty slots
+    virtual bool sparse() const {
+        return false;
+    }
+
+    // False once a read has found the input malformed, so the reads ended early rather than
+    // at the end of the stream
+    virtual bool good() const {
+        return true;
+    }
+
+private:
+    SlotBitmap scratch;
+};
+
+// Where channelBlocks sends its slots, one block at a time and in order
+class BlockSink {
+public:
+    virtual ~BlockSink() = default;
+
+    virtual void writeBlock(const SlotBitmap& block) = 0;
+
+    // Writes a block given as its occupied slots (numbered from first_slot, in order) and its
+    // length. The default builds the bitmap; sinks that can do without it override it.
+    virtual void writePulses(const std::vector<long long>& pulses, long long first_slot, long long slots);
+
+    // Called once after the last block
+    virtual void finish() = 0;
+
+private:
+    SlotBitmap scratch;
+};
+
+class RLEBlockReader : public BlockSource {
+public:
+    explicit RLEBlockReader(std::istream& input);
+
+    // Expands up to maxSlots slots into block
+    bool readBlock(SlotBitmap& block, long long maxSlots) override;
+
+    bool good() const override {
+        return reader.good();
+    }
+
+private:
+    RLEReader reader;
+    long long zerosLeft = 0; // part of the current pair not yet expanded
+    long long onesLeft = 0;
+};
+
+// Appends every slot of the block to the writer
+void writeBlock(const SlotBitmap& block, RLEWriter& writer);
+
+// Writes blocks back out as ASCII RLE pairs
+class RLEBlockWriter : public BlockSink {
+public:
+    explicit RLEBlockWriter(std::ostream& output);
+
+    void writeBlock(const SlotBitmap& block) override;
+    void writePulses(const std::vector<long long>& pulses, long long first_slot, long long slots) override;
+    void finish() override;
+
+private:
+    RLEWriter writer;
+};
@@ -0,0 +1,244 @@
+#include "ChannelPipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "poisson.h"
+
+SlotBitmap randomMask(long long first_slot, long long size, double probability, uint64_t seed, uint32_t stage,
+    long long* draws) {
+    SlotBitmap mask(size);
+    forEachRandomSlot(first_slot, size, probability, seed, stage, draws, [&](long long slot) {
+        mask.set(slot - first_slot);
+    });
+
+    return mask;
+}
+
+// 53 random bits mapped onto [0, 1)
+static double uniform(Philox& rng) {
+    return (double)(rng() >> 11) * 0x1.0p-53;
+}
+
+void PoissonDetection::apply(PhotonSlot& slot, Philox& rng, bool) const {
+    double signal = mean * slot.gain;
+    if (slot.pulse && signal > 0.0) {
+        slot.signal = poisson_sample(signal, Philox::bits, &rng);
+    }
+}
+
+void PulseErasure::apply(PhotonSlot& slot, Philox& rng, bool) const {
+    if (slot.pulse && uniform(rng) < probability) {
+        slot.erased = true;
+        slot.signal = 0;
+    }
+}
+
+BackgroundNoise::BackgroundNoise(double mean) : mean(mean), nonZero(-std::expm1(-mean)) {}
+
+double BackgroundNoise::meanForProbability(double probability) {
+    return probability >= 1.0 ? HUGE_VAL : -std::log1p(-probability);
+}
+
+double BackgroundNoise::emptySlotProbability() const {
+    return nonZero;
+}
+
+void BackgroundNoise::apply(PhotonSlot& slot, Philox& rng, bool triggered) const {
+    if (!triggered) {
+        return;
+    }
+    // The skip-ahead already decided there is at least one photon, so draw from the
+    // Poisson distribution conditioned on k >= 1 by inversion
+    double target = uniform(rng) * nonZero;
+    double term = mean * std::exp(-mean); // Pr(k = 1)
+    double cumulative = term;
+    int k = 1;
+    while (cumulative < target && term > 0.0) {
+        k++;
+        term *= mean / k;
+        cumulative += term;
+    }
+    slot.background += k;
+}
+
+void Threshold::apply(PhotonSlot& slot, Philox&, bool) const {
+    slot.detected = slot.photons() >= photons;
+}
+
+void DetectionSink::writeBlock(long long first_slot, long long slots, const std::vector<PhotonSlot>& events) {
+    detected.clear();
+    for (const PhotonSlot& event : events) {
+        if (event.detected) {
+            detected.push_back(event.slot);
+        }
+    }
+    output.writePulses(detected, first_slot, slots);
+}
+
+void DetectionSink::finish() {
+    output.finish();
+}
+
+void PhotonCountSink::writeBlock(long long first_slot, long long slots, const std::vector<PhotonSlot>& events) {
+    long long previous = first_slot - 1; // Last slot written
+    long long occupied = 0;
+    pairs.clear();
+    for (const PhotonSlot& event : events) {
+        if (event.photons() > 0) {
+            pairs.push_back((uint32_t)(event.slot - previous - 1));
+            pairs.push_back((uint32_t)event.photons());
+            previous = event.slot;
+            occupied++;
+        }
+    }
+    if (first_slot + slots - previous - 1 > 0) {
+        pairs.push_back((uint32_t)(first_slot + slots - previous - 1));
+        pairs.push_back(0);
+    }
+    output.writePairs(pairs, slots, occupied);
+}
+
+void PhotonCountSink::finish() {
+    output.finish();
+}
+
+void PhotonEventSink::writeBlock(long long first_slot, long long slots, const std::vector<PhotonSlot>& events) {
+    counts.clear();
+    for (const PhotonSlot& event : events) {
+        if (event.photons() > 0) {
+            counts.push_back({ event.slot, (uint32_t)event.photons() });
+        }
+    }
+    output.writeCounts(counts, first_slot, slots);
+}
+
+void PhotonEventSink::finish() {
+    output.finish();
+}
+
+void ChannelPipeline::runPulses(const std::vector<long long>& pulses, long long first_slot, long long slots,
+    uint64_t seed, std::vector<PhotonSlot>& events, long long* draws) const {
+    // Every slot that any stage can touch: the pulses plus the empty slots each
+    // spontaneous stage picks by skipping ahead
+    std::vector<std::vector<long long>> triggers(stages.size());
+    for (size_t i = 0; i < stages.size(); i++) {
+        double probability = stages[i]->emptySlotProbability();
+        if (probability > 0.0) {
+            forEachRandomSlot(first_slot, slots, probability, seed, pipeline_stage + (uint32_t)(2 * i + 1), draws,
+                [&](long long slot) {
+                    triggers[i].push_back(slot);
+                });
+        }
+    }
+
+    // The fading gains of all the block's pulses are worked out together
+    std::vector<double> gains;
+    if (fading) {
+        fading->sample(pulses, gains, draws);
+    }
+
+    // One pass in slot order, merging the lists: each slot goes through every stage before
+    // the next slot is looked at
+    const long long none = std::numeric_limits<long long>::max();
+    size_t pulse = 0;
+    std::vector<size_t> next(stages.size(), 0);
+    events.clear();
+    while (true) {
+        long long slot = (pulse < pulses.size()) ? pulses[pulse] : none;
+        for (size_t i = 0; i < stages.size(); i++) {
+            if (next[i] < triggers[i].size()) {
+                slot = std::min(slot, triggers[i][next[i]]);
+            }
+        }
+        if (slot == none) {
+            break;
+        }
+
+        PhotonSlot event;
+        event.slot = slot;
+        event.pulse = (pulse < pulses.size() && pulses[pulse] == slot);
+        if (event.pulse && fading) {
+            event.gain = gains[pulse];
+        }
+        pulse += event.pulse;
+        for (size_t i = 0; i < stages.size(); i++) {
+            Philox rng(seed, pipeline_stage + (uint32_t)(2 * i), (uint64_t)slot);
+            bool triggered = (next[i] < triggers[i].size() && triggers[i][next[i]] == slot);
+            next[i] += triggered;
+            stages[i]->apply(event, rng, triggered);
+            if (draws != nullptr) {
+                *draws += (long long)rng.draws();
+            }
+        }
+        events.push_back(event);
+    }
+}
+
+PipelineStats ChannelPipeline::run(BlockSource& source, PipelineSink& sink, long long block_slots, uint64_t seed,
+    ThreadPool& pool, run_report* report) const {
+    PipelineStats stats;
+
+    // Two blocks per thread keeps everyone busy while a slow block finishes
+    std::vector<std::vector<long long>> batch(2 * pool.size());
+    std::vector<long long> firstSlots(batch.size());
+    std::vector<long long> batchSlots(batch.size());
+    std::vector<std::vector<PhotonSlot>> batchEvents(batch.size());
+    std::vector<long long> batchDraws(batch.size());
+    long long next_slot = 0;
+    run_report unused;
+    if (report == nullptr) {
+        run_report_init(&unused, "");
+        report = &unused;
+    }
+
+    bool more = true;
+    while (more) {
+        int stage = run_report_begin(report, "read");
+        size_t blocks = 0;
+        while (blocks < batch.size() && source.readPulses(batch[blocks], next_slot, batchSlots[blocks], block_slots)) {
+            firstSlots[blocks] = next_slot;
+            next_slot += batchSlots[blocks];
+            blocks++;
+        }
+        more = (blocks == batch.size());
+        run_report_end(report, stage);
+
+        stage = run_report_begin(report, "stages");
+        pool.parallelFor((long long)blocks, [&](long long i) {
+            batchDraws[i] = 0;
+            runPulses(batch[i], firstSlots[i], batchSlots[i], seed, batchEvents[i], &batchDraws[i]);
+        });
+        run_report_end(report, stage);
+
+        stage = run_report_begin(report, "write");
+        for (size_t i = 0; i < blocks; i++) {
+            stats.slots += batchSlots[i];
+            stats.rngDraws += batchDraws[i];
+            for (const PhotonSlot& event : batchEvents[i]) {
+                stats.pulses += event.pulse;
+                stats.erasures += event.erased;
+                stats.photons += event.photons();
+                stats.detections += event.detected;
+                stats.missedPulses += event.pulse && !event.detected;
+                stats.falseDetections += !event.pulse && event.detected;
+                if (event.pulse) {
+                    stats.gainSum += event.gain;
+                    stats.gainSquares += event.gain * event.gain;
+                    stats.histogram[std::min(event.photons(), RUN_REPORT_HISTOGRAM_BINS - 1)]++;
+                }
+            }
+            sink.writeBlock(firstSlots[i], batchSlots[i], batchEvents[i]);
+        }
+        run_report_end(report, stage);
+
+        report->slots = (uint64_t)stats.slots;
+        report->pulses = (uint64_t)stats.pulses;
+        report->rng_draws = (uint64_t)stats.rngDraws;
+        run_report_progress(report);
+    }
+    sink.finish();
+
+    return stats;
+}
@@ -0,0 +1,252 @@
+// ChannelPipeline.h
+//
+// The whole physical layer as one pass over each block of slots.
+//
+// A pipeline is a block source (RLE text or a .slots container), a list of stages and
+// a sink. Instead of expanding the signal into a vector, writing it out and reading it
+// back for the next step, the driver visits only the slots that matter - the pulses and
+// the empty slots a stage lights up on its own (background light) - and runs every
+// stage on each of them in turn before moving to the next slot. Empty slots that no
+// stage touches are never looked at, so the cost follows the number of pulses and
+// noise events and nothing is written until the sink.
+//
+// Random numbers come from Philox keyed by the seed, the stage's position in the
+// pipeline and the absolute slot index, so the output is the same for any block size
+// or thread count.
+//
+// A block travels between the source, the stages and the sink as the list of its pulse
+// slots, so a sparse source (a .events stream) never has its empty slots expanded.
+//
+// An optional fading process (Fading.h) gives each pulse a gain, sampled for the whole
+// block at once, that scales the mean number of signal photons the detection stage draws from.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "BlockStream.h"
+#include "EventStream.h"
+#include "Fading.h"
+#include "GeometricSampler.h"
+#include "SlotBitmap.h"
+#include "SlotContainer.h"
+#include "ThreadPool.h"
+#include "philox.h"
+#include "run_report.h"
+
+// Slots that share one random number stream when skipping ahead to the next event
+const long long rng_segment_slots = 1 << 16;
+
+// Which stage a random stream belongs to, so erasures and noise never share numbers.
+// Pipeline stages number their streams from pipeline_stage upwards.
+enum ChannelStage : uint32_t { erasure_stage = 1, noise_stage = 2, pipeline_stage = 0x100 };
+
+// Calls fn(slot) in increasing order for each slot of [first_slot, first_slot + size) whose roll
+// comes up with the given probability, by jumping straight to the next one. The numbers only
+// depend on the seed, the stage and the slot, so any block split gives the same slots.
+// If draws is given, the random numbers used are added to it.
+template <typename Function>
+void forEachRandomSlot(long long first_slot, long long size, double probability, uint64_t seed, uint32_t stage,
+    long long* draws, Function fn) {
+    GeometricSampler sampler(probability);
+    long long end = first_slot + size;
+
+    for (long long segment = first_slot / rng_segment_slots; segment * rng_segment_slots < end; segment++) {
+        Philox rng(seed, stage, (uint64_t)segment);
+        long long segment_start = segment * rng_segment_slots;
+        long long segment_end = std::min(segment_start + rng_segment_slots, end);
+
+        // A block can start part way into a segment, so replay the segment from its start
+        long long gap = sampler.next(rng);
+        if (gap < segment_end - segment_start) {
+            long long counter = segment_start + gap; // index of the next slot whose roll comes up
+            while (true) {
+                if (counter >= first_slot) {
+                    fn(counter);
+                }
+                gap = sampler.next(rng);
+                if (gap >= segment_end - counter - 1) {
+                    break;
+                }
+                counter += gap + 1;
+            }
+        }
+        if (draws != nullptr) {
+            *draws += (long long)rng.draws();
+        }
+    }
+}
+
+// Builds a mask for the slots [first_slot, first_slot + size) with each slot set independently with the
+// given probability, by jumping straight to the next slot whose roll would have come up.
+// If draws is given, the random numbers used are added to it.
+SlotBitmap randomMask(long long first_slot, long long size, double probability, uint64_t seed, uint32_t stage,
+    long long* draws = nullptr);
+
+// One slot on its way through the stages
+struct PhotonSlot {
+    long long slot = 0;     // absolute slot index
+    bool pulse = false;     // a pulse was sent in this slot
+    int signal = 0;         // signal photons, set by the detection stage
+    int background = 0;     // background photons
+    bool detected = false;  // set by the threshold stage
+    bool erased = false;    // the pulse was lost in the channel
+    double gain = 1.0;      // received irradiance relative to its mean, set for pulses when fading
+
+    int photons() const {
+        return signal + background;
+    }
+};
+
+class PipelineStage {
+public:
+    virtual ~PipelineStage() = default;
+
+    // Probability that the stage does something to a slot without a pulse. Those slots are
+    // found by skipping ahead, and apply() is told whether this slot was one of them.
+    virtual double emptySlotProbability() const {
+        return 0.0;
+    }
+
+    // rng is keyed by this stage and this slot alone
+    virtual void apply(PhotonSlot& slot, Philox& rng, bool triggered) const = 0;
+};
+
+// Each pulse yields a Poisson number of detected signal photons with mean K times its gain
+class PoissonDetection : public PipelineStage {
+public:
+    explicit PoissonDetection(double mean) : mean(mean) {}
+    void apply(PhotonSlot& slot, Philox& rng, bool triggered) const override;
+
+private:
+    double mean;
+};
+
+// Each pulse is lost with the given probability (no signal photons reach the detector)
+class PulseErasure : public PipelineStage {
+public:
+    explicit PulseErasure(double probability) : probability(probability) {}
+    void apply(PhotonSlot& slot, Philox& rng, bool triggered) const override;
+
+private:
+    double probability;
+};
+
+// Every slot collects a Poisson number of background photons with the given mean
+class BackgroundNoise : public PipelineStage {
+public:
+    explicit BackgroundNoise(double mean);
+
+    // The legacy noise probability is the chance of at least one background photon
+    static double meanForProbability(double probability);
+
+    double emptySlotProbability() const override;
+    void apply(PhotonSlot& slot, Philox& rng, bool triggered) const override;
+
+private:
+    double mean;
+    double nonZero; // Pr(at least one photon) = 1 - exp(-mean)
+};
+
+// A slot is detected when it holds at least the threshold number of photons
+class Threshold : public PipelineStage {
+public:
+    explicit Threshold(int photons) : photons(photons) {}
+    void apply(PhotonSlot& slot, Philox& rng, bool triggered) const override;
+
+private:
+    int photons;
+};
+
+// Totals over a pipeline run
+struct PipelineStats {
+    long long slots = 0;
+    long long pulses = 0;
+    long long erasures = 0;         // pulses lost in the channel
+    long long photons = 0;          // signal plus background photons
+    long long detections = 0;       // slots passing the threshold
+    long long missedPulses = 0;     // pulses that were not detected
+    long long falseDetections = 0;  // detections in slots without a pulse
+    long long rngDraws = 0;         // 64-bit random numbers used
+    double gainSum = 0.0;           // gains of the pulses and their squares, for the
+    double gainSquares = 0.0;       // scintillation index the fading actually produced
+    std::vector<long long> histogram = std::vector<long long>(RUN_REPORT_HISTOGRAM_BINS, 0); // pulses by photon count
+};
+
+// Where the pipeline sends each finished block, in order: where it starts, its size and its
+// non-empty slots in increasing order
+class PipelineSink {
+public:
+    virtual ~PipelineSink() = default;
+    virtual void writeBlock(long long first_slot, long long slots, const std::vector<PhotonSlot>& events) = 0;
+    virtual void finish() = 0;
+};
+
+// Writes the detected slots as pulses to a block sink (RLE text, container or event stream)
+class DetectionSink : public PipelineSink {
+public:
+    explicit DetectionSink(BlockSink& output) : output(output) {}
+    void writeBlock(long long first_slot, long long slots, const std::vector<PhotonSlot>& events) override;
+    void finish() override;
+
+private:
+    BlockSink& output;
+    std::vector<long long> detected;
+};
+
+// Writes the photon count of every slot to a container
+class PhotonCountSink : public PipelineSink {
+public:
+    explicit PhotonCountSink(ContainerBlockWriter& output) : output(output) {}
+    void writeBlock(long long first_slot, long long slots, const std::vector<PhotonSlot>& events) override;
+    void finish() override;
+
+private:
+    ContainerBlockWriter& output;
+    std::vector<uint32_t> pairs;
+};
+
+// Writes the photon count of every non-empty slot to an event stream
+class PhotonEventSink : public PipelineSink {
+public:
+    explicit PhotonEventSink(EventBlockWriter& output) : output(output) {}
+    void writeBlock(long long first_slot, long long slots, const std::vector<PhotonSlot>& events) override;
+    void finish() override;
+
+private:
+    EventBlockWriter& output;
+    std::vector<SlotEvent> counts;
+};
+
+class ChannelPipeline {
+public:
+    void add(std::unique_ptr<PipelineStage> stage) {
+        stages.push_back(std::move(stage));
+    }
+
+    // Fades the signal of every pulse with the given process (no fading by default)
+    void setFading(std::unique_ptr<FadingProcess> process) {
+        fading = std::move(process);
+    }
+
+    // Runs the stages over one block of the given length starting at first_slot, with its pulses
+    // listed in increasing order, and returns its non-empty slots. Only the pulses and the slots
+    // the stages light up on their own are visited. If draws is given, the random numbers used
+    // are added to it.
+    void runPulses(const std::vector<long long>& pulses, long long first_slot, long long slots, uint64_t seed,
+        std::vector<PhotonSlot>& events, long long* draws = nullptr) const;
+
+    // Streams the whole source through the stages into the sink, a batch of blocks at a time.
+    // If report is given, reading, the stages and writing are timed in it and its totals are
+    // kept up to date for the progress line.
+    PipelineStats run(BlockSource& source, PipelineSink& sink, long long block_slots, uint64_t seed,
+        ThreadPool& pool, run_report* report = nullptr) const;
+
+private:
+    std::vector<std::unique_ptr<PipelineStage>> stages;
+    std::unique_ptr<FadingProcess> fading;
+};
@@ -0,0 +1,270 @@
+#include "Detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+// Random streams for the detector, clear of the channel and PPM stages
+const uint32_t detector_arrival_stage = 0x400;     // arrival times and pixels of one slot's photons
+const uint32_t detector_dark_stage = 0x401;        // dark counts in one segment
+const uint32_t detector_afterpulse_stage = 0x402;  // afterpulse of one detection
+
+// Jitter past this many standard deviations is cut off, which bounds how far a photon
+// can move and so how long a block has to be held back
+const double jitter_cutoff = 8.0;
+
+// M_PI is not standard C++
+constexpr double pi = 3.14159265358979323846;
+
+// 53 random bits mapped onto [0, 1)
+static double uniform(Philox& rng) {
+    return (double)(rng() >> 11) * 0x1.0p-53;
+}
+
+// 53 random bits mapped onto (0, 1], so the logarithm is always finite
+static double positiveUniform(Philox& rng) {
+    return (double)((rng() >> 11) + 1) * 0x1.0p-53;
+}
+
+// Standard normal by Box-Muller from two uniforms, so a seed gives the same jitter with
+// every standard library
+static double gaussian(Philox& rng) {
+    double radius = std::sqrt(-2.0 * std::log(positiveUniform(rng)));
+    double angle = uniform(rng) * 2.0 * pi;
+    return radius * std::cos(angle);
+}
+
+bool DetectorModel::parse(const std::string& text, DetectorModel& model) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(start, end - start);
+        start = end + 1;
+
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string name = item.substr(0, equals);
+        std::string value = item.substr(equals + 1);
+        char* parsed = nullptr;
+        double number = std::strtod(value.c_str(), &parsed);
+        if (value.empty() || *parsed != '\0' || number < 0) {
+            return false;
+        }
+
+        if (name == "dead") {
+            model.deadTime = number;
+        }
+        else if (name == "dark") {
+            model.darkRate = number;
+        }
+        else if (name == "afterpulse") {
+            if (number > 1) {
+                return false;
+            }
+            model.afterpulseProbability = number;
+        }
+        else if (name == "delay") {
+            model.afterpulseDelay = number;
+        }
+        else if (name == "jitter") {
+            model.jitter = number;
+        }
+        else if (name == "pixels") {
+            if (number < 1 || number > 65536) {
+                return false;
+            }
+            model.pixels = (int)number;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+SinglePhotonDetector::SinglePhotonDetector(const DetectorModel& model, uint64_t seed, PipelineSink& output)
+    : model(model), seed(seed), output(output), maxJitter(jitter_cutoff * model.jitter),
+      recovered(model.pixels, -std::numeric_limits<double>::infinity()) {}
+
+void SinglePhotonDetector::writeBlock(long long first_slot, long long slots, const std::vector<PhotonSlot>& events) {
+    PendingBlock block;
+    block.first_slot = first_slot;
+    block.slots = slots;
+    for (const PhotonSlot& event : events) {
+        if (event.pulse) {
+            block.pulses.push_back(event.slot);
+        }
+    }
+    pending.push_back(std::move(block));
+
+    addArrivals(events);
+    addDarkCounts(first_slot, slots);
+
+    // Photons from later blocks can arrive up to maxJitter before this block ends
+    double settled = (double)(first_slot + slots) - maxJitter;
+    detectUntil(settled);
+    emitReady(settled);
+}
+
+void SinglePhotonDetector::finish() {
+    if (!pending.empty()) {
+        // Anything arriving after the last slot is lost with it
+        double end = (double)(pending.back().first_slot + pending.back().slots);
+        detectUntil(end);
+        emitReady(end);
+    }
+    output.finish();
+}
+
+void SinglePhotonDetector::addArrivals(const std::vector<PhotonSlot>& events) {
+    for (const PhotonSlot& event : events) {
+        int photons = event.signal + event.background;
+        if (photons == 0) {
+            continue;
+        }
+        Philox rng(seed, detector_arrival_stage, (uint64_t)event.slot);
+        for (int i = 0; i < photons; i++) {
+            Arrival arrival;
+            arrival.source = (i < event.signal) ? signal_photon : background_photon;
+            // The pulse is short next to a slot; background light is spread over it
+            arrival.time = (double)event.slot + (arrival.source == signal_photon ? 0.5 : uniform(rng));
+            if (model.jitter > 0.0) {
+                arrival.time += std::max(-maxJitter, std::min(maxJitter, model.jitter * gaussian(rng)));
+            }
+            arrival.time = std::max(arrival.time, 0.0);
+            arrival.order = (uint64_t)i;
+            arrival.origin = event.slot;
+            arrival.pixel = (model.pixels > 1) ? (int)(((rng() >> 32) * (uint64_t)model.pixels) >> 32) : 0;
+            arrivals.push(arrival);
+        }
+        totals.arrivals += photons;
+        totals.rngDraws += (long long)rng.draws();
+    }
+}
+
+void SinglePhotonDetector::addDarkCounts(long long first_slot, long long slots) {
+    if (model.darkRate <= 0.0) {
+        return;
+    }
+    long long end = first_slot + slots;
+    for (long long segment = first_slot / rng_segment_slots; segment * rng_segment_slots < end; segment++) {
+        Philox rng(seed, detector_dark_stage, (uint64_t)segment);
+        long long segment_start = segment * rng_segment_slots;
+        double segment_end = (double)std::min(segment_start + rng_segment_slots, end);
+
+        // A block can start part way into a segment, so replay the segment from its start
+        double time = (double)segment_start;
+        while (true) {
+            time += -std::log(positiveUniform(rng)) / model.darkRate;
+            if (time >= segment_end) {
+                break;
+            }
+            int pixel = (model.pixels > 1) ? (int)(((rng() >> 32) * (uint64_t)model.pixels) >> 32) : 0;
+            if (time >= (double)first_slot) {
+                Arrival arrival;
+                arrival.time = time;
+                arrival.order = 0;
+                arrival.origin = (long long)time;
+                arrival.pixel = pixel;
+                arrival.source = dark_count;
+                arrivals.push(arrival);
+                totals.darkCounts++;
+            }
+        }
+        totals.rngDraws += (long long)rng.draws();
+    }
+}
+
+// Walks the arrivals before the given time in order through the dead time of their pixels
+void SinglePhotonDetector::detectUntil(double time) {
+    while (!arrivals.empty() && arrivals.top().time < time) {
+        Arrival arrival = arrivals.top();
+        arrivals.pop();
+        if (arrival.time < recovered[arrival.pixel]) {
+            totals.blocked++;
+            continue;
+        }
+        recovered[arrival.pixel] = arrival.time + model.deadTime;
+
+        Click click;
+        click.slot = (long long)arrival.time;
+        click.signal = (arrival.source == signal_photon);
+        clicks.push_back(click);
+        if ((arrival.source == signal_photon || arrival.source == background_photon) && click.slot != arrival.origin) {
+            totals.shifted++;
+        }
+
+        if (model.afterpulseProbability > 0.0) {
+            Philox rng(seed, detector_afterpulse_stage, (uint64_t)totals.detections);
+            if (uniform(rng) < model.afterpulseProbability) {
+                // A trapped carrier is released some time after the pixel has recovered
+                Arrival echo;
+                echo.time = recovered[arrival.pixel];
+                if (model.afterpulseDelay > 0.0) {
+                    echo.time += -std::log(positiveUniform(rng)) * model.afterpulseDelay;
+                }
+                echo.order = 0;
+                echo.origin = click.slot;
+                echo.pixel = arrival.pixel;
+                echo.source = afterpulse;
+                arrivals.push(echo);
+                totals.afterpulses++;
+            }
+            totals.rngDraws += (long long)rng.draws();
+        }
+        totals.detections++;
+    }
+}
+
+// Passes on every pending block that no later arrival can reach
+void SinglePhotonDetector::emitReady(double time) {
+    while (!pending.empty() && (double)(pending.front().first_slot + pending.front().slots) <= time) {
+        emitBlock(pending.front());
+        pending.pop_front();
+    }
+}
+
+void SinglePhotonDetector::emitBlock(const PendingBlock& block) {
+    long long end = block.first_slot + block.slots;
+    out.clear();
+    size_t pulse = 0;
+    while (pulse < block.pulses.size() || (!clicks.empty() && clicks.front().slot < end)) {
+        // Next slot holding a pulse or a click
+        long long slot = std::numeric_limits<long long>::max();
+        if (pulse < block.pulses.size()) {
+            slot = block.pulses[pulse];
+        }
+        if (!clicks.empty() && clicks.front().slot < end) {
+            slot = std::min(slot, clicks.front().slot);
+        }
+
+        PhotonSlot event;
+        event.slot = slot;
+        if (pulse < block.pulses.size() && block.pulses[pulse] == slot) {
+            event.pulse = true;
+            pulse++;
+        }
+        while (!clicks.empty() && clicks.front().slot == slot) {
+            if (clicks.front().signal) {
+                event.signal++;
+            }
+            else {
+                event.background++;
+            }
+            clicks.pop_front();
+        }
+        event.detected = model.threshold > 0 && event.photons() >= model.threshold;
+
+        totals.detectedSlots += event.detected;
+        totals.missedPulses += event.pulse && !event.detected;
+        totals.falseDetections += !event.pulse && event.detected;
+        out.push_back(event);
+    }
+    output.writeBlock(block.first_slot, block.slots, out);
+}
@@ -0,0 +1,120 @@
+// Detector.h
+//
+// Event-driven model of the single-photon detector (SPAD or SNSPD array) at the end of
+// the channel pipeline.
+//
+// The pipeline stages give each slot a number of signal and background photons. The
+// detector turns those into a time-ordered list of photon arrivals, in units of slots:
+// a pulse's photons arrive at the centre of its slot and background photons anywhere in
+// theirs, each moved by Gaussian timing jitter. Dark counts are added as a Poisson process
+// in time. Each arrival lands on a random pixel. The list is then walked in time order:
+// a pixel that fired less than the dead time ago misses the photon, and every detection
+// may be followed by an afterpulse on the same pixel once it recovers. The detections
+// are binned back into slots and handed to the next sink.
+//
+// Only photon events are touched, so the cost follows the number of photons and dark
+// counts, not the number of slots. Dead time, jitter and afterpulses reach across block
+// edges, so the walk runs in order over the whole stream and each block is held back
+// until every arrival that could land in it has been seen. Random numbers are keyed by
+// slot, by dark-count segment and by detection number, so the output does not depend
+// on the block size or thread count.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "ChannelPipeline.h"
+
+struct DetectorModel {
+    double deadTime = 0.0;              // slots a pixel is blind for after a detection
+    double darkRate = 0.0;              // dark counts per slot over the whole array
+    double afterpulseProbability = 0.0; // chance that a detection is followed by an afterpulse
+    double afterpulseDelay = 0.0;       // mean wait for the afterpulse once the pixel recovers, in slots
+    double jitter = 0.0;                // standard deviation of the timing jitter, in slots
+    int pixels = 1;                     // pixels the light is spread over, each with its own dead time
+    int threshold = 1;                  // detections for a slot to count as detected, 0 to keep only the counts
+
+    // Parses "dead=40,dark=1e-6,afterpulse=0.01,delay=10,jitter=0.2,pixels=4" (any subset, in
+    // any order). Returns false for an unknown name or a bad value.
+    static bool parse(const std::string& text, DetectorModel& model);
+};
+
+// Totals over a run
+struct DetectorStats {
+    long long arrivals = 0;         // signal and background photons reaching the detector
+    long long darkCounts = 0;
+    long long afterpulses = 0;
+    long long blocked = 0;          // arrivals that hit a pixel during its dead time
+    long long detections = 0;       // clicks, from any source
+    long long shifted = 0;          // photon detections binned into a neighbouring slot by jitter
+    long long detectedSlots = 0;    // slots with at least threshold clicks
+    long long missedPulses = 0;     // pulses whose slot was not detected
+    long long falseDetections = 0;  // detected slots without a pulse
+    long long rngDraws = 0;         // 64-bit random numbers used
+};
+
+// Runs the detector over the pipeline's output and passes the detections on to output.
+// A slot's signal count is its clicks from signal photons and its background count is
+// every other click (background, dark counts and afterpulses).
+class SinglePhotonDetector : public PipelineSink {
+public:
+    SinglePhotonDetector(const DetectorModel& model, uint64_t seed, PipelineSink& output);
+
+    void writeBlock(long long first_slot, long long slots, const std::vector<PhotonSlot>& events) override;
+    void finish() override;
+
+    const DetectorStats& stats() const {
+        return totals;
+    }
+
+private:
+    enum Source { signal_photon, background_photon, dark_count, afterpulse };
+
+    struct Arrival {
+        double time;        // in slots from the start of the stream
+        uint64_t order;     // breaks ties between photons of one slot
+        long long origin;   // slot the photon was sent in
+        int pixel;
+        Source source;
+
+        bool operator>(const Arrival& other) const {
+            return time > other.time || (time == other.time && order > other.order);
+        }
+    };
+
+    // A block waiting for its detections
+    struct PendingBlock {
+        long long first_slot;
+        long long slots;
+        std::vector<long long> pulses; // pulse slots in increasing order
+    };
+
+    // A click, binned into its slot
+    struct Click {
+        long long slot;
+        bool signal;
+    };
+
+    void addArrivals(const std::vector<PhotonSlot>& events);
+    void addDarkCounts(long long first_slot, long long slots);
+    void detectUntil(double time);
+    void emitReady(double time);
+    void emitBlock(const PendingBlock& block);
+
+    DetectorModel model;
+    uint64_t seed;
+    PipelineSink& output;
+    double maxJitter;       // jitter is cut off at 8 standard deviations
+
+    std::priority_queue<Arrival, std::vector<Arrival>, std::greater<Arrival>> arrivals;
+    std::vector<double> recovered;  // time each pixel can fire again
+    std::deque<PendingBlock> pending;
+    std::deque<Click> clicks;       // in time order, so in slot order too
+    std::vector<PhotonSlot> out;
+    DetectorStats totals;
+};
@@ -0,0 +1,134 @@
+#include "EventStream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Events decoded per event_stream_read() call
+const size_t event_batch = 4096;
+
+bool isEventStream(const std::string& filename) {
+    std::ifstream input(filename, std::ios::binary);
+    char magic[4] = {};
+    input.read(magic, sizeof(magic));
+    return input.gcount() == sizeof(magic) && std::memcmp(magic, EVENT_STREAM_MAGIC, sizeof(magic)) == 0;
+}
+
+EventBlockReader::EventBlockReader(const std::string& filename)
+    : slotBuffer(event_batch), countBuffer(event_batch) {
+    open = (event_stream_open(&reader, filename.c_str()) == 0);
+}
+
+EventBlockReader::~EventBlockReader() {
+    if (open) {
+        event_stream_close_reader(&reader);
+    }
+}
+
+bool EventBlockReader::readEvents(std::vector<SlotEvent>& events, long long& slots, long long maxSlots) {
+    events.clear();
+    slots = std::min(maxSlots, (long long)reader.header.total_slots - nextSlot);
+    if (slots <= 0) {
+        slots = 0;
+        return false;
+    }
+    long long end = nextSlot + slots;
+    while (true) {
+        long got = event_stream_read(&reader, (uint64_t)end, slotBuffer.data(), countBuffer.data(), event_batch);
+        if (got < 0) {
+            std::cerr << "The event stream is corrupt after slot " << reader.next_slot << std::endl;
+            events.clear();
+            slots = 0;
+            ok = false;
+            return false;
+        }
+        for (long i = 0; i < got; i++) {
+            events.push_back({ (long long)slotBuffer[i], countBuffer[i] });
+        }
+        if ((size_t)got < event_batch) {
+            break;
+        }
+    }
+    nextSlot = end;
+    return true;
+}
+
+bool EventBlockReader::readPulses(std::vector<long long>& pulses, long long, long long& slots, long long maxSlots) {
+    pulses.clear();
+    if (!readEvents(blockEvents, slots, maxSlots)) {
+        return false;
+    }
+    for (const SlotEvent& event : blockEvents) {
+        pulses.push_back(event.slot);
+    }
+    return true;
+}
+
+bool EventBlockReader::readBlock(SlotBitmap& block, long long maxSlots) {
+    long long first_slot = nextSlot;
+    long long slots;
+    block.clear();
+    if (!readEvents(blockEvents, slots, maxSlots)) {
+        return false;
+    }
+    block.appendZeros(slots);
+    for (const SlotEvent& event : blockEvents) {
+        block.set(event.slot - first_slot);
+    }
+    return true;
+}
+
+int EventBlockReader::nextEvent(SlotEvent& event) {
+    uint64_t slot;
+    int status = event_stream_next(&reader, &slot, &event.count);
+    event.slot = (long long)slot;
+    ok = ok && (status >= 0);
+    return status;
+}
+
+EventBlockWriter::EventBlockWriter(const std::string& filename, double mean_photons, uint64_t seed) {
+    open = (event_stream_create(&writer, filename.c_str(), mean_photons, seed) == 0);
+    ok = open;
+}
+
+EventBlockWriter::~EventBlockWriter() {
+    if (open) {
+        finish();
+    }
+}
+
+void EventBlockWriter::writeBlock(const SlotBitmap& block) {
+    long long first_slot = nextSlot;
+    block.forEachOne([&](long long slot) {
+        if (event_stream_write(&writer, (uint64_t)(first_slot + slot), 1) != 0) {
+            ok = false;
+        }
+    });
+    nextSlot += block.size();
+}
+
+void EventBlockWriter::writePulses(const std::vector<long long>& pulses, long long first_slot, long long slots) {
+    for (long long slot : pulses) {
+        if (event_stream_write(&writer, (uint64_t)slot, 1) != 0) {
+            ok = false;
+        }
+    }
+    nextSlot = first_slot + slots;
+}
+
+void EventBlockWriter::writeCounts(const std::vector<SlotEvent>& counts, long long first_slot, long long slots) {
+    for (const SlotEvent& event : counts) {
+        if (event_stream_write(&writer, (uint64_t)event.slot, event.count) != 0) {
+            ok = false;
+        }
+    }
+    nextSlot = first_slot + slots;
+}
+
+void EventBlockWriter::finish() {
+    if (event_stream_close(&writer, (uint64_t)nextSlot) != 0) {
+        ok = false;
+    }
+    open = false;
+}
@@ -0,0 +1,105 @@
+// EventStream.h
+//
+// Block source and sink for sparse .events streams, shared with the photon generator
+// (Ian's Work/event_stream.h). A stream lists only the occupied slots, each as a 64-bit
+// slot index and a count, so blocks are read and written as lists of pulses and nothing
+// proportional to the number of slots is ever held in memory.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BlockStream.h"
+#include "SlotBitmap.h"
+#include "event_stream.h"
+
+// One occupied slot and what it holds (1 for a pulse, the photons for a count stream)
+struct SlotEvent {
+    long long slot;
+    uint32_t count;
+};
+
+// True if the file starts with the event stream magic
+bool isEventStream(const std::string& filename);
+
+class EventBlockReader : public BlockSource {
+public:
+    // Check isOpen() before use
+    explicit EventBlockReader(const std::string& filename);
+    ~EventBlockReader();
+
+    EventBlockReader(const EventBlockReader&) = delete;
+    EventBlockReader& operator=(const EventBlockReader&) = delete;
+
+    bool isOpen() const {
+        return open;
+    }
+
+    const event_stream_header& header() const {
+        return reader.header;
+    }
+
+    // False once a read has found the stream corrupt
+    bool good() const override {
+        return ok;
+    }
+
+    // The occupied slots of the next maxSlots slots, whatever their counts (photon counts
+    // collapse to a single pulse). Returns false at the end or if the stream is corrupt.
+    bool readEvents(std::vector<SlotEvent>& events, long long& slots, long long maxSlots);
+
+    bool readPulses(std::vector<long long>& pulses, long long first_slot, long long& slots, long long maxSlots) override;
+    bool readBlock(SlotBitmap& block, long long maxSlots) override;
+
+    // One event at a time, for readers that don't work in blocks. Returns 1, 0 at the end
+    // of the stream or -1 if it is corrupt. Don't mix with the block reads.
+    int nextEvent(SlotEvent& event);
+
+    bool sparse() const override {
+        return true;
+    }
+
+private:
+    event_stream_reader reader;
+    bool open = false;
+    bool ok = true;
+    long long nextSlot = 0;          // first slot of the next block
+    std::vector<uint64_t> slotBuffer; // event_stream_read() output
+    std::vector<uint32_t> countBuffer;
+    std::vector<SlotEvent> blockEvents;
+};
+
+class EventBlockWriter : public BlockSink {
+public:
+    // mean_photons and seed are only recorded in the header
+    EventBlockWriter(const std::string& filename, double mean_photons, uint64_t seed);
+    ~EventBlockWriter();
+
+    EventBlockWriter(const EventBlockWriter&) = delete;
+    EventBlockWriter& operator=(const EventBlockWriter&) = delete;
+
+    bool isOpen() const {
+        return open;
+    }
+
+    void writeBlock(const SlotBitmap& block) override;
+    void writePulses(const std::vector<long long>& pulses, long long first_slot, long long slots) override;
+    void finish() override;
+
+    // Writes a block of the given length starting at first_slot from its occupied slots and
+    // their counts, in increasing slot order
+    void writeCounts(const std::vector<SlotEvent>& counts, long long first_slot, long long slots);
+
+    // False if any write failed
+    bool good() const {
+        return ok;
+    }
+
+private:
+    event_stream_writer writer;
+    bool open = false;
+    bool ok = true;
+    long long nextSlot = 0; // first slot of the next block
+};
@@ -0,0 +1,298 @@
+#include "Fading.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "philox.h"
+
+// Random streams for the fading processes, clear of the channel, PPM and detector stages
+const uint32_t fading_stage = 0x500;            // the (log-normal or large-scale gamma) Gaussian process
+const uint32_t fading_small_scale_stage = 0x501; // the small-scale gamma process
+
+// M_PI is not standard C++
+constexpr double pi = 3.14159265358979323846;
+
+// Coarse points per coherence time. The gain moves by a few percent between points, so linear
+// interpolation between them is well inside the spread of a Poisson photon count.
+const double points_per_coherence = 16.0;
+
+// The filter is cut off this many of its standard deviations from the centre
+const double filter_cutoff = 3.0;
+
+// Gaussian values past this are clamped before they are mapped onto a gamma distribution,
+// which keeps the tail probabilities representable
+const double gaussian_cutoff = 8.0;
+
+// Intervals of the gamma quantile tables over [-gaussian_cutoff, gaussian_cutoff]. The log of
+// the quantile is smooth in the Gaussian value, so linear interpolation over intervals of 1/128
+// is good to a few parts in 10^5 even for shapes well below 1.
+const int quantile_intervals = 2048;
+
+bool FadingModel::parse(const std::string& text, FadingModel& model) {
+    model = FadingModel();
+    bool named = false;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(start, end - start);
+        start = end + 1;
+
+        if (!named) {
+            if (item == "lognormal") {
+                model.kind = lognormal;
+            }
+            else if (item == "gamma") {
+                model.kind = gamma_gamma;
+            }
+            else {
+                return false;
+            }
+            named = true;
+            continue;
+        }
+
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string name = item.substr(0, equals);
+        std::string value = item.substr(equals + 1);
+        char* parsed = nullptr;
+        double number = std::strtod(value.c_str(), &parsed);
+        if (value.empty() || *parsed != '\0' || !(number > 0) || std::isinf(number)) {
+            return false;
+        }
+
+        if (name == "index" && model.kind == lognormal) {
+            model.scintillationIndex = number;
+        }
+        else if (name == "alpha" && model.kind == gamma_gamma) {
+            model.alpha = number;
+        }
+        else if (name == "beta" && model.kind == gamma_gamma) {
+            model.beta = number;
+        }
+        else if (name == "coherence") {
+            model.coherence = number;
+        }
+        else {
+            return false;
+        }
+    }
+    if (model.kind == gamma_gamma && (model.alpha == 0 || model.beta == 0)) {
+        return false;
+    }
+    return named && model.coherence > 0;
+}
+
+double FadingModel::expectedScintillationIndex() const {
+    if (kind == lognormal) {
+        return scintillationIndex;
+    }
+    return 1.0 / alpha + 1.0 / beta + 1.0 / (alpha * beta);
+}
+
+// Regularised incomplete gamma functions P(a, x) and Q(a, x) = 1 - P(a, x): the series below
+// a + 1 and the continued fraction above it, each of which is accurate for the smaller of the two
+// where it is used
+static void incompleteGamma(double a, double x, double& lower, double& upper) {
+    if (x <= 0.0) {
+        lower = 0.0;
+        upper = 1.0;
+        return;
+    }
+    double front = std::exp(a * std::log(x) - x - std::lgamma(a));
+    if (x < a + 1.0) {
+        double term = 1.0 / a;
+        double sum = term;
+        for (int n = 1; n < 1000 && term > sum * 1e-16; n++) {
+            term *= x / (a + n);
+            sum += term;
+        }
+        lower = sum * front;
+        upper = 1.0 - lower;
+    }
+    else {
+        // Lentz's method
+        const double tiny = 1e-300;
+        double b = x + 1.0 - a;
+        double c = 1.0 / tiny;
+        double d = 1.0 / b;
+        double fraction = d;
+        for (int n = 1; n < 1000; n++) {
+            double an = -n * (n - a);
+            b += 2.0;
+            d = an * d + b;
+            d = 1.0 / (std::fabs(d) < tiny ? tiny : d);
+            c = b + an / c;
+            c = std::fabs(c) < tiny ? tiny : c;
+            fraction *= d * c;
+            if (std::fabs(d * c - 1.0) < 1e-15) {
+                break;
+            }
+        }
+        upper = fraction * front;
+        lower = 1.0 - upper;
+    }
+}
+
+// The unit-mean gamma variate (shape a, scale 1/a) at the same point of its distribution as the
+// unit Gaussian x. Newton steps on whichever tail is the smaller, from the Wilson-Hilferty
+// approximation (or the small-x series when that comes out negative).
+static double unitGamma(double a, double x) {
+    x = std::max(-gaussian_cutoff, std::min(gaussian_cutoff, x));
+    double tail = 0.5 * std::erfc(std::fabs(x) / std::sqrt(2.0));
+    double logGamma = std::lgamma(a);
+
+    double root = 1.0 - 1.0 / (9.0 * a) + x / (3.0 * std::sqrt(a));
+    double g = a * root * root * root;
+    if (root <= 0.0 || (x < 0.0 && g < 0.1 * a)) {
+        g = std::exp((std::log(tail) + std::lgamma(a + 1.0)) / a); // P(a, g) ~ g^a / Gamma(a + 1)
+    }
+    for (int i = 0; i < 50; i++) {
+        double lower, upper;
+        incompleteGamma(a, g, lower, upper);
+        double error = (x < 0.0) ? lower - tail : tail - upper; // rises with g either way
+        double density = std::exp((a - 1.0) * std::log(g) - g - logGamma);
+        double next = g - error / density;
+        if (!std::isfinite(next)) {
+            break;
+        }
+        next = std::max(next, 0.5 * g);
+        bool converged = std::fabs(next - g) <= 1e-12 * g;
+        g = next;
+        if (converged) {
+            break;
+        }
+    }
+    return g / a;
+}
+
+// Tabulates ln unitGamma(a, x) over the clamped range of x
+static std::vector<double> quantileTable(double a) {
+    std::vector<double> table(quantile_intervals + 1);
+    for (int i = 0; i <= quantile_intervals; i++) {
+        double x = gaussian_cutoff * (2.0 * i / quantile_intervals - 1.0);
+        table[(size_t)i] = std::log(unitGamma(a, x));
+    }
+    return table;
+}
+
+// The unit gamma variate for the Gaussian x, from a table made by quantileTable()
+static double lookupGamma(const std::vector<double>& table, double x) {
+    double position = (std::max(-gaussian_cutoff, std::min(gaussian_cutoff, x)) + gaussian_cutoff) *
+        (0.5 * quantile_intervals / gaussian_cutoff);
+    int i = std::min((int)position, quantile_intervals - 1);
+    double fraction = position - i;
+    return std::exp(table[(size_t)i] + fraction * (table[(size_t)i + 1] - table[(size_t)i]));
+}
+
+FadingProcess::FadingProcess(const FadingModel& model, uint64_t seed) : fading(model), seed(seed) {
+    // Short coherence times still get a point per slot at most
+    step = std::max(fading.coherence / points_per_coherence, 1.0);
+    sigma = std::sqrt(std::log1p(fading.scintillationIndex));
+
+    // White noise through a Gaussian filter of standard deviation s points has the autocorrelation
+    // exp(-tau^2 / 4 s^2), which falls to 1/e at one coherence time for s = coherence / 2
+    double width = fading.coherence / (2.0 * step);
+    reach = std::max((long long)std::ceil(filter_cutoff * width), 1LL);
+    double squares = 0.0;
+    for (long long k = -reach; k <= reach; k++) {
+        double tap = std::exp(-0.5 * (double)(k * k) / (width * width));
+        taps.push_back(tap);
+        squares += tap * tap;
+    }
+    for (double& tap : taps) {
+        tap /= std::sqrt(squares);
+    }
+
+    if (fading.kind == FadingModel::gamma_gamma) {
+        largeScale = quantileTable(fading.alpha);
+        smallScale = quantileTable(fading.beta);
+    }
+}
+
+// A unit Gaussian by Box-Muller from the point's own random numbers
+static double whiteNoise(uint64_t seed, uint32_t stream, long long point) {
+    Philox rng(seed, stream, (uint64_t)point);
+    double radius = std::sqrt(-2.0 * std::log((double)((rng() >> 11) + 1) * 0x1.0p-53));
+    double angle = (double)(rng() >> 11) * 0x1.0p-53 * 2.0 * pi;
+    return radius * std::cos(angle);
+}
+
+void FadingProcess::gaussian(uint32_t stream, const std::vector<long long>& points, std::vector<double>& values,
+    long long* draws) const {
+    values.resize(points.size());
+    std::vector<double> noise;
+    size_t i = 0;
+    while (i < points.size()) {
+        // Points whose filter windows overlap or touch share one stretch of noise
+        size_t end = i + 1;
+        while (end < points.size() && points[end] - points[end - 1] <= 2 * reach + 1) {
+            end++;
+        }
+        long long first = points[i] - reach;
+        noise.resize((size_t)(points[end - 1] + reach - first + 1));
+        for (size_t j = 0; j < noise.size(); j++) {
+            noise[j] = whiteNoise(seed, stream, first + (long long)j);
+        }
+        if (draws != nullptr) {
+            *draws += 2 * (long long)noise.size();
+        }
+
+        for (; i < end; i++) {
+            const double* window = &noise[(size_t)(points[i] - reach - first)];
+            double sum = 0.0;
+            for (size_t k = 0; k < taps.size(); k++) {
+                sum += taps[k] * window[k];
+            }
+            values[i] = sum;
+        }
+    }
+}
+
+void FadingProcess::sample(const std::vector<long long>& pulses, std::vector<double>& gains, long long* draws) const {
+    // The points either side of each pulse. Each point depends only on the noise around it, so
+    // working out just these gives the same gains as working out every point of the block.
+    std::vector<long long> points;
+    for (long long slot : pulses) {
+        long long point = (long long)((double)slot / step);
+        if (points.empty() || points.back() < point) {
+            points.push_back(point);
+        }
+        if (points.back() < point + 1) {
+            points.push_back(point + 1);
+        }
+    }
+
+    std::vector<double> x, y;
+    gaussian(fading_stage, points, x, draws);
+    if (fading.kind == FadingModel::gamma_gamma) {
+        gaussian(fading_small_scale_stage, points, y, draws);
+    }
+    std::vector<double> pointGains(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        if (fading.kind == FadingModel::lognormal) {
+            pointGains[i] = std::exp(sigma * x[i] - 0.5 * sigma * sigma);
+        }
+        else {
+            pointGains[i] = lookupGamma(largeScale, x[i]) * lookupGamma(smallScale, y[i]);
+        }
+    }
+
+    // Linear interpolation between the two points either side of each pulse
+    gains.resize(pulses.size());
+    size_t k = 0;
+    for (size_t i = 0; i < pulses.size(); i++) {
+        double position = (double)pulses[i] / step;
+        long long point = (long long)position;
+        while (points[k] < point) {
+            k++;
+        }
+        gains[i] = pointGains[k] + (position - (double)point) * (pointGains[k + 1] - pointGains[k]);
+    }
+}
@@ -0,0 +1,72 @@
+// Fading.h
+//
+// Time-correlated scintillation of the received light for the channel pipeline.
+//
+// Atmospheric turbulence makes the irradiance at the receiver wander about its mean over a
+// coherence time that is many slots long. The fading process gives every slot a gain, the
+// irradiance relative to its mean, which scales the mean number of signal photons of a pulse.
+// Two distributions are offered:
+//   - log-normal (weak turbulence): I = exp(sigma X - sigma^2 / 2) with sigma^2 = ln(1 + SI),
+//     where SI is the scintillation index (the variance of I) and X a unit Gaussian process
+//   - gamma-gamma (moderate to strong turbulence): I = X Y, the product of two unit-mean gamma
+//     processes with shapes alpha (large eddies) and beta (small eddies), each a Gaussian
+//     process mapped onto its gamma distribution through the two CDFs; SI = 1/alpha + 1/beta + 1/(alpha beta)
+//
+// The Gaussian processes have the autocorrelation exp(-(tau / coherence)^2). They are made at a
+// coarse resolution, points_per_coherence points per coherence time, by running white noise
+// through a Gaussian FIR filter, and the gain is interpolated linearly between the points.
+// The white noise of each point comes from Philox keyed by the seed and the point's index,
+// so any point can be made on its own: a block works out only the points either side of its
+// pulses, and the noise they are filtered from, and then costs one interpolation per pulse.
+// The fading is the same for any block size or thread count. The gamma quantiles are
+// tabulated once per shape, so mapping a point costs a table lookup rather than a root search.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FadingModel {
+    enum Kind { lognormal, gamma_gamma };
+
+    Kind kind = lognormal;
+    double scintillationIndex = 0.0;    // log-normal: variance of the normalised irradiance
+    double alpha = 0.0;                 // gamma-gamma: shape of the large-scale process
+    double beta = 0.0;                  // gamma-gamma: shape of the small-scale process
+    double coherence = 0.0;             // slots over which the correlation falls to 1/e
+
+    // Parses "lognormal,index=0.3,coherence=1e6" or "gamma,alpha=4,beta=2,coherence=1e6" (the
+    // named values in any order). Returns false for an unknown name, a missing value or a bad one.
+    static bool parse(const std::string& text, FadingModel& model);
+
+    // Variance of the normalised irradiance
+    double expectedScintillationIndex() const;
+};
+
+class FadingProcess {
+public:
+    FadingProcess(const FadingModel& model, uint64_t seed);
+
+    // Gives the gain at each of the pulse slots, which are in increasing order. If draws is
+    // given, the random numbers used are added to it.
+    void sample(const std::vector<long long>& pulses, std::vector<double>& gains, long long* draws = nullptr) const;
+
+    const FadingModel& model() const {
+        return fading;
+    }
+
+private:
+    // Unit Gaussian process values of one stream at the given points, which are in increasing order
+    void gaussian(uint32_t stream, const std::vector<long long>& points, std::vector<double>& values,
+        long long* draws) const;
+
+    FadingModel fading;
+    uint64_t seed;
+    double step;                    // slots between coarse points
+    double sigma;                   // log-normal: standard deviation of ln I
+    std::vector<double> taps;       // filter taps, -reach..reach, with unit sum of squares
+    long long reach;
+    std::vector<double> largeScale; // gamma-gamma: ln of the unit gamma variates of each shape at
+    std::vector<double> smallScale; // evenly spaced Gaussian values (see Fading.cpp)
+};
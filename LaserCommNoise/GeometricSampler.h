@@ -0,0 +1,56 @@
+// GeometricSampler.h
+//
+// Draws the distance to the next event in a stream of independent Bernoulli trials.
+//
+// When every slot has the same small probability p of an event, the number of
+// slots without an event before the next one is geometrically distributed:
+//     Pr(gap = k) = (1 - p)^k * p
+// so we can jump straight to the next noisy slot (or erased pulse) instead of
+// rolling a random number for every slot. Sampling is done by inversion,
+//     gap = floor(log(u) / log(1 - p)),   u uniform in (0, 1]
+// with log1p used so probabilities down to ~1e-300 keep full double precision.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+class GeometricSampler {
+public:
+    // Returned when the probability is zero and no event will ever happen
+    static constexpr long long never = std::numeric_limits<long long>::max();
+
+    explicit GeometricSampler(double probability) : probability(probability) {
+        if (probability > 0.0 && probability < 1.0) {
+            logComplement = std::log1p(-probability);
+        }
+    }
+
+    double getProbability() const {
+        return probability;
+    }
+
+    // Number of trials without an event before the next event
+    // Generator must return 64 random bits per call (e.g. std::mt19937_64)
+    template <typename Generator>
+    long long next(Generator& rng) const {
+        if (probability <= 0.0) {
+            return never;
+        }
+        if (probability >= 1.0) {
+            return 0;
+        }
+        // 53 random bits mapped onto (0, 1] so log(u) is always finite
+        double u = (double)((uint64_t(rng()) >> 11) + 1) * 0x1.0p-53;
+        double gap = std::floor(std::log(u) / logComplement);
+        if (gap >= (double)never) {
+            return never;
+        }
+        return (long long)gap;
+    }
+
+private:
+    double probability;
+    double logComplement = 0.0; // log(1 - p)
+};
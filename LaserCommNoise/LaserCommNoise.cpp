@@ -1,21 +1,34 @@
-
-/*
-TODO:
-
-Handle error correction code for command line arguments 
-split code into .h and .cpp
-Adjust probabilites to work on number ~ 10^-5
-
-*/
-
-
-
 #include <iostream>
 #include <fstream> //For reading files
 #include <string>
 #include <vector>
 #include <cstdlib>
 #include <ctime>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <memory>
+#include <sstream>
+
+#include "BlockStream.h"
+#include "ChannelPipeline.h"
+#include "Detector.h"
+#include "Fading.h"
+#include "EventStream.h"
+#include "GeometricSampler.h"
+#include "NoiseModel.h"
+#include "PPMDemodulator.h"
+#include "PPMSymbols.h"
+#include "RLEChannel.h"
+#include "SlotBitmap.h"
+#include "SlotChannel.h"
+#include "SlotContainer.h"
+#include "SlotConvert.h"
+#include "TextCodec.h"
+#include "Sweep.h"
+#include "ThreadPool.h"
+#include "philox.h"
+#include "run_report.h"
 
 // Overloading << Operator to print everything the vector
 template <typename S>
@@ -30,201 +43,961 @@ std::ostream& operator<<(std::ostream& os,
     return os;
 }
 
-// Opens the provided file with error handling
-// Returns vector of signal photons
-std::vector<int> openfile(std::string filename) {
-    std::ifstream inputFile(filename);
-    
-    if (!inputFile.is_open()) {
-        std::cerr << "Unable to open file :C";
-    }
-    
-    std::vector<int> signalPhotons;
-
-    int element;
-
-    //Reads elements from the file and appends them to the vector
-    while (inputFile >> element) {
-        signalPhotons.push_back(element);
-    }
-    
-
-    return signalPhotons;
-}
-
-//Takes in ASCII vector, converts it to binary
-std::vector<int> ASCIItoBinary(std::vector<int> signalPhotons) {
-    // ASCII vectors come in form of <number of zeros> <number of signal photons>
-    std::vector<int> signalBinary;
-
-    int count = 0; // Counter to help us keep track if we are counting zeros or ones
-    
-    for (auto element : signalPhotons) {
-        // for zeros
-        if (count == 0)
-        {
-            for (int i = 0; i < element; i++) {
-                signalBinary.push_back(0);
+// Reads, corrupts and re-encodes the signal a batch of blocks at a time, with the blocks of each
+// batch spread over the thread pool. Only one batch is held in memory, so the input can be any
+// length, and the output is identical for any number of threads. A sparse source (.events or
+// .slots) hands its blocks over as lists of pulses, which are corrupted and written as lists too.
+ChannelStats channelBlocks(BlockSource& reader, BlockSink& writer, double erasure_probability,
+    double noise_probability, long long block_slots, uint64_t seed, ThreadPool& pool, bool verbose,
+    run_report& report) {
+    ChannelStats stats;
+    bool sparse = reader.sparse();
+
+    // Two blocks per thread keeps everyone busy while a slow block finishes
+    std::vector<SlotBitmap> batch(sparse ? 0 : 2 * pool.size());
+    std::vector<std::vector<long long>> batchPulses(sparse ? 2 * pool.size() : 0);
+    std::vector<long long> firstSlots(2 * pool.size());
+    std::vector<ChannelStats> batchStats(firstSlots.size());
+    long long next_slot = 0;
+
+    bool more = true;
+    while (more) {
+        int stage = run_report_begin(&report, "read");
+        size_t blocks = 0;
+        while (blocks < firstSlots.size()) {
+            batchStats[blocks] = ChannelStats();
+            if (sparse) {
+                if (!reader.readPulses(batchPulses[blocks], next_slot, batchStats[blocks].slots, block_slots)) {
+                    break;
+                }
+            }
+            else {
+                if (!reader.readBlock(batch[blocks], block_slots)) {
+                    break;
+                }
+                batchStats[blocks].slots = batch[blocks].size();
             }
-            count = 1; //switching for next case
+            firstSlots[blocks] = next_slot;
+            next_slot += batchStats[blocks].slots;
+            if (verbose) {
+                if (sparse) {
+                    std::cout << batchPulses[blocks] << std::endl;
+                }
+                else {
+                    std::cout << batch[blocks] << std::endl;
+                }
+            }
+            blocks++;
         }
-        else // for signal photons
-        {
-            for (int i = 0; i < element; i++) {
-                signalBinary.push_back(1);
+        more = (blocks == firstSlots.size());
+        run_report_end(&report, stage);
+
+        stage = run_report_begin(&report, "channel");
+        pool.parallelFor((long long)blocks, [&](long long i) {
+            ChannelStats& blockStats = batchStats[i];
+            long long first_slot = firstSlots[i];
+
+            if (sparse) {
+                std::vector<long long>& pulses = batchPulses[i];
+                blockStats.pulses = (long long)pulses.size();
+                blockStats.erasures = signalErasure(pulses, first_slot, blockStats.slots, erasure_probability, seed,
+                    &blockStats.rngDraws);
+                blockStats.noise = signalNoise(pulses, first_slot, blockStats.slots, noise_probability, seed,
+                    &blockStats.rngDraws);
+            }
+            else {
+                SlotBitmap& block = batch[i];
+                blockStats.pulses = block.popcount();
+                blockStats.erasures = signalErasure(block, first_slot, erasure_probability, seed, &blockStats.rngDraws);
+                blockStats.noise = signalNoise(block, first_slot, noise_probability, seed, &blockStats.rngDraws);
+            }
+        });
+        run_report_end(&report, stage);
+
+        stage = run_report_begin(&report, "write");
+        for (size_t i = 0; i < blocks; i++) {
+            if (verbose) {
+                if (sparse) {
+                    std::cout << "\n" << batchPulses[i] << std::endl;
+                }
+                else {
+                    std::cout << "\n" << batch[i] << std::endl;
+                }
+                std::cout << "Occupied slots: " << batchStats[i].pulses << ", erasures: " << batchStats[i].erasures
+                    << ", noise photons: " << batchStats[i].noise << std::endl;
             }
-            count = 0; // switching for the next case
+            if (sparse) {
+                writer.writePulses(batchPulses[i], firstSlots[i], batchStats[i].slots);
+            }
+            else {
+                writer.writeBlock(batch[i]);
+            }
+            stats.slots += batchStats[i].slots;
+            stats.pulses += batchStats[i].pulses;
+            stats.erasures += batchStats[i].erasures;
+            stats.noise += batchStats[i].noise;
+            stats.rngDraws += batchStats[i].rngDraws;
         }
+        run_report_end(&report, stage);
+
+        report.slots = (uint64_t)stats.slots;
+        report.pulses = (uint64_t)stats.pulses;
+        report.rng_draws = (uint64_t)stats.rngDraws;
+        run_report_progress(&report);
     }
+    writer.finish();
 
-    return signalBinary;
+    return stats;
+}
 
+// Size of a file in bytes, 0 if it can't be opened
+static uint64_t fileBytes(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    return file.is_open() ? (uint64_t)file.tellg() : 0;
 }
 
-// Introduces erasures by turning ones into zeros
-std::vector<int> signalErasure(std::vector<int> signalOriginal, double erasure_probability) {
-    // Index through each element of the original signal, roll a random number and if it is higher, erase the value
-   // To safe time, we only have to do this with values that are 1.
-    
-    // Providing a seed value
-    srand((unsigned)time(NULL));
+// Writes the -j report, if one was asked for
+static void writeReport(const run_report& report, const std::string& report_file) {
+    if (!report_file.empty() && run_report_write(&report, report_file.c_str()) != 0) {
+        std::cerr << "Unable to write " << report_file << std::endl;
+    }
+}
 
-    int counter = 0; //used to index elements later
-    int debug_count = 0;
-    //Looping through the original signal
-    for (auto element : signalOriginal) {
-        if (element == 1) { // only worried about slots with signal photons
+// Says so when reading the pulse file stopped on something malformed rather than at its end,
+// since everything after that point is missing from the output
+static bool inputComplete(bool good, const std::string& filename, long long slots) {
+    if (!good) {
+        std::cerr << filename << " is malformed after slot " << slots << ", so the output stops there" << std::endl;
+    }
+    return good;
+}
 
-            // Generate a random number between 0 and 100
-            int random = rand() % 100;
+// Opens a pulse file of any kind: a .slots container or .events stream by its magic, varint RLE
+// and the other stls count files by their names, otherwise RLE text read through inputFile. Returns nullptr if it can't be opened.
+static std::unique_ptr<BlockSource> openPulseSource(const std::string& filename, std::ifstream& inputFile) {
+    if (isSlotContainer(filename)) {
+        std::unique_ptr<ContainerBlockReader> reader(new ContainerBlockReader(filename));
+        return reader->isOpen() ? std::move(reader) : nullptr;
+    }
+    if (isEventStream(filename)) {
+        std::unique_ptr<EventBlockReader> reader(new EventBlockReader(filename));
+        return reader->isOpen() ? std::move(reader) : nullptr;
+    }
+    if (isCountFile(filename)) {
+        std::unique_ptr<CountBlockReader> reader(new CountBlockReader(filename));
+        return reader->isOpen() ? std::move(reader) : nullptr;
+    }
+    inputFile.open(filename);
+    if (!inputFile.is_open()) {
+        return nullptr;
+    }
+    return std::unique_ptr<BlockSource>(new RLEBlockReader(inputFile));
+}
 
-            // Convert our probaility to an int
-            int probability_int = (int)(erasure_probability * 100);
+// Symbol mode (-m): reads the transmitted symbols (or makes up random ones with -N), runs them
+// through the channel a symbol at a time and reports the symbol error and erasure rates
+int runSymbolMode(const std::vector<std::string>& arguments, int ppm_order, long long random_symbols,
+    double mean_photons, int detection_threshold, const std::string& decoded_file, int rs_message,
+    uint64_t seed, int threads, run_report& report, const std::string& report_file) {
+    size_t expected = random_symbols > 0 ? 2 : 3;
+    if (arguments.size() != expected || mean_photons <= 0) {
+        std::cout << "Symbol mode takes -k and [Name of Input] [Erasure Probability] [Noise Probability]," << std::endl;
+        std::cout << "or just the two probabilities with -N. Use -h for help." << std::endl;
+        return 0;
+    }
 
-            if (random < probability_int) {
-                signalOriginal[counter] = 0;
+    PPMChannel channel;
+    channel.order = ppm_order;
+    channel.mean_photons = mean_photons;
+    channel.erasure_probability = std::stod(arguments[expected - 2]);
+    channel.background_mean = BackgroundNoise::meanForProbability(std::stod(arguments[expected - 1]));
+    channel.threshold = std::max(detection_threshold, 1);
 
-                debug_count++;
-            }
+    if (rs_message > 0) {
+        if (ppm_order != ReedSolomon::symbol_bits || random_symbols == 0) {
+            std::cout << "-Q needs -m 10 and -N." << std::endl;
+            return 0;
+        }
+        ReedSolomon code(rs_message);
+        ThreadPool pool(threads);
+        int stage = run_report_begin(&report, "coded channel");
+        CodedStats coded = runCodedPPM(channel, code, random_symbols, seed, pool);
+        run_report_end(&report, stage);
+        long long symbols = coded.codewords * ReedSolomon::length;
+        std::cout << "Codewords: " << coded.codewords << ", frame errors: " << coded.frameErrors
+            << ", decoder failures: " << coded.decodeFailures << std::endl;
+        std::cout << "Frame error rate: " << (double)coded.frameErrors / coded.codewords
+            << ", symbol erasure rate: " << (double)coded.symbolErasures / symbols
+            << ", symbol error rate: " << (double)coded.symbolErrors / symbols << std::endl;
+        std::cout << "Decoder: " << coded.codewords / coded.decodeSeconds << " codewords/s on "
+            << pool.size() << " threads" << std::endl;
+
+        report.slots = (uint64_t)symbols << ppm_order;
+        report.pulses = (uint64_t)symbols;
+        run_report_count(&report, "codewords", (uint64_t)coded.codewords);
+        run_report_count(&report, "frame_errors", (uint64_t)coded.frameErrors);
+        run_report_count(&report, "decoder_failures", (uint64_t)coded.decodeFailures);
+        run_report_count(&report, "symbol_erasures", (uint64_t)coded.symbolErasures);
+        run_report_count(&report, "symbol_errors", (uint64_t)coded.symbolErrors);
+        writeReport(report, report_file);
+        return 0;
+    }
 
+    std::vector<uint32_t> symbols;
+    if (random_symbols == 0) {
+        int stage = run_report_begin(&report, "read");
+        std::ifstream inputFile;
+        std::unique_ptr<BlockSource> reader = openPulseSource(arguments[0], inputFile);
+        if (!reader) {
+            std::cerr << "Unable to open file :C";
+            return 0;
         }
-        counter++;
+        long long badFrames = 0;
+        if (!readPPMSymbols(*reader, ppm_order, symbols, badFrames)) {
+            std::cerr << arguments[0] << " is malformed, so its symbols can't be read" << std::endl;
+            return 1;
+        }
+        if (badFrames > 0) {
+            std::cout << badFrames << " frames don't hold exactly one pulse" << std::endl;
+        }
+        run_report_end(&report, stage);
+        report.bytes_in = fileBytes(arguments[0]);
     }
-    
-    return signalOriginal;
-}
 
-// Introduces noise by turning zeros into ones
-std::vector<int> signalNoise(std::vector<int> signalOriginal, double noise_probability) {
-    // Index through each element of the original signal, roll a random number and if it is higher, add noise
-   // To safe time, we only have to do this with values that are 0.
+    ThreadPool pool(threads);
+    int stage = run_report_begin(&report, "channel");
+    std::vector<int> decoded;
+    PPMStats stats;
+    if (random_symbols == 0) {
+        // The detected slots go to output.txt like the slot-level modes
+        std::ofstream outfile("output.txt");
+        RLEWriter writer(outfile);
+        stats = runPPMSymbols(channel, symbols, 0, seed, pool, &writer, decoded_file.empty() ? nullptr : &decoded);
+        outfile << std::endl;
+    }
+    else {
+        stats = runPPMSymbols(channel, symbols, random_symbols, seed, pool, nullptr,
+            decoded_file.empty() ? nullptr : &decoded);
+    }
+    run_report_end(&report, stage);
 
-    // Providing a seed value
-    srand((unsigned)time(NULL)); 
+    if (!decoded_file.empty()) {
+        std::ofstream decodedFile(decoded_file);
+        TextWriter writer(decodedFile);
+        for (int symbol : decoded) {
+            writer.write(symbol);
+        }
+        writer.flush();
+        decodedFile << std::endl;
+    }
 
-    int counter = 0; //used to index elements later
-    int debug_count = 0;
-    //Looping through the original signal
-    for (auto element : signalOriginal) {
-        if (element == 0) { // only worried about slots with signal photons
+    std::cout << "Symbols: " << stats.symbols << ", erased pulses: " << stats.erasedPulses
+        << ", erasures: " << stats.erasures << ", symbol errors: " << stats.symbolErrors
+        << ", photons: " << stats.photons << std::endl;
+    if (stats.symbols > 0) {
+        std::cout << "Symbol error rate: " << (double)stats.symbolErrors / stats.symbols
+            << ", erasure rate: " << (double)stats.erasures / stats.symbols << std::endl;
+    }
 
-            // Generate a random number between 0 and 100
-            int random = rand() % 100;
-            
-            // Convert our probaility to an int
-            int probability_int = (int)(noise_probability * 100);
+    report.slots = (uint64_t)stats.symbols << ppm_order;
+    report.pulses = (uint64_t)stats.symbols;
+    report.bytes_out = (random_symbols == 0) ? fileBytes("output.txt") : 0;
+    if (!decoded_file.empty()) {
+        report.bytes_out += fileBytes(decoded_file);
+    }
+    run_report_count(&report, "symbols", (uint64_t)stats.symbols);
+    run_report_count(&report, "erased_pulses", (uint64_t)stats.erasedPulses);
+    run_report_count(&report, "symbol_erasures", (uint64_t)stats.erasures);
+    run_report_count(&report, "symbol_errors", (uint64_t)stats.symbolErrors);
+    run_report_count(&report, "photons", (uint64_t)stats.photons);
+    writeReport(report, report_file);
+    return 0;
+}
 
-            if (random < probability_int) {
-                signalOriginal[counter] = 1;
-                debug_count++;
-            }
+// Receiver mode (-R): demodulates a photon count file and, given the transmitted pulses,
+// reports the symbol error and erasure rates
+int runReceiverMode(const std::vector<std::string>& arguments, int ppm_order, const std::string& photon_file,
+    const std::string& decoded_file, const std::string& soft_file, uint64_t seed, int threads,
+    run_report& report, const std::string& report_file) {
+    if (arguments.size() > 1) {
+        std::cout << "Receiver mode takes at most the transmitted pulses file. Use -h for help." << std::endl;
+        return 0;
+    }
 
+    std::vector<uint32_t> transmitted;
+    if (arguments.size() == 1) {
+        int stage = run_report_begin(&report, "read");
+        std::ifstream inputFile;
+        std::unique_ptr<BlockSource> reader = openPulseSource(arguments[0], inputFile);
+        if (!reader) {
+            std::cerr << "Unable to open file :C";
+            return 0;
         }
-        counter++;
+        long long badFrames = 0;
+        if (!readPPMSymbols(*reader, ppm_order, transmitted, badFrames)) {
+            std::cerr << arguments[0] << " is malformed, so its symbols can't be read" << std::endl;
+            return 1;
+        }
+        if (badFrames > 0) {
+            std::cout << badFrames << " frames don't hold exactly one pulse" << std::endl;
+        }
+        run_report_end(&report, stage);
+        report.bytes_in = fileBytes(arguments[0]);
     }
-    
-    return signalOriginal;
-}
-    
 
-std::vector<int> BinarytoASCII(std::vector<int> BinaryVector) {
-    int counter = 0; // Internal Counter
+    PhotonCountReader photons(photon_file);
+    if (!photons.isOpen()) {
+        std::cerr << "Unable to open file :C";
+        return 0;
+    }
+    ThreadPool pool(threads);
+    bool keepDecisions = !decoded_file.empty() || !soft_file.empty();
+    std::vector<SymbolDecision> decisions;
+    bool malformed = false;
+    int stage = run_report_begin(&report, "demodulate");
+    DemodulatorStats stats = demodulatePPM(photons, ppm_order, transmitted, seed, pool,
+        keepDecisions ? &decisions : nullptr, malformed);
+    run_report_end(&report, stage);
+    if (malformed) {
+        std::cout << "The photon file is malformed; results stop where it went wrong." << std::endl;
+    }
 
-    std::vector<int> BinaryOutput; // Output Vector
-    for (auto element : BinaryVector){
-        if (element == 0) {
-            counter++;
+    if (!decoded_file.empty()) {
+        std::ofstream decodedFile(decoded_file);
+        TextWriter writer(decodedFile);
+        for (const SymbolDecision& decision : decisions) {
+            writer.write(decision.symbol);
         }
-        else {
-            BinaryOutput.push_back(counter);
-            BinaryOutput.push_back(1);
-            counter = 0;
+        writer.flush();
+        decodedFile << std::endl;
+    }
+    if (!soft_file.empty()) {
+        std::ofstream softFile(soft_file);
+        for (const SymbolDecision& decision : decisions) {
+            softFile << decision.symbol << " " << decision.best << " " << decision.second << " "
+                << decision.photons << "\n";
+        }
+    }
+
+    std::cout << "Symbols: " << stats.symbols << ", erasures: " << stats.erasures << ", ties: " << stats.ties
+        << ", photons: " << stats.photons;
+    if (!transmitted.empty()) {
+        std::cout << ", symbol errors: " << stats.errors;
+    }
+    std::cout << std::endl;
+    if (stats.symbols > 0) {
+        if (!transmitted.empty()) {
+            std::cout << "Symbol error rate: " << (double)stats.errors / stats.symbols << ", ";
         }
+        std::cout << "erasure rate: " << (double)stats.erasures / stats.symbols << std::endl;
     }
 
-    return BinaryOutput;
+    report.slots = (uint64_t)stats.symbols << ppm_order;
+    report.bytes_in += fileBytes(photon_file);
+    report.bytes_out = (decoded_file.empty() ? 0 : fileBytes(decoded_file)) + (soft_file.empty() ? 0 : fileBytes(soft_file));
+    run_report_count(&report, "symbols", (uint64_t)stats.symbols);
+    run_report_count(&report, "symbol_erasures", (uint64_t)stats.erasures);
+    run_report_count(&report, "symbol_errors", (uint64_t)stats.errors);
+    run_report_count(&report, "ties", (uint64_t)stats.ties);
+    run_report_count(&report, "photons", (uint64_t)stats.photons);
+    writeReport(report, report_file);
+    return 0;
 }
 
 int main(int argc, char** argv)
 {
     // Script expects 3 arguments: Name of noise file in 'Noise' folder, erasure probability, and noise probability 
     
-    // If user does not input correct amount of commands
+    bool rle_mode = false; // -r: work on the run-length-encoded pairs without expanding to slots
+    bool verbose = false; // -v: print every block as it goes through the channel
+    bool container_output = false; // -C: write output.slots instead of output.txt
+    bool event_output = false; // -E: write output.events instead of output.txt
+    std::string convert_output; // -X: convert the input file into this file's format
+    double mean_photons = 0; // -k: run the full pipeline with this mean number of photons per pulse
+    int detection_threshold = 1; // -d: photons needed for a slot to count as detected in the pipeline
+    std::string detector_model; // -S: with -k, run the photons through an event-driven detector model
+    std::string fading_model; // -F: with -k, fade the signal with time-correlated scintillation
+    int ppm_order = 0; // -m: simulate whole PPM symbols of 2^order slots instead of single slots
+    long long random_symbols = 0; // -N: with -m, simulate this many random symbols instead of reading a file
+    std::string decoded_file; // -D: with -m, write the decided symbols here
+    int rs_message = 0; // -Q: with -m 10 -N, send Reed-Solomon (1023, k) codewords instead of raw symbols
+    std::string photon_file; // -R: with -m, demodulate this photon count file
+    std::string soft_file; // -M: with -R, write the soft metrics of every symbol here
+    long long block_slots = 1 << 24; // -b: slots expanded at a time (2 MB of bitmap)
+    int threads = 1; // -t: worker threads, 0 for one per core
+    uint64_t seed = (uint64_t)time(NULL); // -s: same seed gives the same output
+    std::string points_file; // -p: sweep over the points listed in this file
+    std::vector<std::string> grid; // -g: sweep over every combination of these lists
+    long long trials = 1; // -n: trials per sweep point
+    std::string results_file; // -o: where the sweep (default sweep.csv) or noise table (noise.csv) goes
+    std::string spectra_files; // -L: background spectra to derive the noise probability from
+    double collecting_area = 1.0; // -A: m^2 of collecting area for irradiance spectra
+    std::vector<std::string> band; // -w: wavelength, bandwidth and slot time for the noise probability
+    std::vector<std::string> noise_table; // -T: wavelengths, bandwidths and slot times to tabulate
+    std::string report_file; // -j: write the run report here, JSON or a Prometheus textfile by extension
+    std::vector<std::string> arguments;
+
+    run_report report;
+    run_report_init(&report, "LaserCommNoise");
+
     // Handling each input
-    for (int i = 0; i < argc; i++) {
-        if (std::string(argv[i]) == "-h") {
-            std::cout << "This code inserts noise and erasures into a ASCII file.";
-            std::cout << "The input file must be placed in the 'Noise' Folder" << std::endl;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "-h") {
+            std::cout << "This code inserts noise and erasures into a pulse file (RLE text, .slots, .events or .vrle)." << std::endl;
+            std::cout << "The input is the path given on the command line." << std::endl;
             std::cout << "Command Line arguments are: \n" << std::endl;
-            std::cout << "[Name of Input] [Erasure Probability] [Noise Probability]" << std::endl;
+            std::cout << "[Options] [Name of Input] [Erasure Probability] [Noise Probability]" << std::endl;
+            std::cout << "\nOptions:" << std::endl;
+            std::cout << "  -r          apply the channel directly to the RLE pairs (cost scales with pulses, not slots)" << std::endl;
+            std::cout << "  -b [slots]  number of slots expanded at a time (default 16777216)" << std::endl;
+            std::cout << "  -t [count]  number of worker threads, 0 for one per core (default 1)" << std::endl;
+            std::cout << "  -s [seed]   random seed; the output only depends on the seed, not the thread count" << std::endl;
+            std::cout << "  -v          print every block as it passes through the channel" << std::endl;
+            std::cout << "  -C          write an indexed .slots container (output.slots) instead of output.txt" << std::endl;
+            std::cout << "  -E          write a sparse .events stream (output.events) instead of output.txt" << std::endl;
+            std::cout << "              .slots and .events inputs are recognised automatically, .vrle by its name" << std::endl;
+            std::cout << "  -j [file]   write a run report: stage times, slots, pulses, bytes, random numbers," << std::endl;
+            std::cout << "              peak memory and the photon histogram; JSON for a .json file, otherwise" << std::endl;
+            std::cout << "              a Prometheus textfile" << std::endl;
+            std::cout << "  -P [secs]   print a progress line to stderr every this many seconds" << std::endl;
+            std::cout << "  -k [mean]   run the whole channel in one pass: Poisson detection with this mean per pulse," << std::endl;
+            std::cout << "              erasures, background light (noise probability = Pr(at least one photon)) and" << std::endl;
+            std::cout << "              a detection threshold" << std::endl;
+            std::cout << "  -d [count]  photons needed to detect a slot with -k (default 1); 0 writes the photon" << std::endl;
+            std::cout << "              counts themselves, which needs -C" << std::endl;
+            std::cout << "  -S [model]  with -k, detect the photons with a SPAD/SNSPD model instead of counting them," << std::endl;
+            std::cout << "              e.g. dead=40,dark=1e-6,afterpulse=0.01,delay=10,jitter=0.2,pixels=4" << std::endl;
+            std::cout << "              (times in slots, dark counts per slot); -d then counts clicks per slot" << std::endl;
+            std::cout << "  -F [model]  with -k, scale each pulse's mean by a time-correlated scintillation gain," << std::endl;
+            std::cout << "              lognormal,index=0.3,coherence=1e6 or gamma,alpha=4,beta=2,coherence=1e6" << std::endl;
+            std::cout << "              (index = variance of the irradiance, coherence = 1/e correlation time in slots)" << std::endl;
+            std::cout << "\nSymbol mode: [Options] [Name of Input] [Erasure Probability] [Noise Probability]" << std::endl;
+            std::cout << "  -m [order]  simulate PPM symbols of 2^order slots (order up to 31) as a whole (needs -k);" << std::endl;
+            std::cout << "              the noise probability is Pr(at least one background photon) per slot" << std::endl;
+            std::cout << "  -N [count]  simulate this many random symbols instead of reading an input file" << std::endl;
+            std::cout << "  -D [file]   write the decided symbol of every frame, -1 for an erasure" << std::endl;
+            std::cout << "  -Q [k]      with -m 10 -N, send -N Reed-Solomon (1023, k) codewords and report the frame" << std::endl;
+            std::cout << "              error rate and the decoder speed; no-photon symbols are decoded as erasures" << std::endl;
+            std::cout << "\nReceiver mode: -m [order] -R [photon file] [Options] [Name of transmitted pulses file]" << std::endl;
+            std::cout << "  -R [file]   demodulate a photon count file (any stls_pulse_to_photons_poisson format or" << std::endl;
+            std::cout << "              .slots, .events, .vrle); the pulses file is optional and gives the symbol" << std::endl;
+            std::cout << "              error rate. The sparse formats are decided without expanding the frames" << std::endl;
+            std::cout << "  -M [file]   write 'decision best second photons' for every symbol" << std::endl;
+            std::cout << "\nConvert mode: -X [Name of Output] [Name of Input]" << std::endl;
+            std::cout << "  -X [file]   convert a pulse or photon count file between .events, .slots, the stls" << std::endl;
+            std::cout << "              formats (.rle.txt, .rle.bin, .bin, .pulses.txt, .photons.txt), varint RLE" << std::endl;
+            std::cout << "              (.vrle) and the <zeros> <ones> text of output.txt (any other name)" << std::endl;
+            std::cout << "\nSweep mode: [Options] [Name of Input]" << std::endl;
+            std::cout << "  -p [file]   sweep over the points in the file, one 'erasure,noise,k' per line" << std::endl;
+            std::cout << "  -g [erasures] [noises] [ks]   sweep over every combination of the comma-separated lists" << std::endl;
+            std::cout << "  -n [count]  trials per point (default 1)" << std::endl;
+            std::cout << "  -o [file]   results table, CSV or JSON by extension (default sweep.csv)" << std::endl;
+            std::cout << "\nBackground spectra:" << std::endl;
+            std::cout << "  -L [files]  comma-separated spectrum CSVs (e.g. Spectra/zodi_90.csv,Spectra/cib.csv): wavelength" << std::endl;
+            std::cout << "              against photons s-1 micron-1, or W/m^2-nm for stellar spectra" << std::endl;
+            std::cout << "  -A [m^2]    collecting area for W/m^2-nm spectra (default 1)" << std::endl;
+            std::cout << "  -w [microns] [bandwidth microns] [slot seconds]   use the spectra's Pr(at least one photon)" << std::endl;
+            std::cout << "              per slot as the noise probability, which is then left off the command line" << std::endl;
+            std::cout << "  -T [wavelengths] [bandwidths] [slot times]   write lambda and Pr(at least one photon) per" << std::endl;
+            std::cout << "              source and in total for every combination to -o (default noise.csv); each" << std::endl;
+            std::cout << "              list is comma-separated values or first:last:count ranges" << std::endl;
             return 0;
         }
+        else if (option == "-r") {
+            rle_mode = true;
+        }
+        else if (option == "-v") {
+            verbose = true;
+        }
+        else if (option == "-C") {
+            container_output = true;
+        }
+        else if (option == "-E") {
+            event_output = true;
+        }
+        else if (option == "-X" && i + 1 < argc) {
+            convert_output = argv[++i];
+        }
+        else if (option == "-k" && i + 1 < argc) {
+            mean_photons = std::stod(argv[++i]);
+        }
+        else if (option == "-d" && i + 1 < argc) {
+            detection_threshold = std::stoi(argv[++i]);
+        }
+        else if (option == "-S" && i + 1 < argc) {
+            detector_model = argv[++i];
+        }
+        else if (option == "-F" && i + 1 < argc) {
+            fading_model = argv[++i];
+        }
+        else if (option == "-m" && i + 1 < argc) {
+            ppm_order = std::stoi(argv[++i]);
+            if (ppm_order < 1 || ppm_order > 31) {
+                std::cout << "The PPM order must be between 1 and 31." << std::endl;
+                return 0;
+            }
+        }
+        else if (option == "-N" && i + 1 < argc) {
+            random_symbols = std::stoll(argv[++i]);
+        }
+        else if (option == "-D" && i + 1 < argc) {
+            decoded_file = argv[++i];
+        }
+        else if (option == "-Q" && i + 1 < argc) {
+            rs_message = std::stoi(argv[++i]);
+            if (rs_message < 1 || rs_message >= ReedSolomon::length) {
+                std::cout << "The Reed-Solomon message length must be between 1 and 1022 symbols." << std::endl;
+                return 0;
+            }
+        }
+        else if (option == "-R" && i + 1 < argc) {
+            photon_file = argv[++i];
+        }
+        else if (option == "-M" && i + 1 < argc) {
+            soft_file = argv[++i];
+        }
+        else if (option == "-t" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        }
+        else if (option == "-s" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        }
+        else if (option == "-p" && i + 1 < argc) {
+            points_file = argv[++i];
+        }
+        else if (option == "-g" && i + 3 < argc) {
+            grid = { argv[i + 1], argv[i + 2], argv[i + 3] };
+            i += 3;
+        }
+        else if (option == "-n" && i + 1 < argc) {
+            trials = std::stoll(argv[++i]);
+        }
+        else if (option == "-o" && i + 1 < argc) {
+            results_file = argv[++i];
+        }
+        else if (option == "-L" && i + 1 < argc) {
+            spectra_files = argv[++i];
+        }
+        else if (option == "-A" && i + 1 < argc) {
+            collecting_area = std::stod(argv[++i]);
+        }
+        else if (option == "-w" && i + 3 < argc) {
+            band = { argv[i + 1], argv[i + 2], argv[i + 3] };
+            i += 3;
+        }
+        else if (option == "-T" && i + 3 < argc) {
+            noise_table = { argv[i + 1], argv[i + 2], argv[i + 3] };
+            i += 3;
+        }
+        else if (option == "-j" && i + 1 < argc) {
+            report_file = argv[++i];
+        }
+        else if (option == "-P" && i + 1 < argc) {
+            report.progress_interval = std::stod(argv[++i]);
+        }
+        else if (option == "-b" && i + 1 < argc) {
+            block_slots = std::stoll(argv[++i]);
+            if (block_slots <= 0) {
+                std::cout << "The block size must be at least one slot." << std::endl;
+                return 0;
+            }
+        }
+        else {
+            arguments.push_back(option);
+        }
+    }
+    if (!band.empty() || !noise_table.empty()) {
+        NoiseModel noise;
+        std::string error;
+        int stage = run_report_begin(&report, "spectra");
+        if (!noise.load(spectra_files, collecting_area, error)) {
+            std::cerr << error << " (-w and -T need -L)" << std::endl;
+            return 0;
+        }
+        run_report_end(&report, stage);
+
+        if (!noise_table.empty()) {
+            if (!arguments.empty()) {
+                std::cout << "-T takes no input file. Use -h for help." << std::endl;
+                return 0;
+            }
+            std::vector<double> wavelengths = parseNoiseList(noise_table[0]);
+            std::vector<double> bandwidths = parseNoiseList(noise_table[1]);
+            std::vector<double> slot_times = parseNoiseList(noise_table[2]);
+            std::string table_file = results_file.empty() ? "noise.csv" : results_file;
+            stage = run_report_begin(&report, "noise table");
+            bool ok = writeNoiseTable(table_file, noise, wavelengths, bandwidths, slot_times);
+            run_report_end(&report, stage);
+            if (!ok) {
+                std::cerr << "Unable to write " << table_file << std::endl;
+                return 0;
+            }
+            size_t points = wavelengths.size() * bandwidths.size() * slot_times.size();
+            std::cout << "Wrote " << points << " noise points from " << noise.sources().size() << " spectra to "
+                << table_file << " in " << report.stages[stage].wall_seconds * 1e3 << " ms ("
+                << noise.cacheHits() << " band lookups cached)" << std::endl;
+            if (noise.partialBands() > 0) {
+                std::cerr << "Warning: " << noise.partialBands() << " bands run past the end of a spectrum; "
+                    << "only the part inside it is counted" << std::endl;
+            }
+
+            report.bytes_out = fileBytes(table_file);
+            run_report_count(&report, "noise_points", (uint64_t)points);
+            writeReport(report, report_file);
+            return 0;
+        }
+
+        // The derived probability takes the place of the noise probability argument
+        NoiseRates rates = noise.rates(std::stod(band[0]), std::stod(band[1]), std::stod(band[2]));
+        for (size_t s = 0; s < noise.sources().size(); s++) {
+            const NoiseSpectrum& source = noise.sources()[s];
+            std::cout << source.name << ": lambda " << rates.lambda[s] << ", Pr(X>=1) "
+                << rates.probability[s] << std::endl;
+            if (rates.coverage[s] > 0.0 && rates.coverage[s] < 1.0) {
+                std::cerr << "Warning: " << source.name << " only covers " << source.wavelength.front() << " to "
+                    << source.wavelength.back() << " um, so its lambda counts " << rates.coverage[s] * 100.0
+                    << "% of the band" << std::endl;
+            }
+        }
+        std::cout << "Background at " << band[0] << " um (" << band[1] << " um wide, " << band[2]
+            << " s slots): lambda " << rates.totalLambda << ", noise probability " << rates.totalProbability << std::endl;
+        std::ostringstream probability;
+        probability.precision(17);
+        probability << rates.totalProbability;
+        arguments.push_back(probability.str());
+    }
+
+    if (!convert_output.empty()) {
+        if (arguments.size() != 1) {
+            std::cout << "Convert mode takes just the input file. Use -h for help." << std::endl;
+            return 0;
+        }
+        ConvertStats converted;
+        std::string error;
+        int stage = run_report_begin(&report, "convert");
+        bool ok = convertSlots(arguments[0], convert_output, converted, error);
+        run_report_end(&report, stage);
+        if (!ok) {
+            std::cerr << error << std::endl;
+            return 0;
+        }
+        std::cout << "Converted " << converted.slots << " slots (" << converted.occupied << " occupied, "
+            << converted.count << " in total) to " << convert_output << std::endl;
+
+        report.slots = (uint64_t)converted.slots;
+        report.pulses = (uint64_t)converted.occupied;
+        report.bytes_in = fileBytes(arguments[0]);
+        report.bytes_out = fileBytes(convert_output);
+        writeReport(report, report_file);
+        return 0;
+    }
+
+    if (!fading_model.empty() && (ppm_order > 0 || !points_file.empty() || !grid.empty())) {
+        std::cout << "-F only works in the slot-by-slot -k pipeline, not with -m or a sweep." << std::endl;
+        return 0;
+    }
+
+    if (!points_file.empty() || !grid.empty()) {
+        if (arguments.size() != 1) {
+            std::cout << "Sweep mode takes just the input file. Use -h for help." << std::endl;
+            return 0;
+        }
+        std::vector<SweepPoint> points;
+        if (!points_file.empty() && !readSweepPoints(points_file, points)) {
+            std::cerr << "Unable to open file :C";
+            return 0;
+        }
+        if (!grid.empty()) {
+            std::vector<SweepPoint> gridPoints = sweepGrid(grid[0], grid[1], grid[2]);
+            points.insert(points.end(), gridPoints.begin(), gridPoints.end());
+        }
+
+        // Parse once; every trial of every point shares it
+        int stage = run_report_begin(&report, "read");
+        PulseSummary summary;
+        if (!readPulseSummary(arguments[0], summary)) {
+            std::cerr << "Unable to read pulse file " << arguments[0] << std::endl;
+            return 1;
+        }
+        run_report_end(&report, stage);
+        std::cout << "Sweeping " << points.size() << " points x " << trials << " trials over "
+            << summary.slots << " slots (" << summary.pulses << " pulses)" << std::endl;
+
+        ThreadPool pool(threads);
+        stage = run_report_begin(&report, "sweep");
+        std::vector<SweepResult> results = runSweep(summary, points, trials, seed, pool);
+        run_report_end(&report, stage);
+        if (results_file.empty()) {
+            results_file = "sweep.csv";
+        }
+        if (!writeSweepResults(results_file, results)) {
+            std::cerr << "Unable to write " << results_file << std::endl;
+        }
+
+        // Every trial covers the whole input
+        uint64_t runs = (uint64_t)points.size() * (uint64_t)trials;
+        report.slots = (uint64_t)summary.slots * runs;
+        report.pulses = (uint64_t)summary.pulses * runs;
+        report.bytes_in = fileBytes(arguments[0]);
+        report.bytes_out = fileBytes(results_file);
+        run_report_count(&report, "sweep_points", (uint64_t)points.size());
+        writeReport(report, report_file);
+        return 0;
     }
-    if (argc != 4) {
+
+    if (ppm_order > 0 && !photon_file.empty()) {
+        return runReceiverMode(arguments, ppm_order, photon_file, decoded_file, soft_file, seed, threads,
+            report, report_file);
+    }
+    if (ppm_order > 0) {
+        return runSymbolMode(arguments, ppm_order, random_symbols, mean_photons, detection_threshold,
+            decoded_file, rs_message, seed, threads, report, report_file);
+    }
+
+    // If user does not input correct amount of commands
+    if (arguments.size() != 3) {
         std::cout << "You have entered an incorrect amount of arguments. Use -h for help." << std::endl;
         return 0;
     }
 
 
     // Input file 
-    std::string input_file = argv[1];
+    std::string input_file = arguments[0];
 
     // Erasure Probability
-    double erasure_prob = std::stod(argv[2]);
+    double erasure_prob = std::stod(arguments[1]);
 
     // Noise probability
-    double noise_prob = std::stod(argv[3]);
+    double noise_prob = std::stod(arguments[2]);
 
-    // DEBUGGING: printing out command line arguments to see if they worked
-    std::cout << input_file << ", " << erasure_prob << ", " << noise_prob << std::endl;
+    report.bytes_in = fileBytes(input_file);
 
-    // Opening file
-    std::string fname = R"(Noise\test.txt)";
-    std::vector<int> signal = openfile(fname);
+    bool container_input = isSlotContainer(input_file);
+    bool event_input = isEventStream(input_file);
+    bool varint_input = !container_input && !event_input && isCountFile(input_file);
+    if (rle_mode && (container_input || event_input || varint_input || container_output || event_output)) {
+        std::cout << "-r works on ASCII RLE files only." << std::endl;
+        return 0;
+    }
+    if (container_output && event_output) {
+        std::cout << "Pick one of -C and -E." << std::endl;
+        return 0;
+    }
+    std::string output_file = container_output ? "output.slots" : event_output ? "output.events" : "output.txt";
+    bool pipeline_mode = (mean_photons > 0);
+    if (pipeline_mode && (rle_mode || (detection_threshold <= 0 && !container_output && !event_output))) {
+        std::cout << "-k can't be combined with -r, and -d 0 needs -C or -E." << std::endl;
+        return 0;
+    }
+    DetectorModel detector;
+    if (!detector_model.empty() && (!pipeline_mode || !DetectorModel::parse(detector_model, detector))) {
+        std::cout << "-S needs -k and a model like dead=40,dark=1e-6,afterpulse=0.01,jitter=0.2,pixels=4." << std::endl;
+        return 0;
+    }
+    detector.threshold = std::max(detection_threshold, 0);
+    FadingModel fading;
+    if (!fading_model.empty() && (!pipeline_mode || !FadingModel::parse(fading_model, fading))) {
+        std::cout << "-F needs -k and a model like lognormal,index=0.3,coherence=1e6 or "
+            "gamma,alpha=4,beta=2,coherence=1e6." << std::endl;
+        return 0;
+    }
+    if (container_output && block_slots > (long long)SLOT_CONTAINER_MAX_BLOCK_SLOTS) {
+        std::cout << "Container blocks hold at most " << SLOT_CONTAINER_MAX_BLOCK_SLOTS << " slots." << std::endl;
+        return 0;
+    }
 
-    //Printing all the elements
-    std::cout << signal << std::endl;
+    std::ifstream inputFile;
+    std::unique_ptr<BlockSource> reader;
+    slot_container_header info = {};
+    if (container_input) {
+        std::unique_ptr<ContainerBlockReader> containerReader(new ContainerBlockReader(input_file));
+        if (!containerReader->isOpen()) {
+            std::cerr << "Unable to open file :C";
+            return 0;
+        }
+        // The output keeps the input's PPM order and block layout
+        info.ppm_order = containerReader->header().ppm_order;
+        info.block_slots = containerReader->header().block_slots;
+        reader = std::move(containerReader);
+    }
+    else if (event_input) {
+        std::unique_ptr<EventBlockReader> eventReader(new EventBlockReader(input_file));
+        if (!eventReader->isOpen()) {
+            std::cerr << "Unable to open file :C";
+            return 0;
+        }
+        info.block_slots = (uint64_t)block_slots;
+        reader = std::move(eventReader);
+    }
+    else if (varint_input) {
+        std::unique_ptr<CountBlockReader> varintReader(new CountBlockReader(input_file));
+        if (!varintReader->isOpen()) {
+            std::cerr << "Unable to open file :C";
+            return 0;
+        }
+        info.block_slots = (uint64_t)block_slots;
+        reader = std::move(varintReader);
+    }
+    else {
+        inputFile.open(input_file);
+        if (!inputFile.is_open()) {
+            std::cerr << "Unable to open file :C";
+            return 0;
+        }
+        info.block_slots = (uint64_t)block_slots;
+        // -r runs channelRLE straight on inputFile and outfile
+        if (!rle_mode) {
+            reader.reset(new RLEBlockReader(inputFile));
+        }
+    }
 
+    std::ofstream outfile;
+    std::unique_ptr<BlockSink> writer;
+    ContainerBlockWriter* containerSink = nullptr;
+    EventBlockWriter* eventSink = nullptr;
+    if (container_output) {
+        info.seed = seed;
+        info.mean_photons = mean_photons;
+        setProvenance(info, "LaserCommNoise " + input_file + " erasure " + arguments[1] + " noise " + arguments[2]);
+        std::unique_ptr<ContainerBlockWriter> containerWriter(new ContainerBlockWriter("output.slots", info));
+        if (!containerWriter->isOpen()) {
+            std::cerr << "Unable to write output.slots" << std::endl;
+            return 0;
+        }
+        containerSink = containerWriter.get();
+        writer = std::move(containerWriter);
+    }
+    else if (event_output) {
+        std::unique_ptr<EventBlockWriter> eventWriter(new EventBlockWriter(output_file, mean_photons, seed));
+        if (!eventWriter->isOpen()) {
+            std::cerr << "Unable to write " << output_file << std::endl;
+            return 0;
+        }
+        eventSink = eventWriter.get();
+        writer = std::move(eventWriter);
+    }
+    else {
+        outfile.open("output.txt");
+        if (!rle_mode) {
+            writer.reset(new RLEBlockWriter(outfile));
+        }
+    }
 
-    std::vector<int> signalBinary = ASCIItoBinary(signal);
-    std::cout << signalBinary << std::endl;
+    if (pipeline_mode) {
+        ChannelPipeline pipeline;
+        pipeline.add(std::unique_ptr<PipelineStage>(new PoissonDetection(mean_photons)));
+        pipeline.add(std::unique_ptr<PipelineStage>(new PulseErasure(erasure_prob)));
+        pipeline.add(std::unique_ptr<PipelineStage>(new BackgroundNoise(BackgroundNoise::meanForProbability(noise_prob))));
+        if (!fading_model.empty()) {
+            pipeline.setFading(std::unique_ptr<FadingProcess>(new FadingProcess(fading, seed)));
+        }
+        std::unique_ptr<PipelineSink> sink;
+        if (detection_threshold > 0) {
+            // With a detector model the threshold is applied to its clicks instead
+            if (detector_model.empty()) {
+                pipeline.add(std::unique_ptr<PipelineStage>(new Threshold(detection_threshold)));
+            }
+            sink.reset(new DetectionSink(*writer));
+        }
+        else if (containerSink != nullptr) {
+            sink.reset(new PhotonCountSink(*containerSink));
+        }
+        else {
+            sink.reset(new PhotonEventSink(*eventSink));
+        }
+        std::unique_ptr<SinglePhotonDetector> spad;
+        if (!detector_model.empty()) {
+            spad.reset(new SinglePhotonDetector(detector, seed, *sink));
+        }
 
-    std::vector<int> signalErasured = signalErasure(signalBinary, erasure_prob);
-    std::cout << "\n" << signalErasured << std::endl;
+        ThreadPool pool(threads);
+        PipelineStats totals = pipeline.run(*reader, spad ? *spad : *sink, block_slots, seed, pool, &report);
+        if ((containerSink != nullptr && !containerSink->good()) || (eventSink != nullptr && !eventSink->good())) {
+            std::cerr << "Unable to write " << output_file << std::endl;
+        }
+        if (!container_output && !event_output) {
+            outfile << std::endl;
+            outfile.close();
+        }
+        if (!inputComplete(reader->good(), input_file, totals.slots)) {
+            return 1;
+        }
+        if (spad) {
+            // The first line reports what came out of the detector, not the photon counts going in
+            const DetectorStats& clicks = spad->stats();
+            totals.detections = clicks.detectedSlots;
+            totals.missedPulses = clicks.missedPulses;
+            totals.falseDetections = clicks.falseDetections;
+        }
+        std::cout << "Slots: " << totals.slots << ", pulses: " << totals.pulses << ", erasures: " << totals.erasures
+            << ", photons: " << totals.photons << ", detections: " << totals.detections
+            << ", missed pulses: " << totals.missedPulses << ", false detections: " << totals.falseDetections << std::endl;
+        if (!fading_model.empty() && totals.pulses > 0) {
+            // Over the pulses, so it only settles down once the run covers many coherence times
+            double meanGain = totals.gainSum / (double)totals.pulses;
+            double index = totals.gainSquares / (double)totals.pulses / (meanGain * meanGain) - 1.0;
+            std::cout << "Fading: mean gain " << meanGain << ", scintillation index " << index << " (model "
+                << fading.expectedScintillationIndex() << ") over " << totals.pulses << " pulses" << std::endl;
+        }
+        if (spad) {
+            const DetectorStats& clicks = spad->stats();
+            std::cout << "Detector: " << clicks.detections << " clicks from " << clicks.arrivals << " photons, "
+                << clicks.darkCounts << " dark counts and " << clicks.afterpulses << " afterpulses; "
+                << clicks.blocked << " lost to dead time, " << clicks.shifted << " moved by jitter" << std::endl;
+            report.rng_draws += (uint64_t)clicks.rngDraws;
+            run_report_count(&report, "dark_counts", (uint64_t)clicks.darkCounts);
+            run_report_count(&report, "afterpulses", (uint64_t)clicks.afterpulses);
+            run_report_count(&report, "dead_time_losses", (uint64_t)clicks.blocked);
+            run_report_count(&report, "clicks", (uint64_t)clicks.detections);
+            run_report_count(&report, "jitter_shifts", (uint64_t)clicks.shifted);
+        }
 
-    std::vector<int> signalNoised = signalNoise(signalErasured, noise_prob);
-    std::cout << "\n" << signalNoised << std::endl;
+        report.bytes_out = fileBytes(output_file);
+        run_report_count(&report, "erasures", (uint64_t)totals.erasures);
+        run_report_count(&report, "photons", (uint64_t)totals.photons);
+        run_report_count(&report, "detections", (uint64_t)totals.detections);
+        run_report_count(&report, "missed_pulses", (uint64_t)totals.missedPulses);
+        run_report_count(&report, "false_detections", (uint64_t)totals.falseDetections);
+        std::vector<uint64_t> histogram(totals.histogram.begin(), totals.histogram.end());
+        run_report_add_histogram(&report, histogram.data(), histogram.size());
+        writeReport(report, report_file);
+        return 0;
+    }
 
-    // Turning ASCII into Binary
-    std::vector<int> outputBinary = BinarytoASCII(signalNoised);
-    std::cout << "Binary Output\n" << outputBinary << std::endl;
+    ChannelStats stats;
+    if (rle_mode) {
+        // The RLE walk is sequential, so one generator serves both stages
+        std::mt19937_64 rng(seed);
+        int stage = run_report_begin(&report, "channel");
+        stats = channelRLE(inputFile, outfile, erasure_prob, noise_prob, rng);
+        run_report_end(&report, stage);
+        report.slots = (uint64_t)stats.slots;
+        report.pulses = (uint64_t)stats.pulses;
+        report.rng_draws = (uint64_t)stats.rngDraws;
+    }
+    else {
+        ThreadPool pool(threads);
+        stats = channelBlocks(*reader, *writer, erasure_prob, noise_prob, block_slots, seed, pool, verbose, report);
+    }
+    if ((containerSink != nullptr && !containerSink->good()) || (eventSink != nullptr && !eventSink->good())) {
+        std::cerr << "Unable to write " << output_file << std::endl;
+    }
+    if (!container_output && !event_output) {
+        outfile << std::endl;
+        outfile.close();
+    }
+    if (!inputComplete(rle_mode ? !stats.malformed : reader->good(), input_file, stats.slots)) {
+        return 1;
+    }
 
-    //Writes the vector to an output file
-    std::ofstream outfile("output.txt");
-    outfile << outputBinary << std::endl;
-    outfile.close();
+    std::cout << "Slots: " << stats.slots << ", pulses: " << stats.pulses
+        << ", erasures: " << stats.erasures << ", noise: " << stats.noise << std::endl;
 
+    report.bytes_out = fileBytes(output_file);
+    run_report_count(&report, "erasures", (uint64_t)stats.erasures);
+    run_report_count(&report, "noise", (uint64_t)stats.noise);
+    writeReport(report, report_file);
 
     return 0;
 }
-
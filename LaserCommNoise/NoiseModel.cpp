@@ -0,0 +1,369 @@
+#include "NoiseModel.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <utility>
+
+// Planck constant times the speed of light, J m
+const double planck_c = 1.98644586e-25;
+
+// Splits a CSV line, allowing quoted fields (Excel quotes any field with a comma in it)
+static std::vector<std::string> splitCSV(const std::string& line) {
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '"') {
+            if (quoted && i + 1 < line.size() && line[i + 1] == '"') {
+                fields.back() += '"';
+                i++;
+            }
+            else {
+                quoted = !quoted;
+            }
+        }
+        else if (c == ',' && !quoted) {
+            fields.emplace_back();
+        }
+        else if (c != '\r') {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+static std::string lowerTrimmed(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t");
+    size_t end = text.find_last_not_of(" \t");
+    std::string result = (start == std::string::npos) ? "" : text.substr(start, end - start + 1);
+    std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return result;
+}
+
+static bool parseNumber(const std::string& text, double& value) {
+    const char* start = text.c_str();
+    char* end;
+    value = std::strtod(start, &end);
+    if (end == start) {
+        return false;
+    }
+    while (*end == ' ' || *end == '\t') {
+        end++;
+    }
+    return *end == '\0' && std::isfinite(value);
+}
+
+// Microns per unit of a "Wavelength (...)" column
+static double wavelengthScale(const std::string& header) {
+    if (header.find("(nm)") != std::string::npos) {
+        return 1e-3;
+    }
+    if (header.find("(m)") != std::string::npos) {
+        return 1e6;
+    }
+    return 1.0;
+}
+
+// Photon rate at x between table points (x0, y0) and (x1, y1): a power law if both rates
+// are positive, otherwise a straight line
+static double segmentRate(double x0, double y0, double x1, double y1, double x) {
+    if (x1 <= x0) {
+        return y0;
+    }
+    if (y0 > 0 && y1 > 0) {
+        double k = std::log(y1 / y0) / std::log(x1 / x0);
+        return std::exp(std::log(y0) + k * std::log(x / x0));
+    }
+    return y0 + (y1 - y0) * (x - x0) / (x1 - x0);
+}
+
+// Integral of the rate over [a, b], inside one segment
+static double segmentIntegral(double x0, double y0, double x1, double y1, double a, double b) {
+    if (b <= a || x1 <= x0) {
+        return 0.0;
+    }
+    double ya = segmentRate(x0, y0, x1, y1, a);
+    double yb = segmentRate(x0, y0, x1, y1, b);
+    if (y0 > 0 && y1 > 0) {
+        // x^k integrates to x^(k+1) / (k+1), i.e. x y(x) / (k+1); k = -1 is the logarithm
+        double e = std::log(y1 / y0) / std::log(x1 / x0) + 1.0;
+        if (std::fabs(e) < 1e-9) {
+            return a * ya * std::log(b / a);
+        }
+        return (b * yb - a * ya) / e;
+    }
+    return 0.5 * (ya + yb) * (b - a);
+}
+
+double NoiseSpectrum::rateAt(double microns) const {
+    if (wavelength.empty() || microns < wavelength.front() || microns > wavelength.back()) {
+        return 0.0;
+    }
+    size_t i = std::upper_bound(wavelength.begin(), wavelength.end(), microns) - wavelength.begin();
+    if (i == wavelength.size()) {
+        return rate.back();
+    }
+    return segmentRate(wavelength[i - 1], rate[i - 1], wavelength[i], rate[i], microns);
+}
+
+double NoiseSpectrum::bandRate(double low, double high) const {
+    if (wavelength.size() < 2) {
+        return 0.0;
+    }
+    low = std::max(low, wavelength.front());
+    high = std::min(high, wavelength.back());
+    if (high <= low) {
+        return 0.0;
+    }
+
+    // segments i and j hold the two ends (segment s runs from point s to point s + 1)
+    size_t last = wavelength.size() - 2;
+    size_t i = std::min((size_t)(std::upper_bound(wavelength.begin(), wavelength.end(), low) - wavelength.begin()) - 1, last);
+    size_t j = std::min((size_t)(std::upper_bound(wavelength.begin(), wavelength.end(), high) - wavelength.begin()) - 1, last);
+    if (i == j) {
+        return segmentIntegral(wavelength[i], rate[i], wavelength[i + 1], rate[i + 1], low, high);
+    }
+    return segmentIntegral(wavelength[i], rate[i], wavelength[i + 1], rate[i + 1], low, wavelength[i + 1])
+        + (integral[j] - integral[i + 1])
+        + segmentIntegral(wavelength[j], rate[j], wavelength[j + 1], rate[j + 1], wavelength[j], high);
+}
+
+double NoiseSpectrum::coverage(double low, double high) const {
+    if (wavelength.size() < 2) {
+        return 0.0;
+    }
+    if (high <= low) {
+        return (low >= wavelength.front() && low <= wavelength.back()) ? 1.0 : 0.0;
+    }
+    double inside = std::min(high, wavelength.back()) - std::max(low, wavelength.front());
+    return std::max(inside, 0.0) / (high - low);
+}
+
+bool loadNoiseSpectrum(const std::string& filename, double area, NoiseSpectrum& spectrum, std::string& error) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        error = "Unable to open " + filename;
+        return false;
+    }
+
+    // Column choice comes from the header row if there is one, otherwise the first two columns
+    // are taken as microns and photons s-1 micron-1
+    size_t wavelengthColumn = 0, rateColumn = 1;
+    double microns = 1.0;
+    bool irradiance = false, headerSeen = false;
+    std::vector<std::pair<double, double>> points;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields = splitCSV(line);
+        double w, r;
+        if (!headerSeen) {
+            int wavelengthFound = -1, rateFound = -1;
+            bool irradianceFound = false;
+            for (size_t c = 0; c < fields.size(); c++) {
+                std::string name = lowerTrimmed(fields[c]);
+                if (name.compare(0, 10, "wavelength") == 0) {
+                    // prefer microns, then nm, then m, as the master sheets carry several
+                    bool better = wavelengthFound < 0
+                        || (wavelengthScale(name) == 1.0 && wavelengthScale(lowerTrimmed(fields[wavelengthFound])) != 1.0)
+                        || (wavelengthScale(name) == 1e-3 && wavelengthScale(lowerTrimmed(fields[wavelengthFound])) == 1e6);
+                    if (better) {
+                        wavelengthFound = (int)c;
+                    }
+                }
+                else if (rateFound < 0 && name.compare(0, 18, "photons s-1 micron") == 0) {
+                    rateFound = (int)c;
+                }
+                else if (rateFound < 0 && (name.find("w/m^2-nm") != std::string::npos || name.find("w m-2 nm-1") != std::string::npos)) {
+                    rateFound = (int)c;
+                    irradianceFound = true;
+                }
+            }
+            if (wavelengthFound >= 0 && rateFound >= 0) {
+                wavelengthColumn = (size_t)wavelengthFound;
+                rateColumn = (size_t)rateFound;
+                microns = wavelengthScale(lowerTrimmed(fields[wavelengthColumn]));
+                irradiance = irradianceFound;
+                headerSeen = true;
+                points.clear();     // numbers above the header were part of the sheet's preamble
+                continue;
+            }
+        }
+        if (fields.size() <= std::max(wavelengthColumn, rateColumn) ||
+            !parseNumber(fields[wavelengthColumn], w) || !parseNumber(fields[rateColumn], r)) {
+            continue;   // titles above the header, blank rows and unfilled cells
+        }
+        w *= microns;
+        if (irradiance) {
+            // W m-2 nm-1 to photons s-1 micron-1 over the area: 1000 nm per micron, hc/wavelength per photon
+            r = r * 1000.0 * area * (w * 1e-6) / planck_c;
+        }
+        points.push_back(std::make_pair(w, r));
+    }
+    if (points.size() < 2) {
+        error = filename + " has fewer than two points under 'Wavelength' and 'photons s-1 micron-1' (or 'W/m^2-nm') columns";
+        return false;
+    }
+
+    std::stable_sort(points.begin(), points.end(),
+        [](const std::pair<double, double>& a, const std::pair<double, double>& b) { return a.first < b.first; });
+    size_t slash = filename.find_last_of("/\\");
+    spectrum.name = filename.substr(slash == std::string::npos ? 0 : slash + 1);
+    spectrum.name = spectrum.name.substr(0, spectrum.name.find('.'));
+    spectrum.wavelength.clear();
+    spectrum.rate.clear();
+    spectrum.integral.assign(1, 0.0);
+    for (const auto& point : points) {
+        spectrum.wavelength.push_back(point.first);
+        spectrum.rate.push_back(point.second);
+    }
+    for (size_t i = 1; i < points.size(); i++) {
+        spectrum.integral.push_back(spectrum.integral.back() + segmentIntegral(spectrum.wavelength[i - 1],
+            spectrum.rate[i - 1], spectrum.wavelength[i], spectrum.rate[i], spectrum.wavelength[i - 1], spectrum.wavelength[i]));
+    }
+    return true;
+}
+
+bool NoiseModel::load(const std::string& files, double area, std::string& error) {
+    std::stringstream names(files);
+    std::string filename;
+    while (std::getline(names, filename, ',')) {
+        if (filename.empty()) {
+            continue;
+        }
+        NoiseSpectrum spectrum;
+        if (!loadNoiseSpectrum(filename, area, spectrum, error)) {
+            return false;
+        }
+        spectra.push_back(std::move(spectrum));
+    }
+    bandCache.clear();
+    if (spectra.empty()) {
+        error = "No noise spectra given";
+        return false;
+    }
+    return true;
+}
+
+size_t NoiseModel::BandHash::operator()(const BandKey& key) const {
+    size_t h = std::hash<double>()(key.wavelength);
+    return h ^ (std::hash<double>()(key.bandwidth) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+}
+
+NoiseRates NoiseModel::rates(double wavelength, double bandwidth, double slot_time) {
+    BandKey key = { wavelength, bandwidth };
+    auto cached = bandCache.find(key);
+    if (cached == bandCache.end()) {
+        Band band;
+        double low = wavelength - 0.5 * bandwidth, high = wavelength + 0.5 * bandwidth;
+        for (const NoiseSpectrum& spectrum : spectra) {
+            band.perSecond.push_back(spectrum.bandRate(low, high));
+            band.coverage.push_back(spectrum.coverage(low, high));
+            // A band wholly outside a table is a source with nothing at that wavelength (the CMB
+            // in the near infrared); one that is cut off by the table's end is short of photons
+            if (band.coverage.back() > 0.0 && band.coverage.back() < 1.0) {
+                partial++;
+            }
+        }
+        cached = bandCache.emplace(key, std::move(band)).first;
+    }
+    else {
+        hits++;
+    }
+
+    NoiseRates result;
+    result.coverage = cached->second.coverage;
+    for (double perSecond : cached->second.perSecond) {
+        double lambda = perSecond * slot_time;
+        result.lambda.push_back(lambda);
+        result.probability.push_back(noiseProbability(lambda));
+        result.totalLambda += lambda;
+    }
+    result.totalProbability = noiseProbability(result.totalLambda);
+    return result;
+}
+
+double noiseProbability(double lambda) {
+    return -std::expm1(-lambda);
+}
+
+std::vector<double> parseNoiseList(const std::string& list) {
+    std::vector<double> values;
+    std::stringstream fields(list);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        if (field.empty()) {
+            continue;
+        }
+        size_t colon = field.find(':');
+        if (colon == std::string::npos) {
+            values.push_back(std::stod(field));
+            continue;
+        }
+        size_t second = field.find(':', colon + 1);
+        double first = std::stod(field.substr(0, colon));
+        double last = std::stod(field.substr(colon + 1, second == std::string::npos ? std::string::npos : second - colon - 1));
+        long long count = (second == std::string::npos) ? 2 : std::stoll(field.substr(second + 1));
+        for (long long i = 0; i < count; i++) {
+            values.push_back(count > 1 ? first + (last - first) * (double)i / (double)(count - 1) : first);
+        }
+    }
+    return values;
+}
+
+bool writeNoiseTable(const std::string& filename, NoiseModel& model, const std::vector<double>& wavelengths,
+    const std::vector<double>& bandwidths, const std::vector<double>& slot_times) {
+    std::ofstream outfile(filename);
+    if (!outfile.is_open()) {
+        return false;
+    }
+    outfile.precision(10);
+    bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    const std::vector<NoiseSpectrum>& sources = model.sources();
+
+    if (json) {
+        outfile << "[\n";
+    }
+    else {
+        outfile << "wavelength_um,bandwidth_um,slot_s";
+        for (const NoiseSpectrum& source : sources) {
+            outfile << "," << source.name << "_lambda," << source.name << "_prob";
+        }
+        outfile << ",lambda,noise_prob\n";
+    }
+
+    size_t total = wavelengths.size() * bandwidths.size() * slot_times.size(), n = 0;
+    for (double wavelength : wavelengths) {
+        for (double bandwidth : bandwidths) {
+            for (double slot_time : slot_times) {
+                NoiseRates rates = model.rates(wavelength, bandwidth, slot_time);
+                if (json) {
+                    outfile << "  {\"wavelength_um\": " << wavelength << ", \"bandwidth_um\": " << bandwidth
+                        << ", \"slot_s\": " << slot_time << ", \"sources\": {";
+                    for (size_t s = 0; s < sources.size(); s++) {
+                        outfile << (s > 0 ? ", " : "") << "\"" << sources[s].name << "\": {\"lambda\": "
+                            << rates.lambda[s] << ", \"prob\": " << rates.probability[s] << "}";
+                    }
+                    outfile << "}, \"lambda\": " << rates.totalLambda << ", \"noise_prob\": " << rates.totalProbability
+                        << "}" << (++n < total ? "," : "") << "\n";
+                }
+                else {
+                    outfile << wavelength << "," << bandwidth << "," << slot_time;
+                    for (size_t s = 0; s < sources.size(); s++) {
+                        outfile << "," << rates.lambda[s] << "," << rates.probability[s];
+                    }
+                    outfile << "," << rates.totalLambda << "," << rates.totalProbability << "\n";
+                }
+            }
+        }
+    }
+
+    if (json) {
+        outfile << "]\n";
+    }
+    return true;
+}
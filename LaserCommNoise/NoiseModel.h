@@ -0,0 +1,118 @@
+// NoiseModel.h
+//
+// Background-light rates per slot from the noise spectra (zodiacal light, faint stars,
+// the cosmic infrared and microwave backgrounds, stellar spectra), replacing the hand
+// calculation of noise_calc.ipynb and poisson.md.
+//
+// Each spectrum is a CSV of wavelength against photon rate, e.g. a sheet of
+// "Master Noise-e.xlsm" saved as CSV (the "Wavelength (microns)" column and the
+// diffraction-limited "photons s-1 micron-1" column are picked out of the header) or the
+// two-column exports in Spectra/. Stellar spectra given as irradiance ("Wavelength (nm)",
+// "Flux (W/m^2-nm)") are turned into photons s-1 micron-1 for a collecting area.
+//
+// Between two table points the rate follows a power law (a straight line on the log-log
+// plots the tables come from), and is zero outside the table; a band that runs past the end
+// of a table counts only the part inside it, and is flagged so that the caller can warn. The
+// rate integrated over a band is tabulated as a running integral when the spectrum is loaded, so the mean number
+// of photons in a slot,
+//
+//     lambda = slot time * integral of the rate over [wavelength - bandwidth/2, wavelength + bandwidth/2]
+//
+// (Noise * s * um in poisson.md for a narrow band) costs two binary searches per source,
+// and the noise probability handed to the channel is Pr(X >= 1) = 1 - exp(-lambda).
+// The band integrals are cached by (wavelength, bandwidth), so a sweep over slot times
+// only looks the spectra up once per band.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct NoiseSpectrum {
+    std::string name;               // file name without the directory and extension
+    std::vector<double> wavelength; // microns, increasing
+    std::vector<double> rate;       // photons s-1 micron-1 at each wavelength
+    std::vector<double> integral;   // photons s-1 from the first wavelength to each one
+
+    // Photons s-1 micron-1 at a wavelength in microns
+    double rateAt(double microns) const;
+
+    // Photons s-1 between two wavelengths in microns
+    double bandRate(double low, double high) const;
+
+    // Fraction of the band between two wavelengths that lies inside the table
+    double coverage(double low, double high) const;
+};
+
+// Reads a spectrum CSV. area is the collecting area in m^2 for irradiance spectra.
+// Returns false with a message in error if the file can't be read or has no usable columns.
+bool loadNoiseSpectrum(const std::string& filename, double area, NoiseSpectrum& spectrum, std::string& error);
+
+// One (wavelength, bandwidth, slot time) point
+struct NoiseRates {
+    std::vector<double> lambda;         // mean photons per slot from each source
+    std::vector<double> probability;    // Pr(at least one photon) from each source
+    std::vector<double> coverage;       // fraction of the band inside each source's table
+    double totalLambda = 0.0;
+    double totalProbability = 0.0;      // the noise probability for the channel
+};
+
+class NoiseModel {
+public:
+    // Loads a comma-separated list of spectrum files
+    bool load(const std::string& files, double area, std::string& error);
+
+    const std::vector<NoiseSpectrum>& sources() const {
+        return spectra;
+    }
+
+    // Rates for a band centred on wavelength (microns) of the given bandwidth (microns) and a
+    // slot time in seconds. Not thread-safe: the cache is filled as it goes.
+    NoiseRates rates(double wavelength, double bandwidth, double slot_time);
+
+    // Band lookups answered from the cache
+    long long cacheHits() const {
+        return hits;
+    }
+
+    // Bands that reached part way past the end of a source's table, so that only the part
+    // inside it was counted
+    long long partialBands() const {
+        return partial;
+    }
+
+private:
+    struct BandKey {
+        double wavelength;
+        double bandwidth;
+        bool operator==(const BandKey& other) const {
+            return wavelength == other.wavelength && bandwidth == other.bandwidth;
+        }
+    };
+    struct BandHash {
+        size_t operator()(const BandKey& key) const;
+    };
+
+    struct Band {
+        std::vector<double> perSecond;  // photons s-1 per source
+        std::vector<double> coverage;
+    };
+
+    std::vector<NoiseSpectrum> spectra;
+    std::unordered_map<BandKey, Band, BandHash> bandCache;
+    long long hits = 0;
+    long long partial = 0;
+};
+
+// Pr(X >= 1) for a Poisson count of mean lambda, accurate for tiny lambda
+double noiseProbability(double lambda);
+
+// Parses "0.8,1.064,1.55" or an evenly spaced range "first:last:count", or a mix of both
+std::vector<double> parseNoiseList(const std::string& list);
+
+// Every (wavelength, bandwidth, slot time) combination, written as CSV (or JSON for a
+// .json name) with lambda and probability per source and in total
+bool writeNoiseTable(const std::string& filename, NoiseModel& model, const std::vector<double>& wavelengths,
+    const std::vector<double>& bandwidths, const std::vector<double>& slot_times);
@@ -0,0 +1,524 @@
+#include "PPMDemodulator.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// Random stream for breaking ties, clear of the channel stages
+const uint32_t demodulator_stage = 0x300;
+
+// Frames expanded and decided per task
+const long long demodulator_chunk_slots = 1 << 20;
+
+// RLE words read through the codec at a time
+const size_t codec_words = 1 << 16;
+
+static bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+PhotonCountReader::PhotonCountReader(const std::string& filename) {
+    if (isSlotContainer(filename)) {
+        format = container;
+        blocks.reset(new ContainerBlockReader(filename));
+        open = blocks->isOpen();
+        return;
+    }
+    if (isEventStream(filename)) {
+        format = events;
+        eventStream.reset(new EventBlockReader(filename));
+        open = eventStream->isOpen();
+        return;
+    }
+    if (endsWith(filename, ".vrle")) {
+        format = varint_rle;
+        open = (mapped_file_open(&map, filename.c_str()) == 0);
+        if (open) {
+            varints.reset(new varint_rle_reader);
+            varint_rle_reader_init(varints.get(), map.data, map.size);
+        }
+        return;
+    }
+
+    const slot_codec* stlsCodec = slot_codec_from_name(filename.c_str());
+    if (stlsCodec == &slot_codec_pulse_text) {
+        format = pulse_text;
+        file.open(filename);
+        open = file.is_open();
+        return;
+    }
+
+    // Any other name is read as counts in text
+    format = stls_file;
+    codec = (stlsCodec != nullptr) ? stlsCodec : &slot_codec_count_text;
+    open = (slot_codec_open_reader(&codecReader, codec, filename.c_str()) == 0);
+    if (codec->compressed) {
+        words.resize(codec_words);
+    }
+}
+
+PhotonCountReader::~PhotonCountReader() {
+    if (format == varint_rle && open) {
+        mapped_file_close(&map);
+    }
+    if (format == stls_file && open) {
+        slot_codec_close_reader(&codecReader);
+    }
+}
+
+bool PhotonCountReader::nextWord(uint32_t& word) {
+    while (wordPosition == wordCount) {
+        if (wordStatus == SLOT_CODEC_END) {
+            return false;
+        }
+        if (wordStatus != SLOT_CODEC_OK && wordStatus != SLOT_CODEC_FULL) {
+            malformed = true;
+            return false;
+        }
+        uint64_t occupied = 0;
+        wordPosition = 0;
+        wordStatus = codec->read_words(&codecReader, words.data(), words.size(), words.size(), 65535, &wordCount,
+            &occupied);
+    }
+    word = words[wordPosition++];
+    return true;
+}
+
+bool PhotonCountReader::nextPair(long long& zeros, uint32_t& value) {
+    if (format == container) {
+        while (pairsLeft == 0) {
+            if (block >= blocks->blockCount()) {
+                return false;
+            }
+            pairs = blocks->blockPairs(block, pairsLeft);
+            block++;
+            if (pairs == nullptr) {
+                malformed = true;
+                return false;
+            }
+        }
+        zeros = pairs[0];
+        value = pairs[1];
+        pairs += 2;
+        pairsLeft--;
+        return true;
+    }
+    if (format == events) {
+        SlotEvent event;
+        int status = eventStream->nextEvent(event);
+        if (status < 0) {
+            malformed = true;
+            return false;
+        }
+        if (status == 0) {
+            // The empty slots after the last event, as a final (run, 0) pair
+            long long end = (long long)eventStream->header().total_slots;
+            if (eventSlot >= end) {
+                return false;
+            }
+            zeros = end - eventSlot;
+            value = 0;
+            eventSlot = end;
+            return true;
+        }
+        zeros = event.slot - eventSlot;
+        value = event.count;
+        eventSlot = event.slot + 1;
+        return true;
+    }
+    if (format == varint_rle) {
+        uint64_t run;
+        if (!varint_rle_next_pair(varints.get(), &run, &value)) {
+            malformed = (varints->malformed != 0);
+            return false;
+        }
+        if (run > (uint64_t)LLONG_MAX) {
+            malformed = true;
+            return false;
+        }
+        zeros = (long long)run;
+        return true;
+    }
+
+    // A zero run of 65535 carries on into the next word
+    uint32_t word;
+    zeros = 0;
+    do {
+        if (!nextWord(word)) {
+            return false;
+        }
+        zeros += word;
+    } while (word == 65535);
+    if (!nextWord(value)) {
+        malformed = true; // a run with no value after it
+        return false;
+    }
+    return true;
+}
+
+template <typename Zeros, typename Value>
+long long PhotonCountReader::walkPairs(long long maxSlots, Zeros zeros, Value value) {
+    long long filled = 0;
+
+    // Hand out what is left of the current pair first
+    while (filled < maxSlots) {
+        if (zerosLeft == 0 && !valuePending) {
+            long long run;
+            uint32_t count;
+            if (!nextPair(run, count)) {
+                break;
+            }
+            zerosLeft = run;
+            pendingValue = count;
+            valuePending = (count != 0); // a final (run, 0) pair only carries zeros
+        }
+        long long run = std::min(zerosLeft, maxSlots - filled);
+        zeros(run);
+        filled += run;
+        zerosLeft -= run;
+        if (zerosLeft == 0 && valuePending && filled < maxSlots) {
+            value(filled++, pendingValue);
+            valuePending = false;
+        }
+    }
+    return malformed ? -1 : filled;
+}
+
+long long PhotonCountReader::read(uint32_t* counts, long long maxSlots) {
+    long long filled = 0;
+
+    if (format == stls_file && !codec->compressed) {
+        size_t got;
+        uint64_t occupied = 0;
+        int status = codec->read_slots(&codecReader, counts, (size_t)maxSlots, codec->max_count, &got, &occupied);
+        return (status < 0) ? -1 : (long long)got;
+    }
+    if (format == pulse_text) {
+        char c;
+        while (filled < maxSlots && file.get(c)) {
+            if (c == '0' || c == '1') {
+                counts[filled++] = (uint32_t)(c - '0');
+            }
+            else if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                return -1;
+            }
+        }
+        return filled;
+    }
+
+    return walkPairs(maxSlots,
+        [&](long long run) {
+            std::memset(counts + filled, 0, (size_t)run * sizeof(uint32_t));
+            filled += run;
+        },
+        [&](long long slot, uint32_t count) {
+            counts[slot] = count;
+            filled = slot + 1;
+        });
+}
+
+long long PhotonCountReader::readEvents(std::vector<SlotEvent>& events, long long maxSlots) {
+    events.clear();
+    if (!sparse()) {
+        // Expand a piece at a time and keep the occupied slots
+        std::vector<uint32_t> counts((size_t)std::min(maxSlots, demodulator_chunk_slots));
+        long long filled = 0;
+        while (filled < maxSlots) {
+            long long got = read(counts.data(), std::min((long long)counts.size(), maxSlots - filled));
+            if (got < 0) {
+                return -1;
+            }
+            for (long long i = 0; i < got; i++) {
+                if (counts[(size_t)i] != 0) {
+                    events.push_back({ filled + i, counts[(size_t)i] });
+                }
+            }
+            filled += got;
+            if (got < (long long)counts.size()) {
+                break;
+            }
+        }
+        return filled;
+    }
+    return walkPairs(maxSlots, [](long long) {}, [&](long long slot, uint32_t count) {
+        events.push_back({ slot, count });
+    });
+}
+
+SymbolDecision demodulateFrame(const uint32_t* counts, long long slots, Philox& rng) {
+    SymbolDecision decision;
+    long long i = 0;
+    uint32_t best = 0;
+    uint64_t photons = 0;
+
+    // Pass 1: the largest count and the total
+#if defined(__AVX512F__)
+    __m512i vmax = _mm512_setzero_si512();
+    __m512i vsum = _mm512_setzero_si512();
+    for (; i + 16 <= slots; i += 16) {
+        __m512i v = _mm512_loadu_si512((const void*)(counts + i));
+        vmax = _mm512_max_epu32(vmax, v);
+        vsum = _mm512_add_epi32(vsum, v);
+    }
+    best = _mm512_reduce_max_epu32(vmax);
+    photons = (uint32_t)_mm512_reduce_add_epi32(vsum);
+#elif defined(__AVX2__)
+    __m256i vmax = _mm256_setzero_si256();
+    __m256i vsum = _mm256_setzero_si256();
+    for (; i + 8 <= slots; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(counts + i));
+        vmax = _mm256_max_epu32(vmax, v);
+        vsum = _mm256_add_epi32(vsum, v);
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, vmax);
+    for (int lane = 0; lane < 8; lane++) {
+        best = std::max(best, lanes[lane]);
+    }
+    _mm256_storeu_si256((__m256i*)lanes, vsum);
+    for (int lane = 0; lane < 8; lane++) {
+        photons += lanes[lane];
+    }
+#endif
+    for (; i < slots; i++) {
+        best = std::max(best, counts[i]);
+        photons += counts[i];
+    }
+    decision.photons = (uint32_t)photons;
+    decision.best = best;
+    if (best == 0) {
+        return decision; // no photons: an erasure
+    }
+
+    // Pass 2: how many slots hold the largest count, and the largest of the rest
+    int ties = 0;
+    uint32_t second = 0;
+    i = 0;
+#if defined(__AVX512F__)
+    __m512i vbest = _mm512_set1_epi32((int)best);
+    __m512i vsecond = _mm512_setzero_si512();
+    for (; i + 16 <= slots; i += 16) {
+        __m512i v = _mm512_loadu_si512((const void*)(counts + i));
+        __mmask16 equal = _mm512_cmpeq_epu32_mask(v, vbest);
+        ties += __builtin_popcount(equal);
+        vsecond = _mm512_mask_max_epu32(vsecond, (__mmask16)~equal, vsecond, v);
+    }
+    second = _mm512_reduce_max_epu32(vsecond);
+#elif defined(__AVX2__)
+    __m256i vbest = _mm256_set1_epi32((int)best);
+    __m256i vsecond = _mm256_setzero_si256();
+    for (; i + 8 <= slots; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(counts + i));
+        __m256i equal = _mm256_cmpeq_epi32(v, vbest);
+        ties += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(equal)));
+        vsecond = _mm256_max_epu32(vsecond, _mm256_andnot_si256(equal, v));
+    }
+    _mm256_storeu_si256((__m256i*)lanes, vsecond);
+    for (int lane = 0; lane < 8; lane++) {
+        second = std::max(second, lanes[lane]);
+    }
+#endif
+    for (; i < slots; i++) {
+        if (counts[i] == best) {
+            ties++;
+        }
+        else {
+            second = std::max(second, counts[i]);
+        }
+    }
+    decision.ties = ties;
+    decision.second = (ties > 1) ? best : second;
+
+    // Pass 3: stop at the chosen one of the tied slots
+    int pick = (ties > 1) ? (int)(((rng() >> 32) * (uint64_t)ties) >> 32) : 0;
+    i = 0;
+#if defined(__AVX512F__)
+    for (; i + 16 <= slots; i += 16) {
+        __m512i v = _mm512_loadu_si512((const void*)(counts + i));
+        unsigned equal = _mm512_cmpeq_epu32_mask(v, vbest);
+        int found = __builtin_popcount(equal);
+        if (pick < found) {
+            for (; pick > 0; pick--) {
+                equal &= equal - 1;
+            }
+            decision.symbol = (int)(i + countTrailingZeros(equal));
+            return decision;
+        }
+        pick -= found;
+    }
+#elif defined(__AVX2__)
+    for (; i + 8 <= slots; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(counts + i));
+        unsigned equal = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, vbest)));
+        int found = __builtin_popcount(equal);
+        if (pick < found) {
+            for (; pick > 0; pick--) {
+                equal &= equal - 1;
+            }
+            decision.symbol = (int)(i + countTrailingZeros(equal));
+            return decision;
+        }
+        pick -= found;
+    }
+#endif
+    for (; i < slots; i++) {
+        if (counts[i] == best && pick-- == 0) {
+            decision.symbol = (int)i;
+            break;
+        }
+    }
+    return decision;
+}
+
+SymbolDecision demodulateEvents(const SlotEvent* events, size_t count, Philox& rng) {
+    SymbolDecision decision;
+    uint32_t best = 0;
+    uint64_t photons = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        best = std::max(best, events[i].count);
+        photons += events[i].count;
+    }
+    decision.photons = (uint32_t)photons;
+    decision.best = best;
+    if (best == 0) {
+        return decision;
+    }
+
+    // The empty slots left out of the list are zeros, which is what second starts at
+    int ties = 0;
+    uint32_t second = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].count == best) {
+            ties++;
+        }
+        else {
+            second = std::max(second, events[i].count);
+        }
+    }
+    decision.ties = ties;
+    decision.second = (ties > 1) ? best : second;
+
+    // Same draw as demodulateFrame, over the tied slots in the same order
+    int pick = (ties > 1) ? (int)(((rng() >> 32) * (uint64_t)ties) >> 32) : 0;
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].count == best && pick-- == 0) {
+            decision.symbol = (int)events[i].slot;
+            break;
+        }
+    }
+    return decision;
+}
+
+DemodulatorStats demodulatePPM(PhotonCountReader& input, int order, const std::vector<uint32_t>& transmitted,
+    uint64_t seed, ThreadPool& pool, std::vector<SymbolDecision>* decisions, bool& malformed) {
+    DemodulatorStats stats;
+    long long slotsPerSymbol = 1LL << order;
+    long long chunkSlots = std::max(demodulator_chunk_slots, slotsPerSymbol);
+    bool sparse = input.sparse();
+    malformed = false;
+
+    // Two chunks per thread keeps everyone busy while a slow chunk finishes. A sparse file
+    // fills lists of occupied slots instead of buffers of counts.
+    size_t batchSize = 2 * pool.size();
+    std::vector<std::vector<uint32_t>> batch;
+    std::vector<std::vector<SlotEvent>> batchEvents;
+    if (sparse) {
+        batchEvents.resize(batchSize);
+    }
+    else {
+        batch.assign(batchSize, std::vector<uint32_t>((size_t)chunkSlots));
+    }
+    std::vector<long long> batchSlots(batchSize);
+    std::vector<DemodulatorStats> batchStats(batchSize);
+    long long next_symbol = 0;
+
+    bool more = true;
+    while (more) {
+        size_t chunks = 0;
+        while (chunks < batchSize) {
+            long long got = sparse ? input.readEvents(batchEvents[chunks], chunkSlots)
+                                   : input.read(batch[chunks].data(), chunkSlots);
+            if (got < 0) {
+                malformed = true;
+                got = 0;
+            }
+            if (got == 0) {
+                break;
+            }
+            // A last frame cut short is padded with empty slots
+            long long padded = (got + slotsPerSymbol - 1) / slotsPerSymbol * slotsPerSymbol;
+            if (!sparse) {
+                std::fill(batch[chunks].begin() + got, batch[chunks].begin() + padded, 0);
+            }
+            batchSlots[chunks] = padded;
+            chunks++;
+            if (got < chunkSlots) {
+                break;
+            }
+        }
+        more = (chunks == batchSize);
+
+        std::vector<long long> firstSymbols(chunks);
+        for (size_t c = 0; c < chunks; c++) {
+            firstSymbols[c] = next_symbol;
+            next_symbol += batchSlots[c] / slotsPerSymbol;
+        }
+        if (decisions != nullptr) {
+            decisions->resize((size_t)next_symbol);
+        }
+
+        pool.parallelFor((long long)chunks, [&](long long c) {
+            DemodulatorStats& chunkStats = batchStats[c];
+            chunkStats = DemodulatorStats();
+            long long frames = batchSlots[c] / slotsPerSymbol;
+            std::vector<SlotEvent> frameEvents;
+            size_t next_event = 0;
+            for (long long f = 0; f < frames; f++) {
+                long long symbol = firstSymbols[c] + f;
+                Philox rng(seed, demodulator_stage, (uint64_t)symbol);
+                SymbolDecision decision;
+                if (sparse) {
+                    // The frame's occupied slots, renumbered from its first slot
+                    const std::vector<SlotEvent>& events = batchEvents[c];
+                    long long frame_end = (f + 1) * slotsPerSymbol;
+                    frameEvents.clear();
+                    for (; next_event < events.size() && events[next_event].slot < frame_end; next_event++) {
+                        frameEvents.push_back({ events[next_event].slot - f * slotsPerSymbol, events[next_event].count });
+                    }
+                    decision = demodulateEvents(frameEvents.data(), frameEvents.size(), rng);
+                }
+                else {
+                    decision = demodulateFrame(batch[c].data() + f * slotsPerSymbol, slotsPerSymbol, rng);
+                }
+
+                chunkStats.symbols++;
+                chunkStats.photons += decision.photons;
+                chunkStats.ties += (decision.ties > 1);
+                if (decision.symbol < 0) {
+                    chunkStats.erasures++;
+                }
+                else if (symbol < (long long)transmitted.size() && (uint32_t)decision.symbol != transmitted[symbol]) {
+                    chunkStats.errors++;
+                }
+                if (decisions != nullptr) {
+                    (*decisions)[(size_t)symbol] = decision;
+                }
+            }
+        });
+
+        for (size_t c = 0; c < chunks; c++) {
+            stats.symbols += batchStats[c].symbols;
+            stats.erasures += batchStats[c].erasures;
+            stats.errors += batchStats[c].errors;
+            stats.ties += batchStats[c].ties;
+            stats.photons += batchStats[c].photons;
+        }
+    }
+
+    return stats;
+}
@@ -0,0 +1,125 @@
+// PPMDemodulator.h
+//
+// Receiver for uncoded M-ary PPM: frames a stream of photon counts into symbols of
+// M = 2^order slots and picks the slot with the most photons in each.
+//
+// The count files are the ones written by stls_pulse_to_photons_poisson (ASCII or
+// binary, compressed or not, or varint RLE), a .slots container or a .events stream. Frames
+// are expanded into a buffer of counts a batch at a time and each frame is scanned with AVX-512
+// or AVX2 max/compare kernels when the compiler targets them, plain loops otherwise. Files that
+// hold only the occupied slots (containers, event streams and varint RLE) are decided from
+// their occupied slots instead, so a frame of 2^31 slots costs no more than its photons. Ties
+// for the largest count are broken uniformly at random and a frame without a single
+// photon is an erasure.
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "EventStream.h"
+#include "SlotBitmap.h"
+#include "SlotContainer.h"
+#include "ThreadPool.h"
+#include "mapped_file.h"
+#include "philox.h"
+#include "slot_codec.h"
+#include "varint.h"
+
+// Reads photon counts one slot at a time from any of the photon file formats
+class PhotonCountReader {
+public:
+    // The format comes from the name (.rle.txt, .rle.bin, .vrle, .bin, .pulses.txt for '0'/'1'
+    // characters, otherwise uncompressed ASCII) unless the file is a container or an event
+    // stream. Check isOpen() before use.
+    explicit PhotonCountReader(const std::string& filename);
+    ~PhotonCountReader();
+
+    bool isOpen() const {
+        return open;
+    }
+
+    // Fills counts with up to maxSlots slots and returns how many it filled (0 at the end).
+    // Returns -1 if the file is malformed.
+    long long read(uint32_t* counts, long long maxSlots);
+
+    // Like read, but gives only the occupied slots (numbered from the first slot read) and
+    // returns the number of slots covered
+    long long readEvents(std::vector<SlotEvent>& events, long long maxSlots);
+
+    // True if the file stores only the occupied slots, so readEvents never visits the empty ones
+    bool sparse() const {
+        return format == container || format == events || format == varint_rle;
+    }
+
+private:
+    // stls_file covers the stls formats read through their slot_codec (RLE text and binary,
+    // uncompressed binary and counts as text); pulse_text has '0'/'1' characters, which may be
+    // separated by whitespace here
+    enum Format { stls_file, pulse_text, varint_rle, container, events };
+
+    // Hands out the current pair and then the following ones until maxSlots slots are covered,
+    // calling zeros(run) for each stretch of empty slots and value(slot, count) for each
+    // occupied one. Returns the slots covered, or -1 if the file is malformed.
+    template <typename Zeros, typename Value>
+    long long walkPairs(long long maxSlots, Zeros zeros, Value value);
+
+    // Next 16-bit word of an RLE file, false at the end
+    bool nextWord(uint32_t& word);
+    // Next (zero run, value) pair of an RLE file, container or event stream, false at the end
+    bool nextPair(long long& zeros, uint32_t& value);
+
+    Format format = stls_file;
+    bool open = false;
+    const slot_codec* codec = nullptr;
+    slot_codec_reader codecReader = {};
+    std::vector<uint16_t> words;    // RLE words read through the codec, whole pairs at a time
+    size_t wordPosition = 0;
+    size_t wordCount = 0;
+    int wordStatus = SLOT_CODEC_OK; // result of the read that filled words
+    std::ifstream file;
+    std::unique_ptr<ContainerBlockReader> blocks;
+    std::unique_ptr<EventBlockReader> eventStream;
+    mapped_file map = {};
+    std::unique_ptr<varint_rle_reader> varints;
+    long long eventSlot = 0;        // slot after the last event
+    long long block = 0;            // container block being read
+    const uint32_t* pairs = nullptr; // its pairs and how many are left
+    size_t pairsLeft = 0;
+    long long zerosLeft = 0;        // part of the current pair not yet handed out
+    uint32_t pendingValue = 0;
+    bool valuePending = false;
+    bool malformed = false;
+};
+
+// The decision for one frame and the numbers behind it
+struct SymbolDecision {
+    int symbol = -1;        // decided slot, or -1 for an erasure
+    uint32_t best = 0;      // photons in the fullest slot
+    uint32_t second = 0;    // photons in the next fullest slot (equal to best on a tie)
+    uint32_t photons = 0;   // photons in the whole frame
+    int ties = 0;           // slots sharing the largest count
+};
+
+// Decides one frame of counts. rng is only used for ties.
+SymbolDecision demodulateFrame(const uint32_t* counts, long long slots, Philox& rng);
+
+// The same decision from the occupied slots of a frame, numbered from its first slot and in order.
+// Gives exactly what demodulateFrame gives for the expanded frame, random tie-break included.
+SymbolDecision demodulateEvents(const SlotEvent* events, size_t count, Philox& rng);
+
+struct DemodulatorStats {
+    long long symbols = 0;
+    long long erasures = 0;      // frames with no photons
+    long long errors = 0;        // wrong decisions, not counting erasures
+    long long ties = 0;          // decisions settled by a random pick
+    long long photons = 0;
+};
+
+// Demodulates the whole file on the thread pool. If transmitted is not empty the decisions are
+// checked against it. Per-symbol decisions and soft metrics go to the vectors that are given.
+DemodulatorStats demodulatePPM(PhotonCountReader& input, int order, const std::vector<uint32_t>& transmitted,
+    uint64_t seed, ThreadPool& pool, std::vector<SymbolDecision>* decisions, bool& malformed);
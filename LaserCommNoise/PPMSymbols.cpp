@@ -0,0 +1,292 @@
+#include "PPMSymbols.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "ChannelPipeline.h"
+
+// Random streams for the symbol simulator, clear of the slot-level stages
+const uint32_t ppm_symbol_stage = 0x200;   // everything drawn inside one symbol
+const uint32_t ppm_source_stage = 0x201;   // random transmitted symbols
+const uint32_t ppm_message_stage = 0x202;  // random Reed-Solomon messages
+
+// Symbols handed to one task at a time
+const long long ppm_chunk_symbols = 1 << 16;
+
+// Means up to this use a table; the tail past the table holds less than 2^-53
+const double poisson_table_max_mean = 32.0;
+
+PoissonTable::PoissonTable(double mean) {
+    if (mean > poisson_table_max_mean) {
+        poisson_table_init(&large, mean);
+        return;
+    }
+    double term = std::exp(-mean);
+    double cumulative = term;
+    for (long long k = 1; cumulative < 1.0 - 0x1.0p-53 && term > 0; k++) {
+        cdf.push_back(cumulative);
+        term *= mean / k;
+        cumulative += term;
+    }
+    cdf.push_back(1.0);
+}
+
+PPMSymbolSimulator::PPMSymbolSimulator(const PPMChannel& channel)
+    : channel(channel), signal(channel.mean_photons), pulseBackground(channel.background_mean),
+    otherBackground(channel.background_mean * (channel.slotsPerSymbol() - 1)) {}
+
+bool PPMSymbolSimulator::simulate(uint32_t symbol, Philox& rng, std::vector<SlotCount>& counts) {
+    counts.clear();
+    uint32_t slots = (uint32_t)channel.slotsPerSymbol();
+
+    bool erased = (double)(rng() >> 11) * 0x1.0p-53 < channel.erasure_probability;
+    int signalPhotons = 0;
+    if (!erased && channel.mean_photons > 0) {
+        signalPhotons = (int)signal(rng);
+    }
+
+    int pulseBackgroundPhotons = 0;
+    long long otherBackgroundPhotons = 0;
+    if (channel.background_mean > 0) {
+        pulseBackgroundPhotons = (int)pulseBackground(rng);
+        otherBackgroundPhotons = otherBackground(rng);
+    }
+
+    // Scatter the background of the empty slots, skipping over the pulse slot
+    for (long long i = 0; i < otherBackgroundPhotons; i++) {
+        uint32_t slot = (uint32_t)(((rng() >> 32) * (slots - 1)) >> 32);
+        if (slot >= symbol) {
+            slot++;
+        }
+        counts.push_back({ slot, 1 });
+    }
+    if (signalPhotons + pulseBackgroundPhotons > 0) {
+        counts.push_back({ symbol, (uint32_t)(signalPhotons + pulseBackgroundPhotons) });
+    }
+
+    // Merge photons that landed in the same slot
+    std::sort(counts.begin(), counts.end(), [](const SlotCount& a, const SlotCount& b) {
+        return a.slot < b.slot;
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (kept > 0 && counts[kept - 1].slot == counts[i].slot) {
+            counts[kept - 1].photons += counts[i].photons;
+        }
+        else {
+            counts[kept++] = counts[i];
+        }
+    }
+    counts.resize(kept);
+
+    return erased;
+}
+
+int decideSymbol(const std::vector<SlotCount>& counts, Philox& rng) {
+    uint32_t most = 0;
+    int ties = 0;
+    int decision = erased_symbol;
+    for (const SlotCount& count : counts) {
+        if (count.photons > most) {
+            most = count.photons;
+            decision = (int)count.slot;
+            ties = 1;
+        }
+        else if (count.photons == most && most > 0) {
+            // Reservoir sampling keeps each tied slot with equal chance
+            ties++;
+            if ((((rng() >> 32) * (uint64_t)ties) >> 32) == 0) {
+                decision = (int)count.slot;
+            }
+        }
+    }
+    return decision;
+}
+
+bool readPPMSymbols(BlockSource& source, int order, std::vector<uint32_t>& symbols, long long& badFrames) {
+    long long slotsPerSymbol = 1LL << order;
+    std::vector<int> pulsesInFrame;
+    std::vector<long long> pulses;
+    long long first_slot = 0;
+    long long slots = 0;
+    symbols.clear();
+    badFrames = 0;
+
+    // A dense source goes through a bitmap, so its blocks are capped whatever the frame size;
+    // a sparse one only ever holds the pulses
+    long long maxSlots = source.sparse() ? slotsPerSymbol << 14 : std::min(slotsPerSymbol << 14, 1LL << 24);
+
+    // Blocks needn't line up with frames, so track the frame of every pulse by its absolute slot
+    while (source.readPulses(pulses, first_slot, slots, maxSlots)) {
+        long long frames = (first_slot + slots + slotsPerSymbol - 1) / slotsPerSymbol;
+        symbols.resize(frames, 0);
+        pulsesInFrame.resize(frames, 0);
+        for (long long slot : pulses) {
+            long long frame = slot / slotsPerSymbol;
+            if (pulsesInFrame[frame]++ == 0) {
+                symbols[frame] = (uint32_t)(slot % slotsPerSymbol);
+            }
+        }
+        first_slot += slots;
+    }
+    if (!source.good()) {
+        return false;
+    }
+    for (int pulses : pulsesInFrame) {
+        badFrames += (pulses != 1);
+    }
+    if (first_slot % slotsPerSymbol != 0) {
+        badFrames++; // the last frame is cut short
+    }
+    return true;
+}
+
+PPMStats runPPMSymbols(const PPMChannel& channel, const std::vector<uint32_t>& symbols, long long count,
+    uint64_t seed, ThreadPool& pool, RLEWriter* rle, std::vector<int>* decoded) {
+    PPMStats stats;
+    if (!symbols.empty()) {
+        count = (long long)symbols.size();
+    }
+    if (decoded != nullptr) {
+        decoded->assign(count, erased_symbol);
+    }
+
+    // The detected slots of every symbol in a chunk, kept only when writing RLE
+    struct Chunk {
+        PPMStats stats;
+        std::vector<long long> detected; // slot offsets from the start of the chunk
+    };
+    std::vector<Chunk> batch(2 * pool.size());
+    long long chunks = (count + ppm_chunk_symbols - 1) / ppm_chunk_symbols;
+
+    for (long long start = 0; start < chunks; start += (long long)batch.size()) {
+        long long batchChunks = std::min((long long)batch.size(), chunks - start);
+        pool.parallelFor(batchChunks, [&](long long c) {
+            Chunk& chunk = batch[c];
+            chunk.stats = PPMStats();
+            chunk.detected.clear();
+            std::vector<SlotCount> counts;
+            PPMSymbolSimulator simulator(channel);
+            long long first = (start + c) * ppm_chunk_symbols;
+            long long last = std::min(first + ppm_chunk_symbols, count);
+
+            for (long long s = first; s < last; s++) {
+                uint32_t symbol;
+                if (symbols.empty()) {
+                    Philox source(seed, ppm_source_stage, (uint64_t)s);
+                    symbol = (uint32_t)(source() & (uint64_t)(channel.slotsPerSymbol() - 1));
+                }
+                else {
+                    symbol = symbols[s];
+                }
+
+                Philox rng(seed, ppm_symbol_stage, (uint64_t)s);
+                bool erased = simulator.simulate(symbol, rng, counts);
+                int decision = decideSymbol(counts, rng);
+
+                chunk.stats.symbols++;
+                chunk.stats.erasedPulses += erased;
+                if (decision == erased_symbol) {
+                    chunk.stats.erasures++;
+                }
+                else if ((uint32_t)decision != symbol) {
+                    chunk.stats.symbolErrors++;
+                }
+                for (const SlotCount& slot : counts) {
+                    chunk.stats.photons += slot.photons;
+                    if (rle != nullptr && (int)slot.photons >= channel.threshold) {
+                        chunk.detected.push_back((s - first) * channel.slotsPerSymbol() + slot.slot);
+                    }
+                }
+                if (decoded != nullptr) {
+                    (*decoded)[s] = decision;
+                }
+            }
+        });
+
+        // Merge in order so the RLE output is the same for any thread count
+        for (long long c = 0; c < batchChunks; c++) {
+            const Chunk& chunk = batch[c];
+            stats.symbols += chunk.stats.symbols;
+            stats.erasedPulses += chunk.stats.erasedPulses;
+            stats.erasures += chunk.stats.erasures;
+            stats.symbolErrors += chunk.stats.symbolErrors;
+            stats.photons += chunk.stats.photons;
+            if (rle != nullptr) {
+                long long previous = -1;
+                for (long long slot : chunk.detected) {
+                    rle->addZeros(slot - previous - 1);
+                    rle->addOne();
+                    previous = slot;
+                }
+                rle->addZeros(chunk.stats.symbols * channel.slotsPerSymbol() - previous - 1);
+            }
+        }
+    }
+    if (rle != nullptr) {
+        rle->finish();
+    }
+
+    return stats;
+}
+
+CodedStats runCodedPPM(const PPMChannel& channel, const ReedSolomon& code, long long count, uint64_t seed,
+    ThreadPool& pool) {
+    CodedStats stats;
+    const int n = ReedSolomon::length;
+    const long long batchCodewords = 1024;
+
+    std::vector<uint16_t> sent, received;
+    std::vector<uint8_t> erased;
+    std::vector<CodedStats> codewordStats;
+    std::vector<int> results;
+
+    for (long long start = 0; start < count; start += batchCodewords) {
+        long long codewords = std::min(batchCodewords, count - start);
+        sent.resize((size_t)(codewords * n));
+        received.resize(sent.size());
+        erased.resize(sent.size());
+        codewordStats.assign(codewords, CodedStats());
+
+        // Encode, transmit and decide every symbol; streams are keyed by the absolute symbol index
+        pool.parallelFor(codewords, [&](long long c) {
+            long long codeword = start + c;
+            uint16_t* out = &sent[(size_t)(c * n)];
+            std::vector<uint16_t> message(code.messageLength());
+            Philox source(seed, ppm_message_stage, (uint64_t)codeword);
+            for (uint16_t& symbol : message) {
+                symbol = (uint16_t)(source() & (ReedSolomon::field_size - 1));
+            }
+            code.encode(message.data(), out);
+
+            PPMSymbolSimulator simulator(channel);
+            std::vector<SlotCount> counts;
+            for (int i = 0; i < n; i++) {
+                Philox rng(seed, ppm_symbol_stage, (uint64_t)(codeword * n + i));
+                simulator.simulate(out[i], rng, counts);
+                int decision = decideSymbol(counts, rng);
+                size_t at = (size_t)(c * n + i);
+                erased[at] = (decision == erased_symbol);
+                received[at] = erased[at] ? 0 : (uint16_t)decision;
+                codewordStats[c].symbolErasures += erased[at];
+                codewordStats[c].symbolErrors += !erased[at] && received[at] != out[i];
+            }
+        });
+
+        auto begin = std::chrono::steady_clock::now();
+        code.decodeBatch(received.data(), erased.data(), codewords, pool, results);
+        stats.decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        for (long long c = 0; c < codewords; c++) {
+            stats.codewords++;
+            stats.symbolErasures += codewordStats[c].symbolErasures;
+            stats.symbolErrors += codewordStats[c].symbolErrors;
+            stats.decodeFailures += (results[c] < 0);
+            stats.frameErrors += !std::equal(sent.begin() + c * n, sent.begin() + (c + 1) * n,
+                received.begin() + c * n);
+        }
+    }
+
+    return stats;
+}
@@ -0,0 +1,126 @@
+// PPMSymbols.h
+//
+// Symbol-level simulation of uncoded M-ary PPM.
+//
+// Every symbol is M = 2^order slots with exactly one pulse. Rather than visiting the
+// slots, each symbol is simulated as a whole:
+//   - the pulse is erased with the erasure probability, otherwise it yields a
+//     Poisson(K) number of signal photons,
+//   - the pulse slot picks up Poisson(nb) background photons of its own,
+//   - the other M-1 slots share one Poisson((M-1) nb) draw, and each of those photons
+//     lands in one of them uniformly at random.
+// Splitting a Poisson total uniformly gives independent Poisson(nb) counts per slot, so
+// this is the same distribution as the per-slot model at a cost per symbol that
+// depends only on the number of photons. The photons can be written out as detected
+// slots (RLE) or decided on straight away (largest count wins, ties broken at random,
+// no photons at all is an erasure).
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "BlockStream.h"
+#include "RLEChannel.h"
+#include "ReedSolomon.h"
+#include "ThreadPool.h"
+#include "philox.h"
+#include "poisson.h"
+
+struct PPMChannel {
+    int order = 10;                   // log2 of the slots per symbol
+    double mean_photons = 0.5;        // K, signal photons per pulse
+    double erasure_probability = 0;   // chance the pulse is lost altogether
+    double background_mean = 0;       // background photons per slot
+    int threshold = 1;                // photons needed to detect a slot in the RLE output
+
+    long long slotsPerSymbol() const {
+        return 1LL << order;
+    }
+};
+
+// Photons in one slot of a symbol
+struct SlotCount {
+    uint32_t slot;     // offset inside the symbol
+    uint32_t photons;
+};
+
+// Returned by decideSymbol when no slot saw a photon
+const int erased_symbol = -1;
+
+// Poisson sampler by inversion of a precomputed CDF: one uniform per draw for the small
+// means seen per slot and per symbol, falling back to PTRS (poisson.c) for large ones
+class PoissonTable {
+public:
+    explicit PoissonTable(double mean);
+
+    long long operator()(Philox& rng) {
+        if (cdf.empty()) {
+            return poisson_table_sample(&large, Philox::bits, &rng);
+        }
+        double u = (double)(rng() >> 11) * 0x1.0p-53;
+        long long k = 0;
+        while (k + 1 < (long long)cdf.size() && u >= cdf[k]) {
+            k++;
+        }
+        return k;
+    }
+
+private:
+    std::vector<double> cdf; // Pr(X <= k), empty when the mean is too large for a table
+    poisson_table large{};   // PTRS constants, set when the mean is too large for a table
+};
+
+// Draws the photons of one symbol at a time. Setting up the Poisson tables is the
+// expensive part, so one simulator is kept per worker and reused.
+class PPMSymbolSimulator {
+public:
+    explicit PPMSymbolSimulator(const PPMChannel& channel);
+
+    // Draws the photons of one symbol into counts (sorted by slot, one entry per slot)
+    // and returns true if the pulse was erased. rng should be keyed by the symbol.
+    bool simulate(uint32_t symbol, Philox& rng, std::vector<SlotCount>& counts);
+
+private:
+    PPMChannel channel;
+    PoissonTable signal;
+    PoissonTable pulseBackground;   // background in the pulse slot
+    PoissonTable otherBackground;   // background over the other M-1 slots
+};
+
+// The slot with the most photons, ties broken uniformly at random, or erased_symbol
+int decideSymbol(const std::vector<SlotCount>& counts, Philox& rng);
+
+// Reads the transmitted symbols (the pulse position in each frame of M slots).
+// Frames without exactly one pulse are counted in badFrames and use their first pulse, or 0.
+// Returns false if the source is malformed, rather than the symbols read before it went wrong.
+bool readPPMSymbols(BlockSource& source, int order, std::vector<uint32_t>& symbols, long long& badFrames);
+
+struct PPMStats {
+    long long symbols = 0;
+    long long erasedPulses = 0;    // pulses lost in the channel
+    long long erasures = 0;        // symbols with no photons at all
+    long long symbolErrors = 0;    // symbols decided wrongly (not counting erasures)
+    long long photons = 0;
+};
+
+// Runs the symbols through the channel on the thread pool. symbols may be empty, in which
+// case count random symbols are generated from the seed. If rle is given, the detected
+// slots are written to it; if decoded is given, it receives the decision for every symbol.
+PPMStats runPPMSymbols(const PPMChannel& channel, const std::vector<uint32_t>& symbols, long long count,
+    uint64_t seed, ThreadPool& pool, RLEWriter* rle, std::vector<int>* decoded);
+
+struct CodedStats {
+    long long codewords = 0;
+    long long frameErrors = 0;      // codewords not recovered exactly
+    long long decodeFailures = 0;   // codewords the decoder gave up on
+    long long symbolErasures = 0;   // before decoding
+    long long symbolErrors = 0;     // before decoding
+    double decodeSeconds = 0;       // time spent in the decoder
+};
+
+// Sends count random Reed-Solomon codewords over the channel, one PPM symbol per code symbol
+// (the order must be 10), and decodes them with no-photon symbols as erasures
+CodedStats runCodedPPM(const PPMChannel& channel, const ReedSolomon& code, long long count, uint64_t seed,
+    ThreadPool& pool);
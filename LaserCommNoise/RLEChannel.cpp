@@ -0,0 +1,94 @@
+#include "RLEChannel.h"
+
+#include "GeometricSampler.h"
+
+RLEReader::RLEReader(std::istream& input) : input(input) {}
+
+bool RLEReader::next(long long& zeros, long long& ones) {
+    if (!input.next(zeros)) {
+        return false;
+    }
+    // Files can end on a zero count with nothing after it
+    if (!input.next(ones)) {
+        ones = 0;
+    }
+    return true;
+}
+
+RLEWriter::RLEWriter(std::ostream& output) : output(output) {}
+
+void RLEWriter::addZeros(long long count) {
+    pendingZeros += count;
+}
+
+void RLEWriter::addOne() {
+    output.write(pendingZeros);
+    output.write(1);
+    pendingZeros = 0;
+}
+
+void RLEWriter::finish() {
+    if (pendingZeros > 0) {
+        output.write(pendingZeros);
+        output.write(0);
+        pendingZeros = 0;
+    }
+    output.flush();
+}
+
+ChannelStats channelRLE(std::istream& input, std::ostream& output,
+    double erasure_probability, double noise_probability, std::mt19937_64& rng) {
+    RLEReader reader(input);
+    RLEWriter writer(output);
+    ChannelStats stats;
+
+    GeometricSampler noiseSampler(noise_probability);
+    GeometricSampler erasureSampler(erasure_probability);
+    auto draw = [&]() {
+        stats.rngDraws++;
+        return rng();
+    };
+
+    // Distance (in eligible slots) to the next noisy zero and to the next erased pulse
+    long long noiseGap = noiseSampler.next(draw);
+    long long erasureGap = erasureSampler.next(draw);
+
+    // Places noise photons inside a run of zeros
+    auto zeroRun = [&](long long count) {
+        while (noiseGap < count) {
+            writer.addZeros(noiseGap);
+            writer.addOne();
+            stats.noise++;
+            count -= noiseGap + 1;
+            noiseGap = noiseSampler.next(draw);
+        }
+        noiseGap -= count;
+        writer.addZeros(count);
+    };
+
+    long long zeros, ones;
+    while (reader.next(zeros, ones)) {
+        stats.slots += zeros + ones;
+        stats.pulses += ones;
+
+        zeroRun(zeros);
+
+        // Only the pulse slots are rolled for erasures
+        for (long long i = 0; i < ones; i++) {
+            if (erasureGap == 0) {
+                stats.erasures++;
+                erasureGap = erasureSampler.next(draw);
+                // An erased slot is a zero again, so it can still pick up noise
+                zeroRun(1);
+            }
+            else {
+                erasureGap--;
+                writer.addOne();
+            }
+        }
+    }
+    writer.finish();
+    stats.malformed = !reader.good();
+
+    return stats;
+}
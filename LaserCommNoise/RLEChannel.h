@@ -0,0 +1,70 @@
+// RLEChannel.h
+//
+// Applies erasures and noise directly to a run-length-encoded signal.
+//
+// The ASCII files come in the form <number of zeros> <number of signal photons>.
+// Instead of expanding every pair into one entry per slot, the channel walks the
+// pairs and jumps ahead by geometrically distributed gaps to find the next noisy
+// slot or the next erased pulse. The work done scales with the number of pulses
+// and noise events rather than with the number of slots.
+
+#pragma once
+
+#include <iostream>
+#include <random>
+
+#include "TextCodec.h"
+
+// Reads <number of zeros> <number of signal photons> pairs from a stream
+class RLEReader {
+public:
+    explicit RLEReader(std::istream& input);
+
+    // Returns false once the stream is exhausted. A trailing lone zero count
+    // (no photon count after it) is returned with ones = 0.
+    bool next(long long& zeros, long long& ones);
+
+    // False if reading stopped on text that isn't a count rather than at the end
+    bool good() const {
+        return input.good();
+    }
+
+private:
+    TextReader input;
+};
+
+// Writes slots back out as <number of zeros> <number of signal photons> pairs.
+// Every occupied slot is written as its own "<zeros> 1" pair (the same as
+// BinarytoASCII), and any trailing zeros are flushed as "<zeros> 0".
+class RLEWriter {
+public:
+    explicit RLEWriter(std::ostream& output);
+
+    void addZeros(long long count);
+    void addOne();
+
+    // Flushes the trailing zero run, if there is one, and everything still buffered
+    void finish();
+
+private:
+    TextWriter output;
+    long long pendingZeros = 0;
+};
+
+// Running totals for one pass of the channel
+struct ChannelStats {
+    long long slots = 0;     // total slots in the input
+    long long pulses = 0;    // occupied slots in the input
+    long long erasures = 0;  // pulses turned into zeros
+    long long noise = 0;     // zeros turned into ones
+    long long rngDraws = 0;  // 64-bit random numbers used
+    bool malformed = false;  // reading stopped on text that isn't a count, before the end
+};
+
+// Introduces erasures and noise into an RLE stream without expanding it.
+// Erasures are applied first and an erased slot is eligible for noise, as when running
+// signalErasure followed by signalNoise on the expanded signal. The draws come from rng rather
+// than the Philox counters those use, so the result is statistically equivalent only: the same
+// rates, but not the same slots for a seed.
+ChannelStats channelRLE(std::istream& input, std::ostream& output,
+    double erasure_probability, double noise_probability, std::mt19937_64& rng);
@@ -0,0 +1,354 @@
+#include "ReedSolomon.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// x^10 + x^3 + 1
+const int rs_primitive_polynomial = 0x409;
+
+// Codewords whose syndromes are computed together
+const int rs_batch = 16;
+
+ReedSolomon::ReedSolomon(int messageLength)
+    : k(messageLength), exps(2 * length), logs(field_size, 0) {
+    int x = 1;
+    for (int i = 0; i < length; i++) {
+        exps[i] = (uint16_t)x;
+        exps[i + length] = (uint16_t)x;
+        logs[x] = i;
+        x <<= 1;
+        if (x & field_size) {
+            x ^= rs_primitive_polynomial;
+        }
+    }
+
+    // g(x) = (x + alpha)(x + alpha^2)...(x + alpha^(n-k))
+    generator.assign(1, 1);
+    for (int j = 1; j <= paritySymbols(); j++) {
+        std::vector<uint16_t> next(generator.size() + 1, 0);
+        for (size_t i = 0; i < next.size(); i++) {
+            if (i < generator.size()) {
+                next[i] ^= generator[i];
+            }
+            if (i > 0) {
+                next[i] ^= multiply(power(j), generator[i - 1]);
+            }
+        }
+        generator = next;
+    }
+
+    // For every syndrome, the products of alpha^j with each nibble of a symbol, split into
+    // low and high bytes: 6 tables of 16 bytes, each repeated to fill a 32-byte register
+    nibbleTables.resize((size_t)paritySymbols() * 192);
+    for (int j = 1; j <= paritySymbols(); j++) {
+        uint8_t* tables = &nibbleTables[(size_t)(j - 1) * 192];
+        for (int nibble = 0; nibble < 3; nibble++) {
+            for (int v = 0; v < 16; v++) {
+                uint16_t product = multiply(power(j), (uint16_t)((v << (4 * nibble)) & length));
+                for (int half = 0; half < 32; half += 16) {
+                    tables[nibble * 64 + half + v] = (uint8_t)product;
+                    tables[nibble * 64 + 32 + half + v] = (uint8_t)(product >> 8);
+                }
+            }
+        }
+    }
+}
+
+uint16_t ReedSolomon::divide(uint16_t a, uint16_t b) const {
+    if (a == 0) {
+        return 0;
+    }
+    return exps[logs[a] + length - logs[b]];
+}
+
+uint16_t ReedSolomon::power(int exponent) const {
+    exponent %= length;
+    if (exponent < 0) {
+        exponent += length;
+    }
+    return exps[exponent];
+}
+
+void ReedSolomon::encode(const uint16_t* message, uint16_t* codeword) const {
+    int parity = paritySymbols();
+    std::vector<uint16_t> remainder(parity, 0);
+
+    // Long division of message(x) x^(n-k) by g(x), one message symbol at a time
+    for (int i = 0; i < k; i++) {
+        uint16_t feedback = message[i] ^ remainder[0];
+        for (int j = 0; j < parity - 1; j++) {
+            remainder[j] = remainder[j + 1] ^ multiply(feedback, generator[j + 1]);
+        }
+        remainder[parity - 1] = multiply(feedback, generator[parity]);
+    }
+
+    std::copy(message, message + k, codeword);
+    std::copy(remainder.begin(), remainder.end(), codeword + k);
+}
+
+bool ReedSolomon::syndromes(const uint16_t* codeword, uint16_t* S) const {
+    bool any = false;
+    for (int j = 1; j <= paritySymbols(); j++) {
+        // Horner's rule: codeword(alpha^j), highest degree first
+        uint16_t s = 0;
+        for (int i = 0; i < length; i++) {
+            s = (s == 0 ? 0 : exps[logs[s] + j]) ^ codeword[i];
+        }
+        S[j - 1] = s;
+        any |= (s != 0);
+    }
+    return any;
+}
+
+void ReedSolomon::syndromes16(const uint16_t* interleaved, uint16_t* S) const {
+    int parity = paritySymbols();
+#if defined(__AVX2__)
+    const __m256i low = _mm256_set1_epi16(0x000F);
+
+    // sum * alpha^(j+1), looked up a nibble at a time from the syndrome's six tables. The
+    // high byte of every index is zero, and so is the product of zero, so each lookup
+    // leaves it clear.
+    auto multiply16 = [&](__m256i sum, const __m256i* tables) {
+        __m256i n0 = _mm256_and_si256(sum, low);
+        __m256i n1 = _mm256_and_si256(_mm256_srli_epi16(sum, 4), low);
+        __m256i n2 = _mm256_srli_epi16(sum, 8);
+        __m256i lo = _mm256_xor_si256(_mm256_xor_si256(_mm256_shuffle_epi8(_mm256_loadu_si256(tables + 0), n0),
+            _mm256_shuffle_epi8(_mm256_loadu_si256(tables + 2), n1)), _mm256_shuffle_epi8(_mm256_loadu_si256(tables + 4), n2));
+        __m256i hi = _mm256_xor_si256(_mm256_xor_si256(_mm256_shuffle_epi8(_mm256_loadu_si256(tables + 1), n0),
+            _mm256_shuffle_epi8(_mm256_loadu_si256(tables + 3), n1)), _mm256_shuffle_epi8(_mm256_loadu_si256(tables + 5), n2));
+        return _mm256_or_si256(lo, _mm256_slli_epi16(hi, 8));
+    };
+
+    // Four syndromes at a time: each Horner step depends on the last, so interleaving
+    // independent ones keeps the shuffle units busy
+    const __m256i* allTables = (const __m256i*)nibbleTables.data();
+    int j = 0;
+    for (; j + 4 <= parity; j += 4) {
+        __m256i sum0 = _mm256_setzero_si256(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+        for (int i = 0; i < length; i++) {
+            __m256i r = _mm256_loadu_si256((const __m256i*)(interleaved + rs_batch * i));
+            sum0 = _mm256_xor_si256(multiply16(sum0, allTables + 6 * (j + 0)), r);
+            sum1 = _mm256_xor_si256(multiply16(sum1, allTables + 6 * (j + 1)), r);
+            sum2 = _mm256_xor_si256(multiply16(sum2, allTables + 6 * (j + 2)), r);
+            sum3 = _mm256_xor_si256(multiply16(sum3, allTables + 6 * (j + 3)), r);
+        }
+        _mm256_storeu_si256((__m256i*)(S + rs_batch * (j + 0)), sum0);
+        _mm256_storeu_si256((__m256i*)(S + rs_batch * (j + 1)), sum1);
+        _mm256_storeu_si256((__m256i*)(S + rs_batch * (j + 2)), sum2);
+        _mm256_storeu_si256((__m256i*)(S + rs_batch * (j + 3)), sum3);
+    }
+    for (; j < parity; j++) {
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < length; i++) {
+            __m256i r = _mm256_loadu_si256((const __m256i*)(interleaved + rs_batch * i));
+            sum = _mm256_xor_si256(multiply16(sum, allTables + 6 * j), r);
+        }
+        _mm256_storeu_si256((__m256i*)(S + rs_batch * j), sum);
+    }
+#else
+    std::vector<uint16_t> codeword(length);
+    std::vector<uint16_t> single(parity);
+    for (int c = 0; c < rs_batch; c++) {
+        for (int i = 0; i < length; i++) {
+            codeword[i] = interleaved[rs_batch * i + c];
+        }
+        syndromes(codeword.data(), single.data());
+        for (int j = 0; j < parity; j++) {
+            S[rs_batch * j + c] = single[j];
+        }
+    }
+#endif
+}
+
+int ReedSolomon::correct(uint16_t* codeword, const uint16_t* S, const int* erasures, int numErasures) const {
+    int parity = paritySymbols();
+    if (numErasures > parity) {
+        return -1;
+    }
+
+    // Erasure locator: product of (1 + X x) over the erased positions, X = alpha^degree
+    std::vector<uint16_t> lambda(parity + 2, 0);
+    lambda[0] = 1;
+    for (int e = 0; e < numErasures; e++) {
+        uint16_t X = power(length - 1 - erasures[e]);
+        for (int i = e + 1; i > 0; i--) {
+            lambda[i] ^= multiply(X, lambda[i - 1]);
+        }
+    }
+
+    // Berlekamp-Massey started from the erasure locator (Blahut's errors-and-erasures form).
+    // The loops only run up to the degrees actually in use, which stay near the errata count.
+    std::vector<uint16_t> B = lambda;
+    std::vector<uint16_t> T(lambda.size(), 0);
+    int L = numErasures;
+    int lambdaDegree = numErasures;
+    int bDegree = numErasures;
+    for (int r = numErasures + 1; r <= parity; r++) {
+        uint16_t delta = 0;
+        for (int i = 0; i <= std::min(lambdaDegree, r - 1); i++) {
+            delta ^= multiply(lambda[i], S[r - i - 1]);
+        }
+        if (delta == 0) {
+            // lambda stays, B = x B
+            for (int i = bDegree + 1; i > 0; i--) {
+                B[i] = B[i - 1];
+            }
+            B[0] = 0;
+            bDegree++;
+            continue;
+        }
+
+        // T = lambda - delta x B
+        int tDegree = std::max(lambdaDegree, bDegree + 1);
+        T[0] = lambda[0];
+        for (int i = 1; i <= tDegree; i++) {
+            T[i] = lambda[i] ^ multiply(delta, B[i - 1]);
+        }
+        if (2 * L <= r + numErasures - 1) {
+            for (int i = 0; i <= std::max(lambdaDegree, bDegree); i++) {
+                B[i] = (i <= lambdaDegree) ? divide(lambda[i], delta) : 0;
+            }
+            bDegree = lambdaDegree;
+            L = r + numErasures - L;
+        }
+        else {
+            for (int i = bDegree + 1; i > 0; i--) {
+                B[i] = B[i - 1];
+            }
+            B[0] = 0;
+            bDegree++;
+        }
+        for (int i = 0; i <= tDegree; i++) {
+            lambda[i] = T[i];
+        }
+        lambdaDegree = tDegree;
+        while (lambdaDegree > 0 && lambda[lambdaDegree] == 0) {
+            lambdaDegree--;
+        }
+        if (lambdaDegree > parity || bDegree > parity) {
+            return -1;
+        }
+    }
+    int degree = lambdaDegree;
+    if (degree != L || L > parity) {
+        return -1;
+    }
+
+    // Evaluator: omega(x) = S(x) lambda(x) mod x^(n-k)
+    std::vector<uint16_t> omega(parity, 0);
+    for (int i = 0; i < parity; i++) {
+        for (int j = 0; j <= std::min(i, degree); j++) {
+            omega[i] ^= multiply(lambda[j], S[i - j]);
+        }
+    }
+
+    // Chien search for the roots alpha^-p, then Forney for the values. Each nonzero term
+    // lambda_i x^i is tracked by its log, which drops by i at every step of p.
+    std::vector<int> termLogs, termPowers;
+    for (int i = 1; i <= degree; i++) {
+        if (lambda[i] != 0) {
+            termLogs.push_back(logs[lambda[i]]);
+            termPowers.push_back(i);
+        }
+    }
+    int found = 0;
+    std::vector<int> positions;
+    std::vector<uint16_t> values;
+    for (int p = 0; p < length && found < degree; p++) {
+        uint16_t value = lambda[0];
+        for (size_t t = 0; t < termLogs.size(); t++) {
+            value ^= exps[termLogs[t]];
+            termLogs[t] -= termPowers[t];
+            if (termLogs[t] < 0) {
+                termLogs[t] += length;
+            }
+        }
+        if (value != 0) {
+            continue;
+        }
+        found++;
+
+        // omega(x) and lambda'(x) at x = alpha^-p, by Horner's rule from the top
+        uint16_t xInverse = power(-p);
+        uint16_t numerator = 0;
+        for (int i = parity - 1; i >= 0; i--) {
+            numerator = multiply(numerator, xInverse) ^ omega[i];
+        }
+        // lambda'(x) keeps the odd terms only in characteristic 2
+        uint16_t xSquared = multiply(xInverse, xInverse);
+        uint16_t denominator = 0;
+        for (int i = degree - (degree % 2 == 0 ? 1 : 0); i >= 1; i -= 2) {
+            denominator = multiply(denominator, xSquared) ^ lambda[i];
+        }
+        if (denominator == 0) {
+            return -1;
+        }
+        positions.push_back(length - 1 - p);
+        values.push_back(divide(numerator, denominator));
+    }
+    if (found != degree) {
+        return -1;
+    }
+
+    int changed = 0;
+    for (size_t e = 0; e < positions.size(); e++) {
+        codeword[positions[e]] ^= values[e];
+        changed += (values[e] != 0);
+    }
+    return changed;
+}
+
+int ReedSolomon::decode(uint16_t* codeword, const int* erasures, int numErasures) const {
+    std::vector<uint16_t> S(paritySymbols());
+    if (!syndromes(codeword, S.data())) {
+        return 0;
+    }
+    return correct(codeword, S.data(), erasures, numErasures);
+}
+
+void ReedSolomon::decodeBatch(uint16_t* codewords, const uint8_t* erased, long long count, ThreadPool& pool,
+    std::vector<int>& results) const {
+    results.assign(count, 0);
+    long long groups = (count + rs_batch - 1) / rs_batch;
+    int parity = paritySymbols();
+
+    pool.parallelFor(groups, [&](long long g) {
+        std::vector<uint16_t> interleaved((size_t)length * rs_batch, 0);
+        std::vector<uint16_t> S((size_t)parity * rs_batch);
+        std::vector<uint16_t> single(parity);
+        std::vector<int> erasures;
+        long long first = g * rs_batch;
+        int members = (int)std::min<long long>(rs_batch, count - first);
+
+        for (int c = 0; c < members; c++) {
+            const uint16_t* codeword = codewords + (first + c) * length;
+            for (int i = 0; i < length; i++) {
+                interleaved[rs_batch * i + c] = codeword[i];
+            }
+        }
+        syndromes16(interleaved.data(), S.data());
+
+        for (int c = 0; c < members; c++) {
+            bool any = false;
+            for (int j = 0; j < parity; j++) {
+                single[j] = S[rs_batch * j + c];
+                any |= (single[j] != 0);
+            }
+            if (!any) {
+                continue; // already a codeword, erased symbols included
+            }
+            erasures.clear();
+            const uint8_t* flags = erased + (first + c) * length;
+            for (int i = 0; i < length; i++) {
+                if (flags[i]) {
+                    erasures.push_back(i);
+                }
+            }
+            results[first + c] = correct(codewords + (first + c) * length, single.data(),
+                erasures.data(), (int)erasures.size());
+        }
+    });
+}
@@ -0,0 +1,77 @@
+// ReedSolomon.h
+//
+// Reed-Solomon code of length 1023 over GF(2^10), so one m10 PPM symbol is one code
+// symbol. Decoding corrects errors and erasures together: a symbol with no photons
+// is a known position with an unknown value (an erasure) and costs one parity
+// symbol to fill in, while a wrong decision costs two. Any mix with
+// 2 * errors + erasures <= n - k is corrected.
+//
+// Field arithmetic uses log/antilog tables (primitive polynomial x^10 + x^3 + 1,
+// first consecutive root alpha^1). Syndromes - the bulk of the work for a codeword
+// that needs little or no correction - are computed for 16 codewords at once with
+// AVX2 when the compiler targets it: a multiply by a fixed power of alpha splits each
+// 10-bit symbol into nibbles and looks the partial products up with pshufb.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ThreadPool.h"
+
+class ReedSolomon {
+public:
+    static const int symbol_bits = 10;
+    static const int field_size = 1 << symbol_bits;
+    static const int length = field_size - 1;     // n
+
+    // (1023, k) code; n - k parity symbols
+    explicit ReedSolomon(int messageLength);
+
+    int messageLength() const {
+        return k;
+    }
+
+    int paritySymbols() const {
+        return length - k;
+    }
+
+    // Systematic encoding: codeword = message followed by parity (length symbols)
+    void encode(const uint16_t* message, uint16_t* codeword) const;
+
+    // Corrects the codeword in place, given the positions of erased symbols.
+    // Returns the number of symbols changed, or -1 if the codeword can't be decoded.
+    int decode(uint16_t* codeword, const int* erasures, int numErasures) const;
+
+    // Decodes count codewords laid end to end on the thread pool. erased holds one flag
+    // per symbol. results receives decode's return value for every codeword.
+    void decodeBatch(uint16_t* codewords, const uint8_t* erased, long long count, ThreadPool& pool,
+        std::vector<int>& results) const;
+
+    uint16_t multiply(uint16_t a, uint16_t b) const {
+        if (a == 0 || b == 0) {
+            return 0;
+        }
+        return exps[logs[a] + logs[b]];
+    }
+
+    // S[j - 1] = codeword(alpha^j) for j = 1 .. n - k; returns false if all are zero
+    bool syndromes(const uint16_t* codeword, uint16_t* S) const;
+
+    // Syndromes of 16 codewords stored interleaved (symbol i of codeword c at [16 i + c]),
+    // S[16 (j - 1) + c] for codeword c; the same values as syndromes gives one at a time
+    void syndromes16(const uint16_t* interleaved, uint16_t* S) const;
+
+private:
+    uint16_t divide(uint16_t a, uint16_t b) const;
+    uint16_t power(int exponent) const; // alpha^exponent for any exponent
+
+    // Finds and fixes the errata from the syndromes
+    int correct(uint16_t* codeword, const uint16_t* S, const int* erasures, int numErasures) const;
+
+    int k;
+    std::vector<uint16_t> exps;       // alpha^i for i in [0, 2 * 1023)
+    std::vector<int> logs;            // log_alpha(x), x != 0
+    std::vector<uint16_t> generator;  // generator polynomial, highest degree first, monic
+    std::vector<uint8_t> nibbleTables; // per syndrome: product lookups for the pshufb multiply
+};
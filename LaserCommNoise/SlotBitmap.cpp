@@ -0,0 +1,179 @@
+#include "SlotBitmap.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+static long long wordsFor(long long slots) {
+    return (slots + 63) >> 6;
+}
+
+static int popcount64(uint64_t x) {
+#if defined(_MSC_VER)
+    return (int)__popcnt64(x);
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+SlotBitmap::SlotBitmap(long long slots) : bits(wordsFor(slots), 0), slots(slots) {}
+
+void SlotBitmap::clear() {
+    bits.clear();
+    slots = 0;
+}
+
+void SlotBitmap::appendZeros(long long count) {
+    // New words come in as zeros, so only the size has to grow
+    slots += count;
+    bits.resize(wordsFor(slots), 0);
+}
+
+void SlotBitmap::appendOnes(long long count) {
+    long long first = slots;
+    long long last = slots + count; // one past the final slot
+    slots = last;
+    bits.resize(wordsFor(slots), 0);
+    if (count <= 0) {
+        return;
+    }
+
+    long long firstWord = first >> 6;
+    long long lastWord = (last - 1) >> 6;
+    uint64_t headMask = ~uint64_t(0) << (first & 63);
+    uint64_t tailMask = ~uint64_t(0) >> (63 - ((last - 1) & 63));
+
+    if (firstWord == lastWord) {
+        bits[firstWord] |= headMask & tailMask;
+        return;
+    }
+    bits[firstWord] |= headMask;
+    std::fill(bits.begin() + firstWord + 1, bits.begin() + lastWord, ~uint64_t(0));
+    bits[lastWord] |= tailMask;
+}
+
+void SlotBitmap::orWith(const SlotBitmap& mask) {
+    long long n = std::min(bits.size(), mask.bits.size());
+    uint64_t* dst = bits.data();
+    const uint64_t* src = mask.bits.data();
+    long long i = 0;
+#if defined(__AVX512F__)
+    for (; i + 8 <= n; i += 8) {
+        __m512i a = _mm512_loadu_si512((const void*)(dst + i));
+        __m512i b = _mm512_loadu_si512((const void*)(src + i));
+        _mm512_storeu_si512((void*)(dst + i), _mm512_or_si512(a, b));
+    }
+#elif defined(__AVX2__)
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(a, b));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] |= src[i];
+    }
+}
+
+void SlotBitmap::andNot(const SlotBitmap& mask) {
+    long long n = std::min(bits.size(), mask.bits.size());
+    uint64_t* dst = bits.data();
+    const uint64_t* src = mask.bits.data();
+    long long i = 0;
+#if defined(__AVX512F__)
+    for (; i + 8 <= n; i += 8) {
+        __m512i a = _mm512_loadu_si512((const void*)(dst + i));
+        __m512i b = _mm512_loadu_si512((const void*)(src + i));
+        _mm512_storeu_si512((void*)(dst + i), _mm512_andnot_si512(b, a));
+    }
+#elif defined(__AVX2__)
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_andnot_si256(b, a));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] &= ~src[i];
+    }
+}
+
+long long SlotBitmap::popcount() const {
+    long long n = (long long)bits.size();
+    const uint64_t* src = bits.data();
+    long long i = 0;
+    long long total = 0;
+#if defined(__AVX512VPOPCNTDQ__)
+    __m512i sum = _mm512_setzero_si512();
+    for (; i + 8 <= n; i += 8) {
+        __m512i v = _mm512_loadu_si512((const void*)(src + i));
+        sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(v));
+    }
+    total += _mm512_reduce_add_epi64(sum);
+#elif defined(__AVX2__)
+    // Nibble lookup with pshufb, summed per 64-bit lane with psadbw
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i sum = _mm256_setzero_si256();
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+        __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+    total += _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1)
+        + _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+#endif
+    for (; i < n; i++) {
+        total += popcount64(src[i]);
+    }
+    return total;
+}
+
+long long SlotBitmap::lastOne() const {
+    for (long long w = (long long)bits.size() - 1; w >= 0; w--) {
+        if (bits[w] != 0) {
+            return w * 64 + 63 - countLeadingZeros(bits[w]);
+        }
+    }
+    return -1;
+}
+
+long long SlotBitmap::nextNonZeroWord(long long from) const {
+    long long n = (long long)bits.size();
+    const uint64_t* src = bits.data();
+    long long i = from;
+#if defined(__AVX512F__)
+    for (; i + 8 <= n; i += 8) {
+        __m512i v = _mm512_loadu_si512((const void*)(src + i));
+        __mmask8 nonZero = _mm512_test_epi64_mask(v, v);
+        if (nonZero != 0) {
+            return i + countTrailingZeros(nonZero);
+        }
+    }
+#elif defined(__AVX2__)
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        if (!_mm256_testz_si256(v, v)) {
+            break;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (src[i] != 0) {
+            return i;
+        }
+    }
+    return n;
+}
+
+std::ostream& operator<<(std::ostream& os, const SlotBitmap& bitmap) {
+    for (long long i = 0; i < bitmap.size(); i++) {
+        os << bitmap.test(i) << " ";
+    }
+    return os;
+}
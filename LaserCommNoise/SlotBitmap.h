@@ -0,0 +1,112 @@
+// SlotBitmap.h
+//
+// Packed slot occupancy: one bit per slot instead of one int per slot.
+//
+// Slot i lives in bit (i % 64) of word (i / 64). Bits past the last slot are always
+// kept at zero so the word-wide kernels (OR, AND-NOT, popcount) never have to mask
+// the tail. The kernels use AVX-512 or AVX2 when the compiler targets them
+// (-mavx512f / -mavx2, or /arch:AVX512 / /arch:AVX2 on MSVC) and plain 64-bit
+// word loops otherwise.
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit (x must not be 0). Compiles to tzcnt when BMI is enabled.
+inline int countTrailingZeros(uint64_t x) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (int)index;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+// Number of zero bits above the highest set bit (x must not be 0). Compiles to lzcnt when enabled.
+inline int countLeadingZeros(uint64_t x) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63 - (int)index;
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+class SlotBitmap {
+public:
+    SlotBitmap() = default;
+
+    // All slots start empty
+    explicit SlotBitmap(long long slots);
+
+    long long size() const {
+        return slots;
+    }
+
+    bool test(long long slot) const {
+        return (bits[slot >> 6] >> (slot & 63)) & 1;
+    }
+
+    void set(long long slot) {
+        bits[slot >> 6] |= uint64_t(1) << (slot & 63);
+    }
+
+    void reset(long long slot) {
+        bits[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+    }
+
+    // Empties the bitmap but keeps its memory for reuse
+    void clear();
+
+    // Expansion from <number of zeros> <number of signal photons> pairs
+    void appendZeros(long long count);
+    void appendOnes(long long count);
+
+    // Turns on every slot set in the mask (noise)
+    void orWith(const SlotBitmap& mask);
+
+    // Turns off every slot set in the mask (erasures)
+    void andNot(const SlotBitmap& mask);
+
+    // Number of occupied slots
+    long long popcount() const;
+
+    // Index of the last occupied slot, or -1 if there are none
+    long long lastOne() const;
+
+    // Calls visit(slot) for every occupied slot in increasing order. Empty words are
+    // skipped several at a time and the ones inside a word are found with tzcnt.
+    template <typename Visitor>
+    void forEachOne(Visitor visit) const {
+        long long numWords = (long long)bits.size();
+        for (long long w = nextNonZeroWord(0); w < numWords; w = nextNonZeroWord(w + 1)) {
+            uint64_t word = bits[w];
+            while (word != 0) {
+                visit(w * 64 + countTrailingZeros(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+    const std::vector<uint64_t>& words() const {
+        return bits;
+    }
+
+private:
+    // First word at or after 'from' with any bit set, or the word count if there is none
+    long long nextNonZeroWord(long long from) const;
+
+    std::vector<uint64_t> bits;
+    long long slots = 0;
+};
+
+// Prints every slot as 0 or 1, like the vector printer in LaserCommNoise.cpp
+std::ostream& operator<<(std::ostream& os, const SlotBitmap& bitmap);
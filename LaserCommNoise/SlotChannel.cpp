@@ -0,0 +1,144 @@
+#include "SlotChannel.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+
+#include "ChannelPipeline.h"
+#include "TextCodec.h"
+
+// Opens the provided file with error handling
+// Returns vector of signal photons
+std::vector<long long> openfile(std::string filename) {
+    std::ifstream inputFile(filename);
+    
+    if (!inputFile.is_open()) {
+        std::cerr << "Unable to open file :C";
+    }
+    
+    std::vector<long long> signalPhotons;
+
+    long long element;
+
+    //Reads elements from the file and appends them to the vector
+    TextReader reader(inputFile);
+    while (reader.next(element)) {
+        signalPhotons.push_back(element);
+    }
+    
+
+    return signalPhotons;
+}
+
+//Takes in ASCII vector, converts it to binary
+SlotBitmap ASCIItoBinary(const std::vector<long long>& signalPhotons) {
+    // ASCII vectors come in form of <number of zeros> <number of signal photons>
+    // Each slot is a single bit, and whole runs are filled a word at a time
+    SlotBitmap signalBinary;
+
+    int count = 0; // Counter to help us keep track if we are counting zeros or ones
+    
+    for (auto element : signalPhotons) {
+        // for zeros
+        if (count == 0)
+        {
+            signalBinary.appendZeros(element);
+            count = 1; //switching for next case
+        }
+        else // for signal photons
+        {
+            signalBinary.appendOnes(element);
+            count = 0; // switching for the next case
+        }
+    }
+
+    return signalBinary;
+
+}
+
+// Rolls for the erasure of the pulse in slot with one number keyed by the slot itself, so the
+// same pulse meets the same fate in every block split and in both forms of the block
+static bool pulseErased(long long slot, double erasure_probability, uint64_t seed, long long* draws) {
+    Philox rng(seed, erasure_stage, (uint64_t)slot);
+    bool erased = (double)(rng() >> 11) * 0x1.0p-53 < erasure_probability;
+    if (draws != nullptr) {
+        *draws += (long long)rng.draws();
+    }
+    return erased;
+}
+
+// Introduces erasures by turning ones into zeros
+// Works in place on the block starting at first_slot and returns the number of pulses erased
+long long signalErasure(SlotBitmap& signal, long long first_slot, double erasure_probability, uint64_t seed,
+    long long* draws) {
+    if (erasure_probability <= 0.0) {
+        return 0;
+    }
+    // Only the pulses are rolled, so the cost follows the pulses and not the slots
+    long long erased = 0;
+    signal.forEachOne([&](long long slot) {
+        if (pulseErased(first_slot + slot, erasure_probability, seed, draws)) {
+            signal.reset(slot);
+            erased++;
+        }
+    });
+    
+    return erased;
+}
+
+// Introduces noise by turning zeros into ones
+// Works in place on the block starting at first_slot and returns the number of noise photons added
+long long signalNoise(SlotBitmap& signal, long long first_slot, double noise_probability, uint64_t seed,
+    long long* draws) {
+    // Landing on a slot that is already 1 does nothing, which leaves the odds for the 0s unchanged.
+    long long before = signal.popcount();
+    signal.orWith(randomMask(first_slot, signal.size(), noise_probability, seed, noise_stage, draws));
+    
+    return signal.popcount() - before;
+}
+    
+long long signalErasure(std::vector<long long>& pulses, long long, long long, double erasure_probability,
+    uint64_t seed, long long* draws) {
+    if (erasure_probability <= 0.0) {
+        return 0;
+    }
+    size_t before = pulses.size();
+    pulses.erase(std::remove_if(pulses.begin(), pulses.end(), [&](long long slot) {
+        return pulseErased(slot, erasure_probability, seed, draws);
+    }), pulses.end());
+
+    return (long long)(before - pulses.size());
+}
+
+long long signalNoise(std::vector<long long>& pulses, long long first_slot, long long slots,
+    double noise_probability, uint64_t seed, long long* draws) {
+    std::vector<long long> noise;
+    forEachRandomSlot(first_slot, slots, noise_probability, seed, noise_stage, draws, [&](long long slot) {
+        noise.push_back(slot);
+    });
+    if (noise.empty()) {
+        return 0;
+    }
+
+    size_t before = pulses.size();
+    std::vector<long long> merged;
+    merged.reserve(pulses.size() + noise.size());
+    std::set_union(pulses.begin(), pulses.end(), noise.begin(), noise.end(), std::back_inserter(merged));
+    pulses.swap(merged);
+
+    return (long long)(pulses.size() - before);
+}
+
+std::vector<long long> BinarytoASCII(const SlotBitmap& BinaryVector) {
+    long long previous = -1; // Last occupied slot
+
+    std::vector<long long> BinaryOutput; // Output Vector
+    BinaryVector.forEachOne([&](long long slot) {
+        BinaryOutput.push_back(slot - previous - 1);
+        BinaryOutput.push_back(1);
+        previous = slot;
+    });
+
+    return BinaryOutput;
+}
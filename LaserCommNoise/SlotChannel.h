@@ -0,0 +1,44 @@
+// SlotChannel.h
+//
+// The slot-at-a-time channel: reading a pulse file, expanding the
+// <number of zeros> <number of signal photons> pairs into slots, erasing pulses,
+// adding noise, and writing the slots back out as pairs.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SlotBitmap.h"
+
+// Opens the provided file with error handling
+// Returns vector of signal photons
+std::vector<long long> openfile(std::string filename);
+
+// Takes in ASCII vector, converts it to binary
+SlotBitmap ASCIItoBinary(const std::vector<long long>& signalPhotons);
+
+// Introduces erasures by turning ones into zeros
+// Works in place on the block starting at first_slot and returns the number of pulses erased.
+// Each pulse is rolled with one random number keyed by its slot, so the empty slots cost nothing.
+// If draws is given, the random numbers used are added to it.
+long long signalErasure(SlotBitmap& signal, long long first_slot, double erasure_probability, uint64_t seed,
+    long long* draws = nullptr);
+
+// Introduces noise by turning zeros into ones
+// Works in place on the block starting at first_slot and returns the number of noise photons added.
+// If draws is given, the random numbers used are added to it.
+long long signalNoise(SlotBitmap& signal, long long first_slot, double noise_probability, uint64_t seed,
+    long long* draws = nullptr);
+
+// The same two stages on a block held as its pulse slots (in increasing order) and its length.
+// They use the same random numbers as the bitmap versions, so the results are identical, but
+// only the pulses and the slots the noise lands on are touched.
+long long signalErasure(std::vector<long long>& pulses, long long first_slot, long long slots,
+    double erasure_probability, uint64_t seed, long long* draws = nullptr);
+long long signalNoise(std::vector<long long>& pulses, long long first_slot, long long slots,
+    double noise_probability, uint64_t seed, long long* draws = nullptr);
+
+// Writes every occupied slot as its own <zeros> 1 pair
+std::vector<long long> BinarytoASCII(const SlotBitmap& BinaryVector);
@@ -0,0 +1,151 @@
+#include "SlotContainer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+bool isSlotContainer(const std::string& filename) {
+    std::ifstream input(filename, std::ios::binary);
+    char magic[4] = {};
+    input.read(magic, sizeof(magic));
+    return input.gcount() == sizeof(magic) && std::memcmp(magic, SLOT_CONTAINER_MAGIC, sizeof(magic)) == 0;
+}
+
+ContainerBlockReader::ContainerBlockReader(const std::string& filename) {
+    open = (slot_container_open(&reader, filename.c_str()) == 0);
+}
+
+ContainerBlockReader::~ContainerBlockReader() {
+    if (open) {
+        slot_container_close_reader(&reader);
+    }
+}
+
+long long ContainerBlockReader::findBlock(long long slot) const {
+    return (long long)slot_container_find_block(&reader, (uint64_t)slot);
+}
+
+const uint32_t* ContainerBlockReader::blockPairs(long long index, size_t& numPairs) const {
+    return slot_container_block_pairs(&reader, (uint64_t)index, &numPairs);
+}
+
+bool ContainerBlockReader::readBlock(long long index, SlotBitmap& block) const {
+    size_t numPairs;
+    const uint32_t* pairs = blockPairs(index, numPairs);
+    block.clear();
+    if (pairs == nullptr) {
+        return false;
+    }
+    for (size_t i = 0; i < numPairs; i++) {
+        block.appendZeros(pairs[2 * i]);
+        // Photon counts collapse to a single occupied slot
+        block.appendOnes(pairs[2 * i + 1] != 0 ? 1 : 0);
+    }
+    return block.size() == (long long)reader.index[index].slot_count;
+}
+
+bool ContainerBlockReader::readBlock(SlotBitmap& block, long long) {
+    if (nextBlock >= blockCount()) {
+        block.clear();
+        return false;
+    }
+    if (!readBlock(nextBlock, block)) {
+        std::cerr << "Block " << nextBlock << " of the container is corrupt" << std::endl;
+        ok = false;
+        block.clear();
+        return false;
+    }
+    nextBlock++;
+    return true;
+}
+
+bool ContainerBlockReader::readPulses(std::vector<long long>& pulses, long long first_slot, long long& slots,
+    long long) {
+    pulses.clear();
+    slots = 0;
+    if (nextBlock >= blockCount()) {
+        return false;
+    }
+    size_t numPairs;
+    const uint32_t* pairs = blockPairs(nextBlock, numPairs);
+    long long slot = first_slot;
+    if (pairs != nullptr) {
+        for (size_t i = 0; i < numPairs; i++) {
+            slot += pairs[2 * i];
+            if (pairs[2 * i + 1] != 0) {
+                pulses.push_back(slot++);
+            }
+        }
+    }
+    if (pairs == nullptr || slot - first_slot != (long long)reader.index[nextBlock].slot_count) {
+        std::cerr << "Block " << nextBlock << " of the container is corrupt" << std::endl;
+        ok = false;
+        pulses.clear();
+        return false;
+    }
+    slots = slot - first_slot;
+    nextBlock++;
+    return true;
+}
+
+ContainerBlockWriter::ContainerBlockWriter(const std::string& filename, const slot_container_header& info) {
+    open = (slot_container_create(&writer, filename.c_str(), &info) == 0);
+    ok = open;
+}
+
+ContainerBlockWriter::~ContainerBlockWriter() {
+    if (open) {
+        finish();
+    }
+}
+
+void ContainerBlockWriter::writeBlock(const SlotBitmap& block) {
+    long long previous = -1; // Last occupied slot in this block
+    long long pulses = 0;
+    pairs.clear();
+    block.forEachOne([&](long long slot) {
+        pairs.push_back((uint32_t)(slot - previous - 1));
+        pairs.push_back(1);
+        previous = slot;
+        pulses++;
+    });
+    if (block.size() - previous - 1 > 0) {
+        pairs.push_back((uint32_t)(block.size() - previous - 1));
+        pairs.push_back(0);
+    }
+    writePairs(pairs, block.size(), pulses);
+}
+
+void ContainerBlockWriter::writePulses(const std::vector<long long>& pulses, long long first_slot, long long slots) {
+    long long previous = first_slot - 1; // Last occupied slot in this block
+    pairs.clear();
+    for (long long slot : pulses) {
+        pairs.push_back((uint32_t)(slot - previous - 1));
+        pairs.push_back(1);
+        previous = slot;
+    }
+    if (first_slot + slots - previous - 1 > 0) {
+        pairs.push_back((uint32_t)(first_slot + slots - previous - 1));
+        pairs.push_back(0);
+    }
+    writePairs(pairs, slots, (long long)pulses.size());
+}
+
+void ContainerBlockWriter::writePairs(const std::vector<uint32_t>& blockPairs, long long slots, long long pulses) {
+    if (slot_container_write_pairs(&writer, blockPairs.data(), blockPairs.size() / 2, slots, pulses) != 0) {
+        ok = false;
+    }
+}
+
+void ContainerBlockWriter::finish() {
+    if (slot_container_close(&writer) != 0) {
+        ok = false;
+    }
+    open = false;
+}
+
+void setProvenance(slot_container_header& header, const std::string& text) {
+    std::memset(header.provenance, 0, sizeof(header.provenance));
+    std::memcpy(header.provenance, text.data(), std::min(text.size(), sizeof(header.provenance) - 1));
+}
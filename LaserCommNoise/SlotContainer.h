@@ -0,0 +1,110 @@
+// SlotContainer.h
+//
+// Block source and sink for the indexed .slots container shared with the photon
+// generator (Ian's Work/slot_container.h). Every container block carries its first
+// slot, pulse count and checksum, so any block can be decoded on its own: the reader
+// hands them out in order for channelBlocks, and readBlock(index, ...) lets several
+// threads decode different blocks of the same file at once.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BlockStream.h"
+#include "SlotBitmap.h"
+#include "slot_container.h"
+
+// True if the file starts with the container magic
+bool isSlotContainer(const std::string& filename);
+
+class ContainerBlockReader : public BlockSource {
+public:
+    // Check isOpen() before use
+    explicit ContainerBlockReader(const std::string& filename);
+    ~ContainerBlockReader();
+
+    ContainerBlockReader(const ContainerBlockReader&) = delete;
+    ContainerBlockReader& operator=(const ContainerBlockReader&) = delete;
+
+    bool isOpen() const {
+        return open;
+    }
+
+    const slot_container_header& header() const {
+        return reader.header;
+    }
+
+    long long blockCount() const {
+        return (long long)reader.header.block_count;
+    }
+
+    // Index of the block holding the given slot
+    long long findBlock(long long slot) const;
+
+    // A block's (zero run, value) pairs, or nullptr if the block is out of range or
+    // fails its checksum. The pairs point into the mapping and live as long as the reader.
+    const uint32_t* blockPairs(long long index, size_t& numPairs) const;
+
+    // Decodes any block into a bitmap; safe to call from several threads.
+    // Returns false if the block is out of range or fails its checksum.
+    bool readBlock(long long index, SlotBitmap& block) const;
+
+    // Hands out the blocks in order. Container blocks keep the size they were
+    // written with, so maxSlots is ignored.
+    bool readBlock(SlotBitmap& block, long long maxSlots) override;
+
+    // The next block straight from its pairs, without a bitmap
+    bool readPulses(std::vector<long long>& pulses, long long first_slot, long long& slots, long long maxSlots) override;
+
+    bool sparse() const override {
+        return true;
+    }
+
+    // False once a block has failed its checksum
+    bool good() const override {
+        return ok;
+    }
+
+private:
+    slot_container_reader reader;
+    bool open = false;
+    bool ok = true;
+    long long nextBlock = 0;
+};
+
+class ContainerBlockWriter : public BlockSink {
+public:
+    // The informational header fields (PPM order, K, seed, provenance) come from info
+    ContainerBlockWriter(const std::string& filename, const slot_container_header& info);
+    ~ContainerBlockWriter();
+
+    ContainerBlockWriter(const ContainerBlockWriter&) = delete;
+    ContainerBlockWriter& operator=(const ContainerBlockWriter&) = delete;
+
+    bool isOpen() const {
+        return open;
+    }
+
+    void writeBlock(const SlotBitmap& block) override;
+    void writePulses(const std::vector<long long>& pulses, long long first_slot, long long slots) override;
+    void finish() override;
+
+    // Writes a block already in (zero run, value) pair form, e.g. photon counts
+    void writePairs(const std::vector<uint32_t>& blockPairs, long long slots, long long pulses);
+
+    // False if any write failed
+    bool good() const {
+        return ok;
+    }
+
+private:
+    slot_container_writer writer;
+    std::vector<uint32_t> pairs;
+    bool open = false;
+    bool ok = true;
+};
+
+// Fills the provenance field, truncating if it doesn't fit
+void setProvenance(slot_container_header& header, const std::string& text);
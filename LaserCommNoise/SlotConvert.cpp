@@ -0,0 +1,313 @@
+#include "SlotConvert.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "varint.h"
+
+// Slots converted at a time
+const long long convert_chunk_slots = 1 << 20;
+
+static bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// True for the names of the stls_pulse_to_photons_poisson formats, which PhotonCountReader reads
+static bool stlsName(const std::string& filename) {
+    return slot_codec_from_name(filename.c_str()) != nullptr || endsWith(filename, ".vrle");
+}
+
+bool isVarintRLE(const std::string& filename) {
+    return endsWith(filename, ".vrle");
+}
+
+bool isCountFile(const std::string& filename) {
+    return stlsName(filename) && !endsWith(filename, ".rle.txt");
+}
+
+CountBlockReader::CountBlockReader(const std::string& filename) : reader(filename) {}
+
+bool CountBlockReader::readPulses(std::vector<long long>& pulses, long long first_slot, long long& slots,
+    long long maxSlots) {
+    pulses.clear();
+    slots = ok ? reader.readEvents(events, maxSlots) : 0;
+    if (slots < 0) {
+        std::cerr << "The pulse file is malformed" << std::endl;
+        ok = false;
+        slots = 0;
+    }
+    if (slots == 0) {
+        return false;
+    }
+    for (const SlotEvent& event : events) {
+        pulses.push_back(first_slot + event.slot);
+    }
+    return true;
+}
+
+bool CountBlockReader::readBlock(SlotBitmap& block, long long maxSlots) {
+    long long slots;
+    block.clear();
+    if (!readPulses(blockPulses, 0, slots, maxSlots)) {
+        return false;
+    }
+    block.appendZeros(slots);
+    for (long long slot : blockPulses) {
+        block.set(slot);
+    }
+    return true;
+}
+
+SlotCountWriter::SlotCountWriter(const std::string& filename) {
+    if (endsWith(filename, ".events")) {
+        format = events;
+        eventStream.reset(new EventBlockWriter(filename, 0.0, 0));
+        open = eventStream->isOpen();
+        return;
+    }
+    if (endsWith(filename, ".slots")) {
+        format = container;
+        slot_container_header info = {};
+        info.block_slots = (uint64_t)convert_chunk_slots;
+        setProvenance(info, "LaserCommNoise -X");
+        blocks.reset(new ContainerBlockWriter(filename, info));
+        open = blocks->isOpen();
+        return;
+    }
+
+    if (endsWith(filename, ".vrle")) {
+        format = varint_rle;
+        file.open(filename, std::ios::binary);
+        open = file.is_open();
+        return;
+    }
+    codec = slot_codec_from_name(filename.c_str());
+    if (codec != nullptr) {
+        format = stls_file;
+        open = (slot_codec_create_writer(&codecWriter, codec, filename.c_str()) == 0);
+        return;
+    }
+    file.open(filename);
+    open = file.is_open();
+    pairs.reset(new RLEBlockWriter(file));
+}
+
+void SlotCountWriter::writeVarintPair(uint64_t zeros, uint32_t count) {
+    uint8_t bytes[2 * VARINT_MAX_BYTES];
+    size_t length = varint_put(bytes, zeros);
+    length += varint_put(bytes + length, count);
+    file.write((const char*)bytes, (std::streamsize)length);
+}
+
+void SlotCountWriter::pushPair(uint32_t count) {
+    // A zero run of 65535 carries on into the next word
+    for (; zerosPending >= 65535; zerosPending -= 65535) {
+        words.push_back(65535);
+    }
+    words.push_back((uint16_t)zerosPending);
+    words.push_back((uint16_t)count);
+    zerosPending = 0;
+}
+
+bool SlotCountWriter::write(const std::vector<SlotEvent>& counts, long long first_slot, long long slots) {
+    uint32_t limit = 0xFFFFFFFF;
+    if (format == pairs_text) {
+        limit = 1;
+    }
+    else if (format == stls_file) {
+        limit = codec->max_count;
+    }
+    for (const SlotEvent& event : counts) {
+        if (event.count > limit) {
+            return false;
+        }
+    }
+
+    if (format == events) {
+        eventStream->writeCounts(counts, first_slot, slots);
+        return true;
+    }
+    if (format == pairs_text) {
+        pulses.clear();
+        for (const SlotEvent& event : counts) {
+            pulses.push_back(event.slot);
+        }
+        pairs->writePulses(pulses, first_slot, slots);
+        return true;
+    }
+    if (format == container) {
+        long long previous = first_slot - 1; // Last occupied slot in this block
+        blockPairs.clear();
+        for (const SlotEvent& event : counts) {
+            blockPairs.push_back((uint32_t)(event.slot - previous - 1));
+            blockPairs.push_back(event.count);
+            previous = event.slot;
+        }
+        if (first_slot + slots - previous - 1 > 0) {
+            blockPairs.push_back((uint32_t)(first_slot + slots - previous - 1));
+            blockPairs.push_back(0);
+        }
+        blocks->writePairs(blockPairs, slots, (long long)counts.size());
+        return true;
+    }
+    if (format == varint_rle) {
+        long long previous = first_slot - 1;
+        for (const SlotEvent& event : counts) {
+            writeVarintPair((uint64_t)(zerosPending + event.slot - previous - 1), event.count);
+            zerosPending = 0;
+            previous = event.slot;
+        }
+        zerosPending += first_slot + slots - previous - 1;
+        return true;
+    }
+
+    int status;
+    if (codec->compressed) {
+        long long previous = first_slot - 1;
+        words.clear();
+        for (const SlotEvent& event : counts) {
+            zerosPending += event.slot - previous - 1;
+            pushPair(event.count);
+            previous = event.slot;
+        }
+        zerosPending += first_slot + slots - previous - 1;
+        status = codec->write_words(&codecWriter, words.data(), words.size());
+    }
+    else {
+        // Expanded and written a chunk at a time
+        status = SLOT_CODEC_OK;
+        size_t next = 0;
+        for (long long start = 0; start < slots && status == SLOT_CODEC_OK; start += convert_chunk_slots) {
+            long long length = std::min(slots - start, convert_chunk_slots);
+            slotCounts.assign((size_t)length, 0);
+            for (; next < counts.size() && counts[next].slot < first_slot + start + length; next++) {
+                slotCounts[(size_t)(counts[next].slot - first_slot - start)] = counts[next].count;
+            }
+            status = codec->write_slots(&codecWriter, slotCounts.data(), slotCounts.size());
+        }
+    }
+    if (status != SLOT_CODEC_OK) {
+        failed = true;
+    }
+    return true;
+}
+
+bool SlotCountWriter::finish() {
+    if (format == events) {
+        eventStream->finish();
+        return eventStream->good();
+    }
+    if (format == container) {
+        blocks->finish();
+        return blocks->good();
+    }
+    if (format == stls_file) {
+        if (codec->compressed && zerosPending > 0) {
+            words.clear();
+            pushPair(0);
+            if (codec->write_words(&codecWriter, words.data(), words.size()) != SLOT_CODEC_OK) {
+                failed = true;
+            }
+        }
+        return (slot_codec_close_writer(&codecWriter) == 0) && !failed;
+    }
+    if (format == pairs_text) {
+        pairs->finish();
+        file << std::endl;
+    }
+    else if (format == varint_rle && zerosPending > 0) {
+        writeVarintPair((uint64_t)zerosPending, 0);
+        zerosPending = 0;
+    }
+    file.close();
+    return !file.fail();
+}
+
+bool convertSlots(const std::string& input, const std::string& output, ConvertStats& stats, std::string& error) {
+    // Pick the reader: event streams stay sparse, the stls formats and containers go through
+    // PhotonCountReader a chunk at a time and anything else is read as pairs
+    std::unique_ptr<EventBlockReader> eventStream;
+    std::unique_ptr<PhotonCountReader> photons;
+    std::unique_ptr<RLEBlockReader> pairs;
+    std::ifstream inputFile;
+    bool inputOpen;
+    if (isEventStream(input)) {
+        eventStream.reset(new EventBlockReader(input));
+        inputOpen = eventStream->isOpen();
+    }
+    else if (isSlotContainer(input) || stlsName(input)) {
+        photons.reset(new PhotonCountReader(input));
+        inputOpen = photons->isOpen();
+    }
+    else {
+        inputFile.open(input);
+        inputOpen = inputFile.is_open();
+        pairs.reset(new RLEBlockReader(inputFile));
+    }
+    if (!inputOpen) {
+        error = "Unable to open " + input;
+        return false;
+    }
+
+    SlotCountWriter writer(output);
+    if (!writer.isOpen()) {
+        error = "Unable to write " + output;
+        return false;
+    }
+
+    std::vector<SlotEvent> counts;
+    std::vector<long long> pulses;
+    while (true) {
+        long long slots = 0;
+        counts.clear();
+        if (eventStream) {
+            if (!eventStream->readEvents(counts, slots, convert_chunk_slots)) {
+                if (!eventStream->good()) {
+                    error = input + " is malformed";
+                    writer.finish();
+                    return false;
+                }
+                break;
+            }
+        }
+        else if (photons) {
+            slots = photons->readEvents(counts, convert_chunk_slots);
+            if (slots < 0) {
+                error = input + " is malformed";
+                writer.finish();
+                return false;
+            }
+            if (slots == 0) {
+                break;
+            }
+            for (SlotEvent& event : counts) {
+                event.slot += stats.slots;
+            }
+        }
+        else {
+            if (!pairs->readPulses(pulses, stats.slots, slots, convert_chunk_slots)) {
+                break;
+            }
+            for (long long slot : pulses) {
+                counts.push_back({ slot, 1 });
+            }
+        }
+
+        if (!writer.write(counts, stats.slots, slots)) {
+            error = "A count after slot " + std::to_string(stats.slots) + " doesn't fit the format of " + output;
+            writer.finish();
+            return false;
+        }
+        stats.slots += slots;
+        stats.occupied += (long long)counts.size();
+        for (const SlotEvent& event : counts) {
+            stats.count += event.count;
+        }
+    }
+
+    if (!writer.finish()) {
+        error = "Unable to write " + output;
+        return false;
+    }
+    return true;
+}
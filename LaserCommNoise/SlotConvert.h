@@ -0,0 +1,121 @@
+// SlotConvert.h
+//
+// Converts a pulse or photon count stream between the file formats of the two programs:
+//
+//     .events                sparse event stream (64-bit slot and count per occupied slot)
+//     .slots                 indexed container
+//     .rle.txt / .rle.bin    stls RLE: 16-bit zero runs (65535 carries on into the next word)
+//                            each followed by a count, ending in a "<zeros> 0" pair
+//     .vrle                  varint RLE: the same pairs as LEB128 varints, runs of any length
+//     .bin                   stls uncompressed binary, one byte per slot
+//     .pulses.txt            stls uncompressed ASCII pulses, one '0' or '1' character per slot
+//     .photons.txt           stls uncompressed ASCII counts, one number per slot
+//     anything else          LaserCommNoise's own "<zeros> <ones>" pairs, as in output.txt
+//
+// The .events and .slots files are recognised by their magic whatever their name. The stls
+// formats are read and written through the same slot_codec tables as stls itself. The input
+// is streamed a chunk at a time, so only the dense formats ever cost memory per slot.
+// A .vrle file can also be the pulse input of the channel, through CountBlockReader.
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BlockStream.h"
+#include "EventStream.h"
+#include "PPMDemodulator.h"
+#include "SlotContainer.h"
+#include "slot_codec.h"
+
+// True if the name says varint RLE (.vrle), which has no magic of its own
+bool isVarintRLE(const std::string& filename);
+
+// True for a name that says one of the stls files that aren't "<zeros> <ones>" text at all
+// (.vrle, .bin, .rle.bin, .pulses.txt, .photons.txt), which LaserCommNoise reads through
+// CountBlockReader. .rle.txt is left to the pair reader, which reads the same text.
+bool isCountFile(const std::string& filename);
+
+// Reads any count file PhotonCountReader knows as a pulse stream. Counts collapse to a
+// single pulse, as with EventBlockReader, and the sparse formats are never expanded.
+class CountBlockReader : public BlockSource {
+public:
+    // Check isOpen() before use
+    explicit CountBlockReader(const std::string& filename);
+
+    bool isOpen() const {
+        return reader.isOpen();
+    }
+
+    // False once a read has found the file malformed
+    bool good() const override {
+        return ok;
+    }
+
+    bool readPulses(std::vector<long long>& pulses, long long first_slot, long long& slots, long long maxSlots) override;
+    bool readBlock(SlotBitmap& block, long long maxSlots) override;
+
+    bool sparse() const override {
+        return reader.sparse();
+    }
+
+private:
+    PhotonCountReader reader;
+    bool ok = true;
+    std::vector<SlotEvent> events;
+    std::vector<long long> blockPulses;
+};
+
+// Writes a stream of slots handed over as their non-empty slots and counts, in any of the formats
+class SlotCountWriter {
+public:
+    // The format comes from the name. Check isOpen() before use.
+    explicit SlotCountWriter(const std::string& filename);
+
+    bool isOpen() const {
+        return open;
+    }
+
+    // Appends a block of the given length starting at first_slot. Returns false if a count
+    // doesn't fit the format (more than 1 for pulse formats, 255 for .bin, 65535 for RLE).
+    bool write(const std::vector<SlotEvent>& counts, long long first_slot, long long slots);
+
+    // Writes whatever is still buffered; returns false if any write failed
+    bool finish();
+
+private:
+    // stls_file covers the formats written through a slot_codec
+    enum Format { pairs_text, stls_file, varint_rle, container, events };
+
+    void writeVarintPair(uint64_t zeros, uint32_t count);
+    // Appends the RLE words for a zero run and the count after it
+    void pushPair(uint32_t count);
+
+    Format format = pairs_text;
+    bool open = false;
+    bool failed = false;            // a codec write didn't reach the file
+    std::ofstream file;
+    const slot_codec* codec = nullptr;
+    slot_codec_writer codecWriter = {};
+    std::vector<uint16_t> words;    // RLE words of the block being written
+    std::vector<uint32_t> slotCounts; // a dense block expanded a chunk at a time
+    std::unique_ptr<RLEBlockWriter> pairs;
+    std::unique_ptr<ContainerBlockWriter> blocks;
+    std::unique_ptr<EventBlockWriter> eventStream;
+    std::vector<long long> pulses;
+    std::vector<uint32_t> blockPairs;
+    long long zerosPending = 0; // RLE zero run not yet written
+};
+
+struct ConvertStats {
+    long long slots = 0;
+    long long occupied = 0;     // non-empty slots
+    long long count = 0;        // sum of the counts
+};
+
+// Converts input to output. Returns false and says why in error if the input can't be read
+// or the output can't hold it.
+bool convertSlots(const std::string& input, const std::string& output, ConvertStats& stats, std::string& error);
@@ -0,0 +1,269 @@
+#include "Sweep.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+#include "EventStream.h"
+#include "GeometricSampler.h"
+#include "RLEChannel.h"
+#include "SlotContainer.h"
+#include "SlotConvert.h"
+#include "philox.h"
+#include "poisson.h"
+
+bool readPulseSummary(const std::string& filename, PulseSummary& summary) {
+    // A container already has the totals in its header
+    if (isSlotContainer(filename)) {
+        ContainerBlockReader reader(filename);
+        if (!reader.isOpen()) {
+            return false;
+        }
+        summary.slots = (long long)reader.header().total_slots;
+        summary.pulses = (long long)reader.header().total_pulses;
+        return true;
+    }
+    // So does an event stream; every event counts as one pulse
+    if (isEventStream(filename)) {
+        EventBlockReader reader(filename);
+        if (!reader.isOpen()) {
+            return false;
+        }
+        summary.slots = (long long)reader.header().total_slots;
+        summary.pulses = (long long)reader.header().total_events;
+        return true;
+    }
+    // Varint RLE is counted a chunk at a time, without expanding the empty slots
+    if (isVarintRLE(filename)) {
+        CountBlockReader reader(filename);
+        if (!reader.isOpen()) {
+            return false;
+        }
+        std::vector<long long> pulses;
+        long long slots;
+        while (reader.readPulses(pulses, summary.slots, slots, 1LL << 40)) {
+            summary.slots += slots;
+            summary.pulses += (long long)pulses.size();
+        }
+        return reader.good();
+    }
+    std::ifstream inputFile(filename);
+    if (!inputFile.is_open()) {
+        return false;
+    }
+    RLEReader reader(inputFile);
+    long long zeros, ones;
+    while (reader.next(zeros, ones)) {
+        summary.slots += zeros + ones;
+        summary.pulses += ones;
+    }
+    return reader.good();
+}
+
+bool readSweepPoints(const std::string& filename, std::vector<SweepPoint>& points) {
+    std::ifstream inputFile(filename);
+    if (!inputFile.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(inputFile, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream fields(line);
+        SweepPoint point;
+        if (fields >> point.erasure_probability >> point.noise_probability) {
+            if (!(fields >> point.k)) {
+                point.k = 0.0;
+            }
+            points.push_back(point);
+        }
+    }
+    return true;
+}
+
+static std::vector<double> parseList(const std::string& list) {
+    std::vector<double> values;
+    std::stringstream fields(list);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        if (!field.empty()) {
+            values.push_back(std::stod(field));
+        }
+    }
+    return values;
+}
+
+std::vector<SweepPoint> sweepGrid(const std::string& erasures, const std::string& noises, const std::string& ks) {
+    std::vector<SweepPoint> points;
+    for (double erasure : parseList(erasures)) {
+        for (double noise : parseList(noises)) {
+            for (double k : parseList(ks)) {
+                SweepPoint point;
+                point.erasure_probability = erasure;
+                point.noise_probability = noise;
+                point.k = k;
+                points.push_back(point);
+            }
+        }
+    }
+    return points;
+}
+
+// One channel pass over the pulse file, added into result
+static void runTrial(const PulseSummary& summary, const SweepPoint& point, Philox& rng, SweepResult& result) {
+    GeometricSampler erasureSampler(point.erasure_probability);
+    GeometricSampler noiseSampler(point.noise_probability);
+    poisson_table detection;
+    poisson_table_init(&detection, point.k > 0.0 ? point.k : 1.0);
+
+    long long erasureGap = erasureSampler.next(rng);
+    long long channelErasures = 0;
+    for (long long pulse = 0; pulse < summary.pulses; pulse++) {
+        int photons;
+        if (erasureGap == 0) {
+            photons = 0;
+            channelErasures++;
+            erasureGap = erasureSampler.next(rng);
+        }
+        else {
+            erasureGap--;
+            photons = point.k > 0.0 ? poisson_table_sample(&detection, Philox::bits, &rng) : 1;
+        }
+        result.histogram[std::min(photons, sweep_histogram_max)]++;
+        if (photons == 0) {
+            result.erasures++;
+        }
+    }
+    result.pulses += summary.pulses;
+
+    // Empty slots plus the pulses the channel erased can pick up noise; only the count matters here
+    long long empty = summary.slots - summary.pulses + channelErasures;
+    long long counter = noiseSampler.next(rng);
+    while (counter < empty) {
+        result.falseAlarms++;
+        long long gap = noiseSampler.next(rng);
+        if (gap >= empty - counter - 1) {
+            break;
+        }
+        counter += gap + 1;
+    }
+    result.emptySlots += empty;
+    result.trials++;
+}
+
+std::vector<SweepResult> runSweep(const PulseSummary& summary, const std::vector<SweepPoint>& points,
+    long long trials, uint64_t seed, ThreadPool& pool) {
+    std::vector<SweepResult> results(points.size());
+    std::vector<std::mutex> locks(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        results[i].point = points[i];
+    }
+
+    pool.parallelFor((long long)points.size() * trials, [&](long long task) {
+        long long index = task / trials;
+        long long trial = task % trials;
+
+        Philox rng(seed, (uint32_t)index, (uint64_t)trial);
+        SweepResult trialResult;
+        runTrial(summary, points[index], rng, trialResult);
+
+        // Integer sums, so the totals don't depend on which order the trials finish in
+        std::lock_guard<std::mutex> guard(locks[index]);
+        SweepResult& result = results[index];
+        result.trials += trialResult.trials;
+        result.pulses += trialResult.pulses;
+        result.erasures += trialResult.erasures;
+        result.emptySlots += trialResult.emptySlots;
+        result.falseAlarms += trialResult.falseAlarms;
+        for (int j = 0; j <= sweep_histogram_max; j++) {
+            result.histogram[j] += trialResult.histogram[j];
+        }
+    });
+
+    return results;
+}
+
+// 95% Wilson score interval for successes out of n
+static void wilsonInterval(long long successes, long long n, double& low, double& high) {
+    if (n <= 0) {
+        low = 0.0;
+        high = 1.0;
+        return;
+    }
+    const double z = 1.959963984540054;
+    double p = (double)successes / (double)n;
+    double z2n = z * z / (double)n;
+    double centre = (p + z2n / 2.0) / (1.0 + z2n);
+    double half = z * std::sqrt(p * (1.0 - p) / (double)n + z2n / (4.0 * (double)n)) / (1.0 + z2n);
+    low = std::max(0.0, centre - half);
+    high = std::min(1.0, centre + half);
+}
+
+bool writeSweepResults(const std::string& filename, const std::vector<SweepResult>& results) {
+    std::ofstream outfile(filename);
+    if (!outfile.is_open()) {
+        return false;
+    }
+    outfile.precision(10);
+    bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+
+    if (json) {
+        outfile << "[\n";
+    }
+    else {
+        outfile << "erasure_prob,noise_prob,k,trials,pulses,erasures,erasure_rate,erasure_ci_low,erasure_ci_high,"
+            << "empty_slots,false_alarms,false_alarm_rate,false_alarm_ci_low,false_alarm_ci_high";
+        for (int j = 0; j <= sweep_histogram_max; j++) {
+            outfile << ",count_" << j;
+        }
+        outfile << "\n";
+    }
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const SweepResult& result = results[i];
+        double erasureRate = result.pulses > 0 ? (double)result.erasures / (double)result.pulses : 0.0;
+        double falseAlarmRate = result.emptySlots > 0 ? (double)result.falseAlarms / (double)result.emptySlots : 0.0;
+        double erasureLow, erasureHigh, falseAlarmLow, falseAlarmHigh;
+        wilsonInterval(result.erasures, result.pulses, erasureLow, erasureHigh);
+        wilsonInterval(result.falseAlarms, result.emptySlots, falseAlarmLow, falseAlarmHigh);
+
+        if (json) {
+            outfile << "  {\"erasure_prob\": " << result.point.erasure_probability
+                << ", \"noise_prob\": " << result.point.noise_probability
+                << ", \"k\": " << result.point.k
+                << ", \"trials\": " << result.trials
+                << ", \"pulses\": " << result.pulses
+                << ", \"erasures\": " << result.erasures
+                << ", \"erasure_rate\": " << erasureRate
+                << ", \"erasure_ci\": [" << erasureLow << ", " << erasureHigh << "]"
+                << ", \"empty_slots\": " << result.emptySlots
+                << ", \"false_alarms\": " << result.falseAlarms
+                << ", \"false_alarm_rate\": " << falseAlarmRate
+                << ", \"false_alarm_ci\": [" << falseAlarmLow << ", " << falseAlarmHigh << "]"
+                << ", \"histogram\": [";
+            for (int j = 0; j <= sweep_histogram_max; j++) {
+                outfile << (j > 0 ? ", " : "") << result.histogram[j];
+            }
+            outfile << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        else {
+            outfile << result.point.erasure_probability << "," << result.point.noise_probability << "," << result.point.k
+                << "," << result.trials << "," << result.pulses << "," << result.erasures << "," << erasureRate
+                << "," << erasureLow << "," << erasureHigh << "," << result.emptySlots << "," << result.falseAlarms
+                << "," << falseAlarmRate << "," << falseAlarmLow << "," << falseAlarmHigh;
+            for (int j = 0; j <= sweep_histogram_max; j++) {
+                outfile << "," << result.histogram[j];
+            }
+            outfile << "\n";
+        }
+    }
+
+    if (json) {
+        outfile << "]\n";
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+// Sweep.h
+//
+// Monte Carlo sweep over (erasure probability, noise probability, K) points.
+//
+// The pulse file is parsed once and shared read-only by every trial. Each trial
+// walks the pulses (erasure roll, then a Poisson photon count with mean K) and
+// jumps between noise events in the empty slots, so it costs the same as one
+// channel pass. Trials of all points run together on the thread pool, each with
+// its own Philox stream keyed by (seed, point, trial), so results do not depend
+// on the thread count.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Largest photon count with its own histogram bin (same cap as stls_pulse_to_photons_poisson)
+const int sweep_histogram_max = 20;
+
+struct SweepPoint {
+    double erasure_probability = 0.0;
+    double noise_probability = 0.0;
+    double k = 0.0; // mean detected photons per pulse, 0 to skip the Poisson detection
+};
+
+// What the sweep needs to know about the input: parsed once, then read-only
+struct PulseSummary {
+    long long slots = 0;
+    long long pulses = 0;
+};
+
+struct SweepResult {
+    SweepPoint point;
+    long long trials = 0;
+    long long pulses = 0;       // pulses seen over all trials
+    long long erasures = 0;     // pulses that ended with no photons
+    long long emptySlots = 0;   // slots eligible for noise over all trials
+    long long falseAlarms = 0;  // noise photons in those slots
+    std::vector<long long> histogram = std::vector<long long>(sweep_histogram_max + 1, 0);
+};
+
+// Reads a pulse file once. Returns false if it can't be opened or holds something other than
+// run lengths (text that isn't a number, or a count too large for a long long).
+bool readPulseSummary(const std::string& filename, PulseSummary& summary);
+
+// Reads points as "erasure,noise,k" lines; blank lines and lines starting with '#' are skipped
+bool readSweepPoints(const std::string& filename, std::vector<SweepPoint>& points);
+
+// Every combination of the comma-separated lists, e.g. "0.1,0.2" "1e-6,1e-5" "0.5,1"
+std::vector<SweepPoint> sweepGrid(const std::string& erasures, const std::string& noises, const std::string& ks);
+
+std::vector<SweepResult> runSweep(const PulseSummary& summary, const std::vector<SweepPoint>& points,
+    long long trials, uint64_t seed, ThreadPool& pool);
+
+// Writes one row per point as CSV, or JSON if the filename ends in ".json"
+bool writeSweepResults(const std::string& filename, const std::vector<SweepResult>& results);
@@ -0,0 +1,146 @@
+#include "TextCodec.h"
+
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+static const size_t text_buffer_size = 1 << 20;
+static const size_t text_padding = 16;
+static const size_t text_max_token = 32; // refill below this so a number rarely straddles a refill
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static int lowestSetBit(uint64_t x) {
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (int)index;
+}
+#else
+static int lowestSetBit(uint64_t x) {
+    return __builtin_ctzll(x);
+}
+#endif
+
+// Number of leading decimal digits in the 8 bytes at p, and their value.
+// x = bytes ^ '0' turns digits into 0..9; a byte is a non-digit when it is >= 10, which
+// shows up in its top bit after adding 0x76 (or was already there). A carry out of a
+// non-digit byte can only disturb the bytes after it, which we don't look at.
+static int swarDigits(const char* p, uint64_t& value) {
+    uint64_t x;
+    std::memcpy(&x, p, 8);
+    x ^= 0x3030303030303030ULL;
+    uint64_t nonDigit = ((x + 0x7676767676767676ULL) | x) & 0x8080808080808080ULL;
+    int count = nonDigit == 0 ? 8 : lowestSetBit(nonDigit) >> 3;
+    value = 0;
+    if (count == 0) {
+        return 0;
+    }
+
+    // Right-align the digits as an 8-digit number with leading zeros, then combine pairs, quads, octets
+    x <<= (8 - count) * 8;
+    x = (x * 10 + (x >> 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x * 100 + (x >> 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x * 10000 + (x >> 32)) & 0x00000000FFFFFFFFULL;
+    value = x;
+    return count;
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+TextReader::TextReader(std::istream& input) : input(input), buffer(text_buffer_size + text_padding, 0) {}
+
+void TextReader::refill() {
+    if (eof) {
+        return;
+    }
+    size_t left = length - position;
+    std::memmove(buffer.data(), buffer.data() + position, left);
+    input.read(buffer.data() + left, (std::streamsize)(text_buffer_size - left));
+    size_t got = (size_t)input.gcount();
+    if (got < text_buffer_size - left) {
+        eof = true;
+    }
+    position = 0;
+    length = left + got;
+    std::memset(buffer.data() + length, 0, text_padding);
+}
+
+bool TextReader::next(long long& value) {
+    static const uint64_t powers[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+    while (true) {
+        if (length - position < text_max_token) {
+            refill();
+        }
+        if (position >= length) {
+            return false;
+        }
+        if (!isSpace(buffer[position])) {
+            break;
+        }
+        position++;
+    }
+
+    // Digits are taken eight at a time until a non-digit. A number that runs into the end of
+    // the data read so far carries on after a refill, so however many digits (leading zeros
+    // included) it has, it is read whole; one past LLONG_MAX fails like operator>> does.
+    const uint64_t limit = (uint64_t)std::numeric_limits<long long>::max();
+    const char* p = buffer.data() + position;
+    uint64_t total = 0;
+    uint64_t chunk;
+    size_t digits = 0;
+    bool overflow = false;
+    while (true) {
+        int count = swarDigits(p, chunk);
+        if (total > (limit - chunk) / powers[count]) {
+            overflow = true;
+        }
+        else {
+            total = total * powers[count] + chunk;
+        }
+        p += count;
+        digits += (size_t)count;
+        if (count == 8) {
+            continue;
+        }
+        if ((size_t)(p - buffer.data()) == length && !eof) {
+            position = length;
+            refill();
+            p = buffer.data() + position;
+            continue;
+        }
+        break;
+    }
+
+    if (digits == 0 || overflow) {
+        failed = true;
+        return false;
+    }
+    position = (size_t)(p - buffer.data());
+    value = (long long)total;
+    return true;
+}
+
+TextWriter::TextWriter(std::ostream& output) : output(output), buffer(text_buffer_size) {}
+
+TextWriter::~TextWriter() {
+    flush();
+}
+
+void TextWriter::write(long long value) {
+    if (length + 24 > buffer.size()) {
+        flush();
+    }
+    char* end = std::to_chars(buffer.data() + length, buffer.data() + buffer.size(), value).ptr;
+    *end++ = ' ';
+    length = (size_t)(end - buffer.data());
+}
+
+void TextWriter::flush() {
+    if (length > 0) {
+        output.write(buffer.data(), (std::streamsize)length);
+        length = 0;
+    }
+}
@@ -0,0 +1,56 @@
+// TextCodec.h
+//
+// Fast reading and writing of the whitespace-separated integers in the ASCII files.
+//
+// TextReader pulls the stream into a large buffer and parses eight digits at a time
+// (SWAR: find the digit run in a 64-bit word, then combine it with three multiplies)
+// instead of going through operator>> per value. TextWriter formats with std::to_chars
+// into a reusable buffer and hands it to the stream in one write per block. The text
+// is the same as before: each value followed by a single space.
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+class TextReader {
+public:
+    explicit TextReader(std::istream& input);
+
+    // Skips whitespace and parses a non-negative integer. Returns false at the end of the
+    // stream, if the next character isn't a digit or if the number doesn't fit a long long
+    // (like operator>> failing).
+    bool next(long long& value);
+
+    // False once next() has stopped on something other than the end of the stream
+    bool good() const {
+        return !failed;
+    }
+
+private:
+    void refill();
+
+    std::istream& input;
+    std::vector<char> buffer; // data plus zeroed padding so 8-byte loads stay in bounds
+    size_t position = 0;
+    size_t length = 0;
+    bool eof = false;
+    bool failed = false;
+};
+
+class TextWriter {
+public:
+    explicit TextWriter(std::ostream& output);
+    ~TextWriter();
+
+    // Writes the value followed by a space
+    void write(long long value);
+
+    void flush();
+
+private:
+    std::ostream& output;
+    std::vector<char> buffer;
+    size_t length = 0;
+};
@@ -0,0 +1,93 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threads) {
+    if (threads <= 0) {
+        threads = (int)std::thread::hardware_concurrency();
+        if (threads <= 0) {
+            threads = 1;
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+bool ThreadPool::takeTask(int id, std::function<void()>& task) {
+    int count = (int)queues.size();
+    // Own queue first (newest task), then steal the oldest task from the others
+    for (int offset = 0; offset < count; offset++) {
+        Queue& queue = *queues[(id + offset) % count];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (offset == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int id) {
+    std::function<void()> task;
+    while (true) {
+        if (takeTask(id, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(sleepLock);
+        wake.wait(guard, [&] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(long long count, const std::function<void(long long)>& task) {
+    std::mutex doneLock;
+    std::condition_variable done;
+    long long remaining = count;
+
+    // Deal the indices out round-robin; stealing evens out whatever imbalance is left
+    for (long long i = 0; i < count; i++) {
+        Queue& queue = *queues[i % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back([&, i] {
+            task(i);
+            std::lock_guard<std::mutex> doneGuard(doneLock);
+            if (--remaining == 0) {
+                done.notify_one();
+            }
+        });
+        queued++;
+    }
+    {
+        // Taking the lock orders the wake-up after any worker checking 'queued'
+        std::lock_guard<std::mutex> guard(sleepLock);
+    }
+    wake.notify_all();
+
+    std::unique_lock<std::mutex> guard(doneLock);
+    done.wait(guard, [&] { return remaining == 0; });
+}
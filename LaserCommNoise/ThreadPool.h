@@ -0,0 +1,49 @@
+// ThreadPool.h
+//
+// Small work-stealing thread pool.
+//
+// Every worker owns a queue of tasks. It takes work from the back of its own queue
+// and, when that runs dry, steals from the front of the other queues, so a worker
+// that drew quick blocks (few pulses, little noise) helps out the busy ones.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // threads <= 0 uses one worker per hardware thread
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    int size() const {
+        return (int)workers.size();
+    }
+
+    // Runs task(i) for every i in [0, count) and waits for all of them to finish
+    void parallelFor(long long count, const std::function<void(long long)>& task);
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(int id);
+    bool takeTask(int id, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::atomic<long long> queued{ 0 };
+    bool stopping = false;
+};
@@ -0,0 +1,25 @@
+/* Minimal checks for the test programs (C and C++)
+
+ CHECK() reports a failed condition with its file and line and carries on, so one run shows
+ every failure; a test's main() returns CHECK_STATUS(), which is non-zero if anything failed.
+ ctest runs each program from its own scratch directory under the build tree.
+
+*/
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_STATUS() (check_failures == 0 ? 0 : 1)
+
+#endif
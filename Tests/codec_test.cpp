@@ -0,0 +1,270 @@
+// codec_test.cpp
+//
+// The slot file formats must all carry the same stream. A stream of photon counts is written
+// as an event stream and converted to every format that holds counts, and each is read back
+// slot for slot; a pulse stream is converted to the pulse formats, and the -k channel must
+// give the same slots for a seed whichever of them it reads, sparse or dense. A malformed file
+// stops the reader early with good() false.
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ChannelPipeline.h"
+#include "Check.h"
+#include "EventStream.h"
+#include "PPMDemodulator.h"
+#include "PPMSymbols.h"
+#include "SlotContainer.h"
+#include "SlotConvert.h"
+#include "ThreadPool.h"
+
+namespace {
+
+const long long total_slots = 500000;
+
+// Keeps every slot the pipeline passes on
+class CollectSink : public PipelineSink {
+public:
+    void writeBlock(long long, long long, const std::vector<PhotonSlot>& events) override {
+        slots.insert(slots.end(), events.begin(), events.end());
+    }
+    void finish() override {}
+
+    std::vector<PhotonSlot> slots;
+};
+
+// Occupied slots every 1 to 400 slots with counts of 1 to 200, a gap of 150000 slots (more
+// than one 16-bit RLE run) and empty slots at the end
+std::vector<SlotEvent> makeCounts() {
+    std::vector<SlotEvent> events;
+    uint64_t state = 3;
+    long long slot = 0;
+    while (true) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        slot += 1 + (long long)((state >> 33) % 400);
+        if (slot >= 200000 && slot < 350000) {
+            slot = 350000;
+        }
+        if (slot >= total_slots - 100) {
+            break;
+        }
+        SlotEvent event;
+        event.slot = slot;
+        event.count = ((state >> 20) % 8 == 0) ? 2 + (uint32_t)((state >> 40) % 199) : 1;
+        events.push_back(event);
+    }
+    return events;
+}
+
+// Reads a count file back in uneven chunks, numbering the slots from the start of the file
+bool readCounts(const std::string& filename, std::vector<SlotEvent>& all, long long& slots) {
+    PhotonCountReader reader(filename);
+    if (!reader.isOpen()) {
+        return false;
+    }
+    all.clear();
+    slots = 0;
+    std::vector<SlotEvent> events;
+    long long read;
+    while ((read = reader.readEvents(events, 77777)) > 0) {
+        for (SlotEvent event : events) {
+            event.slot += slots;
+            all.push_back(event);
+        }
+        slots += read;
+    }
+    return read == 0;
+}
+
+bool sameEvents(const std::vector<SlotEvent>& a, const std::vector<SlotEvent>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].slot != b[i].slot || a[i].count != b[i].count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string fileText(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    std::ostringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+// The reader LaserCommNoise would use, with the stls formats read through CountBlockReader
+std::unique_ptr<BlockSource> pulseSource(const std::string& filename, std::ifstream& pairs) {
+    if (isSlotContainer(filename)) {
+        return std::unique_ptr<BlockSource>(new ContainerBlockReader(filename));
+    }
+    if (isEventStream(filename)) {
+        return std::unique_ptr<BlockSource>(new EventBlockReader(filename));
+    }
+    if (filename != "pulses.txt") {
+        return std::unique_ptr<BlockSource>(new CountBlockReader(filename));
+    }
+    pairs.open(filename);
+    return std::unique_ptr<BlockSource>(new RLEBlockReader(pairs));
+}
+
+std::vector<PhotonSlot> runChannel(const std::string& filename) {
+    ChannelPipeline pipeline;
+    pipeline.add(std::unique_ptr<PipelineStage>(new PoissonDetection(1.5)));
+    pipeline.add(std::unique_ptr<PipelineStage>(new PulseErasure(0.1)));
+    pipeline.add(std::unique_ptr<PipelineStage>(new BackgroundNoise(BackgroundNoise::meanForProbability(1e-3))));
+    std::ifstream pairs;
+    std::unique_ptr<BlockSource> reader = pulseSource(filename, pairs);
+    CollectSink sink;
+    ThreadPool pool(3);
+    PipelineStats stats = pipeline.run(*reader, sink, 65536, 5, pool);
+    CHECK(stats.slots == total_slots);
+    return sink.slots;
+}
+
+}
+
+int main() {
+    // Counts: every format that can hold them reads back the stream it was converted from
+    std::vector<SlotEvent> counts = makeCounts();
+    long long occupied = (long long)counts.size(), photons = 0;
+    for (const SlotEvent& event : counts) {
+        photons += event.count;
+    }
+    {
+        SlotCountWriter writer("counts.events");
+        CHECK(writer.isOpen());
+        // in two blocks, split inside the long gap
+        std::vector<SlotEvent> first, second;
+        for (const SlotEvent& event : counts) {
+            (event.slot < 300000 ? first : second).push_back(event);
+        }
+        CHECK(writer.write(first, 0, 300000));
+        CHECK(writer.write(second, 300000, total_slots - 300000));
+        CHECK(writer.finish());
+    }
+    std::vector<SlotEvent> decoded;
+    long long slots = 0;
+    CHECK(readCounts("counts.events", decoded, slots));
+    CHECK(slots == total_slots);
+    CHECK(sameEvents(decoded, counts));
+
+    const char* countFormats[] = { ".slots", ".vrle", ".rle.bin", ".rle.txt", ".bin", ".photons.txt" };
+    for (const char* extension : countFormats) {
+        std::string filename = std::string("counts") + extension;
+        ConvertStats converted;
+        std::string error;
+        CHECK(convertSlots("counts.events", filename, converted, error));
+        CHECK(converted.slots == total_slots && converted.occupied == occupied && converted.count == photons);
+        CHECK(readCounts(filename, decoded, slots));
+        CHECK(slots == total_slots);
+        CHECK(sameEvents(decoded, counts));
+
+        // and converts back to the same event stream
+        ConvertStats back;
+        CHECK(convertSlots(filename, "back.events", back, error));
+        CHECK(readCounts("back.events", decoded, slots));
+        CHECK(slots == total_slots);
+        CHECK(sameEvents(decoded, counts));
+    }
+
+    // A count too large for the format is refused
+    {
+        std::vector<SlotEvent> bright(1, SlotEvent{ 10, 300 });
+        SlotCountWriter writer("bright.bin");
+        CHECK(writer.isOpen());
+        CHECK(!writer.write(bright, 0, 100));
+    }
+
+    // Pulses: the channel gives the same slots for a seed from every pulse format
+    std::ofstream pulseFile("pulses.txt");
+    long long last = -1;
+    for (const SlotEvent& event : counts) {
+        pulseFile << event.slot - last - 1 << " 1 ";
+        last = event.slot;
+    }
+    pulseFile << total_slots - last - 1 << " 0 ";
+    pulseFile.close();
+
+    std::vector<PhotonSlot> reference = runChannel("pulses.txt");
+    long long pulses = 0;
+    for (const PhotonSlot& slot : reference) {
+        pulses += slot.pulse;
+    }
+    CHECK(pulses == occupied);
+
+    const char* pulseFormats[] = { ".events", ".slots", ".vrle", ".rle.bin", ".rle.txt", ".bin", ".pulses.txt" };
+    std::string error;
+    ConvertStats written;
+    CHECK(convertSlots("pulses.txt", "reference.txt", written, error));
+    for (const char* extension : pulseFormats) {
+        std::string filename = std::string("pulses") + extension;
+        ConvertStats converted, back;   // convertSlots adds to the totals it is given
+        CHECK(convertSlots("pulses.txt", filename, converted, error));
+        CHECK(converted.slots == total_slots && converted.occupied == occupied && converted.count == occupied);
+
+        std::vector<PhotonSlot> out = runChannel(filename);
+        bool same = (out.size() == reference.size());
+        for (size_t i = 0; same && i < out.size(); i++) {
+            same = out[i].slot == reference[i].slot && out[i].pulse == reference[i].pulse &&
+                out[i].signal == reference[i].signal && out[i].background == reference[i].background &&
+                out[i].erased == reference[i].erased;
+        }
+        CHECK(same);
+
+        CHECK(convertSlots(filename, "back.txt", back, error));
+        CHECK(fileText("back.txt") == fileText("reference.txt"));
+    }
+
+    // Reading stops at text that isn't a count, and the reader says the file is malformed
+    {
+        std::istringstream bad("10 1 20 1 x 5 1 ");
+        RLEBlockReader reader(bad);
+        SlotBitmap block;
+        long long read = 0;
+        while (reader.readBlock(block, 1000)) {
+            read += block.size();
+        }
+        CHECK(read == 32 && !reader.good());
+        std::istringstream fine("10 1 20 1 5 1 ");
+        RLEBlockReader fineReader(fine);
+        while (fineReader.readBlock(block, 1000)) {
+        }
+        CHECK(fineReader.good());
+
+        // nor can the symbols of a malformed file be read
+        std::istringstream badSymbols("10 1 20 1 x 5 1 ");
+        RLEBlockReader symbolReader(badSymbols);
+        std::vector<uint32_t> symbols;
+        long long badFrames = 0;
+        CHECK(!readPPMSymbols(symbolReader, 2, symbols, badFrames));
+        std::istringstream fineSymbols("1 1 2 1 6 1 ");
+        RLEBlockReader fineSymbolReader(fineSymbols);
+        CHECK(readPPMSymbols(fineSymbolReader, 2, symbols, badFrames));
+        CHECK(symbols == std::vector<uint32_t>({ 1, 0, 3 }) && badFrames == 0);
+    }
+    {
+        std::ofstream("bad.pulses.txt") << "0101x0001";
+        CountBlockReader reader("bad.pulses.txt");
+        CHECK(reader.isOpen());
+        SlotBitmap block;
+        while (reader.readBlock(block, 1000)) {
+        }
+        CHECK(!reader.good());
+    }
+
+    const char* scratch[] = { "counts.events", "counts.slots", "counts.vrle", "counts.rle.bin", "counts.rle.txt",
+        "counts.bin", "counts.photons.txt", "back.events", "bright.bin", "pulses.txt", "reference.txt", "back.txt",
+        "pulses.events", "pulses.slots", "pulses.vrle", "pulses.rle.bin", "pulses.rle.txt", "pulses.bin",
+        "pulses.pulses.txt", "bad.pulses.txt" };
+    for (const char* filename : scratch) {
+        std::remove(filename);
+    }
+    return CHECK_STATUS();
+}
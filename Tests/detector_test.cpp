@@ -0,0 +1,170 @@
+// detector_test.cpp
+//
+// Checks of the event-driven detector model in Detector.cpp: an ideal detector clicks once
+// per photon, dead time blocks photons on a busy pixel, dark counts come at the set rate,
+// the run totals agree with the slots passed on, and the output does not depend on how
+// the stream is cut into blocks.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Check.h"
+#include "Detector.h"
+
+namespace {
+
+// Keeps every slot the detector passes on
+class CollectSink : public PipelineSink {
+public:
+    void writeBlock(long long, long long, const std::vector<PhotonSlot>& events) override {
+        slots.insert(slots.end(), events.begin(), events.end());
+    }
+    void finish() override {
+        finished = true;
+    }
+
+    std::vector<PhotonSlot> slots;
+    bool finished = false;
+};
+
+// A pulse every 64 slots with 0-3 signal photons, and a background photon every 37 slots
+std::vector<PhotonSlot> makeStream(long long slots) {
+    std::vector<PhotonSlot> events;
+    for (long long slot = 0; slot < slots; slot++) {
+        PhotonSlot event;
+        event.slot = slot;
+        event.pulse = (slot % 64 == 5);
+        event.signal = event.pulse ? (int)((slot / 64) % 4) : 0;
+        event.background = (slot % 37 == 0) ? 1 : 0;
+        if (event.pulse || event.background > 0) {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+// Feeds the stream to a detector in blocks of the given size
+DetectorStats run(const DetectorModel& model, const std::vector<PhotonSlot>& stream, long long slots,
+                  long long block, std::vector<PhotonSlot>& out) {
+    CollectSink sink;
+    SinglePhotonDetector detector(model, 42, sink);
+    size_t next = 0;
+    for (long long first = 0; first < slots; first += block) {
+        long long count = std::min(block, slots - first);
+        std::vector<PhotonSlot> events;
+        while (next < stream.size() && stream[next].slot < first + count) {
+            events.push_back(stream[next++]);
+        }
+        detector.writeBlock(first, count, events);
+    }
+    detector.finish();
+    CHECK(sink.finished);
+    out = sink.slots;
+    return detector.stats();
+}
+
+bool sameSlots(const std::vector<PhotonSlot>& a, const std::vector<PhotonSlot>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].slot != b[i].slot || a[i].pulse != b[i].pulse || a[i].signal != b[i].signal ||
+            a[i].background != b[i].background || a[i].detected != b[i].detected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The run totals must match the slots that were passed on
+void checkTotals(const DetectorStats& stats, const std::vector<PhotonSlot>& out) {
+    long long clicks = 0, detected = 0, missed = 0, falseDetections = 0;
+    for (const PhotonSlot& event : out) {
+        clicks += event.photons();
+        detected += event.detected;
+        missed += event.pulse && !event.detected;
+        falseDetections += !event.pulse && event.detected;
+    }
+    CHECK(stats.detections == clicks);
+    CHECK(stats.detectedSlots == detected);
+    CHECK(stats.missedPulses == missed);
+    CHECK(stats.falseDetections == falseDetections);
+    CHECK(stats.detections == stats.arrivals + stats.darkCounts + stats.afterpulses - stats.blocked);
+}
+
+}
+
+int main() {
+    const long long slots = 200000;
+    std::vector<PhotonSlot> stream = makeStream(slots);
+    long long photons = 0, darkPulses = 0;
+    for (const PhotonSlot& event : stream) {
+        photons += event.photons();
+        darkPulses += event.pulse && event.photons() == 0;
+    }
+
+    // An ideal detector gives back the photons it was given, each as a click in its own slot
+    DetectorModel ideal;
+    std::vector<PhotonSlot> out;
+    DetectorStats stats = run(ideal, stream, slots, 4096, out);
+    checkTotals(stats, out);
+    CHECK(stats.arrivals == photons);
+    CHECK(stats.detections == photons);
+    CHECK(stats.blocked == 0 && stats.darkCounts == 0 && stats.afterpulses == 0 && stats.shifted == 0);
+    CHECK(stats.missedPulses == darkPulses);
+    bool matches = (out.size() == stream.size());
+    for (size_t i = 0; matches && i < out.size(); i++) {
+        matches = out[i].slot == stream[i].slot && out[i].pulse == stream[i].pulse && out[i].signal == stream[i].signal &&
+            out[i].background == stream[i].background && out[i].detected == (stream[i].photons() > 0);
+    }
+    CHECK(matches);
+
+    // One pixel with a long dead time clicks once for a slot of several photons
+    DetectorModel dead;
+    dead.deadTime = 10.0;
+    std::vector<PhotonSlot> burst(1);
+    burst[0].slot = 100;
+    burst[0].pulse = true;
+    burst[0].signal = 5;
+    stats = run(dead, burst, 1000, 1000, out);
+    CHECK(stats.arrivals == 5);
+    CHECK(stats.detections == 1);
+    CHECK(stats.blocked == 4);
+    CHECK(out.size() == 1 && out[0].slot == 100 && out[0].signal == 1 && out[0].detected);
+
+    // Dark counts arrive at the set rate, within 5 standard deviations
+    DetectorModel dark;
+    dark.darkRate = 0.01;
+    stats = run(dark, std::vector<PhotonSlot>(), slots, 4096, out);
+    checkTotals(stats, out);
+    double expected = dark.darkRate * (double)slots;
+    CHECK(std::fabs((double)stats.darkCounts - expected) < 5.0 * std::sqrt(expected));
+    CHECK(stats.falseDetections == stats.detectedSlots);
+
+    // Every effect at once gives the same slots and totals whatever the block size
+    DetectorModel full;
+    full.deadTime = 3.0;
+    full.darkRate = 1e-3;
+    full.afterpulseProbability = 0.05;
+    full.afterpulseDelay = 2.0;
+    full.jitter = 0.3;
+    full.pixels = 4;
+    std::vector<PhotonSlot> reference;
+    DetectorStats referenceStats = run(full, stream, slots, slots, reference);
+    checkTotals(referenceStats, reference);
+    CHECK(referenceStats.blocked > 0 && referenceStats.afterpulses > 0 && referenceStats.shifted > 0);
+    const long long blocks[] = { 1, 7, 1000, 65536 };
+    for (long long block : blocks) {
+        stats = run(full, stream, slots, block, out);
+        CHECK(sameSlots(out, reference));
+        CHECK(stats.detections == referenceStats.detections);
+        CHECK(stats.blocked == referenceStats.blocked);
+        CHECK(stats.afterpulses == referenceStats.afterpulses);
+        CHECK(stats.darkCounts == referenceStats.darkCounts);
+        CHECK(stats.missedPulses == referenceStats.missedPulses);
+    }
+
+    return CHECK_STATUS();
+}
@@ -0,0 +1,157 @@
+// pipeline_test.cpp
+//
+// The -k channel pipeline and the sweep promise the same output for a seed whatever the
+// block size and thread count. This runs a pipeline with every stage and fading, and a
+// small sweep, at several block sizes and thread counts and checks that the results are
+// identical, then checks the photon counts against their means.
+
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ChannelPipeline.h"
+#include "Check.h"
+#include "Fading.h"
+#include "Sweep.h"
+#include "ThreadPool.h"
+
+namespace {
+
+const long long total_slots = 2000000;
+const double mean_photons = 2.0;
+
+// Keeps every slot the pipeline passes on
+class CollectSink : public PipelineSink {
+public:
+    void writeBlock(long long, long long, const std::vector<PhotonSlot>& events) override {
+        slots.insert(slots.end(), events.begin(), events.end());
+    }
+    void finish() override {}
+
+    std::vector<PhotonSlot> slots;
+};
+
+// RLE text with a pulse after every 40 to 200 empty slots
+std::string pulseText() {
+    std::ostringstream text;
+    uint64_t state = 7;
+    long long slots = 0;
+    while (true) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        long long zeros = 40 + (long long)((state >> 33) % 161);
+        if (slots + zeros + 1 > total_slots) {
+            break;
+        }
+        text << zeros << " 1 ";
+        slots += zeros + 1;
+    }
+    text << total_slots - slots << " 0 ";
+    return text.str();
+}
+
+PipelineStats runPipeline(const std::string& text, long long blockSlots, int threads, std::vector<PhotonSlot>& out) {
+    ChannelPipeline pipeline;
+    pipeline.add(std::unique_ptr<PipelineStage>(new PoissonDetection(mean_photons)));
+    pipeline.add(std::unique_ptr<PipelineStage>(new PulseErasure(0.1)));
+    pipeline.add(std::unique_ptr<PipelineStage>(new BackgroundNoise(BackgroundNoise::meanForProbability(1e-3))));
+    pipeline.add(std::unique_ptr<PipelineStage>(new Threshold(1)));
+    FadingModel fading;
+    CHECK(FadingModel::parse("lognormal,index=0.2,coherence=5000", fading));
+    pipeline.setFading(std::unique_ptr<FadingProcess>(new FadingProcess(fading, 11)));
+
+    std::istringstream input(text);
+    RLEBlockReader reader(input);
+    CollectSink sink;
+    ThreadPool pool(threads);
+    PipelineStats stats = pipeline.run(reader, sink, blockSlots, 11, pool);
+    out = sink.slots;
+    return stats;
+}
+
+bool sameSlots(const std::vector<PhotonSlot>& a, const std::vector<PhotonSlot>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].slot != b[i].slot || a[i].pulse != b[i].pulse || a[i].signal != b[i].signal ||
+            a[i].background != b[i].background || a[i].detected != b[i].detected || a[i].erased != b[i].erased ||
+            a[i].gain != b[i].gain) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main() {
+    std::string text = pulseText();
+
+    std::vector<PhotonSlot> reference;
+    PipelineStats referenceStats = runPipeline(text, 1 << 20, 1, reference);
+    CHECK(referenceStats.slots == total_slots);
+    CHECK(referenceStats.pulses > 10000);
+
+    const long long blockSizes[] = { 4096, 65536, 300000 };
+    const int threadCounts[] = { 1, 3, 8 };
+    for (long long blockSlots : blockSizes) {
+        for (int threads : threadCounts) {
+            std::vector<PhotonSlot> out;
+            PipelineStats stats = runPipeline(text, blockSlots, threads, out);
+            CHECK(sameSlots(out, reference));
+            CHECK(stats.photons == referenceStats.photons);
+            CHECK(stats.erasures == referenceStats.erasures);
+            CHECK(stats.detections == referenceStats.detections);
+        }
+    }
+
+    // Signal photons of the pulses that got through average K times the pulse's gain
+    double signal = 0.0, expected = 0.0;
+    long long pulses = 0, erased = 0;
+    for (const PhotonSlot& slot : reference) {
+        if (slot.pulse) {
+            pulses++;
+            erased += slot.erased;
+            if (!slot.erased) {
+                signal += slot.signal;
+                expected += mean_photons * slot.gain;
+            }
+        }
+    }
+    CHECK(pulses == referenceStats.pulses);
+    CHECK(std::fabs(signal - expected) < 5.0 * std::sqrt(expected));
+    CHECK(std::fabs((double)erased - 0.1 * pulses) < 5.0 * std::sqrt(0.09 * pulses));
+
+    // A sweep gives the same results on any number of threads
+    PulseSummary summary;
+    summary.slots = total_slots;
+    summary.pulses = referenceStats.pulses;
+    std::vector<SweepPoint> points = sweepGrid("0,0.1", "1e-5", "0.5,12");
+    std::vector<SweepResult> sweepReference;
+    {
+        ThreadPool pool(1);
+        sweepReference = runSweep(summary, points, 4, 3, pool);
+    }
+    for (int threads : threadCounts) {
+        ThreadPool pool(threads);
+        std::vector<SweepResult> results = runSweep(summary, points, 4, 3, pool);
+        CHECK(results.size() == sweepReference.size());
+        for (size_t i = 0; i < results.size() && i < sweepReference.size(); i++) {
+            CHECK(results[i].erasures == sweepReference[i].erasures);
+            CHECK(results[i].falseAlarms == sweepReference[i].falseAlarms);
+            CHECK(results[i].histogram == sweepReference[i].histogram);
+        }
+    }
+    // With no channel erasures, a pulse ends up empty with probability exp(-K)
+    for (const SweepResult& result : sweepReference) {
+        if (result.point.erasure_probability == 0.0) {
+            double p = std::exp(-result.point.k);
+            double n = (double)result.pulses;
+            CHECK(std::fabs((double)result.erasures - p * n) < 5.0 * std::sqrt(p * (1.0 - p) * n) + 1.0);
+        }
+    }
+
+    return CHECK_STATUS();
+}
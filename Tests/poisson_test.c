@@ -0,0 +1,128 @@
+/* Chi-square tests of the Poisson generators in poisson.c against the exact PMF
+
+ Each point draws a million counts and checks the statistic from poisson_chi_square() against
+ the 0.999 quantile of the chi-square distribution for the degrees of freedom the binning gives
+ at that lambda. The binning only depends on lambda and the sample size, so the degrees of
+ freedom are fixed too and are checked first. The seeds are fixed, so a pass is repeatable.
+
+ The grid covers the guide-table inverse CDF (lambda below POISSON_PTRS_LAMBDA), the switch to
+ PTRS at 10 and PTRS well above it. The one-at-a-time samplers LaserCommNoise uses, poisson_sample() and poisson_table_sample(), are
+ run on a caller's generator on both sides of the switch.
+
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Check.h"
+#include "poisson.h"
+
+#define SAMPLES 1000000
+
+typedef struct
+{
+    double lambda;
+    int dof;            // degrees of freedom the binning gives for SAMPLES counts
+    double critical;    // 0.999 quantile of chi-square with dof degrees of freedom
+} chi_square_point;
+
+static const chi_square_point batch_points[] =
+{
+    { 0.01,  2,  13.82 },
+    { 0.2,   4,  18.47 },
+    { 0.5,   6,  22.46 },
+    { 1.0,   8,  26.12 },
+    { 3.0,  13,  34.53 },
+    { 5.0,  18,  42.31 },
+    { 9.5,  26,  54.05 },
+    { 10.0, 27,  55.48 },
+    { 30.0, 48,  84.04 },
+    { 1000.0, 261, 337.34 },
+};
+
+static const chi_square_point sample_points[] =
+{
+    { 0.5,  6,  22.46 },
+    { 3.0, 13,  34.53 },
+    { 9.5, 26,  54.05 },
+    { 30.0, 48, 84.04 },
+};
+
+
+// a caller's generator for the source-driven samplers: splitmix64 on a counter
+static uint64_t splitmix_source(void *context)
+{
+    uint64_t z = (*(uint64_t *)context += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+
+static void check_point(const char *generator, const chi_square_point *point, const int32_t *counts)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < SAMPLES; i++)
+        sum += counts[i];
+
+    int dof;
+    double chi2 = poisson_chi_square(point->lambda, counts, SAMPLES, &dof);
+    printf("%s lambda %g: mean %.4f, chi-square %.2f on %d degrees of freedom (critical %.2f)\n",
+           generator, point->lambda, sum / SAMPLES, chi2, dof, point->critical);
+    CHECK(dof == point->dof);
+    CHECK(chi2 < point->critical);
+    // the mean is within 5 standard errors of lambda
+    CHECK(fabs(sum / SAMPLES - point->lambda) < 5.0 * sqrt(point->lambda / SAMPLES));
+}
+
+
+int main(void)
+{
+    int32_t *counts = malloc(SAMPLES * sizeof(int32_t));
+    if (counts == NULL)
+        return 1;
+
+    for (size_t p = 0; p < sizeof(batch_points) / sizeof(batch_points[0]); p++)
+    {
+        poisson_table table;
+        poisson_rng rng;
+        CHECK(poisson_table_init(&table, batch_points[p].lambda) == 0);
+        CHECK(table.use_ptrs == (batch_points[p].lambda >= POISSON_PTRS_LAMBDA));
+        poisson_rng_seed(&rng, 1234 + p);
+        poisson_batch(&table, &rng, counts, SAMPLES);
+        check_point("batch", &batch_points[p], counts);
+    }
+
+    for (size_t p = 0; p < sizeof(sample_points) / sizeof(sample_points[0]); p++)
+    {
+        uint64_t state = 500 + p;
+        for (size_t i = 0; i < SAMPLES; i++)
+            counts[i] = poisson_sample(sample_points[p].lambda, splitmix_source, &state);
+        check_point("sample", &sample_points[p], counts);
+
+        poisson_table table;
+        CHECK(poisson_table_init(&table, sample_points[p].lambda) == 0);
+        state = 600 + p;
+        for (size_t i = 0; i < SAMPLES; i++)
+            counts[i] = poisson_table_sample(&table, splitmix_source, &state);
+        check_point("table sample", &sample_points[p], counts);
+    }
+
+    // lambda 0 always gives 0, and a negative or NaN mean is refused
+    poisson_table table;
+    poisson_rng rng;
+    CHECK(poisson_table_init(&table, 0.0) == 0);
+    poisson_rng_seed(&rng, 1);
+    poisson_batch(&table, &rng, counts, 1000);
+    int all_zero = 1;
+    for (size_t i = 0; i < 1000; i++)
+        all_zero &= (counts[i] == 0);
+    CHECK(all_zero);
+    uint64_t state = 1;
+    CHECK(poisson_sample(0.0, splitmix_source, &state) == 0 && poisson_sample(NAN, splitmix_source, &state) == 0);
+    CHECK(poisson_table_init(&table, -1.0) != 0);
+    CHECK(poisson_table_init(&table, NAN) != 0);
+
+    free(counts);
+    return CHECK_STATUS();
+}
@@ -0,0 +1,164 @@
+// reed_solomon_test.cpp
+//
+// Checks of the Reed-Solomon decoder in ReedSolomon.cpp. Random messages are encoded, and a
+// random mix of e errors and f erasures with 2e + f <= n - k must be corrected exactly, with
+// decode returning e + f; past that the codeword must be flagged with -1 rather than passed on.
+// The 16-codeword syndromes (AVX2 when the build targets it) must match the scalar ones, and
+// decodeBatch must agree with decode codeword by codeword.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Check.h"
+#include "ReedSolomon.h"
+#include "ThreadPool.h"
+
+namespace {
+
+const int n = ReedSolomon::length;
+
+struct Random {
+    uint64_t state;
+
+    uint64_t next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 33;
+    }
+
+    uint16_t symbol() {
+        return (uint16_t)(next() % ReedSolomon::field_size);
+    }
+
+    // A symbol other than zero, so adding it always changes the one it's added to
+    uint16_t change() {
+        return (uint16_t)(1 + next() % (ReedSolomon::field_size - 1));
+    }
+};
+
+std::vector<uint16_t> randomCodeword(const ReedSolomon& code, Random& random) {
+    std::vector<uint16_t> message(code.messageLength());
+    for (uint16_t& symbol : message) {
+        symbol = random.symbol();
+    }
+    std::vector<uint16_t> codeword(n);
+    code.encode(message.data(), codeword.data());
+    return codeword;
+}
+
+// Changes errors + erasures distinct symbols of the codeword, listing the erased positions
+std::vector<int> damage(std::vector<uint16_t>& codeword, int errors, int erasures, Random& random) {
+    std::vector<int> positions(n);
+    for (int i = 0; i < n; i++) {
+        positions[i] = i;
+    }
+    for (int i = 0; i < errors + erasures; i++) {
+        std::swap(positions[i], positions[i + (int)(random.next() % (uint64_t)(n - i))]);
+        codeword[positions[i]] ^= random.change();
+    }
+    return std::vector<int>(positions.begin() + errors, positions.begin() + errors + erasures);
+}
+
+}
+
+int main() {
+    Random random{ 11 };
+    const int parities[] = { 32, 64 };
+    for (int parity : parities) {
+        ReedSolomon code(n - parity);
+        CHECK(code.paritySymbols() == parity);
+
+        // A codeword is left alone
+        std::vector<uint16_t> codeword = randomCodeword(code, random);
+        std::vector<uint16_t> received = codeword;
+        CHECK(code.decode(received.data(), nullptr, 0) == 0 && received == codeword);
+
+        // Every mix of errors and erasures within the capacity is corrected
+        for (int errors = 0; 2 * errors <= parity; errors += 3) {
+            const int erasureCounts[] = { 0, 1, (parity - 2 * errors) / 2, parity - 2 * errors };
+            for (int erasures : erasureCounts) {
+                codeword = randomCodeword(code, random);
+                received = codeword;
+                std::vector<int> erased = damage(received, errors, erasures, random);
+                CHECK(code.decode(received.data(), erased.data(), erasures) == errors + erasures);
+                CHECK(received == codeword);
+            }
+        }
+
+        // One error past the capacity is flagged, as are more erasures than parity symbols. The
+        // erasures leave at least 20 parity symbols to find the errors with, so a wrong
+        // codeword within reach is too unlikely to turn up.
+        for (int erasures = 0; erasures <= parity - 20; erasures += 4) {
+            int errors = (parity - erasures) / 2 + 1;
+            received = randomCodeword(code, random);
+            std::vector<int> erased = damage(received, errors, erasures, random);
+            CHECK(code.decode(received.data(), erased.data(), erasures) == -1);
+        }
+        received = randomCodeword(code, random);
+        std::vector<int> erased = damage(received, 0, parity + 1, random);
+        CHECK(code.decode(received.data(), erased.data(), parity + 1) == -1);
+
+        // The 16-codeword syndromes are the scalar ones, damaged codewords and clean
+        std::vector<uint16_t> interleaved((size_t)n * 16);
+        std::vector<uint16_t> words((size_t)n * 16);
+        for (int c = 0; c < 16; c++) {
+            std::vector<uint16_t> word = randomCodeword(code, random);
+            if (c % 3 != 0) {
+                damage(word, c, c, random);
+            }
+            std::copy(word.begin(), word.end(), words.begin() + (size_t)n * c);
+            for (int i = 0; i < n; i++) {
+                interleaved[16 * i + c] = word[i];
+            }
+        }
+        std::vector<uint16_t> S16((size_t)parity * 16);
+        code.syndromes16(interleaved.data(), S16.data());
+        std::vector<uint16_t> S(parity);
+        for (int c = 0; c < 16; c++) {
+            bool any = code.syndromes(words.data() + (size_t)n * c, S.data());
+            CHECK(any == (c % 3 != 0));
+            bool same = true;
+            for (int j = 0; j < parity; j++) {
+                same &= (S[j] == S16[16 * j + c]);
+            }
+            CHECK(same);
+        }
+
+        // decodeBatch agrees with decode on a batch that isn't a multiple of 16, some past capacity
+        // (with every parity symbol spent on erasures those can decode to another codeword)
+        const long long count = 37;
+        std::vector<uint16_t> batch((size_t)n * count);
+        std::vector<uint8_t> flags((size_t)n * count, 0);
+        std::vector<std::vector<int>> erasedLists(count);
+        std::vector<bool> correctable(count);
+        std::vector<uint16_t> clean((size_t)n * count);
+        for (long long c = 0; c < count; c++) {
+            std::vector<uint16_t> word = randomCodeword(code, random);
+            std::copy(word.begin(), word.end(), clean.begin() + (size_t)n * c);
+            int errors = (int)(c % 7) * parity / 12;
+            int erasures = (c % 5 == 4) ? parity : (int)(c % 4) * parity / 8;
+            erasedLists[c] = damage(word, errors, erasures, random);
+            correctable[c] = (2 * errors + erasures <= parity);
+            std::copy(word.begin(), word.end(), batch.begin() + (size_t)n * c);
+            for (int position : erasedLists[c]) {
+                flags[(size_t)n * c + position] = 1;
+            }
+        }
+        std::vector<uint16_t> single = batch;
+        ThreadPool pool(3);
+        std::vector<int> results;
+        code.decodeBatch(batch.data(), flags.data(), count, pool, results);
+        bool agree = true;
+        for (long long c = 0; c < count; c++) {
+            uint16_t* word = single.data() + (size_t)n * c;
+            int result = code.decode(word, erasedLists[c].data(), (int)erasedLists[c].size());
+            agree &= (results[c] == result);
+            agree &= std::equal(word, word + n, batch.begin() + (size_t)n * c);
+            if (correctable[c]) {
+                agree &= std::equal(word, word + n, clean.begin() + (size_t)n * c);
+            }
+        }
+        CHECK(agree);
+    }
+    return CHECK_STATUS();
+}
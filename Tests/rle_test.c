@@ -0,0 +1,111 @@
+/* Round trips of the 16-bit run-length coding in rle.c
+
+ Slot buffers with the awkward cases in them are encoded and decoded with both the vector
+ run_length_encode()/run_length_decode() (AVX-512 or AVX2 when the build targets them) and the
+ scalar references: zero runs either side of the vector widths, runs of exactly 65535 and
+ 131070 (carried on through 65535 words), counts of 65535 and above (stored as 65535), an
+ occupied first or last slot and buffers that end in empty slots. The two encoders must give the
+ same words, and decoding them must give back the slots with the counts clamped.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Check.h"
+#include "rle.h"
+
+#define MAX_SLOTS 400000
+
+
+// encodes and decodes slots[0..n-1] both ways; returns 0 if everything agrees
+static int round_trip(const uint32_t *slots, uint32_t n)
+{
+    static uint16_t words[2 * MAX_SLOTS + 16], scalar_words[2 * MAX_SLOTS + 16];
+    static uint32_t decoded[MAX_SLOTS + 64], scalar_decoded[MAX_SLOTS + 64];
+    int failed = 0;
+
+    uint32_t count = run_length_encode(slots, words, n);
+    uint32_t scalar_count = run_length_encode_scalar(slots, scalar_words, n);
+    failed |= (count != scalar_count) || (memcmp(words, scalar_words, count * sizeof(uint16_t)) != 0);
+    failed |= (run_length_decoded_slots(words, count) != n);
+
+    // a guard after the last slot catches a decoder writing past the end
+    decoded[n] = scalar_decoded[n] = 0xDEADBEEF;
+    failed |= (run_length_decode(words, decoded, count) != n);
+    failed |= (run_length_decode_scalar(words, scalar_decoded, count) != n);
+    failed |= (decoded[n] != 0xDEADBEEF || scalar_decoded[n] != 0xDEADBEEF);
+    for (uint32_t i = 0; i < n && !failed; i++)
+    {
+        uint32_t expected = (slots[i] > 65535) ? 65535 : slots[i];
+        failed |= (decoded[i] != expected || scalar_decoded[i] != expected);
+    }
+    return failed;
+}
+
+
+int main(void)
+{
+    uint32_t *slots = calloc(MAX_SLOTS, sizeof(uint32_t));
+    if (slots == NULL)
+        return 1;
+
+    // an empty buffer, all empty slots, a single occupied slot
+    CHECK(round_trip(slots, 0) == 0);
+    CHECK(round_trip(slots, 1) == 0);
+    CHECK(round_trip(slots, 100) == 0);
+    slots[0] = 1;
+    CHECK(round_trip(slots, 1) == 0);
+    slots[0] = 0;
+
+    // a count after every run length from 0 to 40, across the 8 and 16 lane widths
+    for (uint32_t run = 0; run <= 40; run++)
+    {
+        memset(slots, 0, (run + 3) * sizeof(uint32_t));
+        slots[run] = 7;
+        CHECK(round_trip(slots, run + 1) == 0);     // count in the last slot
+        CHECK(round_trip(slots, run + 3) == 0);     // then two empty slots
+    }
+
+    // zero runs of exactly one and two 65535 words, one either side, and 65535 on its own
+    static const uint32_t long_runs[] = { 65534, 65535, 65536, 131069, 131070, 131071, 200000 };
+    for (size_t r = 0; r < sizeof(long_runs) / sizeof(long_runs[0]); r++)
+    {
+        uint32_t run = long_runs[r];
+        memset(slots, 0, (run + 2) * sizeof(uint32_t));
+        slots[run] = 2;
+        CHECK(round_trip(slots, run + 1) == 0);
+        CHECK(round_trip(slots, run + 2) == 0);
+        CHECK(round_trip(slots, run) == 0);         // the buffer is nothing but the run
+    }
+    memset(slots, 0, 65535 * sizeof(uint32_t));
+    slots[65535] = 1;
+    uint16_t words[8];
+    CHECK(run_length_encode(slots, words, 65536) == 3 && words[0] == 65535 && words[1] == 0 && words[2] == 1);
+
+    // counts at and past the 16-bit limit are stored as 65535
+    memset(slots, 0, 10 * sizeof(uint32_t));
+    slots[2] = 65535;
+    slots[3] = 65536;
+    slots[7] = 0xFFFFFFFF;
+    CHECK(round_trip(slots, 10) == 0);
+
+    // sparse random slots with the odd bright one, in lengths that aren't a multiple of anything
+    uint32_t state = 99;
+    for (uint32_t i = 0; i < MAX_SLOTS; i++)
+    {
+        state = state * 1664525u + 1013904223u;
+        slots[i] = ((state >> 24) < 3) ? 1 + (state & 7) : ((state >> 20) == 5) ? 100000 : 0;
+    }
+    static const uint32_t lengths[] = { MAX_SLOTS, MAX_SLOTS - 1, 12345, 777 };
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+        CHECK(round_trip(slots, lengths[l]) == 0);
+
+    // dense slots, every one occupied
+    for (uint32_t i = 0; i < 1000; i++)
+        slots[i] = 1 + i % 5;
+    CHECK(round_trip(slots, 1000) == 0);
+
+    free(slots);
+    return CHECK_STATUS();
+}
@@ -0,0 +1,109 @@
+// slot_channel_test.cpp
+//
+// Checks of the block channel stages in SlotChannel.cpp: erasures and noise give the same
+// slots for a seed whatever the block size, on a bitmap block and on a block held as its
+// pulse list alike; erasures cost one random number per pulse and none for the empty slots;
+// and the erasure and noise rates are the ones asked for.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Check.h"
+#include "SlotBitmap.h"
+#include "SlotChannel.h"
+
+namespace {
+
+const long long total_slots = 1 << 20;
+
+struct Result {
+    std::vector<long long> slots;   // occupied slots after the channel
+    long long erasures = 0;
+    long long noise = 0;
+    long long erasureDraws = 0;
+};
+
+// A pulse every 16 to 111 slots
+std::vector<long long> makePulses() {
+    std::vector<long long> pulses;
+    uint64_t state = 5;
+    for (long long slot = 0;;) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        slot += 16 + (long long)((state >> 33) % 96);
+        if (slot >= total_slots) {
+            break;
+        }
+        pulses.push_back(slot);
+    }
+    return pulses;
+}
+
+// Runs the channel block by block over bitmaps
+Result runBitmap(const std::vector<long long>& pulses, long long block, double erasure, double noise) {
+    Result result;
+    size_t next = 0;
+    for (long long first = 0; first < total_slots; first += block) {
+        long long count = std::min(block, total_slots - first);
+        SlotBitmap bits(count);
+        for (; next < pulses.size() && pulses[next] < first + count; next++) {
+            bits.set(pulses[next] - first);
+        }
+        result.erasures += signalErasure(bits, first, erasure, 9, &result.erasureDraws);
+        result.noise += signalNoise(bits, first, noise, 9);
+        bits.forEachOne([&](long long slot) { result.slots.push_back(first + slot); });
+    }
+    return result;
+}
+
+// Runs the channel block by block over pulse lists
+Result runSparse(const std::vector<long long>& pulses, long long block, double erasure, double noise) {
+    Result result;
+    size_t next = 0;
+    for (long long first = 0; first < total_slots; first += block) {
+        long long count = std::min(block, total_slots - first);
+        std::vector<long long> blockPulses;
+        for (; next < pulses.size() && pulses[next] < first + count; next++) {
+            blockPulses.push_back(pulses[next]);
+        }
+        result.erasures += signalErasure(blockPulses, first, count, erasure, 9, &result.erasureDraws);
+        result.noise += signalNoise(blockPulses, first, count, noise, 9);
+        result.slots.insert(result.slots.end(), blockPulses.begin(), blockPulses.end());
+    }
+    return result;
+}
+
+bool same(const Result& a, const Result& b) {
+    return a.slots == b.slots && a.erasures == b.erasures && a.noise == b.noise && a.erasureDraws == b.erasureDraws;
+}
+
+}
+
+int main() {
+    std::vector<long long> pulses = makePulses();
+    double n = (double)pulses.size();
+
+    // Every block size and both forms of the block give the same slots
+    Result reference = runBitmap(pulses, total_slots, 0.3, 1e-3);
+    const long long blocks[] = { 64, 1000, 65536, 300000 };
+    for (long long block : blocks) {
+        CHECK(same(runBitmap(pulses, block, 0.3, 1e-3), reference));
+        CHECK(same(runSparse(pulses, block, 0.3, 1e-3), reference));
+    }
+    CHECK(same(runSparse(pulses, total_slots, 0.3, 1e-3), reference));
+
+    // One random number per pulse, and erasures at the set rate within 5 standard deviations
+    CHECK(reference.erasureDraws == (long long)pulses.size());
+    CHECK(std::fabs((double)reference.erasures - 0.3 * n) < 5.0 * std::sqrt(0.21 * n));
+    double empty = (double)total_slots - n;
+    CHECK(std::fabs((double)reference.noise - 1e-3 * (empty + reference.erasures)) <
+        5.0 * std::sqrt(1e-3 * (double)total_slots) + 1.0);
+
+    // No erasures costs nothing and changes nothing; certain erasure takes every pulse
+    Result none = runSparse(pulses, 4096, 0.0, 0.0);
+    CHECK(none.slots == pulses && none.erasures == 0 && none.erasureDraws == 0);
+    Result all = runBitmap(pulses, 4096, 1.0, 0.0);
+    CHECK(all.slots.empty() && all.erasures == (long long)pulses.size());
+
+    return CHECK_STATUS();
+}
@@ -0,0 +1,178 @@
+/* Round trip and corruption checks for the seekable slot container in slot_container.c
+
+ A container of several blocks (the last one short) is written from a known slot array, then
+ read back block by block and with the parallel reader at several thread counts; every read must
+ give the original slots. Damaging a payload byte must fail that block's checksum, and an index
+ whose first_slot values are out of order, whose blocks leave a gap or overlap, that doesn't start
+ at slot 0 or whose slot counts don't add up to total_slots must be refused by
+ slot_container_open().
+
+*/
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Check.h"
+#include "slot_container.h"
+
+#define BLOCK_SLOTS 1000
+#define TOTAL_SLOTS 10500       // ten full blocks and a short one
+
+
+static int write_container(const char *filename, const uint32_t *slots)
+{
+    slot_container_writer writer;
+    slot_container_header info;
+    memset(&info, 0, sizeof(info));
+    info.block_slots = BLOCK_SLOTS;
+    info.ppm_order = 4;
+    info.seed = 7;
+    strcpy(info.provenance, "slot_container_test");
+
+    if (slot_container_create(&writer, filename, &info) != 0)
+        return -1;
+    for (uint64_t first = 0; first < TOTAL_SLOTS; first += BLOCK_SLOTS)
+    {
+        uint64_t count = (TOTAL_SLOTS - first < BLOCK_SLOTS) ? TOTAL_SLOTS - first : BLOCK_SLOTS;
+        if (slot_container_write_block(&writer, slots + first, count) != 0)
+            return -1;
+    }
+    return slot_container_close(&writer);
+}
+
+
+// overwrite length bytes at offset in an existing file
+static int patch_file(const char *filename, long offset, const void *bytes, size_t length)
+{
+    FILE *fp = fopen(filename, "r+b");
+    if (fp == NULL)
+        return -1;
+    int ok = (fseek(fp, offset, SEEK_SET) == 0) && (fwrite(bytes, 1, length, fp) == length);
+    return (fclose(fp) == 0 && ok) ? 0 : -1;
+}
+
+
+int main(void)
+{
+    // the standard CRC-32 check value
+    CHECK(slot_container_crc32("123456789", 9) == 0xCBF43926u);
+
+    // sparse slots with the odd multi-photon count, and an empty stretch across a block boundary
+    uint32_t *slots = malloc(TOTAL_SLOTS * sizeof(uint32_t));
+    uint32_t *decoded = malloc(TOTAL_SLOTS * sizeof(uint32_t));
+    if (slots == NULL || decoded == NULL)
+        return 1;
+    uint64_t pulses = 0;
+    uint32_t state = 12345;
+    for (size_t i = 0; i < TOTAL_SLOTS; i++)
+    {
+        state = state * 1664525u + 1013904223u;
+        slots[i] = (i >= 2900 && i < 4100) ? 0 : ((state >> 24) < 8) ? 1 + (state >> 29) : 0;
+        pulses += (slots[i] != 0);
+    }
+    pulses += (slots[TOTAL_SLOTS - 1] == 0);
+    slots[TOTAL_SLOTS - 1] = 3;     // a count in the very last slot
+
+    CHECK(write_container("test.lcsc", slots) == 0);
+
+    slot_container_reader reader;
+    CHECK(slot_container_open(&reader, "test.lcsc") == 0);
+    CHECK(reader.header.total_slots == TOTAL_SLOTS);
+    CHECK(reader.header.total_pulses == pulses);
+    CHECK(reader.header.block_count == 11);
+    CHECK(reader.header.seed == 7 && reader.header.ppm_order == 4);
+
+    // every slot lands in the block that holds it
+    CHECK(slot_container_find_block(&reader, 0) == 0);
+    CHECK(slot_container_find_block(&reader, 999) == 0);
+    CHECK(slot_container_find_block(&reader, 1000) == 1);
+    CHECK(slot_container_find_block(&reader, TOTAL_SLOTS - 1) == 10);
+    CHECK(slot_container_find_block(&reader, TOTAL_SLOTS) == reader.header.block_count);
+
+    // block by block
+    memset(decoded, 0xFF, TOTAL_SLOTS * sizeof(uint32_t));
+    for (uint64_t b = 0; b < reader.header.block_count; b++)
+        CHECK(slot_container_read_block(&reader, b, decoded + reader.index[b].first_slot) == 0);
+    CHECK(memcmp(decoded, slots, TOTAL_SLOTS * sizeof(uint32_t)) == 0);
+
+    // the parallel reader gives the same slots whatever the thread count
+    static const int thread_counts[] = { 1, 2, 3, 8, 16 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++)
+    {
+        memset(decoded, 0xFF, TOTAL_SLOTS * sizeof(uint32_t));
+        CHECK(slot_container_read_blocks_parallel(&reader, 0, reader.header.block_count, decoded,
+                                                  thread_counts[t]) == 0);
+        CHECK(memcmp(decoded, slots, TOTAL_SLOTS * sizeof(uint32_t)) == 0);
+    }
+
+    // a run of blocks starting part way through
+    CHECK(slot_container_read_blocks_parallel(&reader, 3, 4, decoded, 3) == 0);
+    CHECK(memcmp(decoded, slots + 3000, 4000 * sizeof(uint32_t)) == 0);
+
+    slot_container_block first_block = reader.index[0];
+    slot_container_block second_block = reader.index[1];
+    long index_offset = (long)reader.header.index_offset;
+    slot_container_close_reader(&reader);
+
+    // a damaged payload fails its own block's checksum and no other
+    unsigned char flipped;
+    FILE *fp = fopen("test.lcsc", "rb");
+    CHECK(fp != NULL && fseek(fp, (long)second_block.byte_offset, SEEK_SET) == 0 && fread(&flipped, 1, 1, fp) == 1);
+    if (fp != NULL)
+        fclose(fp);
+    flipped ^= 0x01;
+    CHECK(patch_file("test.lcsc", (long)second_block.byte_offset, &flipped, 1) == 0);
+    CHECK(slot_container_open(&reader, "test.lcsc") == 0);
+    CHECK(slot_container_read_block(&reader, 0, decoded) == 0);
+    CHECK(slot_container_read_block(&reader, 1, decoded) != 0);
+    CHECK(slot_container_read_blocks_parallel(&reader, 0, reader.header.block_count, decoded, 4) != 0);
+    slot_container_close_reader(&reader);
+
+    // an index whose first_slot values don't strictly increase is refused, repeated or going back
+    CHECK(write_container("test.lcsc", slots) == 0);
+    CHECK(patch_file("test.lcsc", index_offset, &second_block.first_slot, sizeof(uint64_t)) == 0);
+    CHECK(slot_container_open(&reader, "test.lcsc") != 0);
+    second_block.first_slot = first_block.first_slot;
+    CHECK(patch_file("test.lcsc", index_offset + (long)sizeof(slot_container_block),
+                     &second_block.first_slot, sizeof(uint64_t)) == 0);
+    CHECK(slot_container_open(&reader, "test.lcsc") != 0);
+
+    // blocks that overlap or leave a gap, an index that doesn't start at slot 0, and counts that
+    // don't add up to the header's total
+    long slot_count_offset = index_offset + (long)offsetof(slot_container_block, slot_count);
+    uint64_t bad_count = BLOCK_SLOTS - 1;
+    CHECK(write_container("test.lcsc", slots) == 0);
+    CHECK(patch_file("test.lcsc", slot_count_offset, &bad_count, sizeof(uint64_t)) == 0);
+    CHECK(slot_container_open(&reader, "test.lcsc") != 0);
+    bad_count = BLOCK_SLOTS + 1;
+    CHECK(patch_file("test.lcsc", slot_count_offset, &bad_count, sizeof(uint64_t)) == 0);
+    CHECK(slot_container_open(&reader, "test.lcsc") != 0);
+
+    uint64_t bad_first = 1;
+    CHECK(write_container("test.lcsc", slots) == 0);
+    CHECK(patch_file("test.lcsc", index_offset, &bad_first, sizeof(uint64_t)) == 0);
+    CHECK(slot_container_open(&reader, "test.lcsc") != 0);
+
+    // the last block is short, so giving it a full block's slots only changes the sum
+    bad_count = BLOCK_SLOTS;
+    CHECK(write_container("test.lcsc", slots) == 0);
+    CHECK(patch_file("test.lcsc", slot_count_offset + 10 * (long)sizeof(slot_container_block),
+                     &bad_count, sizeof(uint64_t)) == 0);
+    CHECK(slot_container_open(&reader, "test.lcsc") != 0);
+    uint64_t bad_total = TOTAL_SLOTS + 1;
+    CHECK(write_container("test.lcsc", slots) == 0);
+    CHECK(patch_file("test.lcsc", (long)offsetof(slot_container_header, total_slots), &bad_total,
+                     sizeof(uint64_t)) == 0);
+    CHECK(slot_container_open(&reader, "test.lcsc") != 0);
+
+    // and the untouched container still opens
+    CHECK(write_container("test.lcsc", slots) == 0);
+    CHECK(slot_container_open(&reader, "test.lcsc") == 0);
+    slot_container_close_reader(&reader);
+
+    remove("test.lcsc");
+    free(slots);
+    free(decoded);
+    return CHECK_STATUS();
+}
@@ -0,0 +1,57 @@
+// sweep_test.cpp
+//
+// Checks of the sweep's input handling in Sweep.cpp: readPulseSummary() counts the slots
+// and pulses of an RLE text file, and refuses one that stops on anything but the end
+// (a stray word, a count too large for a long long); the points file and grid parse.
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "Sweep.h"
+
+namespace {
+
+bool summarise(const std::string& text, PulseSummary& summary) {
+    {
+        std::ofstream file("pulses.rle.txt");
+        file << text;
+    }
+    summary = PulseSummary();
+    return readPulseSummary("pulses.rle.txt", summary);
+}
+
+}
+
+int main() {
+    PulseSummary summary;
+
+    CHECK(summarise("10 1 20 1 5 0 \n", summary));
+    CHECK(summary.slots == 37 && summary.pulses == 2);
+
+    // a file can end on a lone zero count
+    CHECK(summarise("10 1 20 1 5", summary));
+    CHECK(summary.slots == 37 && summary.pulses == 2);
+    CHECK(summarise("", summary));
+    CHECK(summary.slots == 0 && summary.pulses == 0);
+
+    // anything that isn't a run length is an error, wherever it is
+    CHECK(!summarise("10 1 20 1 5 0 end\n", summary));
+    CHECK(!summarise("10 1 x 20 1", summary));
+    CHECK(!summarise("10 -1 20 1", summary));
+    CHECK(!summarise("10 1 99999999999999999999 1", summary));
+    CHECK(!readPulseSummary("no such file.rle.txt", summary));
+
+    {
+        std::ofstream file("points.txt");
+        file << "# erasure,noise,k\n0.1,1e-5,0.5\n\n0.2 1e-4\n";
+    }
+    std::vector<SweepPoint> points;
+    CHECK(readSweepPoints("points.txt", points));
+    CHECK(points.size() == 2);
+    CHECK(points.size() == 2 && points[0].k == 0.5 && points[1].erasure_probability == 0.2 && points[1].k == 0.0);
+    CHECK(sweepGrid("0,0.1", "1e-5", "0.5,1,2").size() == 6);
+
+    return CHECK_STATUS();
+}
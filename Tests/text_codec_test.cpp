@@ -0,0 +1,150 @@
+// text_codec_test.cpp
+//
+// Checks of the SWAR text reader in TextCodec.cpp against operator>>: numbers of every
+// length up to the largest long long, long runs of leading zeros, numbers that straddle
+// the reader's buffer refills, values too large for a long long, and a round trip through
+// TextWriter. The same cases go through text_read_uint() in text_io.c, the reader behind the
+// stls text formats, against the 32-bit limit.
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "TextCodec.h"
+#include "text_io.h"
+
+namespace {
+
+// Every value TextReader gives for the text
+std::vector<long long> readAll(const std::string& text) {
+    std::istringstream input(text);
+    TextReader reader(input);
+    std::vector<long long> values;
+    long long value;
+    while (reader.next(value)) {
+        values.push_back(value);
+    }
+    return values;
+}
+
+// The same through operator>>
+std::vector<long long> readStream(const std::string& text) {
+    std::istringstream input(text);
+    std::vector<long long> values;
+    long long value;
+    while (input >> value) {
+        values.push_back(value);
+    }
+    return values;
+}
+
+// Every value text_read_uint() gives for the text, and whether it stopped on a failure
+std::vector<long long> readAllC(const std::string& text, bool& failed) {
+    std::vector<long long> values;
+    FILE* fp = std::tmpfile();
+    if (fp == nullptr) {
+        failed = true;
+        return values;
+    }
+    std::fwrite(text.data(), 1, text.size(), fp);
+    std::rewind(fp);
+    text_reader reader;
+    text_reader_init(&reader, fp);
+    uint32_t value;
+    while (text_read_uint(&reader, &value)) {
+        values.push_back(value);
+    }
+    failed = reader.failed != 0;
+    text_reader_free(&reader);
+    std::fclose(fp);
+    return values;
+}
+
+}
+
+int main() {
+    // 1 to 19 digits, and the largest long long
+    std::string text;
+    long long value = 0;
+    for (int digits = 1; digits <= 18; digits++) {
+        value = value * 10 + digits % 10;
+        text += std::to_string(value) + " ";
+    }
+    text += "1000000000000000000 " + std::to_string(LLONG_MAX) + "\n";
+    CHECK(readAll(text) == readStream(text));
+    CHECK(readAll(text).back() == LLONG_MAX);
+
+    // leading zeros don't count towards the size
+    std::vector<long long> zeros = readAll(std::string(40, '0') + "5 " + std::string(30, '0') + " 7");
+    CHECK(zeros.size() == 3 && zeros[0] == 5 && zeros[1] == 0 && zeros[2] == 7);
+    zeros = readAll(std::string(50, '0') + std::to_string(LLONG_MAX));
+    CHECK(zeros.size() == 1 && zeros[0] == LLONG_MAX);
+
+    // one more than LLONG_MAX fails like operator>>, whether it's 19 or 20 digits long
+    std::vector<long long> values = readAll("12 9223372036854775808 34");
+    CHECK(values.size() == 1 && values[0] == 12);
+    CHECK(readStream("12 9223372036854775808 34").size() == 1);
+    values = readAll("12 123456789012345678901234567890 34");
+    CHECK(values.size() == 1 && values[0] == 12);
+
+    // a 17-digit number used to be cut after 16 digits and read as two
+    values = readAll("12345678901234567 8");
+    CHECK(values.size() == 2 && values[0] == 12345678901234567LL && values[1] == 8);
+
+    // Numbers straddle the 1 MiB refills at every offset: long values with a shifting
+    // amount of padding in front, then a run of zeros longer than the read-ahead
+    std::string big;
+    uint64_t state = 1;
+    for (int i = 0; i < 300000; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        big += std::to_string((long long)(state >> 1 >> (state % 48))) + (i % 7 == 0 ? "\n" : " ");
+    }
+    big += std::string(5000, '0') + "42";
+    std::vector<long long> expected = readStream(big);
+    CHECK(expected.size() == 300001 && expected.back() == 42);
+    CHECK(readAll(big) == expected);
+
+    // TextWriter's text reads back to the same values
+    std::ostringstream output;
+    {
+        TextWriter writer(output);
+        for (long long v : expected) {
+            writer.write(v);
+        }
+    }
+    CHECK(readAll(output.str()) == expected);
+
+    // text_io.c: leading zeros past 16 digits are one number, as fscanf("%hu") read them
+    bool failed;
+    values = readAllC("00000000000000000005 " + std::string(5000, '0') + "7 12345678", failed);
+    CHECK(!failed && values.size() == 3 && values[0] == 5 && values[1] == 7 && values[2] == 12345678);
+
+    // up to UINT32_MAX reads, one more or a longer number fails, and so does a stray character
+    values = readAllC("4294967295 1", failed);
+    CHECK(!failed && values.size() == 2 && values[0] == 4294967295LL);
+    values = readAllC("3 4294967296 1", failed);
+    CHECK(failed && values.size() == 1 && values[0] == 3);
+    values = readAllC("3 12345678901234567 1", failed);
+    CHECK(failed && values.size() == 1);
+    values = readAllC("10 1 20 1 x 5 1", failed);
+    CHECK(failed && values.size() == 4);
+    values = readAllC("10 1 \n", failed);
+    CHECK(!failed && values.size() == 2);
+
+    // and numbers straddling its refills come through whole
+    std::string words;
+    std::vector<long long> wordValues;
+    for (int i = 0; i < 300000; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        long long v = (long long)((state >> 32) >> (state % 32));
+        wordValues.push_back(v);
+        words += std::string((size_t)(state % 5), '0') + std::to_string(v) + " ";
+    }
+    CHECK(readAllC(words, failed) == wordValues && !failed);
+
+    return CHECK_STATUS();
+}